@@ -81,6 +81,10 @@ extern resource_t
   res_radio_ctrl,
   res_temp,
   res_led;
+#if UIP_CONF_IPV6_RPL
+extern resource_t
+  res_rpl_stats;
+#endif /* UIP_CONF_IPV6_RPL */
 
 /*==============================================================================
                                          API FUNCTIONS
@@ -106,6 +110,9 @@ int8_t demo_coapInit(void)
     rest_activate_resource(&res_led, "dev/led");
     rest_activate_resource(&res_radio_info, "dev/txrx/inf");
     rest_activate_resource(&res_radio_ctrl, "dev/txrx/ctrl");
+#if UIP_CONF_IPV6_RPL
+    rest_activate_resource(&res_rpl_stats, "rpl/stats");
+#endif /* UIP_CONF_IPV6_RPL */
 
     return 1;
 }
@@ -0,0 +1,269 @@
+/*
+ * emb6 is licensed under the 3-clause BSD license. This license gives everyone
+ * the right to use and distribute the code, either in binary or source code
+ * format, as long as the copyright license is retained in the source code.
+ *
+ * The emb6 is derived from the Contiki OS platform with the explicit approval
+ * from Adam Dunkels. However, emb6 is made independent from the OS through the
+ * removal of protothreads. In addition, APIs are made more flexible to gain
+ * more adaptivity during run-time.
+ *
+ * The license text is:
+ *
+ * Copyright (c) 2015,
+ * Hochschule Offenburg, University of Applied Sciences
+ * Laboratory Embedded Systems and Communications Electronics.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+/*============================================================================*/
+/**
+ *      \addtogroup emb6
+ *      @{
+ *      \addtogroup demo_coap
+ *      @{
+ *      \addtogroup demo_coap_server
+ *      @{
+*/
+/*! \file   res-rpl.c
+
+ \brief  RPL statistics resource
+
+         GET returns the RPL counters and the candidate parents as
+         text/plain or application/json. The representation is taken
+         when the first block is requested and later blocks are served
+         from that snapshot in the same format.
+
+ \version 0.0.1
+ */
+/*============================================================================*/
+/*==============================================================================
+ INCLUDE FILES
+ =============================================================================*/
+#include <stdarg.h>
+
+#include "er-coap.h"
+#include "emb6.h"
+#include "rpl.h"
+
+#if UIP_CONF_IPV6_RPL
+/*==============================================================================
+ MACROS
+ =============================================================================*/
+#define     LOGGER_ENABLE        LOGGER_DEMO_COAP
+#include    "logger.h"
+
+/** Size of the representation snapshot */
+#define RES_RPL_REPR_SIZE       512
+
+/** Number of candidate parents listed */
+#define RES_RPL_MAX_PARENTS     4
+
+/*==============================================================================
+ LOCAL FUNCTION PROTOTYPES
+ =============================================================================*/
+static void     _res_get_handler(void *request, void *response,
+                            uint8_t *buffer, uint16_t preferred_size,
+                            int32_t *offset);
+static void     _res_print(const char *fmt, ...);
+static void     _res_snapshot(uint8_t json);
+
+/*==============================================================================
+ LOCAL VARIABLE DECLARATIONS
+ =============================================================================*/
+RESOURCE(res_rpl_stats, "title=\"RPL statistics\";rt=\"Stats\"",
+         _res_get_handler, NULL, NULL, NULL);
+
+static char     c_repr[RES_RPL_REPR_SIZE];
+static uint16_t i_repr_len;
+static uint8_t  c_repr_json;
+
+/*==============================================================================
+ LOCAL FUNCTIONS
+ =============================================================================*/
+/*----------------------------------------------------------------------------*/
+/*    _res_print()                                                            */
+/*----------------------------------------------------------------------------*/
+static void _res_print(const char *fmt, ...)
+{
+    va_list ap;
+    int     len;
+
+    if (i_repr_len >= RES_RPL_REPR_SIZE - 1) {
+        return;
+    }
+    va_start(ap, fmt);
+    len = vsnprintf(c_repr + i_repr_len, RES_RPL_REPR_SIZE - i_repr_len, fmt, ap);
+    va_end(ap);
+
+    /* A truncated representation ends at the buffer */
+    if (len < 0 || i_repr_len + len >= RES_RPL_REPR_SIZE) {
+        i_repr_len = RES_RPL_REPR_SIZE - 1;
+    } else {
+        i_repr_len += len;
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+/*    _res_snapshot()                                                         */
+/*----------------------------------------------------------------------------*/
+static void _res_snapshot(uint8_t json)
+{
+    rpl_parent_stats_t  parents[RES_RPL_MAX_PARENTS];
+    rpl_parent_stats_t* p;
+    const uint16_t*     a;
+    int                 num;
+    int                 i;
+#if RPL_CONF_STATS
+    rpl_stats_t         stats;
+
+    rpl_get_stats(&stats);
+#endif /* RPL_CONF_STATS */
+
+    i_repr_len = 0;
+    num = rpl_get_parent_stats(parents, RES_RPL_MAX_PARENTS);
+
+    if (json) {
+        _res_print("{");
+#if RPL_CONF_STATS
+        _res_print("\"dio\":{\"tx\":%u,\"rx\":%u,\"supp\":%u},"
+                   "\"dis\":{\"tx\":%u,\"rx\":%u},",
+                   stats.dio_sent, stats.dio_recv, stats.dio_suppressed,
+                   stats.dis_sent, stats.dis_recv);
+        _res_print("\"dao\":{\"tx\":%u,\"rx\":%u,\"supp\":%u,\"ack\":%u,"
+                   "\"rtx\":%u},",
+                   stats.dao_sent, stats.dao_recv, stats.dao_suppressed,
+                   stats.dao_acked, stats.dao_retransmissions);
+        _res_print("\"repair\":{\"local\":%u,\"global\":%u},"
+                   "\"switch\":%u,\"failover\":%u,",
+                   stats.local_repairs, stats.global_repairs,
+                   stats.parent_switch, stats.parent_failovers);
+        _res_print("\"routes\":{\"num\":%u,\"add\":%u,\"rm\":%u},",
+                   stats.routes, stats.routes_added, stats.routes_removed);
+#endif /* RPL_CONF_STATS */
+        _res_print("\"parents\":[");
+    } else {
+#if RPL_CONF_STATS
+        _res_print("dio tx %u rx %u supp %u\ndis tx %u rx %u\n",
+                   stats.dio_sent, stats.dio_recv, stats.dio_suppressed,
+                   stats.dis_sent, stats.dis_recv);
+        _res_print("dao tx %u rx %u supp %u ack %u rtx %u\n",
+                   stats.dao_sent, stats.dao_recv, stats.dao_suppressed,
+                   stats.dao_acked, stats.dao_retransmissions);
+        _res_print("repair local %u global %u\nswitch %u failover %u\n",
+                   stats.local_repairs, stats.global_repairs,
+                   stats.parent_switch, stats.parent_failovers);
+        _res_print("routes %u add %u rm %u\n",
+                   stats.routes, stats.routes_added, stats.routes_removed);
+#endif /* RPL_CONF_STATS */
+    }
+
+    for (i = 0; i < num; i++) {
+        p = &parents[i];
+        a = p->addr.u16;
+        if (json) {
+            _res_print("%s{\"addr\":\"%x:%x:%x:%x:%x:%x:%x:%x\",\"inst\":%u,"
+                       "\"rank\":%u,\"etx\":%u,\"pref\":%u,\"backup\":%u}",
+                       i ? "," : "",
+                       UIP_HTONS(a[0]), UIP_HTONS(a[1]), UIP_HTONS(a[2]),
+                       UIP_HTONS(a[3]), UIP_HTONS(a[4]), UIP_HTONS(a[5]),
+                       UIP_HTONS(a[6]), UIP_HTONS(a[7]),
+                       p->instance_id, p->rank, p->link_metric,
+                       (p->flags & RPL_PARENT_STATS_PREFERRED) ? 1 : 0,
+                       (p->flags & RPL_PARENT_STATS_BACKUP) ? 1 : 0);
+        } else {
+            _res_print("%c %x:%x:%x:%x:%x:%x:%x:%x inst %u rank %u etx %u\n",
+                       (p->flags & RPL_PARENT_STATS_PREFERRED) ? '*' :
+                       (p->flags & RPL_PARENT_STATS_BACKUP) ? '+' : '-',
+                       UIP_HTONS(a[0]), UIP_HTONS(a[1]), UIP_HTONS(a[2]),
+                       UIP_HTONS(a[3]), UIP_HTONS(a[4]), UIP_HTONS(a[5]),
+                       UIP_HTONS(a[6]), UIP_HTONS(a[7]),
+                       p->instance_id, p->rank, p->link_metric);
+        }
+    }
+
+    if (json) {
+        _res_print("]}");
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+/*    _res_get_handler()                                                      */
+/*----------------------------------------------------------------------------*/
+static void _res_get_handler(void *request,   void *response,
+                            uint8_t *buffer, uint16_t preferred_size,
+                            int32_t *offset)
+{
+    unsigned int    i_accept = -1;
+    int32_t         len;
+
+    LOG2_INFO("Enter _res_get_handler() function");
+
+    /* The first block takes a new snapshot in the requested format, later
+       blocks are served from it whatever their Accept option says */
+    if (*offset == 0) {
+        REST.get_header_accept(request, &i_accept);
+        if (i_accept == -1 || i_accept == REST.type.TEXT_PLAIN) {
+            c_repr_json = 0;
+        } else if (i_accept == REST.type.APPLICATION_JSON) {
+            c_repr_json = 1;
+        } else {
+            REST.set_response_status(response, REST.status.NOT_ACCEPTABLE);
+            const char *msg = "Supporting content-types text/plain and application/json";
+            REST.set_response_payload(response, msg, strlen(msg));
+            return;
+        }
+        _res_snapshot(c_repr_json);
+    } else if (*offset < 0 || *offset >= i_repr_len) {
+        REST.set_response_status(response, REST.status.BAD_OPTION);
+        const char *error_msg = "BlockOutOfScope";
+        REST.set_response_payload(response, error_msg, strlen(error_msg));
+        return;
+    }
+
+    len = i_repr_len - *offset;
+    if (len > preferred_size) {
+        len = preferred_size;
+    }
+    if (len > 0) {
+        memcpy(buffer, c_repr + *offset, len);
+    } else {
+        len = 0;
+    }
+
+    REST.set_header_content_type(response,
+                c_repr_json ? REST.type.APPLICATION_JSON : REST.type.TEXT_PLAIN);
+    REST.set_response_payload(response, buffer, len);
+
+    *offset += len;
+    if (*offset >= i_repr_len) {
+        *offset = -1;
+    }
+
+    LOG2_INFO("Leave _res_get_handler() function");
+}
+#endif /* UIP_CONF_IPV6_RPL */
+/** @} */
+/** @} */
+/** @} */
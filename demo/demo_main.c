@@ -110,6 +110,14 @@
 #include "demo_aptb.h"
 #endif
 
+#if DEMO_USE_ROUTE_BENCH
+#include "demo_route_bench.h"
+#endif
+
+#if DEMO_USE_MCAST_BENCH
+#include "demo_mcast_bench.h"
+#endif
+
 #if DEMO_USE_MQTT
 #include "mqtt.h"
 #endif
@@ -238,6 +246,14 @@ static void loc_demoAppsConf(s_ns_t* pst_netStack, e_nsErr_t *p_err)
   demo_dtlsConf(pst_netStack);
   #endif
 
+  #if DEMO_USE_ROUTE_BENCH
+  demo_routeBenchConf(pst_netStack);
+  #endif
+
+  #if DEMO_USE_MCAST_BENCH
+  demo_mcastBenchConf(pst_netStack);
+  #endif
+
   /* set returned error code */
   *p_err = NETSTK_ERR_NONE;
 }
@@ -311,6 +327,18 @@ static uint8_t loc_demoAppsInit(void)
   }
   #endif
 
+  #if DEMO_USE_ROUTE_BENCH
+  if (!demo_routeBenchInit()) {
+    return 0;
+  }
+  #endif
+
+  #if DEMO_USE_MCAST_BENCH
+  if (!demo_mcastBenchInit()) {
+    return 0;
+  }
+  #endif
+
   return 1;
 }
 
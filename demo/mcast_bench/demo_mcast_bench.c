@@ -0,0 +1,412 @@
+/**
+ *      \addtogroup emb6
+ *      @{
+ *      \addtogroup demo
+ *      @{
+ *      \addtogroup demo_mcast_bench
+ *      @{
+*/
+/*
+ * emb6 is licensed under the 3-clause BSD license. This license gives everyone
+ * the right to use and distribute the code, either in binary or source code
+ * format, as long as the copyright license is retained in the source code.
+ *
+ * The emb6 is derived from the Contiki OS platform with the explicit approval
+ * from Adam Dunkels. However, emb6 is made independent from the OS through the
+ * removal of protothreads. In addition, APIs are made more flexible to gain
+ * more adaptivity during run-time.
+ *
+ * The license text is:
+ *
+ * Copyright (c) 2015,
+ * Hochschule Offenburg, University of Applied Sciences
+ * Laboratory Embedded Systems and Communications Electronics.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+/*============================================================================*/
+/*! \file   demo_mcast_bench.c
+
+ \brief  Multicast engine benchmark. The seed node becomes DODAG root and
+         sends MCAST_BENCH_PACKETS datagrams to a global scope group that all
+         other nodes join. Every node then logs one summary line:
+
+           rx     unique datagrams received of those sent
+           lat    average and maximum latency in ms
+           tx     data transmissions (originals and forwards) and engine
+                  control messages (ROLL-TM ICMP, MPL Control Messages)
+
+         Summing the lines of all nodes gives the delivery ratio and the
+         transmissions per delivered datagram. Latency relies on all nodes
+         sharing one clock, as they do on the native target. Build the same
+         node set once per engine (mb_smrf_lux, mb_rolltm_lux, mb_mpl_lux)
+         with --mac= matching lcmnetwork.conf and start the nodes together.
+
+ \version 0.0.1
+ */
+/*============================================================================*/
+
+/*==============================================================================
+ INCLUDE FILES
+ =============================================================================*/
+
+#include "emb6.h"
+#include "bsp.h"
+#include "demo_mcast_bench.h"
+#include "etimer.h"
+#include "rpl.h"
+#include "uip-ds6.h"
+#include "uip-mcast6.h"
+#include "udp-socket.h"
+
+#if !UIP_MCAST6_ENGINE
+#error "The multicast benchmark needs UIP_MCAST6_CONF_ENGINE, see its SConscript"
+#endif
+
+/*==============================================================================
+                                         MACROS
+ =============================================================================*/
+#define     LOGGER_ENABLE        LOGGER_DEMO_MCAST_BENCH
+#include    "logger.h"
+
+/** MAC address of the node that is DODAG root and multicast seed */
+#ifndef MCAST_BENCH_SEED
+#define     MCAST_BENCH_SEED            0x00AA
+#endif
+
+/** number of datagrams the seed sends */
+#ifndef MCAST_BENCH_PACKETS
+#define     MCAST_BENCH_PACKETS         100
+#endif
+
+/** interval between two datagrams in ms */
+#ifndef MCAST_BENCH_INTERVAL
+#define     MCAST_BENCH_INTERVAL        1000
+#endif
+
+/** seconds for the DODAG (and SMRF's multicast routes) to form */
+#ifndef MCAST_BENCH_WARMUP
+#define     MCAST_BENCH_WARMUP          60
+#endif
+
+/** seconds to wait for late forwards after the last datagram */
+#ifndef MCAST_BENCH_COOLDOWN
+#define     MCAST_BENCH_COOLDOWN        30
+#endif
+
+/** UDP port of the benchmark */
+#define     MCAST_BENCH_PORT            3001
+
+/** benchmark group, global scope so that SMRF advertises it in DAOs */
+#define     MCAST_BENCH_GROUP(a)        uip_ip6addr(a, 0xff1e, 0, 0, 0, 0, 0, \
+                                                    0x89, 0xabcd)
+
+/** milliseconds to clock ticks and back */
+#define     MCAST_BENCH_TICKS(ms)       ((clock_time_t)(ms) * \
+                                         bsp_get(E_BSP_GET_TRES) / 1000)
+#define     MCAST_BENCH_MS(ticks)       ((uint32_t)(((uint64_t)(ticks) * 1000) \
+                                         / bsp_get(E_BSP_GET_TRES)))
+
+/*==============================================================================
+                     TYPEDEF'S DECLARATION
+ =============================================================================*/
+typedef enum e_mcastBenchStateS {
+    E_MCASTBENCH_WARMUP,
+    E_MCASTBENCH_SEND,
+    E_MCASTBENCH_COOLDOWN,
+    E_MCASTBENCH_DONE,
+}e_mcastBench_t;
+
+/** benchmark datagram payload */
+typedef struct s_mcastBenchMsgS {
+    uint16_t    i_seq;
+    uint32_t    l_sent;     /* tick at the seed */
+}s_mcastBenchMsg_t;
+
+/*==============================================================================
+                          LOCAL VARIABLE DECLARATIONS
+ =============================================================================*/
+static struct udp_socket    st_mcastBenchSock;
+static struct etimer        st_mcastBenchTmr;
+static uip_ipaddr_t         s_mcastBenchGroup;
+static e_mcastBench_t       e_mcastBenchState;
+
+/** 1 on the seed */
+static uint8_t              c_mcastBenchSeed;
+
+/** datagrams sent by the seed */
+static uint16_t             i_mcastBenchSent;
+
+/** datagrams received, one bit per sequence number */
+static uint8_t              ac_mcastBenchRx[(MCAST_BENCH_PACKETS + 7) / 8];
+static uint16_t             i_mcastBenchRx;
+
+/** latency sum and maximum in clock ticks */
+static uint32_t             l_mcastBenchLatSum;
+static uint32_t             l_mcastBenchLatMax;
+
+/*==============================================================================
+                               LOCAL FUNCTION PROTOTYPES
+ =============================================================================*/
+static uint8_t _mcastBench_rootInit(void);
+static void _mcastBench_send(void);
+static void _mcastBench_report(void);
+static void _mcastBench_rx(struct udp_socket *c, void *ptr,
+                           const uip_ipaddr_t *source_addr,
+                           uint16_t source_port,
+                           const uip_ipaddr_t *dest_addr, uint16_t dest_port,
+                           const uint8_t *data, uint16_t datalen);
+static void _mcastBench_callback(c_event_t c_event, p_data_t p_data);
+
+/*==============================================================================
+                                    LOCAL FUNCTIONS
+ =============================================================================*/
+
+/*----------------------------------------------------------------------------*/
+/** \brief  Make this node DODAG root with a global address from
+ *          NETWORK_PREFIX_DODAG, the seed address of the benchmark.
+ *
+ *  \returns 1 on success, 0 otherwise
+ */
+/*----------------------------------------------------------------------------*/
+static uint8_t _mcastBench_rootInit(void)
+{
+    uip_ipaddr_t    s_addr;
+    uint16_t        pi_netPrefix[4] = {NETWORK_PREFIX_DODAG};
+    rpl_dag_t       *ps_dag;
+
+    uip_ip6addr(&s_addr, pi_netPrefix[0], pi_netPrefix[1],
+                pi_netPrefix[2], pi_netPrefix[3], 0, 0, 0, 0);
+    uip_ds6_set_addr_iid(&s_addr, (uip_lladdr_t *)&uip_lladdr.addr);
+    uip_ds6_addr_add(&s_addr, 0, ADDR_MANUAL);
+
+    ps_dag = rpl_set_root(rpl_config.defInst, &s_addr);
+    if (ps_dag == NULL) {
+        return 0;
+    }
+    rpl_set_prefix(ps_dag, &s_addr, 64);
+    return 1;
+} /* _mcastBench_rootInit */
+
+/*----------------------------------------------------------------------------*/
+/** \brief  Send the next benchmark datagram to the group.
+ */
+/*----------------------------------------------------------------------------*/
+static void _mcastBench_send(void)
+{
+    s_mcastBenchMsg_t   s_msg;
+
+    s_msg.i_seq = i_mcastBenchSent;
+    s_msg.l_sent = bsp_getTick();
+    if (udp_socket_sendto(&st_mcastBenchSock, &s_msg, sizeof(s_msg),
+                          &s_mcastBenchGroup, MCAST_BENCH_PORT) < 0) {
+        LOG_ERR("Send %u failed", i_mcastBenchSent);
+    }
+    i_mcastBenchSent++;
+} /* _mcastBench_send */
+
+/*----------------------------------------------------------------------------*/
+/** \brief  Log the summary line of this node.
+ */
+/*----------------------------------------------------------------------------*/
+static void _mcastBench_report(void)
+{
+    uint32_t    l_txData = i_mcastBenchSent;
+    uint32_t    l_txCtrl = 0;
+
+#if UIP_MCAST6_STATS
+    l_txData += UIP_MCAST6_STATS_GET(mcast_fwd);
+#if UIP_MCAST6_ENGINE == UIP_MCAST6_ENGINE_ROLL_TM
+    l_txCtrl = ((struct roll_tm_stats *)
+                uip_mcast6_stats.engine_stats)->icmp_out;
+#elif UIP_MCAST6_ENGINE == UIP_MCAST6_ENGINE_MPL
+    l_txCtrl = ((struct mpl_stats *)uip_mcast6_stats.engine_stats)->icmp_out;
+#endif
+#endif /* UIP_MCAST6_STATS */
+
+    LOG_INFO("%s node 0x%04X: rx %u/%u lat avg %lu ms max %lu ms "
+             "tx data %lu ctrl %lu",
+             UIP_MCAST6.name, MAC_ADDR_WORD, i_mcastBenchRx,
+             MCAST_BENCH_PACKETS,
+             (unsigned long)(i_mcastBenchRx ?
+                 MCAST_BENCH_MS(l_mcastBenchLatSum / i_mcastBenchRx) : 0),
+             (unsigned long)MCAST_BENCH_MS(l_mcastBenchLatMax),
+             (unsigned long)l_txData, (unsigned long)l_txCtrl);
+} /* _mcastBench_report */
+
+/*----------------------------------------------------------------------------*/
+/** \brief  Count a benchmark datagram, duplicates delivered by the engine
+ *          are not counted.
+ */
+/*----------------------------------------------------------------------------*/
+static void _mcastBench_rx(struct udp_socket *c, void *ptr,
+                           const uip_ipaddr_t *source_addr,
+                           uint16_t source_port,
+                           const uip_ipaddr_t *dest_addr, uint16_t dest_port,
+                           const uint8_t *data, uint16_t datalen)
+{
+    s_mcastBenchMsg_t   s_msg;
+    uint32_t            l_lat;
+
+    if (c_mcastBenchSeed || (datalen != sizeof(s_msg))) {
+        return;
+    }
+    memcpy(&s_msg, data, sizeof(s_msg));
+    if ((s_msg.i_seq >= MCAST_BENCH_PACKETS) ||
+        (ac_mcastBenchRx[s_msg.i_seq / 8] & (1 << (s_msg.i_seq % 8)))) {
+        return;
+    }
+    ac_mcastBenchRx[s_msg.i_seq / 8] |= 1 << (s_msg.i_seq % 8);
+    i_mcastBenchRx++;
+
+    l_lat = bsp_getTick() - s_msg.l_sent;
+    l_mcastBenchLatSum += l_lat;
+    if (l_lat > l_mcastBenchLatMax) {
+        l_mcastBenchLatMax = l_lat;
+    }
+} /* _mcastBench_rx */
+
+/*----------------------------------------------------------------------------*/
+/** \brief  Benchmark state machine, runs whenever the timer expired.
+ *
+ *  \param  event     Event type
+ *  \param  data      Pointer to data
+ */
+/*----------------------------------------------------------------------------*/
+static void _mcastBench_callback(c_event_t c_event, p_data_t p_data)
+{
+    if (!etimer_expired(&st_mcastBenchTmr)) {
+        return;
+    }
+
+    switch (e_mcastBenchState) {
+    case E_MCASTBENCH_WARMUP:
+        /* receivers wait as long as the seed sends */
+        e_mcastBenchState = E_MCASTBENCH_SEND;
+        if (!c_mcastBenchSeed) {
+            etimer_set(&st_mcastBenchTmr, MCAST_BENCH_PACKETS *
+                       MCAST_BENCH_TICKS(MCAST_BENCH_INTERVAL),
+                       _mcastBench_callback);
+            break;
+        }
+        LOG_INFO("Seed starts sending");
+        etimer_set(&st_mcastBenchTmr, MCAST_BENCH_TICKS(MCAST_BENCH_INTERVAL),
+                   _mcastBench_callback);
+        /* fall through */
+    case E_MCASTBENCH_SEND:
+        if (c_mcastBenchSeed && (i_mcastBenchSent < MCAST_BENCH_PACKETS)) {
+            _mcastBench_send();
+            etimer_restart(&st_mcastBenchTmr);
+            break;
+        }
+        e_mcastBenchState = E_MCASTBENCH_COOLDOWN;
+        etimer_set(&st_mcastBenchTmr,
+                   MCAST_BENCH_COOLDOWN * bsp_get(E_BSP_GET_TRES),
+                   _mcastBench_callback);
+        break;
+    case E_MCASTBENCH_COOLDOWN:
+        e_mcastBenchState = E_MCASTBENCH_DONE;
+        _mcastBench_report();
+        break;
+    case E_MCASTBENCH_DONE:
+    default:
+        break;
+    }
+} /* _mcastBench_callback */
+
+/*=============================================================================
+                                         API FUNCTIONS
+ ============================================================================*/
+
+/*---------------------------------------------------------------------------*/
+/*  demo_mcastBenchConf()                                                    */
+/*---------------------------------------------------------------------------*/
+uint8_t demo_mcastBenchConf(s_ns_t* p_netstk)
+{
+  uint8_t c_ret = 1;
+
+  /*
+   * By default stack
+   */
+  if (p_netstk != NULL) {
+    if (!p_netstk->c_configured) {
+      p_netstk->hc = &hc_driver_sicslowpan;
+      p_netstk->frame = &framer_802154;
+      p_netstk->dllsec = &dllsec_driver_null;
+      p_netstk->c_configured = 1;
+
+    } else {
+      if ((p_netstk->hc == &hc_driver_sicslowpan) &&
+          (p_netstk->frame == &framer_802154) &&
+          (p_netstk->dllsec == &dllsec_driver_null)) {
+      } else {
+        p_netstk = NULL;
+        c_ret = 0;
+      }
+    }
+  }
+
+  return (c_ret);
+}/* demo_mcastBenchConf */
+
+/*---------------------------------------------------------------------------*/
+/*    demo_mcastBenchInit()                                                  */
+/*---------------------------------------------------------------------------*/
+int8_t demo_mcastBenchInit(void)
+{
+    LOG2_INFO( "Enter demo_mcastBenchInit() function" );
+
+    MCAST_BENCH_GROUP(&s_mcastBenchGroup);
+    c_mcastBenchSeed = (MAC_ADDR_WORD == MCAST_BENCH_SEED);
+
+    if (c_mcastBenchSeed) {
+        if (!_mcastBench_rootInit()) {
+            LOG_ERR("Could not create the DODAG");
+            return 0;
+        }
+    } else if (uip_ds6_maddr_add(&s_mcastBenchGroup) == NULL) {
+        LOG_ERR("Could not join the group");
+        return 0;
+    }
+
+    udp_socket_register(&st_mcastBenchSock, NULL, _mcastBench_rx);
+    if (udp_socket_bind(&st_mcastBenchSock, MCAST_BENCH_PORT) < 0) {
+        LOG_ERR("Could not bind port %u", MCAST_BENCH_PORT);
+        return 0;
+    }
+
+    e_mcastBenchState = E_MCASTBENCH_WARMUP;
+    etimer_set(&st_mcastBenchTmr, MCAST_BENCH_WARMUP * bsp_get(E_BSP_GET_TRES),
+               _mcastBench_callback);
+
+    LOG_INFO("%s %s, %u datagrams every %u ms after %u s",
+             UIP_MCAST6.name, c_mcastBenchSeed ? "seed" : "receiver",
+             MCAST_BENCH_PACKETS, MCAST_BENCH_INTERVAL, MCAST_BENCH_WARMUP);
+
+    LOG2_INFO( "Leave demo_mcastBenchInit() function" );
+    return 1;
+}/* demo_mcastBenchInit()  */
+/** @} */
+/** @} */
+/** @} */
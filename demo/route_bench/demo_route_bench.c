@@ -0,0 +1,294 @@
+/**
+ *      \addtogroup emb6
+ *      @{
+ *      \addtogroup demo
+ *      @{
+ *      \addtogroup demo_route_bench
+ *      @{
+*/
+/*
+ * emb6 is licensed under the 3-clause BSD license. This license gives everyone
+ * the right to use and distribute the code, either in binary or source code
+ * format, as long as the copyright license is retained in the source code.
+ *
+ * The emb6 is derived from the Contiki OS platform with the explicit approval
+ * from Adam Dunkels. However, emb6 is made independent from the OS through the
+ * removal of protothreads. In addition, APIs are made more flexible to gain
+ * more adaptivity during run-time.
+ *
+ * The license text is:
+ *
+ * Copyright (c) 2015,
+ * Hochschule Offenburg, University of Applied Sciences
+ * Laboratory Embedded Systems and Communications Electronics.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+/*============================================================================*/
+/*! \file   demo_route_bench.c
+
+ \brief  Routing table lookup benchmark. Fills the routing table with a mix
+         of host routes and prefix routes, then compares the lookup time of
+         uip_ds6_route_lookup() with a linear scan of the route list.
+
+ \version 0.0.1
+ */
+/*============================================================================*/
+
+/*==============================================================================
+ INCLUDE FILES
+ =============================================================================*/
+
+#include "emb6.h"
+#include "bsp.h"
+#include "demo_route_bench.h"
+#include "random.h"
+#include "uip-ds6.h"
+
+/*==============================================================================
+                                         MACROS
+ =============================================================================*/
+#define     LOGGER_ENABLE        LOGGER_DEMO_ROUTE_BENCH
+#include    "logger.h"
+
+/** number of next hops the routes are spread over */
+#define     ROUTE_BENCH_NEXTHOPS        4
+
+/** number of lookups per measurement */
+#ifndef ROUTE_BENCH_LOOKUPS
+#define     ROUTE_BENCH_LOOKUPS         10000
+#endif
+
+/** one route out of ROUTE_BENCH_PREFIX_RATIO is a prefix route */
+#define     ROUTE_BENCH_PREFIX_RATIO    8
+
+/*==============================================================================
+                          LOCAL VARIABLE DECLARATIONS
+ =============================================================================*/
+/** routing table sizes to measure */
+static const uint16_t ai_benchSizes[] = { 1000, 10000 };
+
+/** an address covered by each route */
+static uip_ipaddr_t as_benchAddr[UIP_DS6_ROUTE_NB];
+
+static uip_ipaddr_t as_benchNexthop[ROUTE_BENCH_NEXTHOPS];
+
+/** number of routes added so far */
+static uint16_t i_benchNum;
+
+/*==============================================================================
+                               LOCAL FUNCTION PROTOTYPES
+ =============================================================================*/
+static uint8_t _routeBench_addRoutes(uint16_t i_num);
+static uip_ds6_route_t * _routeBench_linearLookup(uip_ipaddr_t *ps_addr);
+static uint32_t _routeBench_measure(uint8_t c_linear);
+
+/*==============================================================================
+                                    LOCAL FUNCTIONS
+ =============================================================================*/
+
+/*----------------------------------------------------------------------------*/
+/** \brief  Add routes until the routing table holds i_num routes. Host routes
+ *          are taken from 2001:db8::/64, prefix routes of length 48 to 64 are
+ *          taken from 2001:db8:x::/48 with x > 0.
+ *
+ *  \param  i_num       Number of routes the table should hold
+ *
+ *  \returns 1 on success, 0 if a route could not be added
+ */
+/*----------------------------------------------------------------------------*/
+static uint8_t _routeBench_addRoutes(uint16_t i_num)
+{
+    uip_ipaddr_t    s_prefix;
+    uint8_t         c_len;
+
+    for (; i_benchNum < i_num; i_benchNum++) {
+        if ((i_benchNum % ROUTE_BENCH_PREFIX_RATIO) == 0) {
+            c_len = 48 + (random_rand() % 17);
+            uip_ip6addr(&s_prefix, 0x2001, 0x0db8, i_benchNum + 1,
+                        random_rand(), 0, 0, 0, 0);
+            if (uip_ds6_route_add(&s_prefix, c_len,
+                    &as_benchNexthop[i_benchNum % ROUTE_BENCH_NEXTHOPS]) == NULL) {
+                return 0;
+            }
+            /* look up an address inside the prefix */
+            as_benchAddr[i_benchNum] = s_prefix;
+            as_benchAddr[i_benchNum].u16[7] = random_rand();
+        } else {
+            uip_ip6addr(&as_benchAddr[i_benchNum], 0x2001, 0x0db8, 0, 0,
+                        0, random_rand(), random_rand(), i_benchNum);
+            if (uip_ds6_route_add(&as_benchAddr[i_benchNum], 128,
+                    &as_benchNexthop[i_benchNum % ROUTE_BENCH_NEXTHOPS]) == NULL) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+} /* _routeBench_addRoutes */
+
+/*----------------------------------------------------------------------------*/
+/** \brief  Longest prefix match by scanning the whole route list, as the
+ *          routing table used to do.
+ *
+ *  \param  ps_addr     Destination address
+ *
+ *  \returns the matching route or NULL
+ */
+/*----------------------------------------------------------------------------*/
+static uip_ds6_route_t * _routeBench_linearLookup(uip_ipaddr_t *ps_addr)
+{
+    uip_ds6_route_t *ps_route;
+    uip_ds6_route_t *ps_found = NULL;
+
+    for (ps_route = uip_ds6_route_head(); ps_route != NULL;
+         ps_route = uip_ds6_route_next(ps_route)) {
+        if ((ps_found == NULL || ps_route->length > ps_found->length) &&
+            uip_ipaddr_prefixcmp(ps_addr, &ps_route->ipaddr, ps_route->length)) {
+            ps_found = ps_route;
+            if (ps_found->length == 128) {
+                break;
+            }
+        }
+    }
+    return ps_found;
+} /* _routeBench_linearLookup */
+
+/*----------------------------------------------------------------------------*/
+/** \brief  Run ROUTE_BENCH_LOOKUPS lookups over the added routes.
+ *
+ *  \param  c_linear    1 to use the linear scan, 0 for uip_ds6_route_lookup()
+ *
+ *  \returns elapsed time in microseconds
+ */
+/*----------------------------------------------------------------------------*/
+static uint32_t _routeBench_measure(uint8_t c_linear)
+{
+    uint32_t        i;
+    uint32_t        l_start;
+    uint32_t        l_ticks;
+    uint32_t        l_missed = 0;
+    uip_ds6_route_t *ps_route;
+
+    l_start = bsp_get(E_BSP_GET_TICK);
+    for (i = 0; i < ROUTE_BENCH_LOOKUPS; i++) {
+        if (c_linear) {
+            ps_route = _routeBench_linearLookup(&as_benchAddr[i % i_benchNum]);
+        } else {
+            ps_route = uip_ds6_route_lookup(&as_benchAddr[i % i_benchNum]);
+        }
+        if (ps_route == NULL) {
+            l_missed++;
+        }
+    }
+    l_ticks = bsp_get(E_BSP_GET_TICK) - l_start;
+
+    if (l_missed) {
+        LOG_ERR("%lu lookups failed", (unsigned long)l_missed);
+    }
+    return (uint32_t)(((uint64_t)l_ticks * 1000000) / bsp_get(E_BSP_GET_TRES));
+} /* _routeBench_measure */
+
+/*=============================================================================
+                                         API FUNCTIONS
+ ============================================================================*/
+
+/*---------------------------------------------------------------------------*/
+/*  demo_routeBenchConf()                                                    */
+/*---------------------------------------------------------------------------*/
+uint8_t demo_routeBenchConf(s_ns_t* p_netstk)
+{
+  uint8_t c_ret = 1;
+
+  /*
+   * By default stack
+   */
+  if (p_netstk != NULL) {
+    if (!p_netstk->c_configured) {
+      p_netstk->hc = &hc_driver_sicslowpan;
+      p_netstk->frame = &framer_802154;
+      p_netstk->dllsec = &dllsec_driver_null;
+      p_netstk->c_configured = 1;
+
+    } else {
+      if ((p_netstk->hc == &hc_driver_sicslowpan) &&
+          (p_netstk->frame == &framer_802154) &&
+          (p_netstk->dllsec == &dllsec_driver_null)) {
+      } else {
+        p_netstk = NULL;
+        c_ret = 0;
+      }
+    }
+  }
+
+  return (c_ret);
+}/* demo_routeBenchConf */
+
+/*---------------------------------------------------------------------------*/
+/*    demo_routeBenchInit()                                                  */
+/*---------------------------------------------------------------------------*/
+int8_t demo_routeBenchInit(void)
+{
+    uint8_t         i;
+    uip_lladdr_t    s_lladdr;
+    uint32_t        l_trie;
+    uint32_t        l_linear;
+
+    LOG2_INFO( "Enter demo_routeBenchInit() function" );
+
+    /* routes need their next hop in the neighbor cache */
+    for (i = 0; i < ROUTE_BENCH_NEXTHOPS; i++) {
+        uip_ip6addr(&as_benchNexthop[i], 0xfe80, 0, 0, 0, 0, 0, 0xbe, i + 1);
+        memset(&s_lladdr, 0, sizeof(s_lladdr));
+        s_lladdr.addr[0] = 0xbe;
+        s_lladdr.addr[sizeof(s_lladdr) - 1] = i + 1;
+        if (uip_ds6_nbr_add(&as_benchNexthop[i], &s_lladdr, 1,
+                            NBR_REACHABLE) == NULL) {
+            LOG_ERR("Could not add next hop %u", i);
+            return 0;
+        }
+    }
+
+    for (i = 0; i < sizeof(ai_benchSizes) / sizeof(ai_benchSizes[0]); i++) {
+        if (ai_benchSizes[i] > UIP_DS6_ROUTE_NB) {
+            LOG_INFO("%u routes: skipped, UIP_CONF_MAX_ROUTES is %u",
+                     ai_benchSizes[i], UIP_DS6_ROUTE_NB);
+            continue;
+        }
+        if (!_routeBench_addRoutes(ai_benchSizes[i])) {
+            LOG_ERR("Could not add route %u", i_benchNum);
+            return 0;
+        }
+        l_trie = _routeBench_measure(0);
+        l_linear = _routeBench_measure(1);
+        LOG_INFO("%u routes, %u lookups: lookup %lu us, linear scan %lu us",
+                 i_benchNum, ROUTE_BENCH_LOOKUPS,
+                 (unsigned long)l_trie, (unsigned long)l_linear);
+    }
+
+    LOG2_INFO( "Leave demo_routeBenchInit() function" );
+    return 1;
+}/* demo_routeBenchInit()  */
+/** @} */
+/** @} */
+/** @} */
@@ -103,10 +103,14 @@
 #endif
 
 /** Neighbor table size */
+#ifndef NBR_TABLE_CONF_MAX_NEIGHBORS
 #define NBR_TABLE_CONF_MAX_NEIGHBORS         10
+#endif
 
 /** Routing table */
+#ifndef UIP_CONF_MAX_ROUTES
 #define UIP_CONF_MAX_ROUTES                  10
+#endif
 
 /** Unicast address list */
 #define UIP_CONF_DS6_ADDR_NBU                3
@@ -161,6 +165,14 @@
 #define UIP_ND6_SEND_NA UIP_CONF_ND6_SEND_NA
 #endif
 
+/** enable/disable 6LoWPAN-ND (RFC 6775/8505): addresses are registered
+ *  with the routers instead of multicast DAD and address resolution */
+#ifndef UIP_CONF_ND6_6LOWPAN
+#define UIP_ND6_6LOWPAN                     FALSE
+#else
+#define UIP_ND6_6LOWPAN UIP_CONF_ND6_6LOWPAN
+#endif
+
 
 /*=============================================================================
                                   RPL SECTION
@@ -185,17 +197,21 @@
 #define UIP_CONF_IPV6_RPL                   TRUE
 #endif
 
-/** Set to 1 to enable RPL statistics */
+/** Set to 1 to enable RPL statistics, see rpl_get_stats() */
+#ifndef RPL_CONF_STATS
 #define    RPL_CONF_STATS                   FALSE
+#endif
 
 #define    RPL_CONF_DAO_LATENCY             bsp_get(E_BSP_GET_TRES)
 #define RPL_CONF_DAG_MC                     RPL_DAG_MC_ETX
 /**
- * Select routing metric supported at runtime. This must be a valid
- * DAG Metric Container Object Type (see below). Currently, we only
- * support RPL_DAG_MC_ETX and RPL_DAG_MC_ENERGY.
- * When MRHOF (RFC6719) is used with ETX, no metric container must
- * be used; instead the rank carries ETX directly.
+ * Select the routing metric of the DODAGs this node is root of. This must
+ * be a valid DAG Metric Container Object Type (see rpl.h). Supported are
+ * RPL_DAG_MC_ETX, RPL_DAG_MC_ENERGY, RPL_DAG_MC_HOPCOUNT,
+ * RPL_DAG_MC_LATENCY and RPL_DAG_MC_LQL, a root changes it per instance
+ * with rpl_set_objective(). Other nodes use the metric of the DODAG.
+ * With RPL_DAG_MC_NONE no metric container is used at all; instead the
+ * rank carries ETX directly.
  */
 #ifdef RPL_CONF_DAG_MC
 #define RPL_DAG_MC                          RPL_CONF_DAG_MC
@@ -205,7 +221,8 @@
 /**
  * The objective function used by RPL is configurable through the
  * RPL_CONF_OF parameter. This should be defined to be the name of an
- * rpl_of object linked into the system image, e.g., rpl_of0.
+ * rpl_of object linked into the system image, e.g., rpl_of0. Joining
+ * nodes use the one of the DODAG, rpl_mrhof and rpl_of0 are known.
  */
 #ifdef RPL_CONF_OF
 #define RPL_OF RPL_CONF_OF
@@ -262,7 +279,9 @@
 #endif
 
 /**
- * Maximum of concurent RPL instances.
+ * Maximum of concurent RPL instances. With more than one, rpl_map_flow()
+ * sends the packets of a UDP socket, DSCP or flow label through another
+ * instance than the default one, see RPL_CONF_FLOW_MAP_NUM.
  */
 #ifdef RPL_CONF_MAX_INSTANCES
 #define RPL_MAX_INSTANCES                   RPL_CONF_MAX_INSTANCES
@@ -319,6 +338,41 @@
 #define RPL_DEFAULT_LIFETIME                RPL_CONF_DEFAULT_LIFETIME
 #endif
 
+/*
+ * Carry the 6LoWPAN compression contexts (6CO) in DIOs so that the
+ * contexts of the root propagate down the DODAG
+ */
+#ifndef RPL_CONF_DIO_6CO
+#define RPL_DIO_6CO                         FALSE
+#else
+#define RPL_DIO_6CO                         RPL_CONF_DIO_6CO
+#endif
+
+/*
+ * Non-storing mode of operation (MOP 1): DAOs go to the root, which
+ * keeps the DODAG and source routes downward traffic (RFC 6554). Nodes
+ * need it to join such a DODAG; a root builds one when RPL_CONF_MOP is
+ * RPL_MOP_NON_STORING. A root serving more nodes than
+ * RPL_NS_CONF_LINK_NUM sets RPL_NS_CONF_DYNAMIC to take them from the heap.
+ */
+#ifndef RPL_CONF_WITH_NON_STORING
+#define RPL_WITH_NON_STORING                FALSE
+#else
+#define RPL_WITH_NON_STORING                RPL_CONF_WITH_NON_STORING
+#endif
+
+/*
+ * Ask for a DAO-ACK with every DAO. Unacknowledged targets are sent
+ * again with exponential backoff, and after RPL_DAO_MAX_RETRANSMISSIONS
+ * the preferred parent is given up if the link layer loses frames to it
+ * too. A parent short of room answers that the DAO is to be sent later.
+ */
+#ifndef RPL_CONF_DAO_ACK
+#define RPL_WITH_DAO_ACK                    TRUE
+#else
+#define RPL_WITH_DAO_ACK                    RPL_CONF_DAO_ACK
+#endif
+
 /*
  * DAG preference field
  */
@@ -328,6 +382,38 @@
 #define RPL_PREFERENCE                      0
 #endif
 
+/*
+ * Number of backup parents ranked behind the preferred one. When the
+ * preferred parent goes away the first usable backup takes over at once,
+ * without a local repair.
+ */
+#ifdef RPL_CONF_BACKUP_PARENTS
+#define RPL_BACKUP_PARENTS                  RPL_CONF_BACKUP_PARENTS
+#else
+#define RPL_BACKUP_PARENTS                  2
+#endif
+
+/*
+ * Consecutive unacknowledged transmissions after which the preferred
+ * parent is given up for the best backup, 0 to rely on the ETX only.
+ */
+#ifdef RPL_CONF_PARENT_MAX_FAILURES
+#define RPL_PARENT_MAX_FAILURES             RPL_CONF_PARENT_MAX_FAILURES
+#else
+#define RPL_PARENT_MAX_FAILURES             3
+#endif
+
+/*
+ * Hysteresis of the parent selection, in ETX fixed point: a candidate
+ * must beat the preferred parent by this much path cost before it
+ * replaces it. The hysteresis of other metrics scales along.
+ */
+#ifdef RPL_CONF_PARENT_SWITCH_THRESHOLD
+#define RPL_PARENT_SWITCH_THRESHOLD         RPL_CONF_PARENT_SWITCH_THRESHOLD
+#else
+#define RPL_PARENT_SWITCH_THRESHOLD         (RPL_DAG_MC_ETX_DIVISOR / 2)
+#endif
+
 
 /*=============================================================================
                                   uIP SECTION
@@ -449,13 +535,33 @@
  */
 #define UIP_REASS_MAXAGE                    60 /*60s*/
 
+/**
+ * Number of IP datagrams that can be reassembled at the same time.
+ */
+#ifdef UIP_CONF_REASS_CONTEXTS
+#define UIP_REASS_CONTEXTS                  (UIP_CONF_REASS_CONTEXTS)
+#else /* UIP_CONF_REASS_CONTEXTS */
+#define UIP_REASS_CONTEXTS                  2
+#endif /* UIP_CONF_REASS_CONTEXTS */
+
+/**
+ * Number of IP fragments that can be held by all the reassembly contexts
+ * together. The fragment payloads are stored in the managed memory pool,
+ * whose size is set by MMEM_CONF_SIZE.
+ */
+#ifdef UIP_CONF_REASS_FRAGMENTS
+#define UIP_REASS_FRAGMENTS                 (UIP_CONF_REASS_FRAGMENTS)
+#else /* UIP_CONF_REASS_FRAGMENTS */
+#define UIP_REASS_FRAGMENTS                 8
+#endif /* UIP_CONF_REASS_FRAGMENTS */
+
 /**
  * Turn on support for IP packet reassembly.
  *
  * uIP supports reassembly of fragmented IP packets. This features
- * requires an additional amount of RAM to hold the reassembly buffer
- * and the reassembly code size is approximately 700 bytes.  The
- * reassembly buffer is of the same size as the uip_buf buffer
+ * requires an additional amount of RAM to hold the fragments, which are
+ * taken from the managed memory pool (MMEM_CONF_SIZE) as they arrive. A
+ * reassembled packet can be at most as large as the uip_buf buffer
  * (configured by UIP_BUFSIZE).
  *
  * \note IP packet reassembly is not heavily tested.
@@ -541,6 +647,34 @@
 #define UIP_UDP_CONNS                       10
 #endif /* UIP_CONF_UDP_CONNS */
 
+/**
+ * Allow more UDP connections than UIP_UDP_CONNS.
+ *
+ * If set, uip_udp_new() allocates a connection from the heap once the
+ * static table is exhausted. Removed connections are kept on a free
+ * list and reused, so the heap is never given memory back. Meant for
+ * native/gateway builds hosting many sockets.
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_CONF_UDP_CONNS_DYNAMIC
+#define UIP_UDP_CONNS_DYNAMIC               (UIP_CONF_UDP_CONNS_DYNAMIC)
+#else /* UIP_CONF_UDP_CONNS_DYNAMIC */
+#define UIP_UDP_CONNS_DYNAMIC               0
+#endif /* UIP_CONF_UDP_CONNS_DYNAMIC */
+
+/**
+ * Number of buckets of the port hash used to demultiplex incoming
+ * UDP datagrams and TCP SYNs to connections and listeners.
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_CONF_PORT_HASH_SIZE
+#define UIP_PORT_HASH_SIZE                  (UIP_CONF_PORT_HASH_SIZE)
+#else /* UIP_CONF_PORT_HASH_SIZE */
+#define UIP_PORT_HASH_SIZE                  8
+#endif /* UIP_CONF_PORT_HASH_SIZE */
+
 
 /**
  * Toggles whether TCP support should be compiled in or not.
@@ -884,6 +1018,16 @@ void uip_log(char *msg);
 #define LOGGER_DEMO_MDNS                   	FALSE
 #endif
 
+/** DEMO routing table benchmark           	(see demo_route_bench.c) */
+#ifndef LOGGER_DEMO_ROUTE_BENCH
+#define LOGGER_DEMO_ROUTE_BENCH            	FALSE
+#endif
+
+/** DEMO multicast engine benchmark        	(see demo_mcast_bench.c) */
+#ifndef LOGGER_DEMO_MCAST_BENCH
+#define LOGGER_DEMO_MCAST_BENCH            	FALSE
+#endif
+
 /** DEMO SNIFFER                           	(see demo_sniffer.c) */
 #ifndef LOGGER_DEMO_SNIFFER
 #define LOGGER_DEMO_SNIFFER                	FALSE
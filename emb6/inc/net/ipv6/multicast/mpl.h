@@ -0,0 +1,246 @@
+/*
+ * emb6 is licensed under the 3-clause BSD license. This license gives everyone
+ * the right to use and distribute the code, either in binary or source code
+ * format, as long as the copyright license is retained in the source code.
+ *
+ * The emb6 is derived from the Contiki OS platform with the explicit approval
+ * from Adam Dunkels. However, emb6 is made independent from the OS through the
+ * removal of protothreads. In addition, APIs are made more flexible to gain
+ * more adaptivity during run-time.
+ *
+ * The license text is:
+ *
+ * Copyright (c) 2015,
+ * Hochschule Offenburg, University of Applied Sciences
+ * Laboratory Embedded Systems and Communications Electronics.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \addtogroup uip6-multicast
+ * @{
+ */
+/**
+ * \defgroup mpl Multicast Protocol for Low-Power and Lossy Networks
+ *
+ * IPv6 multicast according to RFC 7731 (MPL).
+ *
+ * Every MPL Forwarder keeps a Seed Set and a Buffered Message Set. New
+ * datagrams are forwarded proactively with one Trickle timer per buffered
+ * message, and MPL Control Messages driven by one Trickle timer per MPL
+ * Domain let neighbours find out what they missed (reactive forwarding).
+ *
+ * The MPL Option is inserted into the multicast datagram itself: datagrams
+ * are not encapsulated in an outer header addressed to the MPL Domain.
+ * A datagram belongs to the domain with its destination address, or to the
+ * first (default) domain if there is none.
+ * @{
+ */
+/**
+ * \file
+ *    Header file for the implementation of the MPL multicast engine
+ */
+
+#ifndef MPL_H_
+#define MPL_H_
+
+#include "emb6.h"
+#include "emb6_conf.h"
+#include "uip-mcast6-stats.h"
+#include "trickle-timer.h"
+
+/*---------------------------------------------------------------------------*/
+/* Protocol Constants */
+/*---------------------------------------------------------------------------*/
+#define MPL_ICMP_CODE                  0   /**< MPL ICMPv6 code field */
+#define MPL_IP_HOP_LIMIT            0xFF   /**< Hop limit for ICMP messages */
+#define MPL_INFINITE_REDUNDANCY     TRICKLE_TIMER_INFINITE_REDUNDANCY
+/*---------------------------------------------------------------------------*/
+/* Default MPL Domain Parameters (RFC 7731, Section 5.4) */
+/*---------------------------------------------------------------------------*/
+/**
+ * Forward new datagrams proactively. When 0, buffered datagrams are only
+ * sent after an MPL Control Message showed that a neighbour misses them
+ */
+#ifdef MPL_CONF_PROACTIVE_FORWARDING
+#define MPL_PROACTIVE_FORWARDING MPL_CONF_PROACTIVE_FORWARDING
+#else
+#define MPL_PROACTIVE_FORWARDING 1
+#endif
+
+/** Lifetime of a Seed Set entry in minutes */
+#ifdef MPL_CONF_SEED_SET_ENTRY_LIFETIME
+#define MPL_SEED_SET_ENTRY_LIFETIME MPL_CONF_SEED_SET_ENTRY_LIFETIME
+#else
+#define MPL_SEED_SET_ENTRY_LIFETIME 30
+#endif
+
+/* Data message Trickle timers. Imin is in clock ticks, Imax in doublings */
+#ifdef MPL_CONF_DATA_MESSAGE_IMIN
+#define MPL_DATA_MESSAGE_IMIN MPL_CONF_DATA_MESSAGE_IMIN
+#else
+#define MPL_DATA_MESSAGE_IMIN (bsp_get(E_BSP_GET_TRES) / 8)  /* 125 msec */
+#endif
+
+#ifdef MPL_CONF_DATA_MESSAGE_IMAX
+#define MPL_DATA_MESSAGE_IMAX MPL_CONF_DATA_MESSAGE_IMAX
+#else
+#define MPL_DATA_MESSAGE_IMAX 0
+#endif
+
+#ifdef MPL_CONF_DATA_MESSAGE_K
+#define MPL_DATA_MESSAGE_K MPL_CONF_DATA_MESSAGE_K
+#else
+#define MPL_DATA_MESSAGE_K 1
+#endif
+
+#ifdef MPL_CONF_DATA_MESSAGE_TIMER_EXPIRATIONS
+#define MPL_DATA_MESSAGE_TIMER_EXPIRATIONS MPL_CONF_DATA_MESSAGE_TIMER_EXPIRATIONS
+#else
+#define MPL_DATA_MESSAGE_TIMER_EXPIRATIONS 3
+#endif
+
+/* Control message Trickle timers. 0 expirations turns them off */
+#ifdef MPL_CONF_CONTROL_MESSAGE_IMIN
+#define MPL_CONTROL_MESSAGE_IMIN MPL_CONF_CONTROL_MESSAGE_IMIN
+#else
+#define MPL_CONTROL_MESSAGE_IMIN (bsp_get(E_BSP_GET_TRES) / 8)
+#endif
+
+#ifdef MPL_CONF_CONTROL_MESSAGE_IMAX
+#define MPL_CONTROL_MESSAGE_IMAX MPL_CONF_CONTROL_MESSAGE_IMAX
+#else
+#define MPL_CONTROL_MESSAGE_IMAX 11   /* about 4 min */
+#endif
+
+#ifdef MPL_CONF_CONTROL_MESSAGE_K
+#define MPL_CONTROL_MESSAGE_K MPL_CONF_CONTROL_MESSAGE_K
+#else
+#define MPL_CONTROL_MESSAGE_K 1
+#endif
+
+#ifdef MPL_CONF_CONTROL_MESSAGE_TIMER_EXPIRATIONS
+#define MPL_CONTROL_MESSAGE_TIMER_EXPIRATIONS \
+  MPL_CONF_CONTROL_MESSAGE_TIMER_EXPIRATIONS
+#else
+#define MPL_CONTROL_MESSAGE_TIMER_EXPIRATIONS 10
+#endif
+/*---------------------------------------------------------------------------*/
+/* Configuration */
+/*---------------------------------------------------------------------------*/
+/**
+ * Number of MPL Domains. The first one is the default domain,
+ * ALL_MPL_FORWARDERS with realm-local scope (ff03::fc)
+ */
+#ifdef MPL_CONF_DOMAIN_SET_SIZE
+#define MPL_DOMAIN_SET_SIZE MPL_CONF_DOMAIN_SET_SIZE
+#else
+#define MPL_DOMAIN_SET_SIZE 1
+#endif
+
+/** Number of MPL Seeds we keep state for, across all domains */
+#ifdef MPL_CONF_SEED_SET_SIZE
+#define MPL_SEED_SET_SIZE MPL_CONF_SEED_SET_SIZE
+#else
+#define MPL_SEED_SET_SIZE 2
+#endif
+
+/**
+ * Maximum number of buffered datagrams, across all seeds. The datagrams are
+ * kept in the managed memory pool (MMEM_CONF_SIZE). When either runs out,
+ * the oldest datagram of the seed with most datagrams is reclaimed
+ */
+#ifdef MPL_CONF_BUFFERED_MESSAGE_SET_SIZE
+#define MPL_BUFFERED_MESSAGE_SET_SIZE MPL_CONF_BUFFERED_MESSAGE_SET_SIZE
+#else
+#define MPL_BUFFERED_MESSAGE_SET_SIZE 6
+#endif
+/*---------------------------------------------------------------------------*/
+/* Domain parameters */
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief Parameters of an MPL Domain
+ */
+struct mpl_domain_param {
+  clock_time_t data_imin;       /**< Data message Imin, clock ticks */
+  clock_time_t control_imin;    /**< Control message Imin, clock ticks */
+  uint8_t data_imax;            /**< Data message Imax, doublings of Imin */
+  uint8_t data_k;               /**< Data message redundancy constant */
+  uint8_t data_expirations;     /**< Data message timer expirations */
+  uint8_t control_imax;         /**< Control message Imax, doublings */
+  uint8_t control_k;            /**< Control message redundancy constant */
+  uint8_t control_expirations;  /**< Control message timer expirations */
+  uint8_t proactive;            /**< Forward new datagrams proactively */
+  uint8_t seed_lifetime;        /**< Seed Set entry lifetime, minutes */
+};
+
+/**
+ * \brief Fill p with the default parameters from the MPL_CONF_ macros
+ */
+void mpl_domain_param_default(struct mpl_domain_param *p);
+
+/**
+ * \brief Add an MPL Domain or change the parameters of an existing one
+ * \param addr The MPL Domain Address, a multicast address of scope 3 or more
+ * \param p The domain parameters, NULL for the defaults
+ * \return 1 on success, 0 if addr is not a valid domain address or the
+ *         domain set is full
+ *
+ * New parameters apply to the Trickle intervals that start afterwards.
+ * We also join the link-scoped address of the domain, which our neighbours
+ * send their MPL Control Messages to.
+ */
+uint8_t mpl_domain_set(const uip_ipaddr_t *addr,
+                       const struct mpl_domain_param *p);
+/*---------------------------------------------------------------------------*/
+/* Stats datatype */
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief Multicast stats extension for the MPL engine
+ */
+struct mpl_stats {
+  /** Number of received MPL Control Messages */
+  UIP_MCAST6_STATS_DATATYPE icmp_in;
+
+  /** Number of MPL Control Messages sent */
+  UIP_MCAST6_STATS_DATATYPE icmp_out;
+
+  /** Number of malformed MPL Control Messages seen by us */
+  UIP_MCAST6_STATS_DATATYPE icmp_bad;
+
+  /** Number of datagrams dropped because they were already buffered */
+  UIP_MCAST6_STATS_DATATYPE dup_dropped;
+
+  /** Number of buffered datagrams evicted to make room for new ones */
+  UIP_MCAST6_STATS_DATATYPE buff_reclaimed;
+
+  /** Number of data timers restarted because a neighbour misses a datagram */
+  UIP_MCAST6_STATS_DATATYPE reactive;
+};
+/*---------------------------------------------------------------------------*/
+#endif /* MPL_H_ */
+/*---------------------------------------------------------------------------*/
+/** @} */
+/** @} */
@@ -65,6 +65,7 @@
 #include "emb6_conf.h"
 #include "emb6.h"
 #include "uip-mcast6-stats.h"
+#include "trickle-timer.h"
 
 /*---------------------------------------------------------------------------*/
 /* Protocol Constants */
@@ -72,7 +73,7 @@
 #define ROLL_TM_VER                    1   /**< Supported Draft Version */
 #define ROLL_TM_ICMP_CODE              0   /**< ROLL TM ICMPv6 code field */
 #define ROLL_TM_IP_HOP_LIMIT        0xFF   /**< Hop limit for ICMP messages */
-#define ROLL_TM_INFINITE_REDUNDANCY 0xFF
+#define ROLL_TM_INFINITE_REDUNDANCY TRICKLE_TIMER_INFINITE_REDUNDANCY
 #define ROLL_TM_DGRAM_OUT              0
 #define ROLL_TM_DGRAM_IN               1
 
@@ -175,11 +176,27 @@
 #define ROLL_TM_WINS 2
 #endif
 /*---------------------------------------------------------------------------*/
+/**
+ * Number of hash buckets for the sliding window lookup (Seed ID and M).
+ * A power of two no smaller than ROLL_TM_WINS / 2 keeps the chains short
+ * when many seeds are active at the same time
+ */
+#ifdef ROLL_TM_CONF_WIN_HASH_SIZE
+#define ROLL_TM_WIN_HASH_SIZE ROLL_TM_CONF_WIN_HASH_SIZE
+#else
+#define ROLL_TM_WIN_HASH_SIZE 4
+#endif
+/*---------------------------------------------------------------------------*/
 /**
  * Maximum Number of Buffered Multicast Messages
  * This buffer is shared across all Seed IDs, therefore a new very active Seed
  * may eventually occupy all slots. It would make little sense (if any) to
  * define support for fewer buffered messages than seeds*2
+ *
+ * Only the message descriptors are allocated statically. The datagrams
+ * themselves are kept in the managed memory pool (MMEM_CONF_SIZE), which is
+ * shared with IP reassembly, and take as many bytes as they are long. When
+ * either runs out, the oldest message of the largest window is reclaimed
  */
 #ifdef ROLL_TM_CONF_BUFF_NUM
 #define ROLL_TM_BUFF_NUM ROLL_TM_CONF_BUFF_NUM
@@ -236,6 +253,12 @@ struct roll_tm_stats {
 
   /** Number of malformed ICMP datagrams seen by us */
   UIP_MCAST6_STATS_DATATYPE icmp_bad;
+
+  /** Number of datagrams dropped because they were already buffered */
+  UIP_MCAST6_STATS_DATATYPE dup_dropped;
+
+  /** Number of buffered datagrams evicted to make room for new ones */
+  UIP_MCAST6_STATS_DATATYPE buff_reclaimed;
 };
 /*---------------------------------------------------------------------------*/
 #endif /* ROLL_TM_H_ */
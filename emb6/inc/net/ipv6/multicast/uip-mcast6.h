@@ -65,6 +65,7 @@
 #include "uip-mcast6-route.h"
 #include "smrf.h"
 #include "roll-tm.h"
+#include "mpl.h"
 
 #include <string.h>
 /*---------------------------------------------------------------------------*/
@@ -155,6 +156,11 @@ struct uip_mcast6_driver {
 #define UIP_CONF_IPV6_ROLL_TM  1        /* ROLL Trickle ICMP type support */
 
 #define UIP_MCAST6             roll_tm_driver
+#elif UIP_MCAST6_ENGINE == UIP_MCAST6_ENGINE_MPL
+#define RPL_CONF_MULTICAST     0        /* Not used by MPL */
+#define UIP_CONF_IPV6_MPL      1        /* MPL Option and ICMP type support */
+
+#define UIP_MCAST6             mpl_driver
 #elif UIP_MCAST6_ENGINE == UIP_MCAST6_ENGINE_SMRF
 #define RPL_CONF_MULTICAST     1
 
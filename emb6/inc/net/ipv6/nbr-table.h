@@ -50,6 +50,13 @@
 #define NBR_TABLE_MAX_NEIGHBORS 8
 #endif /* NBR_TABLE_CONF_MAX_NEIGHBORS */
 
+/* Number of buckets of the link-layer and IPv6 address indexes */
+#ifdef NBR_TABLE_CONF_HASH_SIZE
+#define NBR_TABLE_HASH_SIZE NBR_TABLE_CONF_HASH_SIZE
+#else /* NBR_TABLE_CONF_HASH_SIZE */
+#define NBR_TABLE_HASH_SIZE 16
+#endif /* NBR_TABLE_CONF_HASH_SIZE */
+
 /* An item in a neighbor table */
 typedef void nbr_table_item_t;
 
@@ -90,6 +97,7 @@ nbr_table_item_t *nbr_table_next(nbr_table_t *table, nbr_table_item_t *item);
 /** @{ */
 nbr_table_item_t *nbr_table_add_lladdr(nbr_table_t *table, const linkaddr_t *lladdr);
 nbr_table_item_t *nbr_table_get_from_lladdr(nbr_table_t *table, const linkaddr_t *lladdr);
+nbr_table_item_t *nbr_table_get_from_ipaddr(nbr_table_t *table, const uip_ipaddr_t *ipaddr);
 /** @} */
 
 /** \name Neighbor tables: set flags (unused, locked, unlocked) */
@@ -102,6 +110,11 @@ int nbr_table_unlock(nbr_table_t *table, nbr_table_item_t *item);
 /** \name Neighbor tables: address manipulation */
 /** @{ */
 linkaddr_t *nbr_table_get_lladdr(nbr_table_t *table, const nbr_table_item_t *item);
+/** \brief Change the link-layer address of an item */
+int nbr_table_set_lladdr(nbr_table_t *table, nbr_table_item_t *item, const linkaddr_t *lladdr);
+/** \brief Index an item by an IPv6 address. The address must be stored in
+ * the item itself, it is unindexed when the item is removed or reset. */
+int nbr_table_set_ipaddr(nbr_table_t *table, nbr_table_item_t *item, const uip_ipaddr_t *ipaddr);
 /** @} */
 
 #endif /* NBR_TABLE_H_ */
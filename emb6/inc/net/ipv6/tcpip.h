@@ -352,6 +352,15 @@ void tcpip_set_outputfunc(uint8_t (* f)(void));
  */
 #if NETSTACK_CONF_WITH_IPV6
 void tcpip_ipv6_output(void);
+
+/**
+ * \brief Upper-layer reachability confirmation (RFC 4861, 7.3.1)
+ *
+ * To be called when an upper layer sees forward progress with \p dest,
+ * e.g. an acknowledgement of new data. The neighbor last used as next hop
+ * toward \p dest is marked REACHABLE, which saves the NUD probes.
+ */
+void tcpip_ipv6_confirm_reachable(const uip_ipaddr_t *dest);
 #endif
 
 /**
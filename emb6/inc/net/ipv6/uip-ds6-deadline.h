@@ -0,0 +1,112 @@
+/*
+ * emb6 is licensed under the 3-clause BSD license. This license gives everyone
+ * the right to use and distribute the code, either in binary or source code
+ * format, as long as the copyright license is retained in the source code.
+ *
+ * The emb6 is derived from the Contiki OS platform with the explicit approval
+ * from Adam Dunkels. However, emb6 is made independent from the OS through the
+ * removal of protothreads. In addition, APIs are made more flexible to gain
+ * more adaptivity during run-time.
+ *
+ * The license text is:
+ *
+ * Copyright (c) 2015,
+ * Hochschule Offenburg, University of Applied Sciences
+ * Laboratory Embedded Systems and Communications Electronics.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \addtogroup uip6
+ * @{
+ */
+
+/**
+ * \file
+ *    Expiry queue of the IPv6 data structures
+ *
+ *    Addresses, prefixes, default routers and neighbors embed one
+ *    uip_ds6_deadline_t holding the earliest time at which one of their
+ *    timers needs attention. The entries are kept sorted, so that
+ *    uip_ds6_periodic() only runs when the first one is due and only
+ *    visits the entries that are.
+ */
+
+#ifndef UIP_DS6_DEADLINE_H_
+#define UIP_DS6_DEADLINE_H_
+
+#include <stddef.h>
+#include "emb6.h"
+#include "stimer.h"
+
+/** \brief Owners of the expiry queue entries */
+#define UIP_DS6_DL_ADDR     1
+#define UIP_DS6_DL_PREFIX   2
+#define UIP_DS6_DL_DEFRT    3
+#define UIP_DS6_DL_NBR      4
+#define UIP_DS6_DL_RA       5
+
+/** \brief Tick a is before tick b, across wraparound */
+#define UIP_DS6_DEADLINE_BEFORE(a, b) ((int32_t)((a) - (b)) < 0)
+
+/** \brief Interval meaning that nothing is to be done, see
+ * uip_ds6_deadline_set() */
+#define UIP_DS6_DEADLINE_INFINITE ((clock_time_t)~0)
+
+/** \brief An entry in the expiry queue */
+typedef struct uip_ds6_deadline {
+  struct uip_ds6_deadline *next;
+  clock_time_t expires;   /**< tick at which the owner is to be processed */
+  uint8_t type;           /**< UIP_DS6_DL_ADDR, ... */
+  uint8_t queued;
+} uip_ds6_deadline_t;
+
+/** \brief Get the structure an entry is embedded in */
+#define UIP_DS6_DEADLINE_OWNER(dl, type, member) \
+  ((type *)((uint8_t *)(dl) - offsetof(type, member)))
+
+/** \brief Empty the queue */
+void uip_ds6_deadline_init(void);
+
+/**
+ * \brief Queue an entry to expire in \p interval ticks, or remove it if
+ * \p interval is UIP_DS6_DEADLINE_INFINITE. Entries are never due earlier
+ * than UIP_DS6_PERIOD from now, so that an owner that cannot act yet is
+ * retried later instead of immediately.
+ */
+void uip_ds6_deadline_set(uip_ds6_deadline_t *dl, uint8_t type,
+                          clock_time_t interval);
+
+/** \brief Remove an entry from the queue */
+void uip_ds6_deadline_stop(uip_ds6_deadline_t *dl);
+
+/** \brief Remove and return the first entry if it is due, NULL otherwise */
+uip_ds6_deadline_t *uip_ds6_deadline_next_due(void);
+
+/** \brief Ticks until a stimer expires, 0 if it has */
+clock_time_t uip_ds6_deadline_stimer(struct stimer *t);
+
+#endif /* UIP_DS6_DEADLINE_H_ */
+/** @} */
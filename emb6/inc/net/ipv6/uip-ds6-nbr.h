@@ -48,6 +48,7 @@
 
 #include "uip.h"
 #include "stimer.h"
+#include "uip-ds6-deadline.h"
 #include "uip-ds6.h"
 #include "nbr-table.h"
 
@@ -63,6 +64,11 @@
 #define  NBR_DELAY 3
 #define  NBR_PROBE 4
 
+/** \brief Registration states of the nbr cache entries (6LoWPAN-ND) */
+#define  NBR_REG_NONE 0
+#define  NBR_REG_TENTATIVE 1
+#define  NBR_REG_REGISTERED 2
+
 NBR_TABLE_DECLARE(ds6_neighbors);
 
 /** \brief An entry in the nbr cache */
@@ -74,6 +80,12 @@ typedef struct uip_ds6_nbr {
   uint8_t isrouter;
   uint8_t state;
   uint16_t link_metric;
+  uip_ds6_deadline_t deadline;
+#if UIP_ND6_6LOWPAN && UIP_CONF_ROUTER
+  uint8_t regstate;
+  uint8_t regtid;               /**< TID of the DAR of a tentative entry */
+  struct stimer reglifetime;
+#endif /* UIP_ND6_6LOWPAN && UIP_CONF_ROUTER */
 #if UIP_CONF_IPV6_QUEUE_PKT
   struct uip_packetqueue_handle packethandle;
 #define UIP_DS6_NBR_PACKET_LIFETIME bsp_get(E_BSP_GET_TRES) * 4
@@ -87,13 +99,23 @@ uip_ds6_nbr_t *uip_ds6_nbr_add(const uip_ipaddr_t *ipaddr, const uip_lladdr_t *l
                                uint8_t isrouter, uint8_t state);
 void uip_ds6_nbr_rm(uip_ds6_nbr_t *nbr);
 const uip_lladdr_t *uip_ds6_nbr_get_ll(const uip_ds6_nbr_t *nbr);
+void uip_ds6_nbr_set_ll(uip_ds6_nbr_t *nbr, const uip_lladdr_t *lladdr);
 const uip_ipaddr_t *uip_ds6_nbr_get_ipaddr(const uip_ds6_nbr_t *nbr);
 uip_ds6_nbr_t *uip_ds6_nbr_lookup(const uip_ipaddr_t *ipaddr);
 uip_ds6_nbr_t *uip_ds6_nbr_ll_lookup(const uip_lladdr_t *lladdr);
+#if UIP_ND6_6LOWPAN
+uip_ds6_nbr_t *uip_ds6_nbr_from_iid(const uip_ipaddr_t *ipaddr);
+#endif /* UIP_ND6_6LOWPAN */
 uip_ipaddr_t *uip_ds6_nbr_ipaddr_from_lladdr(const uip_lladdr_t *lladdr);
 const uip_lladdr_t *uip_ds6_nbr_lladdr_from_ipaddr(const uip_ipaddr_t *ipaddr);
+/** \brief Mark a neighbor REACHABLE on a link-layer or upper-layer
+ * confirmation, ending NUD for it */
+void uip_ds6_nbr_confirm_reachable(uip_ds6_nbr_t *nbr);
 void uip_ds6_link_neighbor_callback(int status, int numtx);
-void uip_ds6_neighbor_periodic(void);
+/** \brief Requeue a neighbor after changing its state or timers */
+void uip_ds6_nbr_schedule(uip_ds6_nbr_t *nbr);
+/** \brief Process a neighbor whose deadline passed */
+void uip_ds6_nbr_expired(uip_ds6_nbr_t *nbr);
 int uip_ds6_nbr_num(void);
 
 /**
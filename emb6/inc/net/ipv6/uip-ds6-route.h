@@ -43,6 +43,7 @@
 
 #include "stimer.h"
 #include "clist.h"
+#include "uip-ds6-deadline.h"
 
 void uip_ds6_route_init(void);
 
@@ -89,6 +90,22 @@ void uip_ds6_notification_rm(struct uip_ds6_notification *n);
 #define UIP_DS6_ROUTE_NB UIP_CONF_MAX_ROUTES
 #endif /* UIP_CONF_MAX_ROUTES */
 
+/** \brief Number of buckets of the /128 host route hash, one per route by
+ *  default */
+#ifdef UIP_CONF_DS6_ROUTE_HASH_SIZE
+#define UIP_DS6_ROUTE_HASH_SIZE UIP_CONF_DS6_ROUTE_HASH_SIZE
+#else /* UIP_CONF_DS6_ROUTE_HASH_SIZE */
+#define UIP_DS6_ROUTE_HASH_SIZE UIP_DS6_ROUTE_NB
+#endif /* UIP_CONF_DS6_ROUTE_HASH_SIZE */
+
+/** \brief Number of nodes of the prefix route trie. Host routes do not
+ *  use it; a trie holding n prefix routes needs at most 2n - 1 nodes. */
+#ifdef UIP_CONF_DS6_ROUTE_TRIE_NB
+#define UIP_DS6_ROUTE_TRIE_NB UIP_CONF_DS6_ROUTE_TRIE_NB
+#else /* UIP_CONF_DS6_ROUTE_TRIE_NB */
+#define UIP_DS6_ROUTE_TRIE_NB 8
+#endif /* UIP_CONF_DS6_ROUTE_TRIE_NB */
+
 /** \brief define some additional RPL related route state and
  *  neighbor callback for RPL - if not a DS6_ROUTE_STATE is already set */
 #ifndef UIP_DS6_ROUTE_STATE_TYPE
@@ -111,6 +128,8 @@ struct uip_ds6_route_neighbor_routes {
 /** \brief An entry in the routing table */
 typedef struct uip_ds6_route {
   struct uip_ds6_route *next;
+  /* Next route in the same bucket of the host route hash */
+  struct uip_ds6_route *hash_next;
   /* Each route entry belongs to a specific neighbor. That neighbor
      holds a list of all routing entries that go through it. The
      routes field point to the uip_ds6_route_neighbor_routes that
@@ -137,6 +156,7 @@ typedef struct uip_ds6_defrt {
   uip_ipaddr_t ipaddr;
   struct stimer lifetime;
   uint8_t isinfinite;
+  uip_ds6_deadline_t deadline;
 } uip_ds6_defrt_t;
 
 /** \name Default router list basic routines */
@@ -147,7 +167,8 @@ void uip_ds6_defrt_rm(uip_ds6_defrt_t *defrt);
 uip_ds6_defrt_t *uip_ds6_defrt_lookup(uip_ipaddr_t *ipaddr);
 uip_ipaddr_t *uip_ds6_defrt_choose(void);
 
-void uip_ds6_defrt_periodic(void);
+/** \brief Requeue a default router after changing its lifetime */
+void uip_ds6_defrt_schedule(uip_ds6_defrt_t *defrt);
 /** @} */
 
 
@@ -45,6 +45,7 @@
 #include "emb6_conf.h"
 #include "uip.h"
 #include "stimer.h"
+#include "uip-ds6-deadline.h"
 /* The size of uip_ds6_addr_t depends on UIP_ND6_DEF_MAXDADNS. Include uip-nd6.h to define it. */
 #include "uip-nd6.h"
 #include "uip-ds6-route.h"
@@ -132,7 +133,7 @@
 #define  ADDR_MANUAL 3
 
 /** \brief General DS6 definitions */
-/** Period for uip-ds6 periodic task*/
+/** Shortest delay before uip-ds6 processes an expired entry again */
 #ifndef UIP_DS6_CONF_PERIOD
 #define UIP_DS6_PERIOD   (bsp_get(E_BSP_GET_TRES)/10)
 #else
@@ -166,6 +167,7 @@ typedef struct uip_ds6_prefix {
   uint8_t length;
   struct stimer vlifetime;
   uint8_t isinfinite;
+  uip_ds6_deadline_t deadline;
 } uip_ds6_prefix_t;
 #endif /*UIP_CONF_ROUTER */
 
@@ -181,6 +183,12 @@ typedef struct uip_ds6_addr {
   struct timer dadtimer;
   uint8_t dadnscount;
 #endif /* UIP_ND6_DEF_MAXDADNS > 0 */
+#if UIP_ND6_6LOWPAN && !UIP_CONF_ROUTER
+  struct stimer regtimer;  /**< Next registration attempt or refresh */
+  uint8_t regcount;        /**< Unanswered registration attempts */
+  uip_ipaddr_t regrouter;  /**< Router the registration was sent to */
+#endif /* UIP_ND6_6LOWPAN && !UIP_CONF_ROUTER */
+  uip_ds6_deadline_t deadline;
 } uip_ds6_addr_t;
 
 /** \brief Anycast address  */
@@ -233,6 +241,16 @@ typedef struct uip_ds6_element {
 extern uip_ds6_netif_t uip_ds6_if;
 extern struct etimer uip_ds6_timer_periodic;
 
+/** \brief Generation of the next hop state. Bumped whenever a change to
+ *  the prefixes, routes, default routes or neighbors may change the next
+ *  hop of a destination. Never 0. */
+extern uint32_t uip_ds6_route_gen;
+#define UIP_DS6_ROUTE_GEN_BUMP() do {                     \
+    if(++uip_ds6_route_gen == 0) {                        \
+      uip_ds6_route_gen = 1;                              \
+    }                                                     \
+  } while(0)
+
 #if UIP_CONF_ROUTER
 extern uip_ds6_prefix_t uip_ds6_prefix_list[UIP_DS6_PREFIX_NB];
 #else /* UIP_CONF_ROUTER */
@@ -244,7 +262,9 @@ extern struct etimer uip_ds6_timer_rs;
 /** \brief Initialize data structures */
 void uip_ds6_init(void);
 
-/** \brief Periodic processing of data structures */
+/** \brief Process the entries of the data structures whose lifetime or
+ * timers expired. Runs on uip_ds6_timer_periodic, which the expiry queue
+ * sets to the first deadline. */
 void uip_ds6_periodic(void);
 
 /** \brief Generic loop routine on an abstract data structure, which generalizes
@@ -269,6 +289,10 @@ uip_ds6_prefix_t *uip_ds6_prefix_add(uip_ipaddr_t *ipaddr, uint8_t length,
                                      unsigned long interval);
 #endif /* UIP_CONF_ROUTER */
 void uip_ds6_prefix_rm(uip_ds6_prefix_t *prefix);
+#if !UIP_CONF_ROUTER
+/** \brief Requeue a prefix after changing its lifetime */
+void uip_ds6_prefix_schedule(uip_ds6_prefix_t *prefix);
+#endif /* !UIP_CONF_ROUTER */
 uip_ds6_prefix_t *uip_ds6_prefix_lookup(uip_ipaddr_t *ipaddr,
                                         uint8_t ipaddrlen);
 uint8_t uip_ds6_is_addr_onlink(uip_ipaddr_t *ipaddr);
@@ -280,6 +304,8 @@ uint8_t uip_ds6_is_addr_onlink(uip_ipaddr_t *ipaddr);
 uip_ds6_addr_t *uip_ds6_addr_add(uip_ipaddr_t *ipaddr,
                                  unsigned long vlifetime, uint8_t type);
 void uip_ds6_addr_rm(uip_ds6_addr_t *addr);
+/** \brief Requeue an address after changing its lifetime or timers */
+void uip_ds6_addr_schedule(uip_ds6_addr_t *addr);
 uip_ds6_addr_t *uip_ds6_addr_lookup(uip_ipaddr_t *ipaddr);
 uip_ds6_addr_t *uip_ds6_get_link_local(int8_t state);
 uip_ds6_addr_t *uip_ds6_get_global(int8_t state);
@@ -306,6 +332,9 @@ uip_ds6_aaddr_t *uip_ds6_aaddr_lookup(uip_ipaddr_t *ipaddr);
 /** \brief set the last 64 bits of an IP address based on the MAC address */
 void uip_ds6_set_addr_iid(uip_ipaddr_t *ipaddr, uip_lladdr_t *lladdr);
 
+/** \brief get the MAC address an IP address interface identifier is based on */
+void uip_ds6_set_lladdr_from_iid(uip_lladdr_t *lladdr, const uip_ipaddr_t *ipaddr);
+
 /** \brief Get the number of matching bits of two addresses */
 uint8_t get_match_length(uip_ipaddr_t *src, uip_ipaddr_t *dst);
 
@@ -317,6 +346,11 @@ void uip_ds6_dad(uip_ds6_addr_t *ifaddr);
 int uip_ds6_dad_failed(uip_ds6_addr_t *ifaddr);
 #endif /* UIP_ND6_DEF_MAXDADNS */
 
+#if UIP_ND6_6LOWPAN && !UIP_CONF_ROUTER
+/** \brief Register one address with the default router (RFC 6775) */
+void uip_ds6_reg(uip_ds6_addr_t *ifaddr);
+#endif /* UIP_ND6_6LOWPAN && !UIP_CONF_ROUTER */
+
 /** \brief Source address selection, see RFC 3484 */
 void uip_ds6_select_src(uip_ipaddr_t *src, uip_ipaddr_t *dst);
 
@@ -63,6 +63,9 @@
 #define ICMP6_NA                        136  /**< Neighbor advertisement */
 #define ICMP6_REDIRECT                  137  /**< Redirect */
 #define ICMP6_RPL                       155  /**< RPL */
+#define ICMP6_MPL                       159  /**< MPL Control Message */
+#define ICMP6_DAR                       157  /**< Duplicate Address Request */
+#define ICMP6_DAC                       158  /**< Duplicate Address Confirmation */
 #define ICMP6_PRIV_EXP_100              100  /**< Private Experimentation */
 #define ICMP6_PRIV_EXP_101              101  /**< Private Experimentation */
 #define ICMP6_PRIV_EXP_200              200  /**< Private Experimentation */
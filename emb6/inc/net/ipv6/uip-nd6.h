@@ -94,8 +94,9 @@
 /** @} */
 
 #ifndef UIP_CONF_ND6_DEF_MAXDADNS
-/** \brief Do not try DAD when using EUI-64 as allowed by draft-ietf-6lowpan-nd-15 section 8.2 */
-#if UIP_CONF_LL_802154
+/** \brief Do not try DAD when using EUI-64 as allowed by draft-ietf-6lowpan-nd-15 section 8.2,
+ * nor when addresses are registered with 6LoWPAN-ND */
+#if UIP_CONF_LL_802154 || UIP_ND6_6LOWPAN
 #define UIP_ND6_DEF_MAXDADNS 0
 #else /* UIP_CONF_LL_802154 */
 #define UIP_ND6_DEF_MAXDADNS UIP_ND6_SEND_NA
@@ -146,6 +147,40 @@
 #endif
 /** @} */
 
+/** \name RFC 6775 6LoWPAN Context Option in RAs */
+/** @{ */
+#ifndef UIP_CONF_ND6_RA_6CO
+#define UIP_ND6_RA_6CO                  0
+#else
+#define UIP_ND6_RA_6CO                  UIP_CONF_ND6_RA_6CO
+#endif
+/** @} */
+
+/** \name RFC 6775/8505 6LoWPAN-ND address registration */
+/** @{ */
+/** \brief Registration lifetime requested by hosts, in minutes */
+#ifndef UIP_CONF_ND6_REGISTRATION_LIFETIME
+#define UIP_ND6_REGISTRATION_LIFETIME   60
+#else
+#define UIP_ND6_REGISTRATION_LIFETIME   UIP_CONF_ND6_REGISTRATION_LIFETIME
+#endif
+/** \brief Registrations the border router keeps for duplicate detection */
+#ifndef UIP_CONF_ND6_REG_NB
+#define UIP_ND6_REG_NB                  16
+#else
+#define UIP_ND6_REG_NB                  UIP_CONF_ND6_REG_NB
+#endif
+#define UIP_ND6_TENTATIVE_NCE_LIFETIME  20  /*seconds*/
+#define UIP_ND6_MULTIHOP_HOPLIMIT       64
+
+#define UIP_ND6_ARO_STATUS_SUCCESS      0
+#define UIP_ND6_ARO_STATUS_DUPLICATE    1
+#define UIP_ND6_ARO_STATUS_CACHE_FULL   2
+
+#define UIP_ND6_EARO_FLAG_R             0x02
+#define UIP_ND6_EARO_FLAG_T             0x01
+/** @} */
+
 
 /** \name ND6 option types */
 /** @{ */
@@ -156,6 +191,8 @@
 #define UIP_ND6_OPT_MTU                 5
 #define UIP_ND6_OPT_RDNSS               25
 #define UIP_ND6_OPT_DNSSL               31
+#define UIP_ND6_OPT_ARO                 33
+#define UIP_ND6_OPT_6CO                 34
 /** @} */
 
 /** \name ND6 option types */
@@ -170,6 +207,7 @@
 #define UIP_ND6_NS_LEN                  20
 #define UIP_ND6_RA_LEN                  12
 #define UIP_ND6_RS_LEN                  4
+#define UIP_ND6_DAR_LEN                 28
 /** @} */
 
 
@@ -180,6 +218,8 @@
 #define UIP_ND6_OPT_MTU_LEN            8
 #define UIP_ND6_OPT_RDNSS_LEN          1
 #define UIP_ND6_OPT_DNSSL_LEN          1
+#define UIP_ND6_OPT_6CO_LEN            16
+#define UIP_ND6_OPT_ARO_LEN            16
 
 
 /* Length of TLLAO and SLLAO options, it is L2 dependant */
@@ -269,6 +309,20 @@ typedef struct uip_nd6_redirect {
   uip_ipaddr_t tgtipaddress;
   uip_ipaddr_t destipaddress;
 } uip_nd6_redirect;
+
+/**
+ * \brief A duplicate address request/confirmation (RFC 6775/8505)
+ *
+ * Sent between a router and the border router on behalf of a host
+ * registering a global address.
+ */
+typedef struct uip_nd6_dar {
+  uint8_t status;
+  uint8_t tid;
+  uint16_t lifetime;
+  uint8_t rovr[8];
+  uip_ipaddr_t regipaddr;
+} uip_nd6_dar;
 /** @} */
 
 /**
@@ -311,6 +365,18 @@ typedef struct uip_nd6_opt_dns {
   uip_ipaddr_t ip;
 } uip_nd6_opt_dns;
 
+/** \brief ND option (extended) address registration, RFC 6775/8505 */
+typedef struct uip_nd6_opt_aro {
+  uint8_t type;
+  uint8_t len;
+  uint8_t status;
+  uint8_t opaque;
+  uint8_t flags;
+  uint8_t tid;
+  uint16_t lifetime;
+  uint8_t rovr[8];
+} uip_nd6_opt_aro;
+
 /** \struct Redirected header option */
 typedef struct uip_nd6_opt_redirected_hdr {
   uint8_t type;
@@ -370,6 +436,32 @@ uip_nd6_ns_input(void);
 void
 uip_nd6_ns_output(uip_ipaddr_t *src, uip_ipaddr_t *dest, uip_ipaddr_t *tgt);
 
+#if UIP_ND6_6LOWPAN
+/**
+ * \brief Register an address with a router (RFC 6775/8505)
+ * \param tgt the address to register, used as source and target of the NS
+ * \param dest the router to register with
+ * \param lifetime the registration lifetime in minutes, 0 to unregister
+ *
+ * Sends a unicast NS carrying a SLLAO and an EARO. The router answers
+ * with a NA carrying the registration status.
+ */
+void
+uip_nd6_ns_aro_output(uip_ipaddr_t *tgt, uip_ipaddr_t *dest, uint16_t lifetime);
+
+#if UIP_CONF_ROUTER
+/**
+ * \brief Set the border router checking global registrations for duplicates
+ *
+ * Global addresses registered with us are confirmed with this border
+ * router through DAR/DAC. If it is one of our own addresses, we are the
+ * border router ourselves.
+ */
+void
+uip_nd6_set_6lbr(const uip_ipaddr_t *addr);
+#endif /* UIP_CONF_ROUTER */
+#endif /* UIP_ND6_6LOWPAN */
+
 #if UIP_CONF_ROUTER
 #if UIP_ND6_SEND_RA
 /**
@@ -1,16 +1,34 @@
 /**
  * \file
- *         A brief description the file
+ *         Per-neighbor queues of IPv6 packets awaiting address resolution.
+ *
+ *         Each handle holds a FIFO of at most UIP_PACKETQUEUE_PER_HANDLE
+ *         packets. All handles draw their packets from one shared pool of
+ *         UIP_PACKETQUEUE_NUM buffers.
  */
 #ifndef UIP_PACKETQUEUE_H
 #define UIP_PACKETQUEUE_H
 
 #include "ctimer.h"
 
+/** Number of packet buffers shared by all queues */
+#ifdef UIP_CONF_PACKETQUEUE_NUM
+#define UIP_PACKETQUEUE_NUM UIP_CONF_PACKETQUEUE_NUM
+#else /* UIP_CONF_PACKETQUEUE_NUM */
+#define UIP_PACKETQUEUE_NUM 2
+#endif /* UIP_CONF_PACKETQUEUE_NUM */
+
+/** Maximum number of packets queued on a single handle */
+#ifdef UIP_CONF_PACKETQUEUE_PER_HANDLE
+#define UIP_PACKETQUEUE_PER_HANDLE UIP_CONF_PACKETQUEUE_PER_HANDLE
+#else /* UIP_CONF_PACKETQUEUE_PER_HANDLE */
+#define UIP_PACKETQUEUE_PER_HANDLE 2
+#endif /* UIP_CONF_PACKETQUEUE_PER_HANDLE */
+
 struct uip_packetqueue_handle;
 
 struct uip_packetqueue_packet {
-  struct uip_ds6_queued_packet *next;
+  struct uip_packetqueue_packet *next;
   uint8_t queue_buf[UIP_BUFSIZE - UIP_LLH_LEN];
   uint16_t queue_buf_len;
   struct ctimer lifetimer;
@@ -18,19 +36,33 @@ struct uip_packetqueue_packet {
 };
 
 struct uip_packetqueue_handle {
-  struct uip_packetqueue_packet *packet;
+  struct uip_packetqueue_packet *packet;  /**< Oldest packet, head of the FIFO */
+  uint8_t count;
 };
 
 void uip_packetqueue_new(struct uip_packetqueue_handle *handle);
 
-
+/**
+ * \brief Append a packet buffer to the tail of a queue
+ *
+ * If the queue already holds UIP_PACKETQUEUE_PER_HANDLE packets, its
+ * oldest packet is dropped to make room (RFC 4861, 7.2.2). The caller
+ * fills queue_buf and queue_buf_len of the returned packet.
+ *
+ * \return The new packet, or NULL if the shared pool is exhausted
+ */
 struct uip_packetqueue_packet *
 uip_packetqueue_alloc(struct uip_packetqueue_handle *handle, clock_time_t lifetime);
 
+/** \brief Drop the oldest packet of a queue */
+void
+uip_packetqueue_pop(struct uip_packetqueue_handle *handle);
 
+/** \brief Drop all packets of a queue */
 void
 uip_packetqueue_free(struct uip_packetqueue_handle *handle);
 
+/* Buffer and length of the oldest packet of a queue */
 uint8_t *uip_packetqueue_buf(struct uip_packetqueue_handle *h);
 uint16_t uip_packetqueue_buflen(struct uip_packetqueue_handle *h);
 void uip_packetqueue_set_buflen(struct uip_packetqueue_handle *h, uint16_t len);
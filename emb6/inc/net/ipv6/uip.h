@@ -852,11 +852,12 @@ struct uip_udp_conn *uip_udp_new(const uip_ipaddr_t *ripaddr, uint16_t rport);
 /**
  * Remove a UDP connection.
  *
- * \param conn A pointer to the uip_udp_conn structure for the connection.
+ * The connection is taken out of the port hash and handed back to the
+ * pool of free connections. Removing a connection twice is harmless.
  *
- * \hideinitializer
+ * \param conn A pointer to the uip_udp_conn structure for the connection.
  */
-#define uip_udp_remove(conn) (conn)->lport = 0
+void uip_udp_remove(struct uip_udp_conn *conn);
 
 /**
  * Bind a UDP connection to a local port.
@@ -865,10 +866,8 @@ struct uip_udp_conn *uip_udp_new(const uip_ipaddr_t *ripaddr, uint16_t rport);
  * connection.
  *
  * \param port The local port number, in network byte order.
- *
- * \hideinitializer
  */
-#define uip_udp_bind(conn, port) (conn)->lport = port
+void uip_udp_bind(struct uip_udp_conn *conn, uint16_t port);
 
 /**
  * Send a UDP datagram of length len on the current connection.
@@ -1299,6 +1298,36 @@ CCIF extern uint16_t uip_len;
  * The length of the extension headers
  */
 extern uint8_t uip_ext_len;
+
+/**
+ * Room left free right after the IPv6 header of an outgoing packet,
+ * taken by an extension header instead of moving the payload
+ */
+extern uint8_t uip_ext_room;
+
+/**
+ * Checksum information about the packet in uip_buf, provided by the
+ * lower layer. Either the upper layer checksum was already verified
+ * (e.g. by the radio), or a partial checksum was computed while copying
+ * the packet in (see uip_chksum_copy()): the one's complement sum, in
+ * host byte order, of the bytes from offset to end of the IPv6 packet.
+ * It is used by the next input checksum verification only.
+ */
+typedef struct uip_rx_chksum {
+  uint16_t offset;
+  uint16_t end;
+  uint16_t sum;
+  uint8_t state;
+} uip_rx_chksum_t;
+
+/** \name Values of uip_rx_chksum.state */
+/** @{ */
+#define UIP_RX_CHKSUM_NONE      0
+#define UIP_RX_CHKSUM_PARTIAL   1
+#define UIP_RX_CHKSUM_VERIFIED  2
+/** @} */
+
+extern uip_rx_chksum_t uip_rx_chksum;
 /** @} */
 
 #if UIP_URGDATA > 0
@@ -1379,6 +1408,9 @@ struct uip_udp_conn {
   uint16_t lport;        /**< The local port number in network byte order. */
   uint16_t rport;        /**< The remote port number in network byte order. */
   uint8_t  ttl;          /**< Default time-to-live. */
+  uint8_t  used;         /**< Non-zero while the connection is allocated. */
+  struct uip_udp_conn *hash_next; /**< Next connection in the port hash
+                                       bucket or in the free list. */
 
   /** The application state. */
   uip_udp_appstate_t appstate;
@@ -1870,6 +1902,7 @@ struct uip_udp_hdr {
 #define UIP_PROTO_DESTO       60
 #define UIP_PROTO_ROUTING     43
 #define UIP_PROTO_FRAG        44
+#define UIP_PROTO_IPV6        41
 #define UIP_PROTO_NONE        59
 /** @} */
 
@@ -1878,6 +1911,7 @@ struct uip_udp_hdr {
 #define UIP_EXT_HDR_OPT_PAD1  0
 #define UIP_EXT_HDR_OPT_PADN  1
 #define UIP_EXT_HDR_OPT_RPL   0x63
+#define UIP_EXT_HDR_OPT_MPL   0x6d
 
 /** @} */
 
@@ -2166,6 +2200,59 @@ CCIF extern uip_lladdr_t uip_lladdr;
  */
 uint16_t uip_chksum(uint16_t *data, uint16_t len);
 
+/**
+ * Copy a buffer and add its 16-bit words to a one's complement sum.
+ *
+ * This folds the checksum computation into a copy that is needed
+ * anyway, e.g. when the lower layer moves the payload into uip_buf.
+ * The words are taken in network byte order starting at src, so a
+ * partial sum of data at an odd offset has to be byte-swapped.
+ *
+ * \param dst The destination buffer, or NULL to only compute the sum
+ * \param src The source buffer
+ * \param len The number of bytes to copy
+ * \param sum The sum to add to, in host byte order
+ *
+ * \return The one's complement sum in host byte order
+ */
+uint16_t uip_chksum_copy(uint8_t *dst, const uint8_t *src, uint16_t len,
+                         uint16_t sum);
+
+/**
+ * One's complement addition of two 16-bit values in host byte order.
+ */
+uint16_t uip_chksum_add(uint16_t sum, uint16_t val);
+
+/**
+ * Update a checksum after a 16-bit word of the covered data changed.
+ *
+ * Incremental update as of RFC 1624, eqn. 3, so that rewriting a field
+ * of an already checksummed packet does not need a pass over the
+ * whole payload.
+ *
+ * \param chksum The checksum field, in host byte order
+ * \param old_val The old value of the word, in host byte order
+ * \param new_val The new value of the word, in host byte order
+ *
+ * \return The new checksum field, in host byte order
+ */
+uint16_t uip_chksum_update16(uint16_t chksum, uint16_t old_val,
+                             uint16_t new_val);
+
+/**
+ * Update a checksum after a range of the covered data changed, e.g. an
+ * address of the pseudo-header.
+ *
+ * \param chksum The checksum field, in host byte order
+ * \param old_data The old content of the range
+ * \param new_data The new content of the range
+ * \param len The length of the range, must start at an even offset
+ *
+ * \return The new checksum field, in host byte order
+ */
+uint16_t uip_chksum_update(uint16_t chksum, const uint8_t *old_data,
+                           const uint8_t *new_data, uint16_t len);
+
 /**
  * Calculate the IP header checksum of the packet header in uip_buf.
  *
@@ -0,0 +1,123 @@
+/*
+ * emb6 is licensed under the 3-clause BSD license. This license gives everyone
+ * the right to use and distribute the code, either in binary or source code
+ * format, as long as the copyright license is retained in the source code.
+ *
+ * The emb6 is derived from the Contiki OS platform with the explicit approval
+ * from Adam Dunkels. However, emb6 is made independent from the OS through the
+ * removal of protothreads. In addition, APIs are made more flexible to gain
+ * more adaptivity during run-time.
+ *
+ * The license text is:
+ *
+ * Copyright (c) 2015,
+ * Hochschule Offenburg, University of Applied Sciences
+ * Laboratory Embedded Systems and Communications Electronics.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *   DODAG of a non-storing mode root: the parent of every node that sent
+ *   a DAO, used to build source routes.
+ */
+
+#ifndef RPL_NS_H
+#define RPL_NS_H
+
+#include "rpl.h"
+
+/* Number of nodes kept in static memory */
+#ifdef RPL_NS_CONF_LINK_NUM
+#define RPL_NS_LINK_NUM                 RPL_NS_CONF_LINK_NUM
+#else
+#define RPL_NS_LINK_NUM                 32
+#endif
+
+/*
+ * Take further nodes from the heap, and grow the node hash with them.
+ * Freed nodes are kept for reuse, the heap never gets memory back.
+ * Meant for native border routers serving thousands of nodes.
+ */
+#ifdef RPL_NS_CONF_DYNAMIC
+#define RPL_NS_DYNAMIC                  RPL_NS_CONF_DYNAMIC
+#else
+#define RPL_NS_DYNAMIC                  0
+#endif
+
+/* Initial number of buckets of the node hash, a power of two */
+#ifdef RPL_NS_CONF_HASH_SIZE
+#define RPL_NS_HASH_SIZE                RPL_NS_CONF_HASH_SIZE
+#else
+#define RPL_NS_HASH_SIZE                16
+#endif
+
+/* Slots of the lifetime wheel, one second each, a power of two */
+#ifdef RPL_NS_CONF_WHEEL_SIZE
+#define RPL_NS_WHEEL_SIZE               RPL_NS_CONF_WHEEL_SIZE
+#else
+#define RPL_NS_WHEEL_SIZE               64
+#endif
+
+typedef struct rpl_ns_node {
+  struct rpl_ns_node *next;             /* hash chain */
+  struct rpl_ns_node *parent;
+  struct rpl_ns_node *children;         /* nodes that announced us as parent */
+  struct rpl_ns_node *sibling;
+  struct rpl_ns_node **sibling_pprev;
+  struct rpl_ns_node *wheel_next;       /* nodes expiring in the same slot */
+  struct rpl_ns_node **wheel_pprev;     /* NULL if no DAO keeps us */
+  rpl_dag_t *dag;
+  uint32_t expires;                     /* rpl_ns_periodic() count */
+  /* The prefix is the one of the DAG, only the IID is stored */
+  unsigned char link_identifier[8];
+} rpl_ns_node_t;
+
+void rpl_ns_init(void);
+int rpl_ns_num_nodes(void);
+rpl_ns_node_t *rpl_ns_node_head(void);
+rpl_ns_node_t *rpl_ns_node_next(rpl_ns_node_t *item);
+/* Seconds until the DAO of a node expires, 0 if it is only a parent */
+uint32_t rpl_ns_node_lifetime(const rpl_ns_node_t *node);
+
+/* Lookup by address, only the IID is compared */
+rpl_ns_node_t *rpl_ns_get_node(const rpl_dag_t *dag, const uip_ipaddr_t *addr);
+/* Is there an unbroken chain of parents from the node up to us? */
+int rpl_ns_is_node_reachable(const rpl_dag_t *dag, const uip_ipaddr_t *addr);
+void rpl_ns_get_node_global_addr(uip_ipaddr_t *addr, const rpl_ns_node_t *node);
+
+/* DAO received: child has parent for lifetime seconds */
+rpl_ns_node_t *rpl_ns_update_node(rpl_dag_t *dag, const uip_ipaddr_t *child,
+                                  const uip_ipaddr_t *parent,
+                                  uint32_t lifetime);
+/* No-Path DAO received: child no longer uses parent */
+void rpl_ns_expire_parent(rpl_dag_t *dag, const uip_ipaddr_t *child,
+                          const uip_ipaddr_t *parent);
+
+/* Called every second */
+void rpl_ns_periodic(void);
+void rpl_ns_free_dag(rpl_dag_t *dag);
+
+#endif /* RPL_NS_H */
@@ -89,9 +89,23 @@
 #define RPL_OPTION_SOLICITED_INFO        7
 #define RPL_OPTION_PREFIX_INFO           8
 #define RPL_OPTION_TARGET_DESC           9
+/* 6LoWPAN Context Option carried in DIOs; not IANA assigned, the body
+   is the one of the ND option (RFC 6775, 4.2) */
+#ifdef RPL_CONF_OPTION_6CO
+#define RPL_OPTION_6CO                   RPL_CONF_OPTION_6CO
+#else
+#define RPL_OPTION_6CO                   0x22
+#endif
 
 #define RPL_DAO_K_FLAG                   0x80 /* DAO ACK requested */
 #define RPL_DAO_D_FLAG                   0x40 /* DODAG ID present */
+
+/* DAO-ACK status */
+#define RPL_DAO_ACK_UNCONDITIONAL_ACCEPT 0
+/* Accepted, but the parent was short of room: send the DAO again later */
+#define RPL_DAO_ACK_TRY_LATER            1
+/* From this value on the DAO was rejected */
+#define RPL_DAO_ACK_UNABLE_TO_ACCEPT     128
 /*---------------------------------------------------------------------------*/
 /* RPL IPv6 extension header option. */
 #define RPL_HDR_OPT_LEN            4
@@ -102,6 +116,16 @@
 #define RPL_HDR_OPT_RANK_ERR_SHIFT       6
 #define RPL_HDR_OPT_FWD_ERR        0x20
 #define RPL_HDR_OPT_FWD_ERR_SHIFT       5
+
+/* RPL Source Routing Header (RFC 6554), after the routing header fields */
+#define RPL_RH_TYPE_SRH             3
+#define RPL_RH_LEN                  4
+#define RPL_SRH_LEN                 4
+struct uip_rpl_srh_hdr {
+  uint8_t cmpr;         /* CmprI and CmprE */
+  uint8_t pad;          /* Pad in the upper nibble */
+  uint8_t reserved[2];
+};
 /*---------------------------------------------------------------------------*/
 /* Default values for RPL constants and variables. */
 
@@ -112,6 +136,46 @@
 #define RPL_DAO_LATENCY                 (CLOCK_SECOND * 4)
 #endif /* RPL_DAO_LATENCY */
 
+/* Storing mode targets, our own and those of the sub-DODAG, are
+   collected this long and then sent to the parent in as few DAOs as
+   possible. */
+#ifdef RPL_CONF_DAO_AGGREGATION_DELAY
+#define RPL_DAO_AGGREGATION_DELAY       RPL_CONF_DAO_AGGREGATION_DELAY
+#else /* RPL_CONF_DAO_AGGREGATION_DELAY */
+#define RPL_DAO_AGGREGATION_DELAY       (bsp_get(E_BSP_GET_TRES) / 2)
+#endif /* RPL_CONF_DAO_AGGREGATION_DELAY */
+
+/* Number of targets waiting for the aggregation delay */
+#ifdef RPL_CONF_DAO_AGGREGATION_TARGETS
+#define RPL_DAO_AGGREGATION_TARGETS     RPL_CONF_DAO_AGGREGATION_TARGETS
+#else /* RPL_CONF_DAO_AGGREGATION_TARGETS */
+#define RPL_DAO_AGGREGATION_TARGETS     8
+#endif /* RPL_CONF_DAO_AGGREGATION_TARGETS */
+
+/* Wait for the DAO-ACK, doubled with every retransmission */
+#ifdef RPL_CONF_DAO_RETRANSMISSION_TIMEOUT
+#define RPL_DAO_RETRANSMISSION_TIMEOUT  RPL_CONF_DAO_RETRANSMISSION_TIMEOUT
+#else /* RPL_CONF_DAO_RETRANSMISSION_TIMEOUT */
+#define RPL_DAO_RETRANSMISSION_TIMEOUT  (bsp_get(E_BSP_GET_TRES) * 2)
+#endif /* RPL_CONF_DAO_RETRANSMISSION_TIMEOUT */
+
+/* Retransmissions to the preferred parent before we give up on it,
+   if it also misses link-layer acknowledgements */
+#ifdef RPL_CONF_DAO_MAX_RETRANSMISSIONS
+#define RPL_DAO_MAX_RETRANSMISSIONS     RPL_CONF_DAO_MAX_RETRANSMISSIONS
+#else /* RPL_CONF_DAO_MAX_RETRANSMISSIONS */
+#define RPL_DAO_MAX_RETRANSMISSIONS     3
+#endif /* RPL_CONF_DAO_MAX_RETRANSMISSIONS */
+
+/* Largest DAO we send, by default what fits uip_buf, where it is built */
+#ifdef RPL_CONF_DAO_MAX_LEN
+#define RPL_DAO_MAX_LEN                 RPL_CONF_DAO_MAX_LEN
+#else /* RPL_CONF_DAO_MAX_LEN */
+#define RPL_DAO_MAX_LEN                 (UIP_BUFSIZE - UIP_LLH_LEN - \
+                                         UIP_IPH_LEN - UIP_ICMPH_LEN - \
+                                         RPL_HOP_BY_HOP_LEN)
+#endif /* RPL_CONF_DAO_MAX_LEN */
+
 /* Special value indicating immediate removal. */
 #define RPL_ZERO_LIFETIME               0
 
@@ -170,6 +234,26 @@
 #error "RPL Multicast requires RPL_MOP_DEFAULT==3. Check contiki-conf.h"
 #endif
 
+#if (RPL_MOP_DEFAULT == RPL_MOP_NON_STORING) && !RPL_WITH_NON_STORING
+#error "RPL_MOP_NON_STORING requires RPL_CONF_WITH_NON_STORING. Check emb6_conf.h"
+#endif
+
+/* Does the instance run in non-storing mode? */
+#if RPL_WITH_NON_STORING
+#define RPL_IS_NON_STORING(instance) ((instance)->mop == RPL_MOP_NON_STORING)
+#else
+#define RPL_IS_NON_STORING(instance) 0
+#endif /* RPL_WITH_NON_STORING */
+
+/* Flows that rpl_map_flow() can send through another instance */
+#ifdef RPL_CONF_FLOW_MAP_NUM
+#define RPL_FLOW_MAP_NUM RPL_CONF_FLOW_MAP_NUM
+#elif RPL_MAX_INSTANCES > 1
+#define RPL_FLOW_MAP_NUM 4
+#else
+#define RPL_FLOW_MAP_NUM 0
+#endif
+
 /* Multicast Route Lifetime as a multiple of the lifetime unit */
 #ifdef RPL_CONF_MCAST_LIFETIME
 #define RPL_MCAST_LIFETIME RPL_CONF_MCAST_LIFETIME
@@ -184,6 +268,26 @@
  */
 #define RPL_DAG_MC_ETX_DIVISOR        256
 
+/*
+ * Latency metric: microseconds one transmission attempt takes on a link,
+ * scaled by the ETX of the link, and microseconds a packet waits in this
+ * node before it is forwarded (large for duty-cycled relays).
+ */
+#ifdef RPL_CONF_LINK_TX_LATENCY
+#define RPL_LINK_TX_LATENCY           RPL_CONF_LINK_TX_LATENCY
+#else
+#define RPL_LINK_TX_LATENCY           10000
+#endif
+
+#ifdef RPL_CONF_NODE_LATENCY
+#define RPL_NODE_LATENCY              RPL_CONF_NODE_LATENCY
+#else
+#define RPL_NODE_LATENCY              0
+#endif
+
+/* Reject parents that have a higher link metric than the following. */
+#define RPL_MAX_LINK_METRIC           10
+
 /* DIS related */
 #define RPL_DIS_SEND                    1
 #ifdef  RPL_DIS_INTERVAL_CONF
@@ -236,21 +340,6 @@ struct rpl_dio {
 typedef struct rpl_dio rpl_dio_t;
 
 #if RPL_CONF_STATS
-/* Statistics for fault management. */
-struct rpl_stats {
-  uint16_t mem_overflows;
-  uint16_t local_repairs;
-  uint16_t global_repairs;
-  uint16_t malformed_msgs;
-  uint16_t resets;
-  uint16_t parent_switch;
-  uint16_t forward_errors;
-  uint16_t loop_errors;
-  uint16_t loop_warnings;
-  uint16_t root_repairs;
-};
-typedef struct rpl_stats rpl_stats_t;
-
 extern rpl_stats_t rpl_stats;
 #endif
 /*---------------------------------------------------------------------------*/
@@ -271,7 +360,9 @@ void dis_output(uip_ipaddr_t *addr);
 void dio_output(rpl_instance_t *, uip_ipaddr_t *uc_addr);
 void dao_output(rpl_parent_t *, uint8_t lifetime);
 void dao_output_target(rpl_parent_t *, uip_ipaddr_t *, uint8_t lifetime);
-void dao_ack_output(rpl_instance_t *, uip_ipaddr_t *, uint8_t);
+void dao_output_queue(rpl_instance_t *, uip_ipaddr_t *, uint8_t lifetime);
+void dao_output_flush(void);
+void dao_ack_output(rpl_instance_t *, uip_ipaddr_t *, uint8_t, uint8_t);
 void rpl_icmp6_register_handlers(void);
 
 /* RPL logic functions. */
@@ -295,6 +386,8 @@ void rpl_nullify_parent(rpl_parent_t *);
 void rpl_remove_parent(rpl_parent_t *);
 void rpl_move_parent(rpl_dag_t *dag_src, rpl_dag_t *dag_dst, rpl_parent_t *parent);
 rpl_parent_t *rpl_select_parent(rpl_dag_t *dag);
+/* Consecutive transmissions to the parent failed, switch to a backup. */
+void rpl_parent_failover(rpl_parent_t *parent);
 rpl_dag_t *rpl_select_dag(rpl_instance_t *instance,rpl_parent_t *parent);
 void rpl_recalculate_ranks(void);
 
@@ -314,6 +407,11 @@ void rpl_lock_parent(rpl_parent_t *p);
 /* Objective function. */
 rpl_of_t *rpl_find_of(rpl_ocp_t);
 
+/* Routing metrics, NULL for an unsupported metric container type. */
+const rpl_metric_t *rpl_find_metric(uint8_t type);
+/* ETX estimation of the link to a parent, shared by the OFs. */
+void rpl_update_link_metric(rpl_parent_t *p, int status, int numtx);
+
 /* Timer functions. */
 void rpl_schedule_dao(rpl_instance_t *);
 void rpl_schedule_dao_immediately(rpl_instance_t *);
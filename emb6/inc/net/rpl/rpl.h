@@ -38,13 +38,14 @@
 #ifndef RPL_H
 #define RPL_H
 
-#include "emb6_conf.h"
 #include "emb6.h"
+#include "emb6_conf.h"
 
 #include "clist.h"
 #include "uip.h"
 #include "uip-ds6.h"
 #include "ctimer.h"
+#include "trickle-timer.h"
 
 /*---------------------------------------------------------------------------*/
 typedef uint16_t rpl_rank_t;
@@ -98,6 +99,9 @@ struct rpl_metric_container {
   union metric_object {
     struct rpl_metric_object_energy energy;
     uint16_t etx;
+    uint8_t hopcount;
+    uint32_t latency;   /* microseconds */
+    uint8_t lql;        /* worst link on the path, 1 (best) to 7 */
   } obj;
 };
 typedef struct rpl_metric_container rpl_metric_container_t;
@@ -117,6 +121,7 @@ struct rpl_parent {
   rpl_rank_t rank;
   uint8_t dtsn;
   uint8_t flags;
+  uint8_t failures; /* consecutive unacknowledged transmissions */
 };
 typedef struct rpl_parent rpl_parent_t;
 /*---------------------------------------------------------------------------*/
@@ -140,6 +145,10 @@ struct rpl_dag {
   /* live data for the DAG */
   uint8_t joined;
   rpl_parent_t *preferred_parent;
+#if RPL_BACKUP_PARENTS
+  /* next best parents, best first, refreshed by every parent selection */
+  rpl_parent_t *backup_parents[RPL_BACKUP_PARENTS];
+#endif /* RPL_BACKUP_PARENTS */
   rpl_rank_t rank;
   struct rpl_instance *instance;
   rpl_prefix_t prefix_info;
@@ -195,6 +204,40 @@ typedef struct rpl_of rpl_of_t;
 
 /* Declare the selected objective function. */
 extern rpl_of_t RPL_OF;
+extern rpl_of_t rpl_mrhof;
+extern rpl_of_t rpl_of0;
+/*---------------------------------------------------------------------------*/
+/*
+ * API for the routing metrics (RFC 6551) of metric-based objective
+ * functions such as MRHOF
+ *
+ * path_cost(parent_mc, link_metric)
+ *
+ *  Cost of the path to the root through a parent, from the object the
+ *  parent advertised and the ETX of our link to it. Lower is better.
+ *
+ * update_object(mc, parent_mc, link_metric)
+ *
+ *  Fills in the object we advertise when the preferred parent is the
+ *  one given, "parent_mc" is NULL at the root.
+ *
+ * read(mc, buf) / write(mc, buf)
+ *
+ *  Decode and encode the object of a DIO metric container.
+ */
+struct rpl_metric {
+  uint8_t type;
+  uint8_t aggr;
+  uint8_t length;               /* of the object in a DIO */
+  /* Path costs closer than this are not worth a parent switch */
+  uint16_t switch_threshold;
+  uint16_t (*path_cost)(const rpl_metric_container_t *, uint16_t);
+  void (*update_object)(rpl_metric_container_t *,
+                        const rpl_metric_container_t *, uint16_t);
+  void (*read)(rpl_metric_container_t *, const uint8_t *);
+  void (*write)(const rpl_metric_container_t *, uint8_t *);
+};
+typedef struct rpl_metric rpl_metric_t;
 /*---------------------------------------------------------------------------*/
 /* Instance */
 struct rpl_instance {
@@ -213,23 +256,65 @@ struct rpl_instance {
   uint8_t dio_intmin;
   uint8_t dio_redundancy;
   uint8_t default_lifetime;
-  uint8_t dio_intcurrent;
-  uint8_t dio_send; /* for keeping track of which mode the timer is in */
-  uint8_t dio_counter;
   rpl_rank_t max_rankinc;
   rpl_rank_t min_hoprankinc;
   uint16_t lifetime_unit; /* lifetime in seconds = l_u * d_l */
-#if RPL_CONF_STATS
-  uint16_t dio_totint;
-  uint16_t dio_totsend;
-  uint16_t dio_totrecv;
-#endif /* RPL_CONF_STATS */
-  clock_time_t dio_next_delay; /* delay for completion of dio interval */
-  struct ctimer dio_timer;
+  struct trickle_timer dio_timer;
   struct ctimer dao_timer;
   struct ctimer dao_lifetime_timer;
 };
 
+/*---------------------------------------------------------------------------*/
+/*
+ * Flow selectors of rpl_map_flow(). Packets not mapped to an instance use
+ * the default one.
+ */
+#define RPL_FLOW_UDP_PORT       0 /* local port of a UDP socket */
+#define RPL_FLOW_DSCP           1 /* DiffServ code point of the traffic class */
+#define RPL_FLOW_LABEL          2 /* IPv6 flow label */
+/*---------------------------------------------------------------------------*/
+/* Statistics for fault management, kept if RPL_CONF_STATS is set. */
+struct rpl_stats {
+  uint16_t mem_overflows;
+  uint16_t local_repairs;
+  uint16_t global_repairs;
+  uint16_t malformed_msgs;
+  uint16_t resets;
+  uint16_t parent_switch;
+  uint16_t forward_errors;
+  uint16_t loop_errors;
+  uint16_t loop_warnings;
+  uint16_t root_repairs;
+  uint16_t dao_sent;
+  uint16_t dao_acked;
+  uint16_t dao_retransmissions;
+  uint16_t dao_parent_failures;
+  uint16_t parent_failovers;
+  uint16_t dio_sent;
+  uint16_t dio_recv;
+  uint16_t dio_suppressed;    /* by the Trickle redundancy constant */
+  uint16_t dis_sent;
+  uint16_t dis_recv;
+  uint16_t dao_recv;
+  uint16_t dao_suppressed;    /* superseded before they were sent */
+  uint16_t routes_added;
+  uint16_t routes_removed;
+  uint16_t routes;            /* routing table size, see rpl_get_stats() */
+};
+typedef struct rpl_stats rpl_stats_t;
+
+/* A candidate parent, see rpl_get_parent_stats() */
+struct rpl_parent_stats {
+  uip_ipaddr_t addr;
+  uint8_t instance_id;
+  uint8_t flags;              /* RPL_PARENT_STATS_* */
+  rpl_rank_t rank;            /* advertised by the parent */
+  uint16_t link_metric;       /* ETX, RPL_DAG_MC_ETX_DIVISOR fixed point */
+};
+typedef struct rpl_parent_stats rpl_parent_stats_t;
+
+#define RPL_PARENT_STATS_PREFERRED  0x01
+#define RPL_PARENT_STATS_BACKUP     0x02
 /*---------------------------------------------------------------------------*/
 /* Public RPL functions. */
 void rpl_init(void);
@@ -237,15 +322,30 @@ void uip_rpl_input(void);
 rpl_dag_t *rpl_set_root(uint8_t instance_id, uip_ipaddr_t *dag_id);
 int rpl_set_prefix(rpl_dag_t *dag, uip_ipaddr_t *prefix, unsigned len);
 int rpl_repair_root(uint8_t instance_id);
+int rpl_set_objective(uint8_t instance_id, rpl_ocp_t ocp, uint8_t mc_type);
+int rpl_map_flow(uint8_t selector, uint32_t value, uint8_t instance_id);
+void rpl_unmap_flow(uint8_t selector, uint32_t value);
+rpl_instance_t *rpl_get_packet_instance(void);
+uip_ipaddr_t *rpl_get_upward_nexthop(rpl_instance_t *instance);
+void rpl_set_node_energy(uint8_t type, uint8_t level);
 int rpl_set_default_route(rpl_instance_t *instance, uip_ipaddr_t *from);
 rpl_dag_t *rpl_get_any_dag(void);
 rpl_instance_t *rpl_get_instance(uint8_t instance_id);
+#if RPL_CONF_STATS
+void rpl_get_stats(rpl_stats_t *stats);
+void rpl_reset_stats(void);
+#endif /* RPL_CONF_STATS */
+int rpl_get_parent_stats(rpl_parent_stats_t *stats, int max);
 int rpl_update_header_empty(void);
 int rpl_update_header_final(uip_ipaddr_t *addr);
 int rpl_verify_header(int);
 void rpl_insert_header(void);
+uint8_t rpl_header_room(const uip_ipaddr_t *addr);
 void rpl_remove_header(void);
 uint8_t rpl_invert_header(void);
+int rpl_insert_srh_header(void);
+int rpl_process_srh_header(void);
+int rpl_srh_get_next_hop(uip_ipaddr_t *ipaddr);
 uip_ipaddr_t *rpl_get_parent_ipaddr(rpl_parent_t *nbr);
 rpl_parent_t *rpl_get_parent(uip_lladdr_t *addr);
 rpl_rank_t rpl_get_parent_rank(uip_lladdr_t *addr);
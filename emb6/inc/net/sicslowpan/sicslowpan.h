@@ -49,6 +49,7 @@
 #define SICSLOWPAN_H_
 #include "uip.h"
 #include "mac.h"
+#include "stimer.h"
 
 /**
  * \name General sicslowpan defines
@@ -142,6 +143,19 @@
 /* NHC_EXT_HDR */
 #define SICSLOWPAN_NHC_MASK                         0xF0
 #define SICSLOWPAN_NHC_EXT_HDR                      0xE0
+#define SICSLOWPAN_NHC_EXT_EID_MASK                 0x0E
+#define SICSLOWPAN_NHC_BIT                          0x01
+
+/**
+ * \name LOWPAN_NHC_EH IPv6 Extension Header IDs (EID)
+ * @{
+ */
+#define SICSLOWPAN_NHC_EXT_HDR_HBHO                 0
+#define SICSLOWPAN_NHC_EXT_HDR_ROUTING              1
+#define SICSLOWPAN_NHC_EXT_HDR_FRAG                 2
+#define SICSLOWPAN_NHC_EXT_HDR_DESTO                3
+#define SICSLOWPAN_NHC_EXT_HDR_IPV6                 7
+/** @} */
 
 /**
  * \name LOWPAN_UDP encoding (works together with IPHC)
@@ -209,6 +223,24 @@
 /*   uint16_t udpchksum; */
 /* }; */
 
+/**
+ * \name Address context flags and 6LoWPAN Context Option (RFC 6775, 4.2)
+ * @{
+ */
+/** Context may be used for compression (C bit of the 6CO) */
+#define SICSLOWPAN_CONTEXT_FLAG_COMPRESS            0x10
+/** Context is statically configured and never expires */
+#define SICSLOWPAN_CONTEXT_FLAG_INFINITE            0x01
+/** Mask of the Context Identifier in the 6CO */
+#define SICSLOWPAN_CONTEXT_CID_MASK                 0x0F
+/** Number of distinct Context Identifiers */
+#define SICSLOWPAN_CONTEXT_CID_MAX                  16
+/** Length of the 6CO body (without type and length) for a /64 context */
+#define SICSLOWPAN_CONTEXT_6CO_LEN                  14
+/** Lifetime of a 6CO is carried in units of 60 seconds */
+#define SICSLOWPAN_CONTEXT_6CO_LIFETIME_UNIT        60
+/** @} */
+
 /**
  * \brief An address context for IPHC address compression
  * each context can have upto 8 bytes
@@ -217,6 +249,9 @@ struct sicslowpan_addr_context {
   uint8_t used; /* possibly use as prefix-length */
   uint8_t number;
   uint8_t prefix[8];
+  uint8_t flags;              /* SICSLOWPAN_CONTEXT_FLAG_* */
+  uint8_t next;               /* next context in the same prefix bucket */
+  struct stimer lifetime;     /* valid lifetime, unless FLAG_INFINITE */
 };
 
 /**
@@ -315,6 +350,51 @@ struct sicslowpan_nh_compressor {
 
 int sicslowpan_get_last_rssi(void);
 
+/**
+ * \name Address context table
+ *
+ * Contexts are indexed by CID and by /64 prefix so that both the
+ * compressor and the decompressor find them in constant time. Entries
+ * learned from the network carry a lifetime; once it elapses the
+ * context is kept for decompression only during
+ * SICSLOWPAN_CONTEXT_GRACE seconds and then removed.
+ * @{
+ */
+/**
+ * \brief Add or update the context with the given CID
+ * \param number   Context identifier (0..15)
+ * \param prefix   The 8 bytes of the /64 context prefix
+ * \param flags    SICSLOWPAN_CONTEXT_FLAG_* bits
+ * \param lifetime Valid lifetime in seconds, ignored for FLAG_INFINITE
+ * \return 0 on success, -1 if the table is full or the CID is invalid
+ */
+int8_t sicslowpan_context_update(uint8_t number, const uint8_t *prefix,
+                                 uint8_t flags, unsigned long lifetime);
+
+/** \brief Remove the context with the given CID, if any */
+void sicslowpan_context_remove(uint8_t number);
+
+/**
+ * \brief Iterate over the valid contexts
+ * \param ctx The previous context, NULL to get the first one
+ * \return The next valid context, NULL at the end of the table
+ */
+struct sicslowpan_addr_context *sicslowpan_context_next(struct sicslowpan_addr_context *ctx);
+
+/**
+ * \brief Write the body of a 6CO (after type and length) for a context
+ * \return Number of bytes written (SICSLOWPAN_CONTEXT_6CO_LEN)
+ */
+uint8_t sicslowpan_context_6co_write(uint8_t *buf, struct sicslowpan_addr_context *ctx);
+
+/**
+ * \brief Apply a received 6CO body (after type and length)
+ * \param buf Pointer to the Context Length field
+ * \param len Number of bytes available in the option body
+ */
+void sicslowpan_context_6co_input(const uint8_t *buf, uint8_t len);
+/** @} */
+
 
 #endif /* SICSLOWPAN_H_ */
 /** @} */
@@ -250,6 +250,9 @@ coap_receive(void)
         }
 
         if((transaction = coap_get_transaction_by_mid(message->mid))) {
+          /* our request was answered, the next hop toward the peer works */
+          tcpip_ipv6_confirm_reachable(&UIP_IP_BUF->srcipaddr);
+
           /* free transaction memory before callback, as it may create a new transaction */
           restful_response_handler callback = transaction->callback;
           void *callback_data = transaction->callback_data;
@@ -0,0 +1,1134 @@
+/*
+ * emb6 is licensed under the 3-clause BSD license. This license gives everyone
+ * the right to use and distribute the code, either in binary or source code
+ * format, as long as the copyright license is retained in the source code.
+ *
+ * The emb6 is derived from the Contiki OS platform with the explicit approval
+ * from Adam Dunkels. However, emb6 is made independent from the OS through the
+ * removal of protothreads. In addition, APIs are made more flexible to gain
+ * more adaptivity during run-time.
+ *
+ * The license text is:
+ *
+ * Copyright (c) 2015,
+ * Hochschule Offenburg, University of Applied Sciences
+ * Laboratory Embedded Systems and Communications Electronics.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \addtogroup mpl
+ * @{
+ */
+/**
+ * \file
+ *    This file implements IPv6 MPL multicast forwarding (RFC 7731)
+ */
+
+#include "emb6.h"
+#include "uip-icmp6.h"
+#include "uip-mcast6.h"
+#include "uip-ds6.h"
+#include "mpl.h"
+#include "bsp.h"
+#include "ctimer.h"
+#include "trickle-timer.h"
+#include "mmem.h"
+
+#define DEBUG DEBUG_NONE
+#include "uip-debug.h"
+
+/*---------------------------------------------------------------------------*/
+/* Data Representation */
+/*---------------------------------------------------------------------------*/
+/* Seed IDs. s is the length code of the MPL Option: 1, 2 or 3 for 16, 64 and
+ * 128 bit IDs. Seeds that elide their ID (S=0) are stored as S=3 with their
+ * IPv6 source address */
+struct seed_id {
+  uint8_t id[16];               /* Left aligned, the rest is zero */
+  uint8_t s;
+};
+
+#define SEED_ID_S_ELIDED 0
+#define SEED_ID_S_128    3
+
+/* Length of a Seed ID in bytes for length code s */
+static const uint8_t seed_id_len[4] = { 0, 2, 8, 16 };
+
+#define seed_id_cmp(a, b) \
+  ((a)->s == (b)->s && memcmp((a)->id, (b)->id, seed_id_len[(a)->s]) == 0)
+#define PRINT_SEED(a) PRINT6ADDR((uip_ipaddr_t *)(a)->id)
+/*---------------------------------------------------------------------------*/
+/* Sequence numbers are 8 bit serial numbers (RFC 1982) */
+#define SEQ_VAL_IS_LT(a, b) ((int8_t)((uint8_t)(a) - (uint8_t)(b)) < 0)
+#define SEQ_VAL_IS_GT(a, b) SEQ_VAL_IS_LT(b, a)
+/*---------------------------------------------------------------------------*/
+/* MPL Domains */
+struct mpl_domain {
+  uip_ip6addr_t addr;           /* Unspecified if the entry is unused */
+  struct mpl_domain_param param;
+  struct trickle_timer tt;      /* MPL Control Message timer */
+  uint8_t expirations;
+};
+
+#define DOMAIN_IS_USED(d) (!uip_is_addr_unspecified(&(d)->addr))
+/*---------------------------------------------------------------------------*/
+/* Seed Set */
+struct mpl_msg;
+
+struct mpl_seed {
+  struct seed_id seed_id;
+  struct mpl_domain *domain;    /* NULL if the entry is unused */
+  struct mpl_seed *next;        /* Free list if unused */
+  struct mpl_msg *head;         /* Buffered messages, ascending seq. values */
+  uint8_t min_seqno;            /* MinSequence */
+  uint8_t lifetime;             /* Minutes left */
+  uint8_t count;
+  uint8_t listed;               /* Listed in the current Control Message */
+};
+/*---------------------------------------------------------------------------*/
+/* Buffered Message Set */
+struct mpl_msg {
+  struct mmem data;             /* The datagram, from the IPv6 header on */
+  struct mpl_msg *next;         /* Next of the seed, or in the free list */
+  struct mpl_seed *seed;        /* NULL if the entry is unused */
+  struct trickle_timer tt;      /* MPL Data Message timer */
+  uint8_t seq;
+  uint8_t opt;                  /* Offset of the MPL Option in the datagram */
+  uint8_t expirations;
+};
+
+/**
+ * \brief Get a pointer to the datagram of a buffered message
+ * p: pointer to a message. Only valid until the next mmem_free()
+ */
+#define MPL_MSG_BUFF(p) ((uint8_t *)MMEM_PTR(&(p)->data))
+
+/**
+ * \brief Get the length of the datagram of a buffered message
+ */
+#define MPL_MSG_LEN(p) ((uint16_t)(p)->data.size)
+
+/**
+ * \brief Get the TTL of a buffered message
+ */
+#define MPL_MSG_TTL(p) (((struct uip_ip_hdr *)MPL_MSG_BUFF(p))->ttl)
+
+/**
+ * \brief Get the MPL Option of a buffered message
+ */
+#define MPL_MSG_OPT(p) ((struct hbho_mpl *)(MPL_MSG_BUFF(p) + (p)->opt))
+/*---------------------------------------------------------------------------*/
+/* MPL Option (RFC 7731, Section 4.2) */
+struct hbho_mpl {
+  uint8_t type;
+  uint8_t len;
+  uint8_t flags;                /* S, M, V */
+  uint8_t seq;
+  uint8_t seed_id[];            /* 0, 2, 8 or 16 bytes, depending on S */
+};
+
+#define HBHO_OPT_TYPE_MPL   UIP_EXT_HDR_OPT_MPL
+#define HBHO_MPL_LEN_S0     2   /* Option data length with an elided seed */
+#define HBHO_TOTAL_LEN      8   /* HBH header, MPL Option S=0 and PadN */
+
+#define HBH_GET_S(h)  ((h)->flags >> 6)
+#define HBH_M_BIT     0x20
+#define HBH_V_BIT     0x10
+/*---------------------------------------------------------------------------*/
+/* MPL Seed Info in MPL Control Messages (RFC 7731, Section 4.3) */
+struct seed_info {
+  uint8_t min_seqno;
+  uint8_t bm_len_s;             /* bm-len (6 bit), S (2 bit) */
+  uint8_t seed_id[];
+};
+
+#define SEED_INFO_GET_S(i)      ((i)->bm_len_s & 0x03)
+#define SEED_INFO_GET_BM_LEN(i) ((i)->bm_len_s >> 2)
+#define SEED_INFO_BM_LEN_MAX    0x3F
+
+/* Is seq. value n bit set in bitmap bm, bits are in network order */
+#define BITMAP_IS_SET(bm, n)    ((bm)[(n) >> 3] & (0x80 >> ((n) & 0x07)))
+#define BITMAP_SET(bm, n)       ((bm)[(n) >> 3] |= (0x80 >> ((n) & 0x07)))
+/*---------------------------------------------------------------------------*/
+/* Maintain Stats */
+#if UIP_MCAST6_STATS
+static struct mpl_stats stats;
+
+#define MPL_STATS_ADD(x) stats.x++
+#define MPL_STATS_INIT() do { memset(&stats, 0, sizeof(stats)); } while(0)
+#else /* UIP_MCAST6_STATS */
+#define MPL_STATS_ADD(x)
+#define MPL_STATS_INIT()
+#endif
+/*---------------------------------------------------------------------------*/
+/* Internal Data Structures */
+/*---------------------------------------------------------------------------*/
+static struct mpl_domain domains[MPL_DOMAIN_SET_SIZE];
+static struct mpl_seed seeds[MPL_SEED_SET_SIZE];
+static struct mpl_msg buffered_msgs[MPL_BUFFERED_MESSAGE_SET_SIZE];
+
+/* Unused seeds and messages, linked through next */
+static struct mpl_seed *seed_free;
+static struct mpl_msg *buff_free;
+
+/* Ages the Seed Set once a minute */
+static struct ctimer lifetime_timer;
+
+static uint8_t last_seq;
+/*---------------------------------------------------------------------------*/
+/* uIPv6 Pointers */
+/*---------------------------------------------------------------------------*/
+#define UIP_EXT_BUF       ((struct uip_ext_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN])
+#define UIP_EXT_BUF_NEXT  ((uint8_t *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN + HBHO_TOTAL_LEN])
+#define UIP_EXT_OPT_FIRST ((struct hbho_mpl *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN + 2])
+#define UIP_IP_BUF        ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UIP_ICMP_BUF      ((struct uip_icmp_hdr *)&uip_buf[uip_l2_l3_hdr_len])
+#define UIP_ICMP_PAYLOAD  ((unsigned char *)&uip_buf[uip_l2_l3_icmp_hdr_len])
+extern uint16_t uip_slen;
+/*---------------------------------------------------------------------------*/
+/* Local function prototypes */
+/*---------------------------------------------------------------------------*/
+static void icmp_input(void);
+static void data_timer_expired(void *, uint8_t);
+static void control_timer_expired(void *, uint8_t);
+/*---------------------------------------------------------------------------*/
+/* MPL ICMPv6 handler declaration */
+UIP_ICMP6_HANDLER(mpl_icmp_handler, ICMP6_MPL,
+                  UIP_ICMP6_HANDLER_CODE_ANY, icmp_input);
+/*---------------------------------------------------------------------------*/
+/* Domains */
+/*---------------------------------------------------------------------------*/
+/* The link-scoped MPL Domain Address our Control Messages go to */
+static void
+domain_link_scoped(uip_ip6addr_t *ll, const uip_ip6addr_t *addr)
+{
+  uip_ipaddr_copy(ll, addr);
+  ll->u8[1] = (ll->u8[1] & 0xF0) | UIP_MCAST6_SCOPE_LINK_LOCAL;
+}
+/*---------------------------------------------------------------------------*/
+static struct mpl_domain *
+domain_lookup(const uip_ip6addr_t *addr)
+{
+  struct mpl_domain *d;
+
+  for(d = domains; d < &domains[MPL_DOMAIN_SET_SIZE]; d++) {
+    if(DOMAIN_IS_USED(d) && uip_ipaddr_cmp(&d->addr, addr)) {
+      return d;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* The domain of an MPL Control Message sent to the link-scoped address */
+static struct mpl_domain *
+domain_lookup_link_scoped(const uip_ip6addr_t *ll)
+{
+  struct mpl_domain *d;
+  uip_ip6addr_t addr;
+
+  for(d = domains; d < &domains[MPL_DOMAIN_SET_SIZE]; d++) {
+    if(DOMAIN_IS_USED(d)) {
+      domain_link_scoped(&addr, &d->addr);
+      if(uip_ipaddr_cmp(&addr, ll)) {
+        return d;
+      }
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Restart a domain's Control Message timer, unless they are turned off */
+static void
+domain_reset(struct mpl_domain *d)
+{
+  if(d->param.control_expirations == 0) {
+    return;
+  }
+  d->expirations = 0;
+  if(trickle_timer_is_running(&d->tt)) {
+    trickle_timer_inconsistency(&d->tt);
+  } else {
+    trickle_timer_set(&d->tt, control_timer_expired, d);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+mpl_domain_param_default(struct mpl_domain_param *p)
+{
+  p->data_imin = MPL_DATA_MESSAGE_IMIN;
+  p->data_imax = MPL_DATA_MESSAGE_IMAX;
+  p->data_k = MPL_DATA_MESSAGE_K;
+  p->data_expirations = MPL_DATA_MESSAGE_TIMER_EXPIRATIONS;
+  p->control_imin = MPL_CONTROL_MESSAGE_IMIN;
+  p->control_imax = MPL_CONTROL_MESSAGE_IMAX;
+  p->control_k = MPL_CONTROL_MESSAGE_K;
+  p->control_expirations = MPL_CONTROL_MESSAGE_TIMER_EXPIRATIONS;
+  p->proactive = MPL_PROACTIVE_FORWARDING;
+  p->seed_lifetime = MPL_SEED_SET_ENTRY_LIFETIME;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+mpl_domain_set(const uip_ipaddr_t *addr, const struct mpl_domain_param *p)
+{
+  struct mpl_domain *d;
+  uip_ip6addr_t ll;
+
+  if(!uip_is_addr_mcast(addr) ||
+     uip_mcast6_get_address_scope(addr) <= UIP_MCAST6_SCOPE_LINK_LOCAL) {
+    PRINTF("MPL: Bad domain address ");
+    PRINT6ADDR(addr);
+    PRINTF("\n");
+    return 0;
+  }
+
+  d = domain_lookup(addr);
+  if(d == NULL) {
+    for(d = domains; d < &domains[MPL_DOMAIN_SET_SIZE]; d++) {
+      if(!DOMAIN_IS_USED(d)) {
+        break;
+      }
+    }
+    if(d == &domains[MPL_DOMAIN_SET_SIZE]) {
+      PRINTF("MPL: Domain set full\n");
+      return 0;
+    }
+
+    domain_link_scoped(&ll, addr);
+    if(!uip_ds6_is_my_maddr(&ll) && uip_ds6_maddr_add(&ll) == NULL) {
+      PRINTF("MPL: Failed to join ");
+      PRINT6ADDR(&ll);
+      PRINTF("\n");
+      return 0;
+    }
+    memset(d, 0, sizeof(struct mpl_domain));
+    uip_ipaddr_copy(&d->addr, addr);
+  }
+
+  if(p != NULL) {
+    memcpy(&d->param, p, sizeof(struct mpl_domain_param));
+  } else {
+    mpl_domain_param_default(&d->param);
+  }
+  trickle_timer_config(&d->tt, d->param.control_imin, d->param.control_imax,
+                       d->param.control_k);
+  if(d->param.control_expirations == 0) {
+    trickle_timer_stop(&d->tt);
+  }
+
+  PRINTF("MPL: Domain ");
+  PRINT6ADDR(&d->addr);
+  PRINTF(" proactive=%u\n", d->param.proactive);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Seed Set */
+/*---------------------------------------------------------------------------*/
+static struct mpl_seed *
+seed_lookup(const struct seed_id *s, const struct mpl_domain *d)
+{
+  struct mpl_seed *seed;
+
+  for(seed = seeds; seed < &seeds[MPL_SEED_SET_SIZE]; seed++) {
+    if(seed->domain == d && seed_id_cmp(&seed->seed_id, s)) {
+      return seed;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static struct mpl_seed *
+seed_allocate(const struct seed_id *s, struct mpl_domain *d, uint8_t seq)
+{
+  struct mpl_seed *seed;
+
+  seed = seed_free;
+  if(seed == NULL) {
+    return NULL;
+  }
+  seed_free = seed->next;
+
+  memset(seed, 0, sizeof(struct mpl_seed));
+  memcpy(&seed->seed_id, s, sizeof(struct seed_id));
+  seed->domain = d;
+  seed->min_seqno = seq;
+  return seed;
+}
+/*---------------------------------------------------------------------------*/
+/* The message with sequence value seq buffered for seed, if any */
+static struct mpl_msg *
+seed_find(struct mpl_seed *seed, uint8_t seq)
+{
+  struct mpl_msg *p;
+
+  for(p = seed->head; p != NULL; p = p->next) {
+    if(p->seq == seq) {
+      return p;
+    }
+    if(SEQ_VAL_IS_GT(p->seq, seq)) {
+      /* The list is sorted, seq can't come after this */
+      break;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Add p to seed, keeping its list sorted */
+static void
+seed_insert(struct mpl_seed *seed, struct mpl_msg *p)
+{
+  struct mpl_msg **pp;
+
+  for(pp = &seed->head; *pp != NULL; pp = &(*pp)->next) {
+    if(SEQ_VAL_IS_GT((*pp)->seq, p->seq)) {
+      break;
+    }
+  }
+  p->next = *pp;
+  *pp = p;
+  p->seed = seed;
+  seed->count++;
+}
+/*---------------------------------------------------------------------------*/
+/* Buffered Message Set */
+/*---------------------------------------------------------------------------*/
+static void
+buffer_free(struct mpl_msg *p)
+{
+  struct mpl_seed *seed = p->seed;
+  struct mpl_msg **pp;
+
+  for(pp = &seed->head; *pp != NULL; pp = &(*pp)->next) {
+    if(*pp == p) {
+      *pp = p->next;
+      break;
+    }
+  }
+  trickle_timer_stop(&p->tt);
+  mmem_free(&p->data);
+  p->seed = NULL;
+  p->next = buff_free;
+  buff_free = p;
+  seed->count--;
+}
+/*---------------------------------------------------------------------------*/
+static void
+seed_free_entry(struct mpl_seed *seed)
+{
+  while(seed->head != NULL) {
+    buffer_free(seed->head);
+  }
+  seed->domain = NULL;
+  seed->next = seed_free;
+  seed_free = seed;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Evict the oldest message of the seed with most messages. The seed's
+ * MinSequence moves past it, so that we don't accept it again
+ */
+static uint8_t
+buffer_reclaim()
+{
+  struct mpl_seed *seed;
+  struct mpl_seed *largest = NULL;
+
+  for(seed = seeds; seed < &seeds[MPL_SEED_SET_SIZE]; seed++) {
+    if(seed->domain != NULL &&
+       (largest == NULL || seed->count > largest->count)) {
+      largest = seed;
+    }
+  }
+
+  if(largest == NULL || largest->count == 0) {
+    return 0;
+  }
+
+  PRINTF("MPL: Reclaim seq. val %u from Seed ", largest->head->seq);
+  PRINT_SEED(&largest->seed_id);
+  PRINTF(", count was %u\n", largest->count);
+
+  largest->min_seqno = largest->head->seq + 1;
+  buffer_free(largest->head);
+  MPL_STATS_ADD(buff_reclaimed);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* A descriptor with len bytes for the datagram, reclaiming if we must */
+static struct mpl_msg *
+buffer_allocate(uint16_t len)
+{
+  struct mpl_msg *p;
+
+  if(buff_free == NULL) {
+    PRINTF("MPL: Buffer allocation failed, reclaiming\n");
+    if(!buffer_reclaim()) {
+      return NULL;
+    }
+  }
+  p = buff_free;
+  buff_free = p->next;
+
+  while(mmem_alloc(&p->data, len) == 0) {
+    PRINTF("MPL: Out of memory for %u bytes, reclaiming\n", len);
+    if(!buffer_reclaim()) {
+      p->next = buff_free;
+      buff_free = p;
+      return NULL;
+    }
+  }
+  return p;
+}
+/*---------------------------------------------------------------------------*/
+/* (Re)start the Data Message timer of p: it's new, or a neighbour misses it */
+static void
+buffer_reset(struct mpl_msg *p)
+{
+  p->expirations = 0;
+  if(trickle_timer_is_running(&p->tt)) {
+    trickle_timer_inconsistency(&p->tt);
+  } else {
+    trickle_timer_set(&p->tt, data_timer_expired, p);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Trickle Timers */
+/*---------------------------------------------------------------------------*/
+/*
+ * Called at a random point of each interval of a buffered message's timer.
+ * PTR is the message
+ */
+static void
+data_timer_expired(void *ptr, uint8_t suppress)
+{
+  struct mpl_msg *p = (struct mpl_msg *)ptr;
+  struct hbho_mpl *opt;
+
+  if(!suppress && MPL_MSG_TTL(p) > 0) {
+    PRINTF("MPL: Send seq. val %u from Seed ", p->seq);
+    PRINT_SEED(&p->seed->seed_id);
+    PRINTF("\n");
+
+    /* M is set on the seed's largest sequence value we buffer */
+    opt = MPL_MSG_OPT(p);
+    if(p->next == NULL) {
+      opt->flags |= HBH_M_BIT;
+    } else {
+      opt->flags &= ~HBH_M_BIT;
+    }
+
+    uip_len = MPL_MSG_LEN(p);
+    uip_ext_len = 0;
+    memcpy(UIP_IP_BUF, MPL_MSG_BUFF(p), uip_len);
+    UIP_MCAST6_STATS_ADD(mcast_fwd);
+    tcpip_output(NULL);
+    uip_len = 0;
+    bsp_wdt(E_BSP_WDT_PERIODIC);
+  }
+
+  /* The message stays buffered for reactive forwarding */
+  if(++p->expirations >= p->seed->domain->param.data_expirations) {
+    trickle_timer_stop(&p->tt);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Write the Seed Info of seed to buf. Returns its length or 0 if empty */
+static uint16_t
+seed_info_build(struct mpl_seed *seed, uint8_t *buf, uint16_t room)
+{
+  struct seed_info *info = (struct seed_info *)buf;
+  struct mpl_msg *p;
+  uint8_t *bm;
+  uint8_t id_len;
+  uint8_t bm_len;
+  uint8_t n;
+
+  if(seed->head == NULL) {
+    return 0;
+  }
+
+  /* The bitmap starts at MinSequence and ends with the largest value */
+  for(p = seed->head; p->next != NULL; p = p->next);
+  bm_len = (uint8_t)(p->seq - seed->min_seqno) / 8 + 1;
+  if(bm_len > SEED_INFO_BM_LEN_MAX) {
+    bm_len = SEED_INFO_BM_LEN_MAX;
+  }
+  id_len = seed_id_len[seed->seed_id.s];
+  if(sizeof(struct seed_info) + id_len + bm_len > room) {
+    return 0;
+  }
+
+  info->min_seqno = seed->min_seqno;
+  info->bm_len_s = (bm_len << 2) | seed->seed_id.s;
+  memcpy(info->seed_id, seed->seed_id.id, id_len);
+  bm = info->seed_id + id_len;
+  memset(bm, 0, bm_len);
+  for(p = seed->head; p != NULL; p = p->next) {
+    n = p->seq - seed->min_seqno;
+    if(n < bm_len * 8) {
+      BITMAP_SET(bm, n);
+    }
+  }
+  return sizeof(struct seed_info) + id_len + bm_len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+icmp_output(struct mpl_domain *d)
+{
+  struct mpl_seed *seed;
+  uint16_t payload_len;
+  uint16_t room;
+
+  PRINTF("MPL: ICMPv6 Out\n");
+
+  uip_ext_len = 0;
+  UIP_IP_BUF->vtc = 0x60;
+  UIP_IP_BUF->tcflow = 0;
+  UIP_IP_BUF->flow = 0;
+  UIP_IP_BUF->proto = UIP_PROTO_ICMP6;
+  UIP_IP_BUF->ttl = MPL_IP_HOP_LIMIT;
+
+  payload_len = 0;
+  room = UIP_BUFSIZE - UIP_LLH_LEN - UIP_IPH_LEN - UIP_ICMPH_LEN;
+  for(seed = seeds; seed < &seeds[MPL_SEED_SET_SIZE]; seed++) {
+    if(seed->domain == d) {
+      payload_len += seed_info_build(seed, UIP_ICMP_PAYLOAD + payload_len,
+                                     room - payload_len);
+    }
+  }
+
+  if(payload_len == 0) {
+    PRINTF("MPL: ICMPv6 Out - nothing to send\n");
+    return;
+  }
+
+  domain_link_scoped(&UIP_IP_BUF->destipaddr, &d->addr);
+  uip_ds6_select_src(&UIP_IP_BUF->srcipaddr, &UIP_IP_BUF->destipaddr);
+
+  UIP_IP_BUF->len[0] = (UIP_ICMPH_LEN + payload_len) >> 8;
+  UIP_IP_BUF->len[1] = (UIP_ICMPH_LEN + payload_len) & 0xff;
+
+  UIP_ICMP_BUF->type = ICMP6_MPL;
+  UIP_ICMP_BUF->icode = MPL_ICMP_CODE;
+
+  UIP_ICMP_BUF->icmpchksum = 0;
+  UIP_ICMP_BUF->icmpchksum = ~uip_icmp6chksum();
+
+  uip_len = UIP_IPH_LEN + UIP_ICMPH_LEN + payload_len;
+
+  PRINTF("MPL: ICMPv6 Out - %u bytes\n", payload_len);
+
+  tcpip_ipv6_output();
+  MPL_STATS_ADD(icmp_out);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Called at a random point of each interval of a domain's Control Message
+ * timer. PTR is the domain
+ */
+static void
+control_timer_expired(void *ptr, uint8_t suppress)
+{
+  struct mpl_domain *d = (struct mpl_domain *)ptr;
+
+  /* Bail out pronto if our uIPv6 stack is not ready to send messages */
+  if(uip_ds6_get_link_local(ADDR_PREFERRED) == NULL) {
+    PRINTF("MPL: Suppressing Control Message. Stack not ready\n");
+    return;
+  }
+
+  if(!suppress) {
+    icmp_output(d);
+  }
+
+  if(++d->expirations >= d->param.control_expirations) {
+    trickle_timer_stop(&d->tt);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Seeds that were not heard from for seed_lifetime minutes are removed */
+static void
+lifetime_timer_expired(void *ptr)
+{
+  struct mpl_seed *seed;
+
+  for(seed = seeds; seed < &seeds[MPL_SEED_SET_SIZE]; seed++) {
+    if(seed->domain != NULL) {
+      if(seed->lifetime > 0) {
+        seed->lifetime--;
+      }
+      if(seed->lifetime == 0) {
+        PRINTF("MPL: Seed ");
+        PRINT_SEED(&seed->seed_id);
+        PRINTF(" expired\n");
+        seed_free_entry(seed);
+      }
+    }
+  }
+  ctimer_reset(&lifetime_timer);
+}
+/*---------------------------------------------------------------------------*/
+/* Datagrams */
+/*---------------------------------------------------------------------------*/
+/* The MPL Option of the datagram in uip_buf, NULL if it has none */
+static struct hbho_mpl *
+hbho_find()
+{
+  uint8_t *opt;
+  uint8_t *end;
+
+  if(UIP_IP_BUF->proto != UIP_PROTO_HBHO) {
+    return NULL;
+  }
+
+  opt = (uint8_t *)UIP_EXT_BUF + 2;
+  end = (uint8_t *)UIP_EXT_BUF + (UIP_EXT_BUF->len << 3) + 8;
+  while(opt + 2 <= end) {
+    if(*opt == UIP_EXT_HDR_OPT_PAD1) {
+      opt++;
+      continue;
+    }
+    if(*opt == HBHO_OPT_TYPE_MPL) {
+      return opt + 2 + opt[1] <= end ? (struct hbho_mpl *)opt : NULL;
+    }
+    opt += 2 + opt[1];
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief Processes an incoming or outgoing multicast message and determines
+ * whether it should be dropped or accepted
+ *
+ * \param in 1: Incoming packet, 0: Outgoing (we are the seed)
+ *
+ * \return 0: Drop, 1: Accept
+ */
+static uint8_t
+accept(uint8_t in)
+{
+  struct hbho_mpl *opt;
+  struct mpl_domain *d;
+  struct mpl_seed *seed;
+  struct mpl_msg *p;
+  struct seed_id s;
+
+  PRINTF("MPL: Multicast I/O\n");
+
+#if UIP_CONF_IPV6_CHECKS
+  if(uip_is_addr_mcast_non_routable(&UIP_IP_BUF->destipaddr)) {
+    PRINTF("MPL: Mcast I/O, bad destination\n");
+    UIP_MCAST6_STATS_ADD(mcast_bad);
+    return UIP_MCAST6_DROP;
+  }
+  /*
+   * Abort transmission if the v6 src is unspecified. This may happen if the
+   * seed tries to TX while it's still performing DAD or waiting for a prefix
+   */
+  if(uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr)) {
+    PRINTF("MPL: Mcast I/O, bad source\n");
+    UIP_MCAST6_STATS_ADD(mcast_bad);
+    return UIP_MCAST6_DROP;
+  }
+#endif
+
+  opt = hbho_find();
+  if(opt == NULL) {
+    PRINTF("MPL: Mcast I/O, no MPL Option\n");
+    UIP_MCAST6_STATS_ADD(mcast_bad);
+    return UIP_MCAST6_DROP;
+  }
+
+  /* The V flag is set by MPL versions we don't understand */
+  s.s = HBH_GET_S(opt);
+  if((opt->flags & HBH_V_BIT) ||
+     opt->len != HBHO_MPL_LEN_S0 + seed_id_len[s.s]) {
+    PRINTF("MPL: Mcast I/O, bad MPL Option\n");
+    UIP_MCAST6_STATS_ADD(mcast_bad);
+    return UIP_MCAST6_DROP;
+  }
+
+#if UIP_MCAST6_STATS
+  if(in) {
+    UIP_MCAST6_STATS_ADD(mcast_in_all);
+  }
+#endif
+
+  memset(s.id, 0, sizeof(s.id));
+  if(s.s == SEED_ID_S_ELIDED) {
+    s.s = SEED_ID_S_128;
+    memcpy(s.id, &UIP_IP_BUF->srcipaddr, sizeof(s.id));
+  } else {
+    memcpy(s.id, opt->seed_id, seed_id_len[s.s]);
+  }
+
+  d = domain_lookup(&UIP_IP_BUF->destipaddr);
+  if(d == NULL) {
+    d = &domains[0];
+  }
+
+  seed = seed_lookup(&s, d);
+  if(seed != NULL) {
+    if(SEQ_VAL_IS_LT(opt->seq, seed->min_seqno)) {
+      PRINTF("MPL: Too old\n");
+      UIP_MCAST6_STATS_ADD(mcast_dropped);
+      return UIP_MCAST6_DROP;
+    }
+    p = seed_find(seed, opt->seq);
+    if(p != NULL) {
+      /* A consistent transmission for this message's timer */
+      PRINTF("MPL: Seen before\n");
+      trickle_timer_consistency(&p->tt);
+      MPL_STATS_ADD(dup_dropped);
+      UIP_MCAST6_STATS_ADD(mcast_dropped);
+      return UIP_MCAST6_DROP;
+    }
+  } else {
+    seed = seed_allocate(&s, d, opt->seq);
+    if(seed == NULL) {
+      PRINTF("MPL: Failed to allocate seed\n");
+      UIP_MCAST6_STATS_ADD(mcast_dropped);
+      return UIP_MCAST6_DROP;
+    }
+    PRINTF("MPL: New seed\n");
+  }
+  seed->lifetime = d->param.seed_lifetime;
+
+  p = buffer_allocate(uip_len);
+  if(p == NULL || SEQ_VAL_IS_LT(opt->seq, seed->min_seqno)) {
+    /* Reclaiming may have moved this seed's MinSequence past us */
+    PRINTF("MPL: Buffer reclaim failed\n");
+    if(p != NULL) {
+      p->next = buff_free;
+      buff_free = p;
+      mmem_free(&p->data);
+    }
+    UIP_MCAST6_STATS_ADD(mcast_dropped);
+    return UIP_MCAST6_DROP;
+  }
+#if UIP_MCAST6_STATS
+  if(in) {
+    UIP_MCAST6_STATS_ADD(mcast_in_unique);
+  }
+#endif
+
+  memcpy(MPL_MSG_BUFF(p), UIP_IP_BUF, uip_len);
+  p->seq = opt->seq;
+  p->opt = (uint8_t *)opt - (uint8_t *)UIP_IP_BUF;
+  p->expirations = 0;
+  memset(&p->tt, 0, sizeof(p->tt));
+  trickle_timer_config(&p->tt, d->param.data_imin, d->param.data_imax,
+                       d->param.data_k);
+  seed_insert(seed, p);
+
+  PRINTF("MPL: Seed ");
+  PRINT_SEED(&seed->seed_id);
+  PRINTF(" seq. val %u, %u buffered\n", p->seq, seed->count);
+
+  /* We forward the copy, with its hop limit already decremented */
+  if(in) {
+    MPL_MSG_TTL(p)--;
+  }
+  if(d->param.proactive) {
+    buffer_reset(p);
+  }
+  domain_reset(d);
+
+  /* Deliver if necessary */
+  return UIP_MCAST6_ACCEPT;
+}
+/*---------------------------------------------------------------------------*/
+/* MPL ICMPv6 Input Handler */
+static void
+icmp_input()
+{
+  struct mpl_domain *d;
+  struct mpl_seed *seed;
+  struct mpl_msg *p;
+  struct seed_info *info;
+  struct seed_id s;
+  uint8_t *ptr;
+  uint8_t *end;
+  uint8_t *bm;
+  uint8_t bm_len;
+  uint8_t inconsistent;
+  uint16_t n;
+
+#if UIP_CONF_IPV6_CHECKS
+  if(!uip_is_addr_link_local(&UIP_IP_BUF->srcipaddr)) {
+    PRINTF("MPL: ICMPv6 In, bad source ");
+    PRINT6ADDR(&UIP_IP_BUF->srcipaddr);
+    PRINTF("\n");
+    MPL_STATS_ADD(icmp_bad);
+    return;
+  }
+
+  if(UIP_ICMP_BUF->icode != MPL_ICMP_CODE) {
+    PRINTF("MPL: ICMPv6 In, bad ICMP code\n");
+    MPL_STATS_ADD(icmp_bad);
+    return;
+  }
+
+  if(UIP_IP_BUF->ttl != MPL_IP_HOP_LIMIT) {
+    PRINTF("MPL: ICMPv6 In, bad TTL\n");
+    MPL_STATS_ADD(icmp_bad);
+    return;
+  }
+#endif
+
+  d = domain_lookup_link_scoped(&UIP_IP_BUF->destipaddr);
+  if(d == NULL) {
+    PRINTF("MPL: ICMPv6 In, unknown domain\n");
+    MPL_STATS_ADD(icmp_bad);
+    return;
+  }
+
+  PRINTF("MPL: ICMPv6 In from ");
+  PRINT6ADDR(&UIP_IP_BUF->srcipaddr);
+  PRINTF(" len %u, ext %u\n", uip_len, uip_ext_len);
+
+  MPL_STATS_ADD(icmp_in);
+
+  for(seed = seeds; seed < &seeds[MPL_SEED_SET_SIZE]; seed++) {
+    seed->listed = 0;
+  }
+
+  inconsistent = 0;
+  ptr = UIP_ICMP_PAYLOAD;
+  end = (uint8_t *)UIP_ICMP_PAYLOAD + uip_len - uip_l2_l3_icmp_hdr_len;
+  while(ptr + sizeof(struct seed_info) <= end) {
+    info = (struct seed_info *)ptr;
+    s.s = SEED_INFO_GET_S(info);
+    bm_len = SEED_INFO_GET_BM_LEN(info);
+    bm = info->seed_id + seed_id_len[s.s];
+    if(bm + bm_len > end) {
+      PRINTF("MPL: ICMPv6 In, truncated Seed Info\n");
+      MPL_STATS_ADD(icmp_bad);
+      break;
+    }
+    ptr = bm + bm_len;
+
+    memset(s.id, 0, sizeof(s.id));
+    if(s.s == SEED_ID_S_ELIDED) {
+      s.s = SEED_ID_S_128;
+      memcpy(s.id, &UIP_IP_BUF->srcipaddr, sizeof(s.id));
+    } else {
+      memcpy(s.id, info->seed_id, seed_id_len[s.s]);
+    }
+
+    seed = seed_lookup(&s, d);
+    if(seed == NULL) {
+      /* They have messages of a seed we don't know */
+      for(n = 0; n < bm_len * 8; n++) {
+        if(BITMAP_IS_SET(bm, n)) {
+          PRINTF("MPL: Inconsistency - unknown Seed ");
+          PRINT_SEED(&s);
+          PRINTF("\n");
+          inconsistent = 1;
+          break;
+        }
+      }
+      continue;
+    }
+    seed->listed = 1;
+
+    /* They have new: listed, not below our MinSequence, not buffered */
+    for(n = 0; n < bm_len * 8; n++) {
+      if(BITMAP_IS_SET(bm, n) &&
+         !SEQ_VAL_IS_LT(info->min_seqno + n, seed->min_seqno) &&
+         seed_find(seed, info->min_seqno + n) == NULL) {
+        PRINTF("MPL: Inconsistency - they have %u\n",
+               (uint8_t)(info->min_seqno + n));
+        inconsistent = 1;
+      }
+    }
+
+    /* We have new: not below their MinSequence and not listed */
+    for(p = seed->head; p != NULL; p = p->next) {
+      if(SEQ_VAL_IS_LT(p->seq, info->min_seqno)) {
+        continue;
+      }
+      n = (uint8_t)(p->seq - info->min_seqno);
+      if(n >= bm_len * 8 || !BITMAP_IS_SET(bm, n)) {
+        PRINTF("MPL: Inconsistency - they miss %u\n", p->seq);
+        inconsistent = 1;
+        MPL_STATS_ADD(reactive);
+        buffer_reset(p);
+      }
+    }
+  }
+
+  /* We have new: a seed they did not list at all */
+  for(seed = seeds; seed < &seeds[MPL_SEED_SET_SIZE]; seed++) {
+    if(seed->domain == d && !seed->listed && seed->head != NULL) {
+      PRINTF("MPL: Inconsistency - Seed ");
+      PRINT_SEED(&seed->seed_id);
+      PRINTF(" was not listed\n");
+      inconsistent = 1;
+      for(p = seed->head; p != NULL; p = p->next) {
+        MPL_STATS_ADD(reactive);
+        buffer_reset(p);
+      }
+    }
+  }
+
+  if(inconsistent) {
+    domain_reset(d);
+  } else {
+    trickle_timer_consistency(&d->tt);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+out()
+{
+  struct hbho_mpl *opt;
+
+  if(uip_len + HBHO_TOTAL_LEN > UIP_BUFSIZE) {
+    PRINTF("MPL: Multicast Out can not add HBHO. Packet too long\n");
+    goto drop;
+  }
+
+  /* Slide 'right' by HBHO_TOTAL_LEN bytes */
+  memmove(UIP_EXT_BUF_NEXT, UIP_EXT_BUF, uip_len - UIP_IPH_LEN);
+  memset(UIP_EXT_BUF, 0, HBHO_TOTAL_LEN);
+
+  UIP_EXT_BUF->next = UIP_IP_BUF->proto;
+  UIP_EXT_BUF->len = 0;
+
+  /* MPL Option with S=0, the seed is our source address, then PadN */
+  opt = UIP_EXT_OPT_FIRST;
+  opt->type = HBHO_OPT_TYPE_MPL;
+  opt->len = HBHO_MPL_LEN_S0;
+  opt->flags = HBH_M_BIT;
+  opt->seq = ++last_seq;
+  /* No seed-id follows, the two bytes are the PadN */
+  opt->seed_id[0] = UIP_EXT_HDR_OPT_PADN;
+  opt->seed_id[1] = 0;
+
+  uip_ext_len += HBHO_TOTAL_LEN;
+  uip_len += HBHO_TOTAL_LEN;
+
+  /* Update the proto and length field in the v6 header */
+  UIP_IP_BUF->proto = UIP_PROTO_HBHO;
+  UIP_IP_BUF->len[0] = ((uip_len - UIP_IPH_LEN) >> 8);
+  UIP_IP_BUF->len[1] = ((uip_len - UIP_IPH_LEN) & 0xff);
+
+  PRINTF("MPL: Multicast Out, seq. val %u\n", opt->seq);
+
+  /*
+   * Buffer the message like a received one, so that the Trickle timer and
+   * our Control Messages take care of it. We send it right away for the
+   * first hop and set uip_len = 0 to stop the core from re-sending it.
+   */
+  if(accept(0)) {
+    tcpip_output(NULL);
+    UIP_MCAST6_STATS_ADD(mcast_out);
+  }
+
+drop:
+  uip_slen = 0;
+  uip_len = 0;
+  uip_ext_len = 0;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+in()
+{
+  /*
+   * We call accept() which will sort out caching and forwarding. Depending
+   * on accept()'s return value, we then need to signal the core
+   * whether to deliver this to higher layers
+   */
+  if(accept(1) == UIP_MCAST6_DROP) {
+    return UIP_MCAST6_DROP;
+  }
+
+  if(!uip_ds6_is_my_maddr(&UIP_IP_BUF->destipaddr)) {
+    PRINTF("MPL: Not a group member. No further processing\n");
+    return UIP_MCAST6_DROP;
+  } else {
+    PRINTF("MPL: Ours. Deliver to upper layers\n");
+    UIP_MCAST6_STATS_ADD(mcast_in_ours);
+    return UIP_MCAST6_ACCEPT;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+  uip_ip6addr_t addr;
+  struct mpl_seed *seed;
+  struct mpl_msg *p;
+
+  PRINTF("MPL: RFC 7731 Multicast\n");
+
+  memset(domains, 0, sizeof(domains));
+  memset(seeds, 0, sizeof(seeds));
+  memset(buffered_msgs, 0, sizeof(buffered_msgs));
+  seed_free = NULL;
+  buff_free = NULL;
+  last_seq = 0;
+
+#if !UIP_CONF_IPV6_REASSEMBLY
+  /* Otherwise uip_reass_init() has already set the pool up */
+  mmem_init();
+#endif
+
+  MPL_STATS_INIT();
+  UIP_MCAST6_STATS_INIT(&stats);
+
+  /* Register the ICMPv6 input handler */
+  uip_icmp6_register_input_handler(&mpl_icmp_handler);
+
+  for(seed = &seeds[MPL_SEED_SET_SIZE - 1]; seed >= seeds; seed--) {
+    seed->next = seed_free;
+    seed_free = seed;
+  }
+  for(p = &buffered_msgs[MPL_BUFFERED_MESSAGE_SET_SIZE - 1];
+      p >= buffered_msgs; p--) {
+    p->next = buff_free;
+    buff_free = p;
+  }
+
+  /* The default domain, ALL_MPL_FORWARDERS with realm-local scope */
+  uip_ip6addr(&addr, 0xff03, 0, 0, 0, 0, 0, 0, 0x00fc);
+  mpl_domain_set(&addr, NULL);
+
+  ctimer_set(&lifetime_timer, 60 * bsp_get(E_BSP_GET_TRES),
+             lifetime_timer_expired, NULL);
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief The MPL engine driver
+ */
+const struct uip_mcast6_driver mpl_driver = {
+  "MPL",
+  init,
+  out,
+  in,
+};
+/*---------------------------------------------------------------------------*/
+/** @} */
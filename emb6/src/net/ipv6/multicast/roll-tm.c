@@ -50,7 +50,9 @@
 #include "roll-tm.h"
 #include "bsp.h"
 #include "ctimer.h"
+#include "trickle-timer.h"
 #include "random.h"
+#include "mmem.h"
 //#include "dev/watchdog.h"
 //#include <string.h>
 
@@ -89,32 +91,17 @@ typedef uip_ip6addr_t seed_id_t;
 
 /* Trickle Timers */
 struct trickle_param {
-  clock_time_t i_min;           /* Clock ticks */
-  clock_time_t t_start;         /* Start of the interval (absolute clock_time) */
-  clock_time_t t_end;           /* End of the interval (absolute clock_time) */
-  clock_time_t t_next;          /* Clock ticks, randomised in [I/2, I) */
+  struct trickle_timer tt;      /* Imin, Imax, k and the interval state */
   clock_time_t t_last_trigger;
-  struct ctimer ct;
-  uint8_t i_current;            /* Current doublings from i_min */
-  uint8_t i_max;                /* Max number of doublings */
-  uint8_t k;                    /* Redundancy Constant */
   uint8_t t_active;             /* Units of Imax */
   uint8_t t_dwell;              /* Units of Imax */
-  uint8_t c;                    /* Consistency Counter */
   uint8_t inconsistency;
 };
 
-/**
- * \brief Convert a timer to a sane clock_time_t value after d doublings
- * m is a value of Imin, d is a number of doublings
- * Careful of overflows
- */
-#define TRICKLE_TIME(m, d) ((clock_time_t)((m) << (d)))
-
 /**
  * \brief Convert Imax from number of doublings to clock_time_t units for
  * trickle_param t. Again, watch out for overflows */
-#define TRICKLE_IMAX(t) ((uint32_t)((t)->i_min << (t)->i_max))
+#define TRICKLE_IMAX(t) ((uint32_t)((t)->tt.i_min << (t)->tt.i_max))
 
 /**
  * \brief Convert Tactive for a trickle timer to a sane clock_time_t value
@@ -134,21 +121,20 @@ struct trickle_param {
  * \brief Check if suppression is enabled for trickle_param t
  * t is a pointer to the timer
  */
-#define SUPPRESSION_ENABLED(t) ((t)->k != ROLL_TM_INFINITE_REDUNDANCY)
+#define SUPPRESSION_ENABLED(t) ((t)->tt.k != ROLL_TM_INFINITE_REDUNDANCY)
 
 /**
  * \brief Check if suppression is disabled for trickle_param t
  * t is a pointer to the timer
  */
-#define SUPPRESSION_DISABLED(t) ((t)->k == ROLL_TM_INFINITE_REDUNDANCY)
+#define SUPPRESSION_DISABLED(t) ((t)->tt.k == ROLL_TM_INFINITE_REDUNDANCY)
 
 /**
  * \brief Init trickle_timer[m]
  */
 #define TIMER_CONFIGURE(m) do { \
-  t[m].i_min = ROLL_TM_IMIN_##m; \
-  t[m].i_max = ROLL_TM_IMAX_##m; \
-  t[m].k = ROLL_TM_K_##m; \
+  trickle_timer_config(&t[m].tt, ROLL_TM_IMIN_##m, ROLL_TM_IMAX_##m, \
+                       ROLL_TM_K_##m); \
   t[m].t_active = ROLL_TM_T_ACTIVE_##m; \
   t[m].t_dwell = ROLL_TM_T_DWELL_##m; \
   t[m].t_last_trigger = bsp_getTick(); \
@@ -199,8 +185,12 @@ struct trickle_param {
 #define SEQ_VAL_ADD(s, n) (((s) + (n)) % 0x8000)
 /*---------------------------------------------------------------------------*/
 /* Sliding Windows */
+struct mcast_packet;
+
 struct sliding_window {
   seed_id_t seed_id;
+  struct sliding_window *hash_next; /* Hash chain, or free list if unused */
+  struct mcast_packet *head;    /* Buffered packets, ascending seq. values */
   int16_t lower_bound;          /* lolipop */
   int16_t upper_bound;          /* lolipop */
   int16_t min_listed;           /* lolipop */
@@ -230,7 +220,6 @@ struct sliding_window {
  * w: pointer to a sliding window
  */
 #define SLIDING_WINDOW_IS_USED_CLR(w) ((w)->flags &= ~SLIDING_WINDOW_U_BIT)
-#define window_free(w) SLIDING_WINDOW_IS_USED_CLR(w)
 
 /**
  * \brief Set 'Is Seen' bit for window w
@@ -268,6 +257,16 @@ struct sliding_window {
  */
 #define SLIDING_WINDOW_GET_M(w) \
   ((uint8_t)(((w)->flags & SLIDING_WINDOW_M_BIT) == SLIDING_WINDOW_M_BIT))
+
+/**
+ * \brief Hash bucket for the window of Seed ID s with parametrization m
+ * Long seeds mostly differ in their last bytes (the IID), short ones are
+ * only two bytes long
+ */
+#define SLIDING_WINDOW_HASH(s, m) \
+  ((uint8_t)(((uint8_t *)(s))[sizeof(seed_id_t) - 2] ^ \
+             ((uint8_t *)(s))[sizeof(seed_id_t) - 1] ^ (m)) \
+   % ROLL_TM_WIN_HASH_SIZE)
 /*---------------------------------------------------------------------------*/
 /* Multicast Packet Buffers */
 struct mcast_packet {
@@ -275,13 +274,13 @@ struct mcast_packet {
   /* Short seeds are stored inside the message */
   seed_id_t seed_id;
 #endif
+  struct mmem data;             /* The datagram, from the IPv6 header on */
+  struct mcast_packet *next;    /* Next in the window, or in the free list */
   uint32_t active;              /* Starts at 0 and increments */
   uint32_t dwell;               /* Starts at 0 and increments */
-  uint16_t buff_len;
   uint16_t seq_val;             /* host-byte order */
   struct sliding_window *sw;    /* Pointer to the SW this packet belongs to */
   uint8_t flags;                /* Is-Used, Must Send, Is Listed */
-  uint8_t buff[UIP_BUFSIZE - UIP_LLH_LEN];
 };
 
 /* Flag bits */
@@ -289,12 +288,24 @@ struct mcast_packet {
 #define MCAST_PACKET_S_BIT       0x20   /* Must Send Next Pass */
 #define MCAST_PACKET_L_BIT       0x10   /* Is listed in ICMP message */
 
+/**
+ * \brief Get a pointer to the datagram of a buffered packet
+ * p: pointer to a packet buffer. Only valid until the next mmem_free()
+ */
+#define MCAST_PACKET_BUFF(p) ((uint8_t *)MMEM_PTR(&(p)->data))
+
+/**
+ * \brief Get the length of the datagram of a buffered packet
+ * p: pointer to a packet buffer
+ */
+#define MCAST_PACKET_LEN(p) ((uint16_t)(p)->data.size)
+
 /* Fetch a pointer to the Seed ID of a buffered message p */
 #if ROLL_TM_SHORT_SEEDS
 #define MCAST_PACKET_GET_SEED(p) ((seed_id_t *)&((p)->seed_id))
 #else
 #define MCAST_PACKET_GET_SEED(p) \
-    ((seed_id_t *)&((struct uip_ip_hdr *)&(p)->buff[UIP_LLH_LEN])->srcipaddr)
+    ((seed_id_t *)&((struct uip_ip_hdr *)MCAST_PACKET_BUFF(p))->srcipaddr)
 #endif
 
 /**
@@ -302,7 +313,7 @@ struct mcast_packet {
  * p: pointer to a packet buffer
  */
 #define MCAST_PACKET_TTL(p) \
-    (((struct uip_ip_hdr *)(p)->buff)->ttl)
+    (((struct uip_ip_hdr *)MCAST_PACKET_BUFF(p))->ttl)
 
 /**
  * \brief Set 'Is Used' bit for packet p
@@ -355,12 +366,6 @@ struct mcast_packet {
  * p: pointer to a struct mcast_packet
  */
 #define MCAST_PACKET_LISTED_CLR(p) ((p)->flags &= ~MCAST_PACKET_L_BIT)
-
-/**
- * \brief Free a multicast packet buffer
- * p: pointer to a struct mcast_packet
- */
-#define MCAST_PACKET_FREE(p) ((p)->flags = 0)
 /*---------------------------------------------------------------------------*/
 /* Sequence Lists in Multicast Trickle ICMP messages */
 struct sequence_list_header {
@@ -386,6 +391,12 @@ struct sequence_list_header {
  */
 #define SEQUENCE_LIST_GET_S(l) \
     ((uint8_t)(((l)->flags & SEQUENCE_LIST_S_BIT) == SEQUENCE_LIST_S_BIT))
+
+/**
+ * \brief Largest ICMP payload: every window listed with all the packets
+ */
+#define SEQUENCE_LISTS_MAX_LEN \
+  (ROLL_TM_WINS * sizeof(struct sequence_list_header) + 2 * ROLL_TM_BUFF_NUM)
 /*---------------------------------------------------------------------------*/
 /* Trickle Multicast HBH Option */
 struct hbho_mcast {
@@ -448,6 +459,23 @@ static struct roll_tm_stats stats;
 static struct trickle_param t[2];
 static struct sliding_window windows[ROLL_TM_WINS];
 static struct mcast_packet buffered_msgs[ROLL_TM_BUFF_NUM];
+
+/* Windows in use hashed by Seed ID and M, unused ones linked through
+ * hash_next */
+static struct sliding_window *win_hash[ROLL_TM_WIN_HASH_SIZE];
+static struct sliding_window *win_free;
+
+/* Unused packet descriptors, linked through next */
+static struct mcast_packet *buff_free;
+
+/*
+ * The sequence lists of our ICMP messages. They only change when a packet is
+ * buffered, freed or stops being active, so we keep the last ones and only
+ * rebuild them after such a change (uint16_t for the header alignment)
+ */
+static uint16_t seq_lists[(SEQUENCE_LISTS_MAX_LEN + 1) / 2];
+static uint16_t seq_lists_len;
+static uint8_t seq_lists_dirty;
 /*---------------------------------------------------------------------------*/
 /* Temporary Stores */
 /*---------------------------------------------------------------------------*/
@@ -475,75 +503,26 @@ extern uint16_t uip_slen;
 /*---------------------------------------------------------------------------*/
 static void icmp_input(void);
 static void icmp_output(void);
-static void window_update_bounds(void);
-static void reset_trickle_timer(uint8_t);
-static void handle_timer(void *);
+static void buffer_free(struct mcast_packet *);
+static void handle_timer(void *, uint8_t);
 /*---------------------------------------------------------------------------*/
 /* ROLL TM ICMPv6 handler declaration */
 UIP_ICMP6_HANDLER(roll_tm_icmp_handler, ICMP6_ROLL_TM,
                   UIP_ICMP6_HANDLER_CODE_ANY, icmp_input);
 /*---------------------------------------------------------------------------*/
-/* Return a random number in [I/2, I), for a timer with Imin when the timer's
- * current number of doublings is d */
-static clock_time_t
-random_interval(clock_time_t i_min, uint8_t d)
-{
-  clock_time_t min = TRICKLE_TIME(i_min >> 1, d);
-
-  VERBOSE_PRINTF("ROLL TM: Random [%lu, %lu)\n", (unsigned long)min,
-                 (unsigned long)(TRICKLE_TIME(i_min, d)));
-
-  return min + (random_rand() % (TRICKLE_TIME(i_min, d) - 1 - min));
-}
-/*---------------------------------------------------------------------------*/
-/* Called at the end of the current interval for timer ptr */
-static void
-double_interval(void *ptr)
-{
-  struct trickle_param *param = (struct trickle_param *)ptr;
-  int16_t offset;
-  clock_time_t next;
-
-  /*
-   * If we got called long past our expiration, store the offset and try to
-   * compensate this period
-   */
-  offset = (int16_t)(bsp_getTick() - param->t_end);
-
-  /* Calculate next interval */
-  if(param->i_current < param->i_max) {
-    param->i_current++;
-  }
-
-  param->t_start = param->t_end;
-  param->t_end = param->t_start + (param->i_min << param->i_current);
-
-  next = random_interval(param->i_min, param->i_current);
-  if(next > offset) {
-    next -= offset;
-  } else {
-    next = 0;
-  }
-  param->t_next = next;
-  ctimer_set(&param->ct, param->t_next, handle_timer, (void *)param);
-
-  VERBOSE_PRINTF("ROLL TM: Doubling at %lu (offset %d), Start %lu, End %lu,"
-                 " Periodic in %lu\n", bsp_getTick(), offset,
-                 (unsigned long)param->t_start,
-                 (unsigned long)param->t_end, (unsigned long)param->t_next);
-}
-/*---------------------------------------------------------------------------*/
 /*
  * Called at a random point in [I/2,I) of the current interval for ptr
  * PARAM is a pointer to the timer that triggered the callback (&t[index])
  */
 static void
-handle_timer(void *ptr)
+handle_timer(void *ptr, uint8_t suppress)
 {
   struct trickle_param *param;
+  clock_time_t now;
   clock_time_t diff_last;       /* Time diff from last pass */
   clock_time_t diff_start;      /* Time diff from interval start */
   uint8_t m;
+  uint8_t was_active;
 
   param = (struct trickle_param *)ptr;
   if(param == &t[0]) {
@@ -559,7 +538,7 @@ handle_timer(void *ptr)
   if(uip_ds6_get_link_local(ADDR_PREFERRED) == NULL) {
     VERBOSE_PRINTF
       ("ROLL TM: Suppressing timer processing. Stack not ready\n");
-    reset_trickle_timer(m);
+    trickle_timer_reset_event(&param->tt);
     return;
   }
 
@@ -567,11 +546,10 @@ handle_timer(void *ptr)
                  m, (unsigned long)bsp_getTick(),
                  (unsigned long)param->t_last_trigger);
 
-  /* Temporarily store 'now' in t_next and calculate diffs */
-  param->t_next = bsp_getTick();
-  diff_last = param->t_next - param->t_last_trigger;
-  diff_start = param->t_next - param->t_start;
-  param->t_last_trigger = param->t_next;
+  now = bsp_getTick();
+  diff_last = now - param->t_last_trigger;
+  diff_start = now - param->tt.i_start;
+  param->t_last_trigger = now;
 
   VERBOSE_PRINTF
     ("ROLL TM: M=%u Periodic diff from last %lu, from start %lu\n", m,
@@ -596,6 +574,7 @@ handle_timer(void *ptr)
        * if active == dwell == 0 but i_current != 0, this is an oops
        * (new packet that didn't reset us). We don't handle it
        */
+      was_active = locmpptr->active < TRICKLE_ACTIVE(param);
       if(locmpptr->active == 0) {
         locmpptr->active += diff_start;
         locmpptr->dwell += diff_start;
@@ -609,18 +588,19 @@ handle_timer(void *ptr)
                      TRICKLE_ACTIVE(param));
 
       if(locmpptr->dwell > TRICKLE_DWELL(param)) {
-        locmpptr->sw->count--;
         PRINTF("ROLL TM: M=%u Free Packet %u (%lu > %lu), Window now at %u\n",
                m, locmpptr->seq_val, locmpptr->dwell,
-               TRICKLE_DWELL(param), locmpptr->sw->count);
-        if(locmpptr->sw->count == 0) {
-          PRINTF("ROLL TM: M=%u Free Window ", m);
-          PRINT_SEED(&locmpptr->sw->seed_id);
-          PRINTF("\n");
-          window_free(locmpptr->sw);
-        }
-        MCAST_PACKET_FREE(locmpptr);
-      } else if(MCAST_PACKET_TTL(locmpptr) > 0) {
+               TRICKLE_DWELL(param), locmpptr->sw->count - 1);
+        buffer_free(locmpptr);
+        continue;
+      }
+
+      /* No longer listed in our ICMP messages */
+      if(was_active && locmpptr->active >= TRICKLE_ACTIVE(param)) {
+        seq_lists_dirty = 1;
+      }
+
+      if(MCAST_PACKET_TTL(locmpptr) > 0) {
         /* Handle multicast transmissions */
         if(locmpptr->active < TRICKLE_ACTIVE(param) &&
            ((SUPPRESSION_ENABLED(param) && MCAST_PACKET_MUST_SEND(locmpptr)) ||
@@ -628,8 +608,8 @@ handle_timer(void *ptr)
           PRINTF("ROLL TM: M=%u Periodic - Sending packet from Seed ", m);
           PRINT_SEED(&locmpptr->sw->seed_id);
           PRINTF(" seq %u\n", locmpptr->seq_val);
-          uip_len = locmpptr->buff_len;
-          memcpy(UIP_IP_BUF, &locmpptr->buff, uip_len);
+          uip_len = MCAST_PACKET_LEN(locmpptr);
+          memcpy(UIP_IP_BUF, MCAST_PACKET_BUFF(locmpptr), uip_len);
 
           UIP_MCAST6_STATS_ADD(mcast_fwd);
           tcpip_output(NULL);
@@ -641,73 +621,69 @@ handle_timer(void *ptr)
   }
 
   /* Suppression Enabled - Send an ICMP */
-  if(SUPPRESSION_ENABLED(param)) {
-    if(param->c < param->k) {
-      icmp_output();
-    }
+  if(SUPPRESSION_ENABLED(param) && !suppress) {
+    icmp_output();
   }
 
   /* Done handling inconsistencies for this timer */
   param->inconsistency = 0;
-  param->c = 0;
-
-  window_update_bounds();
-
-  /* Temporarily store 'now' in t_next */
-  param->t_next = bsp_getTick();
-  if(param->t_next >= param->t_end) {
-    /* took us too long to process things, double interval asap */
-    param->t_next = 0;
-  } else {
-    param->t_next = param->t_end - param->t_next;
-  }
-  VERBOSE_PRINTF
-    ("ROLL TM: M=%u Periodic at %lu, Interval End at %lu in %lu\n", m,
-     (unsigned long)bsp_getTick(), (unsigned long)param->t_end,
-     (unsigned long)param->t_next);
-  ctimer_set(&param->ct, param->t_next, double_interval, (void *)param);
 
   return;
 }
 /*---------------------------------------------------------------------------*/
-static void
-reset_trickle_timer(uint8_t index)
+static struct sliding_window *
+window_allocate(seed_id_t *s, uint8_t m)
 {
-  t[index].t_start = bsp_getTick();
-  t[index].t_end = t[index].t_start + (t[index].i_min);
-  t[index].i_current = 0;
-  t[index].c = 0;
-  t[index].t_next = random_interval(t[index].i_min, t[index].i_current);
+  struct sliding_window *w;
+  uint8_t h;
 
-  VERBOSE_PRINTF
-    ("ROLL TM: M=%u Reset at %lu, Start %lu, End %lu, New Interval %lu\n",
-     index, (unsigned long)t[index].t_start, (unsigned long)t[index].t_start,
-     (unsigned long)t[index].t_end, (unsigned long)t[index].t_next);
+  w = win_free;
+  if(w == NULL) {
+    return NULL;
+  }
+  win_free = w->hash_next;
+
+  w->head = NULL;
+  w->count = 0;
+  w->lower_bound = -1;
+  w->upper_bound = -1;
+  w->min_listed = -1;
+  w->flags = 0;
+  SLIDING_WINDOW_IS_USED_SET(w);
+  if(m) {
+    SLIDING_WINDOW_M_SET(w);
+  }
+  seed_id_cpy(&w->seed_id, s);
 
-  ctimer_set(&t[index].ct, t[index].t_next, handle_timer, (void *)&t[index]);
+  h = SLIDING_WINDOW_HASH(s, m);
+  w->hash_next = win_hash[h];
+  win_hash[h] = w;
+  return w;
 }
 /*---------------------------------------------------------------------------*/
-static struct sliding_window *
-window_allocate()
+static void
+window_free(struct sliding_window *w)
 {
-  for(iterswptr = &windows[ROLL_TM_WINS - 1]; iterswptr >= windows;
-      iterswptr--) {
-    if(!SLIDING_WINDOW_IS_USED(iterswptr)) {
-      iterswptr->count = 0;
-      iterswptr->lower_bound = -1;
-      iterswptr->upper_bound = -1;
-      iterswptr->min_listed = -1;
-      return iterswptr;
+  struct sliding_window **pp;
+
+  for(pp = &win_hash[SLIDING_WINDOW_HASH(&w->seed_id,
+                                         SLIDING_WINDOW_GET_M(w))];
+      *pp != NULL; pp = &(*pp)->hash_next) {
+    if(*pp == w) {
+      *pp = w->hash_next;
+      break;
     }
   }
-  return NULL;
+  w->flags = 0;
+  w->hash_next = win_free;
+  win_free = w;
 }
 /*---------------------------------------------------------------------------*/
 static struct sliding_window *
 window_lookup(seed_id_t *s, uint8_t m)
 {
-  for(iterswptr = &windows[ROLL_TM_WINS - 1]; iterswptr >= windows;
-      iterswptr--) {
+  for(iterswptr = win_hash[SLIDING_WINDOW_HASH(s, m)]; iterswptr != NULL;
+      iterswptr = iterswptr->hash_next) {
     VERBOSE_PRINTF("ROLL TM: M=%u (%u) ", SLIDING_WINDOW_GET_M(iterswptr), m);
     VERBOSE_PRINT_SEED(&iterswptr->seed_id);
     VERBOSE_PRINTF("\n");
@@ -719,110 +695,153 @@ window_lookup(seed_id_t *s, uint8_t m)
   return NULL;
 }
 /*---------------------------------------------------------------------------*/
+/* The packet with sequence value seq buffered in window w, if any */
+static struct mcast_packet *
+window_find(struct sliding_window *w, uint16_t seq)
+{
+  struct mcast_packet *p;
+
+  for(p = w->head; p != NULL; p = p->next) {
+    if(SEQ_VAL_IS_EQ(p->seq_val, seq)) {
+      return p;
+    }
+    if(SEQ_VAL_IS_GT(p->seq_val, seq)) {
+      /* The list is sorted, seq can't come after this */
+      break;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Add p to window w, keeping its list sorted and its bounds up to date */
 static void
-window_update_bounds()
+window_insert(struct sliding_window *w, struct mcast_packet *p)
 {
-  for(iterswptr = &windows[ROLL_TM_WINS - 1]; iterswptr >= windows;
-      iterswptr--) {
-    iterswptr->lower_bound = -1;
+  struct mcast_packet **pp;
+
+  for(pp = &w->head; *pp != NULL; pp = &(*pp)->next) {
+    if(SEQ_VAL_IS_GT((*pp)->seq_val, p->seq_val)) {
+      break;
+    }
   }
+  p->next = *pp;
+  *pp = p;
+  p->sw = w;
+
+  w->count++;
+  w->lower_bound = w->head->seq_val;
+  if(w->count == 1 || SEQ_VAL_IS_GT(p->seq_val, w->upper_bound)) {
+    w->upper_bound = p->seq_val;
+  }
+  seq_lists_dirty = 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+buffer_free(struct mcast_packet *p)
+{
+  struct sliding_window *w = p->sw;
+  struct mcast_packet **pp;
 
-  for(locmpptr = &buffered_msgs[ROLL_TM_BUFF_NUM - 1];
-      locmpptr >= buffered_msgs; locmpptr--) {
-    if(MCAST_PACKET_IS_USED(locmpptr)) {
-      iterswptr = locmpptr->sw;
-      VERBOSE_PRINTF("ROLL TM: Update Bounds: [%d - %d] vs %u\n",
-                     iterswptr->lower_bound, iterswptr->upper_bound,
-                     locmpptr->seq_val);
-      if(iterswptr->lower_bound < 0
-         || SEQ_VAL_IS_LT(locmpptr->seq_val, iterswptr->lower_bound)) {
-        iterswptr->lower_bound = locmpptr->seq_val;
-      }
-      if(iterswptr->upper_bound < 0 ||
-         SEQ_VAL_IS_GT(locmpptr->seq_val, iterswptr->upper_bound)) {
-        iterswptr->upper_bound = locmpptr->seq_val;
-      }
+  for(pp = &w->head; *pp != NULL; pp = &(*pp)->next) {
+    if(*pp == p) {
+      *pp = p->next;
+      break;
     }
   }
+  mmem_free(&p->data);
+  p->flags = 0;
+  p->next = buff_free;
+  buff_free = p;
+  seq_lists_dirty = 1;
+
+  w->count--;
+  if(w->count == 0) {
+    PRINTF("ROLL TM: M=%u Free Window ", SLIDING_WINDOW_GET_M(w));
+    PRINT_SEED(&w->seed_id);
+    PRINTF("\n");
+    window_free(w);
+  } else {
+    w->lower_bound = w->head->seq_val;
+  }
 }
 /*---------------------------------------------------------------------------*/
-static struct mcast_packet *
+static uint8_t
 buffer_reclaim()
 {
-  struct sliding_window *largest = windows;
-  struct mcast_packet *rv;
+  struct sliding_window *largest = NULL;
 
   for(iterswptr = &windows[ROLL_TM_WINS - 1]; iterswptr >= windows;
       iterswptr--) {
-    if(iterswptr->count > largest->count) {
+    if(SLIDING_WINDOW_IS_USED(iterswptr) &&
+       (largest == NULL || iterswptr->count > largest->count)) {
       largest = iterswptr;
     }
   }
 
-  if(largest->count == 1) {
+  if(largest == NULL || largest->count <= 1) {
     /* Can't reclaim last entry for a window and this is the largest window */
-    return NULL;
+    return 0;
   }
 
   PRINTF("ROLL TM: Reclaim from Seed ");
   PRINT_SEED(&largest->seed_id);
   PRINTF(" M=%u, count was %u\n",
          SLIDING_WINDOW_GET_M(largest), largest->count);
-  /* Find the packet at the lowest bound for the largest window */
-  for(locmpptr = &buffered_msgs[ROLL_TM_BUFF_NUM - 1];
-      locmpptr >= buffered_msgs; locmpptr--) {
-    if(MCAST_PACKET_IS_USED(locmpptr) && (locmpptr->sw == largest) &&
-       SEQ_VAL_IS_EQ(locmpptr->seq_val, largest->lower_bound)) {
-      rv = locmpptr;
-      PRINTF("ROLL TM: Reclaim seq. val %u\n", locmpptr->seq_val);
-      MCAST_PACKET_FREE(rv);
-      largest->count--;
-      window_update_bounds();
-      VERBOSE_PRINTF("ROLL TM: Reclaim - new bounds [%u , %u]\n",
-                     largest->lower_bound, largest->upper_bound);
-      return rv;
-    }
-  }
 
-  /* oops */
-  return NULL;
+  /* The packet at the lowest bound heads the window's list */
+  PRINTF("ROLL TM: Reclaim seq. val %u\n", largest->head->seq_val);
+  buffer_free(largest->head);
+  ROLL_TM_STATS_ADD(buff_reclaimed);
+  VERBOSE_PRINTF("ROLL TM: Reclaim - new bounds [%u , %u]\n",
+                 largest->lower_bound, largest->upper_bound);
+  return 1;
 }
 /*---------------------------------------------------------------------------*/
+/* A descriptor with len bytes for the datagram, reclaiming if we must */
 static struct mcast_packet *
-buffer_allocate()
+buffer_allocate(uint16_t len)
 {
-  for(locmpptr = &buffered_msgs[ROLL_TM_BUFF_NUM - 1];
-      locmpptr >= buffered_msgs; locmpptr--) {
-    if(!MCAST_PACKET_IS_USED(locmpptr)) {
-      return locmpptr;
+  struct mcast_packet *p;
+
+  if(buff_free == NULL) {
+    PRINTF("ROLL TM: Buffer allocation failed, reclaiming\n");
+    if(!buffer_reclaim()) {
+      return NULL;
     }
   }
-  return NULL;
+  p = buff_free;
+  buff_free = p->next;
+
+  while(mmem_alloc(&p->data, len) == 0) {
+    PRINTF("ROLL TM: Out of memory for %u bytes, reclaiming\n", len);
+    if(!buffer_reclaim()) {
+      p->next = buff_free;
+      buff_free = p;
+      return NULL;
+    }
+  }
+  return p;
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * Rebuild the sequence lists we advertise from the windows' packet lists.
+ * Lists and sequence values that would not fit in ROOM bytes are left out
+ */
 static void
-icmp_output()
+seq_lists_build(uint16_t room)
 {
   struct sequence_list_header *sl;
   uint8_t *buffer;
-  uint16_t payload_len;
-
-  PRINTF("ROLL TM: ICMPv6 Out\n");
 
-  UIP_IP_BUF->vtc = 0x60;
-  UIP_IP_BUF->tcflow = 0;
-  UIP_IP_BUF->flow = 0;
-  UIP_IP_BUF->proto = UIP_PROTO_ICMP6;
-  UIP_IP_BUF->ttl = ROLL_TM_IP_HOP_LIMIT;
-
-  sl = (struct sequence_list_header *)UIP_ICMP_PAYLOAD;
-  payload_len = 0;
-
-  VERBOSE_PRINTF("ROLL TM: ICMPv6 Out - Hdr @ %p, payload @ %p\n", UIP_ICMP_BUF, sl);
+  sl = (struct sequence_list_header *)seq_lists;
+  seq_lists_len = 0;
 
   for(iterswptr = &windows[ROLL_TM_WINS - 1]; iterswptr >= windows;
       iterswptr--) {
     if(SLIDING_WINDOW_IS_USED(iterswptr) && iterswptr->count > 0) {
+      if(seq_lists_len + sizeof(struct sequence_list_header) + 2 > room) {
+        break;
+      }
       memset(sl, 0, sizeof(struct sequence_list_header));
 #if ROLL_TM_SHORT_SEEDS
       sl->flags = SEQUENCE_LIST_S_BIT;
@@ -837,29 +856,53 @@ icmp_output()
 
       buffer = (uint8_t *)sl + sizeof(struct sequence_list_header);
 
-      for(locmpptr = &buffered_msgs[ROLL_TM_BUFF_NUM - 1];
-          locmpptr >= buffered_msgs; locmpptr--) {
-        if(MCAST_PACKET_IS_USED(locmpptr) &&
-           locmpptr->active < TRICKLE_ACTIVE((&t[SLIDING_WINDOW_GET_M(iterswptr)]))) {
-          if(locmpptr->sw == iterswptr) {
-            sl->seq_len++;
-            PRINTF(", %u", locmpptr->seq_val);
-            *buffer = (uint8_t)(locmpptr->seq_val >> 8);
-            buffer++;
-            *buffer = (uint8_t)(locmpptr->seq_val & 0xFF);
-            buffer++;
+      for(locmpptr = iterswptr->head; locmpptr != NULL;
+          locmpptr = locmpptr->next) {
+        if(locmpptr->active <
+           TRICKLE_ACTIVE((&t[SLIDING_WINDOW_GET_M(iterswptr)]))) {
+          if(seq_lists_len + sizeof(struct sequence_list_header) +
+             (sl->seq_len + 1) * 2 > room) {
+            break;
           }
+          sl->seq_len++;
+          PRINTF(", %u", locmpptr->seq_val);
+          *buffer = (uint8_t)(locmpptr->seq_val >> 8);
+          buffer++;
+          *buffer = (uint8_t)(locmpptr->seq_val & 0xFF);
+          buffer++;
         }
       }
       PRINTF(", Len=%u\n", sl->seq_len);
 
       /* Scrap the entire window if it has no content */
       if(sl->seq_len > 0) {
-        payload_len += sizeof(struct sequence_list_header) + sl->seq_len * 2;
+        seq_lists_len += sizeof(struct sequence_list_header) + sl->seq_len * 2;
         sl = (struct sequence_list_header *)buffer;
       }
     }
   }
+  seq_lists_dirty = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+icmp_output()
+{
+  uint16_t payload_len;
+
+  PRINTF("ROLL TM: ICMPv6 Out\n");
+
+  uip_ext_len = 0;
+  UIP_IP_BUF->vtc = 0x60;
+  UIP_IP_BUF->tcflow = 0;
+  UIP_IP_BUF->flow = 0;
+  UIP_IP_BUF->proto = UIP_PROTO_ICMP6;
+  UIP_IP_BUF->ttl = ROLL_TM_IP_HOP_LIMIT;
+
+  if(seq_lists_dirty) {
+    seq_lists_build(UIP_BUFSIZE - UIP_LLH_LEN - UIP_IPH_LEN - UIP_ICMPH_LEN);
+  }
+  payload_len = seq_lists_len;
+  memcpy(UIP_ICMP_PAYLOAD, seq_lists, payload_len);
 
   if(payload_len == 0) {
     VERBOSE_PRINTF("ROLL TM: ICMPv6 Out - nothing to send\n");
@@ -983,17 +1026,12 @@ accept(uint8_t in)
       UIP_MCAST6_STATS_ADD(mcast_dropped);
       return UIP_MCAST6_DROP;
     }
-    for(locmpptr = &buffered_msgs[ROLL_TM_BUFF_NUM - 1];
-        locmpptr >= buffered_msgs; locmpptr--) {
-      if(MCAST_PACKET_IS_USED(locmpptr) &&
-         locmpptr->sw == locswptr &&
-         SLIDING_WINDOW_GET_M(locmpptr->sw) == m &&
-         SEQ_VAL_IS_EQ(seq_val, locmpptr->seq_val)) {
-        /* Seen before , drop */
-        PRINTF("ROLL TM: Seen before\n");
-        UIP_MCAST6_STATS_ADD(mcast_dropped);
-        return UIP_MCAST6_DROP;
-      }
+    if(window_find(locswptr, seq_val) != NULL) {
+      /* Seen before , drop */
+      PRINTF("ROLL TM: Seen before\n");
+      ROLL_TM_STATS_ADD(dup_dropped);
+      UIP_MCAST6_STATS_ADD(mcast_dropped);
+      return UIP_MCAST6_DROP;
     }
   }
 
@@ -1002,7 +1040,7 @@ accept(uint8_t in)
   /* We have not seen this message before */
   /* Allocate a window if we have to */
   if(!locswptr) {
-    locswptr = window_allocate();
+    locswptr = window_allocate(seed_ptr, m);
     PRINTF("ROLL TM: New seed\n");
   }
   if(!locswptr) {
@@ -1013,21 +1051,16 @@ accept(uint8_t in)
   }
 
   /* Allocate a buffer */
-  locmpptr = buffer_allocate();
-  if(!locmpptr) {
-    PRINTF("ROLL TM: Buffer allocation failed, reclaiming\n");
-    locmpptr = buffer_reclaim();
-  }
-
+  locmpptr = buffer_allocate(uip_len);
   if(!locmpptr) {
     /* Failed to allocate / reclaim a buffer. If the window has only just been
      * allocated, free it before dropping */
     PRINTF("ROLL TM: Buffer reclaim failed\n");
     if(locswptr->count == 0) {
       window_free(locswptr);
-      UIP_MCAST6_STATS_ADD(mcast_dropped);
-      return UIP_MCAST6_DROP;
     }
+    UIP_MCAST6_STATS_ADD(mcast_dropped);
+    return UIP_MCAST6_DROP;
   }
 #if UIP_MCAST6_STATS
   if(in == ROLL_TM_DGRAM_IN) {
@@ -1036,39 +1069,24 @@ accept(uint8_t in)
 #endif
 
   /* We have a window and we have a buffer. Accept this message */
-  /* Set the seed ID and correct M for this window */
-  SLIDING_WINDOW_M_CLR(locswptr);
-  if(m) {
-    SLIDING_WINDOW_M_SET(locswptr);
-  }
-  SLIDING_WINDOW_IS_USED_SET(locswptr);
-  seed_id_cpy(&locswptr->seed_id, seed_ptr);
   PRINTF("ROLL TM: Window for seed ");
   PRINT_SEED(&locswptr->seed_id);
   PRINTF(" M=%u, count=%u\n",
          SLIDING_WINDOW_GET_M(locswptr), locswptr->count);
 
-  /* If this window was previously empty, set its lower bound to this packet */
-  if(locswptr->count == 0) {
-    locswptr->lower_bound = seq_val;
-    VERBOSE_PRINTF("ROLL TM: New Lower Bound %u\n", locswptr->lower_bound);
-  }
-
-  /* If this is a new Seq Num, update the window upper bound */
-  if(locswptr->count == 0 || SEQ_VAL_IS_GT(seq_val, locswptr->upper_bound)) {
-    locswptr->upper_bound = seq_val;
-    VERBOSE_PRINTF("ROLL TM: New Upper Bound %u\n", locswptr->upper_bound);
-  }
-
-  locswptr->count++;
-
-  memset(locmpptr, 0, sizeof(struct mcast_packet));
-  memcpy(&locmpptr->buff, UIP_IP_BUF, uip_len);
-  locmpptr->sw = locswptr;
-  locmpptr->buff_len = uip_len;
+  memcpy(MCAST_PACKET_BUFF(locmpptr), UIP_IP_BUF, uip_len);
+#if ROLL_TM_SHORT_SEEDS
+  seed_id_cpy(&locmpptr->seed_id, seed_ptr);
+#endif
+  locmpptr->active = 0;
+  locmpptr->dwell = 0;
   locmpptr->seq_val = seq_val;
+  locmpptr->flags = 0;
   MCAST_PACKET_USED_SET(locmpptr);
 
+  /* Sorted in, this also updates the window bounds */
+  window_insert(locswptr, locmpptr);
+
   PRINTF("ROLL TM: Window for seed ");
   PRINT_SEED(&locswptr->seed_id);
   PRINTF(" M=%u, %u values within [%u , %u]\n",
@@ -1088,7 +1106,7 @@ accept(uint8_t in)
     t[m].inconsistency = 1;
 
     PRINTF("ROLL TM: Inconsistency. Reset T%u\n", m);
-    reset_trickle_timer(m);
+    trickle_timer_reset_event(&t[m].tt);
   }
 
   /* Deliver if necessary */
@@ -1099,7 +1117,6 @@ accept(uint8_t in)
 static void
 icmp_input()
 {
-  uint8_t inconsistency;
   uint16_t *seq_ptr;
   uint16_t *end_ptr;
   uint16_t val;
@@ -1225,28 +1242,19 @@ icmp_input()
            (SEQ_VAL_IS_GT(val, locswptr->lower_bound) ||
             SEQ_VAL_IS_EQ(val, locswptr->lower_bound))) {
 
-          inconsistency = 1;
           /* Check if the advertised sequence is in our buffer */
-          for(locmpptr = &buffered_msgs[ROLL_TM_BUFF_NUM - 1];
-              locmpptr >= buffered_msgs; locmpptr--) {
-            if(MCAST_PACKET_IS_USED(locmpptr) && locmpptr->sw == locswptr) {
-              if(SEQ_VAL_IS_EQ(locmpptr->seq_val, val)) {
-
-                inconsistency = 0;
-                MCAST_PACKET_LISTED_SET(locmpptr);
-                PRINTF("ROLL TM: ICMPv6 In, %u listed\n", locmpptr->seq_val);
-
-                /* Update lowest seq. num listed for this window
-                 * We need this to check for "we have new" */
-                if(locswptr->min_listed == -1 ||
-                   SEQ_VAL_IS_LT(val, locswptr->min_listed)) {
-                  locswptr->min_listed = val;
-                }
-                break;
-              }
+          locmpptr = window_find(locswptr, val);
+          if(locmpptr) {
+            MCAST_PACKET_LISTED_SET(locmpptr);
+            PRINTF("ROLL TM: ICMPv6 In, %u listed\n", locmpptr->seq_val);
+
+            /* Update lowest seq. num listed for this window
+             * We need this to check for "we have new" */
+            if(locswptr->min_listed == -1 ||
+               SEQ_VAL_IS_LT(val, locswptr->min_listed)) {
+              locswptr->min_listed = val;
             }
-          }
-          if(inconsistency) {
+          } else {
             PRINTF("ROLL TM: Inconsistency - ");
             PRINTF("Advertised Seq. ID %u within bounds", val);
             PRINTF(" [%u, %u] but no matching entry\n",
@@ -1306,14 +1314,14 @@ icmp_input()
 drop:
 
   if(t[0].inconsistency) {
-    reset_trickle_timer(0);
+    trickle_timer_reset_event(&t[0].tt);
   } else {
-    t[0].c++;
+    trickle_timer_consistency(&t[0].tt);
   }
   if(t[1].inconsistency) {
-    reset_trickle_timer(1);
+    trickle_timer_reset_event(&t[1].tt);
   } else {
-    t[1].c++;
+    trickle_timer_consistency(&t[1].tt);
   }
 
   return;
@@ -1418,7 +1426,17 @@ init(void)
 
   memset(windows, 0, sizeof(windows));
   memset(buffered_msgs, 0, sizeof(buffered_msgs));
+  memset(win_hash, 0, sizeof(win_hash));
   memset(t, 0, sizeof(t));
+  win_free = NULL;
+  buff_free = NULL;
+  seq_lists_len = 0;
+  seq_lists_dirty = 0;
+
+#if !UIP_CONF_IPV6_REASSEMBLY
+  /* Otherwise uip_reass_init() has already set the pool up */
+  mmem_init();
+#endif
 
   ROLL_TM_STATS_INIT();
   UIP_MCAST6_STATS_INIT(&stats);
@@ -1431,12 +1449,20 @@ init(void)
     iterswptr->lower_bound = -1;
     iterswptr->upper_bound = -1;
     iterswptr->min_listed = -1;
+    iterswptr->hash_next = win_free;
+    win_free = iterswptr;
+  }
+
+  for(locmpptr = &buffered_msgs[ROLL_TM_BUFF_NUM - 1];
+      locmpptr >= buffered_msgs; locmpptr--) {
+    locmpptr->next = buff_free;
+    buff_free = locmpptr;
   }
 
   TIMER_CONFIGURE(0);
-  reset_trickle_timer(0);
+  trickle_timer_set(&t[0].tt, handle_timer, &t[0]);
   TIMER_CONFIGURE(1);
-  reset_trickle_timer(1);
+  trickle_timer_set(&t[1].tt, handle_timer, &t[1]);
   return;
 }
 /*---------------------------------------------------------------------------*/
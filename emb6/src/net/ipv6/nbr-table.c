@@ -47,6 +47,13 @@
 /* List of link-layer addresses of the neighbors, used as key in the tables */
 typedef struct nbr_table_key {
   struct nbr_table_key *next;
+  /* Next key in the same bucket of the link-layer and IPv6 address indexes */
+  struct nbr_table_key *lladdr_next;
+  struct nbr_table_key *ipaddr_next;
+  /* IPv6 address the neighbor is indexed by, stored in an item of table
+   * ipaddr_table */
+  const uip_ipaddr_t *ipaddr;
+  uint8_t ipaddr_table;
   linkaddr_t lladdr;
 } nbr_table_key_t;
 
@@ -66,6 +73,10 @@ static unsigned num_tables;
 MEMB(neighbor_addr_mem, nbr_table_key_t, NBR_TABLE_MAX_NEIGHBORS);
 LIST(nbr_table_keys);
 
+/* Hash indexes of the keys, by link-layer and by IPv6 address */
+static nbr_table_key_t *lladdr_hash[NBR_TABLE_HASH_SIZE];
+static nbr_table_key_t *ipaddr_hash[NBR_TABLE_HASH_SIZE];
+
 /*---------------------------------------------------------------------------*/
 /* Get a key from a neighbor index */
 static nbr_table_key_t *
@@ -109,6 +120,54 @@ key_from_item(nbr_table_t *table, const nbr_table_item_t *item)
   return key_from_index(index_from_item(table, item));
 }
 /*---------------------------------------------------------------------------*/
+/* Get the hash bucket of a link-layer address */
+static unsigned
+lladdr_bucket(const linkaddr_t *lladdr)
+{
+  unsigned hash = 0;
+  int i;
+  for(i = 0; i < LINKADDR_SIZE; i++) {
+    hash = hash * 31 + lladdr->u8[i];
+  }
+  return hash % NBR_TABLE_HASH_SIZE;
+}
+/*---------------------------------------------------------------------------*/
+/* Get the hash bucket of an IPv6 address */
+static unsigned
+ipaddr_bucket(const uip_ipaddr_t *ipaddr)
+{
+  unsigned hash = 0;
+  int i;
+  for(i = 0; i < 16; i++) {
+    hash = hash * 31 + ipaddr->u8[i];
+  }
+  return hash % NBR_TABLE_HASH_SIZE;
+}
+/*---------------------------------------------------------------------------*/
+/* Remove a key from a hash index */
+static void
+hash_unlink(nbr_table_key_t **bucket, nbr_table_key_t *key, int ipaddr)
+{
+  nbr_table_key_t **prev = bucket;
+  while(*prev != NULL) {
+    if(*prev == key) {
+      *prev = ipaddr ? key->ipaddr_next : key->lladdr_next;
+      return;
+    }
+    prev = ipaddr ? &(*prev)->ipaddr_next : &(*prev)->lladdr_next;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Remove a key from the IPv6 address index */
+static void
+ipaddr_unlink(nbr_table_key_t *key)
+{
+  if(key->ipaddr != NULL) {
+    hash_unlink(&ipaddr_hash[ipaddr_bucket(key->ipaddr)], key, 1);
+    key->ipaddr = NULL;
+  }
+}
+/*---------------------------------------------------------------------------*/
 /* Get the index of a neighbor from its link-layer address */
 static int
 index_from_lladdr(const linkaddr_t *lladdr)
@@ -119,12 +178,12 @@ index_from_lladdr(const linkaddr_t *lladdr)
   if(lladdr == NULL) {
     lladdr = &linkaddr_null;
   }
-  key = list_head(nbr_table_keys);
+  key = lladdr_hash[lladdr_bucket(lladdr)];
   while(key != NULL) {
-    if(lladdr && linkaddr_cmp(lladdr, &key->lladdr)) {
+    if(linkaddr_cmp(lladdr, &key->lladdr)) {
       return index_from_key(key);
     }
-    key = list_item_next(key);
+    key = key->lladdr_next;
   }
   return -1;
 }
@@ -218,8 +277,10 @@ nbr_table_allocate(void)
       }
       /* Empty used map */
       used_map[index_from_key(least_used_key)] = 0;
-      /* Remove neighbor from list */
+      /* Remove neighbor from list and indexes */
       list_remove(nbr_table_keys, least_used_key);
+      hash_unlink(&lladdr_hash[lladdr_bucket(&least_used_key->lladdr)], least_used_key, 0);
+      ipaddr_unlink(least_used_key);
       /* Return associated key */
       return least_used_key;
     }
@@ -298,8 +359,17 @@ nbr_table_add_lladdr(nbr_table_t *table, const linkaddr_t *lladdr)
     /* Get index from newly allocated neighbor */
     index = index_from_key(key);
 
-    /* Set link-layer address */
+    /* Set link-layer address and index it */
     linkaddr_copy(&key->lladdr, lladdr);
+    key->ipaddr = NULL;
+    key->lladdr_next = lladdr_hash[lladdr_bucket(lladdr)];
+    lladdr_hash[lladdr_bucket(lladdr)] = key;
+  } else {
+    /* The item is reset below, drop the IPv6 address it was indexed by */
+    key = key_from_index(index);
+    if(key->ipaddr != NULL && key->ipaddr_table == table->index) {
+      ipaddr_unlink(key);
+    }
   }
 
   /* Get item in the current table */
@@ -320,11 +390,38 @@ nbr_table_get_from_lladdr(nbr_table_t *table, const linkaddr_t *lladdr)
   return nbr_get_bit(used_map, table, item) ? item : NULL;
 }
 /*---------------------------------------------------------------------------*/
+/* Get an item from the IPv6 address it was indexed by */
+void *
+nbr_table_get_from_ipaddr(nbr_table_t *table, const uip_ipaddr_t *ipaddr)
+{
+  nbr_table_key_t *key;
+  void *item;
+  if(table == NULL || ipaddr == NULL) {
+    return NULL;
+  }
+  key = ipaddr_hash[ipaddr_bucket(ipaddr)];
+  while(key != NULL) {
+    if(uip_ipaddr_cmp(ipaddr, key->ipaddr)) {
+      item = item_from_key(table, key);
+      if(nbr_get_bit(used_map, table, item)) {
+        return item;
+      }
+    }
+    key = key->ipaddr_next;
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
 /* Removes a neighbor from the current table (unset "used" bit) */
 int
 nbr_table_remove(nbr_table_t *table, void *item)
 {
-  int ret = nbr_set_bit(used_map, table, item, 0);
+  nbr_table_key_t *key = key_from_item(table, item);
+  int ret;
+  if(key != NULL && key->ipaddr != NULL && key->ipaddr_table == table->index) {
+    ipaddr_unlink(key);
+  }
+  ret = nbr_set_bit(used_map, table, item, 0);
   nbr_set_bit(locked_map, table, item, 0);
   return ret;
 }
@@ -350,3 +447,36 @@ nbr_table_get_lladdr(nbr_table_t *table, const void *item)
   nbr_table_key_t *key = key_from_item(table, item);
   return key != NULL ? &key->lladdr : NULL;
 }
+/*---------------------------------------------------------------------------*/
+/* Change the link-layer address of an item, keeping the index consistent */
+int
+nbr_table_set_lladdr(nbr_table_t *table, void *item, const linkaddr_t *lladdr)
+{
+  nbr_table_key_t *key = key_from_item(table, item);
+  if(key == NULL || lladdr == NULL || !nbr_get_bit(used_map, table, item)) {
+    return 0;
+  }
+  hash_unlink(&lladdr_hash[lladdr_bucket(&key->lladdr)], key, 0);
+  linkaddr_copy(&key->lladdr, lladdr);
+  key->lladdr_next = lladdr_hash[lladdr_bucket(lladdr)];
+  lladdr_hash[lladdr_bucket(lladdr)] = key;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Index an item by an IPv6 address stored in the item */
+int
+nbr_table_set_ipaddr(nbr_table_t *table, void *item, const uip_ipaddr_t *ipaddr)
+{
+  nbr_table_key_t *key = key_from_item(table, item);
+  if(key == NULL || !nbr_get_bit(used_map, table, item)) {
+    return 0;
+  }
+  ipaddr_unlink(key);
+  if(ipaddr != NULL) {
+    key->ipaddr = ipaddr;
+    key->ipaddr_table = table->index;
+    key->ipaddr_next = ipaddr_hash[ipaddr_bucket(ipaddr)];
+    ipaddr_hash[ipaddr_bucket(ipaddr)] = key;
+  }
+  return 1;
+}
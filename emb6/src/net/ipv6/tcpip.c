@@ -116,6 +116,39 @@ static struct internal_state {
 /* Called on IP packet output. */
 #if NETSTACK_CONF_WITH_IPV6
 
+/* Destination cache: the next hop neighbor of recent destinations. An entry
+   is valid as long as uip_ds6_route_gen has not changed since it was filled,
+   so that the next hop determination is skipped for steady traffic. */
+#ifdef TCPIP_CONF_DEST_CACHE_SIZE
+#define TCPIP_DEST_CACHE_SIZE TCPIP_CONF_DEST_CACHE_SIZE
+#else
+#define TCPIP_DEST_CACHE_SIZE 8
+#endif
+
+#if TCPIP_DEST_CACHE_SIZE > 0
+struct dest_cache_entry {
+  uip_ipaddr_t dest;
+  uip_ds6_nbr_t *nbr;
+  uint32_t gen;
+#if UIP_CONF_IPV6_RPL
+  rpl_instance_t *instance;     /* flows of another instance go elsewhere */
+#endif /* UIP_CONF_IPV6_RPL */
+};
+static struct dest_cache_entry dest_cache[TCPIP_DEST_CACHE_SIZE];
+
+static struct dest_cache_entry *
+dest_cache_slot(const uip_ipaddr_t *dest)
+{
+  uint16_t hash = 0;
+  uint8_t i;
+
+  for(i = 0; i < 8; i++) {
+    hash ^= (hash << 5) + (hash >> 2) + dest->u16[i];
+  }
+  return &dest_cache[hash % TCPIP_DEST_CACHE_SIZE];
+}
+#endif /* TCPIP_DEST_CACHE_SIZE > 0 */
+
 static uint8_t (* outputfunc)(const uip_lladdr_t *a);
 
 uint8_t
@@ -507,11 +540,35 @@ tcpip_input(void)
 }
 /*---------------------------------------------------------------------------*/
 #if NETSTACK_CONF_WITH_IPV6
+#if UIP_CONF_IPV6_QUEUE_PKT && UIP_ND6_SEND_NA
+/* Append the packet in uip_buf to the queue of a nbr under resolution. */
+static void
+queue_packet(uip_ds6_nbr_t *nbr)
+{
+  struct uip_packetqueue_packet *p;
+
+  p = uip_packetqueue_alloc(&nbr->packethandle, UIP_DS6_NBR_PACKET_LIFETIME);
+  if(p != NULL) {
+    memcpy(p->queue_buf, UIP_IP_BUF, uip_len);
+    p->queue_buf_len = uip_len;
+  }
+}
+#endif /* UIP_CONF_IPV6_QUEUE_PKT && UIP_ND6_SEND_NA */
+/*---------------------------------------------------------------------------*/
 void
 tcpip_ipv6_output(void)
 {
   uip_ds6_nbr_t *nbr = NULL;
   uip_ipaddr_t *nexthop;
+#if TCPIP_DEST_CACHE_SIZE > 0
+  struct dest_cache_entry *dc;
+#endif
+#if UIP_CONF_IPV6_RPL && RPL_WITH_NON_STORING
+  uip_ipaddr_t srh_nexthop;
+#endif
+#if UIP_CONF_IPV6_RPL
+  rpl_instance_t *instance;
+#endif /* UIP_CONF_IPV6_RPL */
 
   if(uip_len == 0) {
     return;
@@ -530,14 +587,52 @@ tcpip_ipv6_output(void)
   }
 
   if(!uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
+#if UIP_CONF_IPV6_RPL && RPL_WITH_NON_STORING
+    /* A non-storing root source routes into its DODAG, the destination
+       becomes the first hop */
+    if(rpl_insert_srh_header()) {
+      uip_len = 0;
+      return;
+    }
+#endif /* UIP_CONF_IPV6_RPL && RPL_WITH_NON_STORING */
+
     /* Next hop determination */
     nbr = NULL;
+#if UIP_CONF_IPV6_RPL
+    instance = rpl_get_packet_instance();
+#endif /* UIP_CONF_IPV6_RPL */
 
-    /* We first check if the destination address is on our immediate
-       link. If so, we simply use the destination address as our
-       nexthop address. */
-    if(uip_ds6_is_addr_onlink(&UIP_IP_BUF->destipaddr)){
+#if TCPIP_DEST_CACHE_SIZE > 0
+    dc = dest_cache_slot(&UIP_IP_BUF->destipaddr);
+    if(dc->gen == uip_ds6_route_gen &&
+#if UIP_CONF_IPV6_RPL
+       dc->instance == instance &&
+#endif /* UIP_CONF_IPV6_RPL */
+       uip_ipaddr_cmp(&dc->dest, &UIP_IP_BUF->destipaddr)) {
+      nbr = dc->nbr;
+    } else {
+      /* Claim the entry, it is validated once the next hop is known */
+      uip_ipaddr_copy(&dc->dest, &UIP_IP_BUF->destipaddr);
+#if UIP_CONF_IPV6_RPL
+      dc->instance = instance;
+#endif /* UIP_CONF_IPV6_RPL */
+      dc->gen = 0;
+    }
+#endif /* TCPIP_DEST_CACHE_SIZE > 0 */
+
+    if(nbr != NULL) {
+      /* Nothing changed since the next hop was determined */
+      nexthop = &nbr->ipaddr;
+    } else if(uip_ds6_is_addr_onlink(&UIP_IP_BUF->destipaddr)){
+      /* We first check if the destination address is on our immediate
+         link. If so, we simply use the destination address as our
+         nexthop address. */
       nexthop = &UIP_IP_BUF->destipaddr;
+#if UIP_CONF_IPV6_RPL && RPL_WITH_NON_STORING
+    } else if(rpl_srh_get_next_hop(&srh_nexthop)) {
+      /* Source routed, the destination is a neighbor */
+      nexthop = &srh_nexthop;
+#endif /* UIP_CONF_IPV6_RPL && RPL_WITH_NON_STORING */
     } else {
       uip_ds6_route_t *route;
       /* Check if we have a route to the destination address. */
@@ -546,7 +641,14 @@ tcpip_ipv6_output(void)
       /* No route was found - we send to the default route instead. */
       if(route == NULL) {
         PRINTF("tcpip_ipv6_output: no route found, using default route\n\r");
-        nexthop = uip_ds6_defrt_choose();
+        nexthop = NULL;
+#if UIP_CONF_IPV6_RPL
+        /* Up the DODAG of the instance the packet belongs to */
+        nexthop = rpl_get_upward_nexthop(instance);
+#endif /* UIP_CONF_IPV6_RPL */
+        if(nexthop == NULL) {
+          nexthop = uip_ds6_defrt_choose();
+        }
         if(nexthop == NULL) {
 #ifdef UIP_FALLBACK_INTERFACE
       PRINTF("FALLBACK: removing ext hdrs & setting proto %d %d\n\r",
@@ -618,7 +720,15 @@ tcpip_ipv6_output(void)
       return;
     }
 #endif /* UIP_CONF_IPV6_RPL */
-    nbr = uip_ds6_nbr_lookup(nexthop);
+    if(nbr == NULL) {
+      nbr = uip_ds6_nbr_lookup(nexthop);
+    }
+#if UIP_ND6_6LOWPAN
+    if(nbr == NULL && uip_is_addr_link_local(nexthop)) {
+      /* No NS needed, the link-layer address is in the IID */
+      nbr = uip_ds6_nbr_from_iid(nexthop);
+    }
+#endif /* UIP_ND6_6LOWPAN */
     if(nbr == NULL) {
 #if UIP_ND6_SEND_NA
       if((nbr = uip_ds6_nbr_add(nexthop, NULL, 0, NBR_INCOMPLETE)) == NULL) {
@@ -627,10 +737,7 @@ tcpip_ipv6_output(void)
       } else {
 #if UIP_CONF_IPV6_QUEUE_PKT
         /* Copy outgoing pkt in the queuing buffer for later transmit. */
-        if(uip_packetqueue_alloc(&nbr->packethandle, UIP_DS6_NBR_PACKET_LIFETIME) != NULL) {
-          memcpy(uip_packetqueue_buf(&nbr->packethandle), UIP_IP_BUF, uip_len);
-          uip_packetqueue_set_buflen(&nbr->packethandle, uip_len);
-        }
+        queue_packet(nbr);
 #endif
       /* RFC4861, 7.2.2:
        * "If the source address of the packet prompting the solicitation is the
@@ -646,6 +753,7 @@ tcpip_ipv6_output(void)
 
         stimer_set(&nbr->sendns, uip_ds6_if.retrans_timer / 1000);
         nbr->nscount = 1;
+        uip_ds6_nbr_schedule(nbr);
       }
 #endif /* UIP_ND6_SEND_NA */
     } else {
@@ -653,12 +761,8 @@ tcpip_ipv6_output(void)
       if(nbr->state == NBR_INCOMPLETE) {
         PRINTF("tcpip_ipv6_output: nbr cache entry incomplete\n\r");
 #if UIP_CONF_IPV6_QUEUE_PKT
-        /* Copy outgoing pkt in the queuing buffer for later transmit and set
-           the destination nbr to nbr. */
-        if(uip_packetqueue_alloc(&nbr->packethandle, UIP_DS6_NBR_PACKET_LIFETIME) != NULL) {
-          memcpy(uip_packetqueue_buf(&nbr->packethandle), UIP_IP_BUF, uip_len);
-          uip_packetqueue_set_buflen(&nbr->packethandle, uip_len);
-        }
+        /* Append outgoing pkt to the queue of the nbr for later transmit. */
+        queue_packet(nbr);
 #endif /*UIP_CONF_IPV6_QUEUE_PKT*/
         uip_len = 0;
         return;
@@ -669,10 +773,16 @@ tcpip_ipv6_output(void)
         nbr->state = NBR_DELAY;
         stimer_set(&nbr->reachable, UIP_ND6_DELAY_FIRST_PROBE_TIME);
         nbr->nscount = 0;
+        uip_ds6_nbr_schedule(nbr);
         PRINTF("tcpip_ipv6_output: nbr cache entry stale moving to delay\n\r");
       }
 #endif /* UIP_ND6_SEND_NA */
 
+#if TCPIP_DEST_CACHE_SIZE > 0
+      dc->nbr = nbr;
+      dc->gen = uip_ds6_route_gen;
+#endif /* TCPIP_DEST_CACHE_SIZE > 0 */
+
       tcpip_output(uip_ds6_nbr_get_ll(nbr));
 
 #if UIP_CONF_IPV6_QUEUE_PKT
@@ -681,11 +791,13 @@ tcpip_ipv6_output(void)
        * This happens in a few cases, for example when instead of receiving a
        * NA after sendiong a NS, you receive a NS with SLLAO: the entry moves
        * to STALE, and you must both send a NA and the queued packet.
+       * When ND hands us the oldest queued packet upon NA, the remaining
+       * ones follow it in the order they were queued.
        */
-      if(uip_packetqueue_buflen(&nbr->packethandle) != 0) {
+      while(uip_packetqueue_buflen(&nbr->packethandle) != 0) {
         uip_len = uip_packetqueue_buflen(&nbr->packethandle);
         memcpy(UIP_IP_BUF, uip_packetqueue_buf(&nbr->packethandle), uip_len);
-        uip_packetqueue_free(&nbr->packethandle);
+        uip_packetqueue_pop(&nbr->packethandle);
         tcpip_output(uip_ds6_nbr_get_ll(nbr));
       }
 #endif /*UIP_CONF_IPV6_QUEUE_PKT*/
@@ -700,6 +812,27 @@ tcpip_ipv6_output(void)
   uip_len = 0;
   uip_ext_len = 0;
 }
+/*---------------------------------------------------------------------------*/
+void
+tcpip_ipv6_confirm_reachable(const uip_ipaddr_t *dest)
+{
+  uip_ds6_nbr_t *nbr = NULL;
+#if TCPIP_DEST_CACHE_SIZE > 0
+  struct dest_cache_entry *dc;
+
+  /* We most likely just sent to dest, its next hop is cached */
+  dc = dest_cache_slot(dest);
+  if(dc->gen == uip_ds6_route_gen && uip_ipaddr_cmp(&dc->dest, dest)) {
+    nbr = dc->nbr;
+  }
+#endif /* TCPIP_DEST_CACHE_SIZE > 0 */
+  if(nbr == NULL) {
+    nbr = uip_ds6_nbr_lookup(dest);
+  }
+  if(nbr != NULL) {
+    uip_ds6_nbr_confirm_reachable(nbr);
+  }
+}
 #endif /* NETSTACK_CONF_WITH_IPV6 */
 /*---------------------------------------------------------------------------*/
 #if UIP_UDP
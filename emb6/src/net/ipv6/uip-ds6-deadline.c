@@ -0,0 +1,175 @@
+/*
+ * emb6 is licensed under the 3-clause BSD license. This license gives everyone
+ * the right to use and distribute the code, either in binary or source code
+ * format, as long as the copyright license is retained in the source code.
+ *
+ * The emb6 is derived from the Contiki OS platform with the explicit approval
+ * from Adam Dunkels. However, emb6 is made independent from the OS through the
+ * removal of protothreads. In addition, APIs are made more flexible to gain
+ * more adaptivity during run-time.
+ *
+ * The license text is:
+ *
+ * Copyright (c) 2015,
+ * Hochschule Offenburg, University of Applied Sciences
+ * Laboratory Embedded Systems and Communications Electronics.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \addtogroup uip6
+ * @{
+ */
+
+/**
+ * \file
+ *    Expiry queue of the IPv6 data structures
+ */
+
+#include "uip-ds6.h"
+#include "uip-ds6-deadline.h"
+#include "tcpip.h"
+#include "clist.h"
+#include "etimer.h"
+#include "bsp.h"
+
+/* Later than any interval we queue, keeps tick comparisons unambiguous */
+#define DEADLINE_MAX        ((clock_time_t)~0 >> 2)
+
+LIST(deadlines);
+
+/*---------------------------------------------------------------------------*/
+/* Wake up when the first entry is due */
+static void
+deadline_arm(void)
+{
+  uip_ds6_deadline_t *head = list_head(deadlines);
+  clock_time_t now;
+
+  if(head == NULL) {
+    etimer_stop(&uip_ds6_timer_periodic);
+    return;
+  }
+  now = bsp_getTick();
+  etimer_set(&uip_ds6_timer_periodic,
+             UIP_DS6_DEADLINE_BEFORE(now, head->expires) ?
+             head->expires - now : 0,
+             tcpip_gethandler());
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_deadline_init(void)
+{
+  list_init(deadlines);
+  etimer_stop(&uip_ds6_timer_periodic);
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_deadline_set(uip_ds6_deadline_t *dl, uint8_t type,
+                     clock_time_t interval)
+{
+  uip_ds6_deadline_t *prev;
+  uip_ds6_deadline_t *cur;
+  uint8_t was_head;
+
+  if(interval == UIP_DS6_DEADLINE_INFINITE) {
+    uip_ds6_deadline_stop(dl);
+    return;
+  }
+  if(interval < UIP_DS6_PERIOD) {
+    interval = UIP_DS6_PERIOD;
+  } else if(interval > DEADLINE_MAX) {
+    /* The owner gets another chance to reschedule before wrapping */
+    interval = DEADLINE_MAX;
+  }
+
+  was_head = (list_head(deadlines) == dl);
+  if(dl->queued) {
+    list_remove(deadlines, dl);
+  }
+  dl->type = type;
+  dl->expires = bsp_getTick() + interval;
+  dl->queued = 1;
+
+  /* Keep the queue sorted, entries with equal expiry stay in order */
+  prev = NULL;
+  for(cur = list_head(deadlines);
+      cur != NULL && !UIP_DS6_DEADLINE_BEFORE(dl->expires, cur->expires);
+      cur = list_item_next(cur)) {
+    prev = cur;
+  }
+  list_insert(deadlines, prev, dl);
+
+  if(was_head || prev == NULL) {
+    deadline_arm();
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_deadline_stop(uip_ds6_deadline_t *dl)
+{
+  uint8_t was_head;
+
+  if(!dl->queued) {
+    return;
+  }
+  was_head = (list_head(deadlines) == dl);
+  list_remove(deadlines, dl);
+  dl->queued = 0;
+  if(was_head) {
+    deadline_arm();
+  }
+}
+/*---------------------------------------------------------------------------*/
+uip_ds6_deadline_t *
+uip_ds6_deadline_next_due(void)
+{
+  uip_ds6_deadline_t *head = list_head(deadlines);
+
+  if(head == NULL || UIP_DS6_DEADLINE_BEFORE(bsp_getTick(), head->expires)) {
+    deadline_arm();
+    return NULL;
+  }
+  list_pop(deadlines);
+  head->queued = 0;
+  return head;
+}
+/*---------------------------------------------------------------------------*/
+clock_time_t
+uip_ds6_deadline_stimer(struct stimer *t)
+{
+  unsigned long remaining;
+
+  if(stimer_expired(t)) {
+    return 0;
+  }
+  remaining = stimer_remaining(t);
+  if(remaining > DEADLINE_MAX / bsp_get(E_BSP_GET_TRES)) {
+    return DEADLINE_MAX;
+  }
+  return remaining * bsp_get(E_BSP_GET_TRES);
+}
+/*---------------------------------------------------------------------------*/
+/** @} */
@@ -81,9 +81,20 @@ uip_ds6_nbr_t *
 uip_ds6_nbr_add(const uip_ipaddr_t *ipaddr, const uip_lladdr_t *lladdr,
                 uint8_t isrouter, uint8_t state)
 {
-  uip_ds6_nbr_t *nbr = nbr_table_add_lladdr(ds6_neighbors, (linkaddr_t*)lladdr);
+  uip_ds6_nbr_t *nbr;
+
+  /* Re-adding resets the entry, take it out of the expiry queue first */
+  nbr = nbr_table_get_from_lladdr(ds6_neighbors,
+                                  lladdr != NULL ? (linkaddr_t *)lladdr :
+                                  &linkaddr_null);
+  if(nbr != NULL) {
+    uip_ds6_deadline_stop(&nbr->deadline);
+  }
+  nbr = nbr_table_add_lladdr(ds6_neighbors, (linkaddr_t*)lladdr);
   if(nbr) {
     uip_ipaddr_copy(&nbr->ipaddr, ipaddr);
+    nbr_table_set_ipaddr(ds6_neighbors, nbr, &nbr->ipaddr);
+    UIP_DS6_ROUTE_GEN_BUMP();
     nbr->isrouter = isrouter;
     nbr->state = state;
   #if UIP_CONF_IPV6_QUEUE_PKT
@@ -93,6 +104,7 @@ uip_ds6_nbr_add(const uip_ipaddr_t *ipaddr, const uip_lladdr_t *lladdr,
     stimer_set(&nbr->reachable, 0);
     stimer_set(&nbr->sendns, 0);
     nbr->nscount = 0;
+    uip_ds6_nbr_schedule(nbr);
     PRINTF("Adding neighbor with ip addr ");
     PRINT6ADDR(ipaddr);
     PRINTF(" link addr ");
@@ -118,8 +130,10 @@ uip_ds6_nbr_rm(uip_ds6_nbr_t *nbr)
 #if UIP_CONF_IPV6_QUEUE_PKT
     uip_packetqueue_free(&nbr->packethandle);
 #endif /* UIP_CONF_IPV6_QUEUE_PKT */
+    uip_ds6_deadline_stop(&nbr->deadline);
     NEIGHBOR_STATE_CHANGED(nbr);
     nbr_table_remove(ds6_neighbors, nbr);
+    UIP_DS6_ROUTE_GEN_BUMP();
   }
   return;
 }
@@ -138,6 +152,13 @@ uip_ds6_nbr_get_ll(const uip_ds6_nbr_t *nbr)
     return (const uip_lladdr_t *)nbr_table_get_lladdr(ds6_neighbors, nbr);
 }
 /*---------------------------------------------------------------------------*/
+void
+uip_ds6_nbr_set_ll(uip_ds6_nbr_t *nbr, const uip_lladdr_t *lladdr)
+{
+  nbr_table_set_lladdr(ds6_neighbors, nbr, (const linkaddr_t *)lladdr);
+  UIP_DS6_ROUTE_GEN_BUMP();
+}
+/*---------------------------------------------------------------------------*/
 int
 uip_ds6_nbr_num(void)
 {
@@ -156,16 +177,7 @@ uip_ds6_nbr_num(void)
 uip_ds6_nbr_t *
 uip_ds6_nbr_lookup(const uip_ipaddr_t *ipaddr)
 {
-  uip_ds6_nbr_t *nbr = nbr_table_head(ds6_neighbors);
-  if(ipaddr != NULL) {
-    while(nbr != NULL) {
-      if(uip_ipaddr_cmp(&nbr->ipaddr, ipaddr)) {
-        return nbr;
-      }
-      nbr = nbr_table_next(ds6_neighbors, nbr);
-    }
-  }
-  return NULL;
+  return nbr_table_get_from_ipaddr(ds6_neighbors, ipaddr);
 }
 /*---------------------------------------------------------------------------*/
 uip_ds6_nbr_t *
@@ -174,6 +186,33 @@ uip_ds6_nbr_ll_lookup(const uip_lladdr_t *lladdr)
   return nbr_table_get_from_lladdr(ds6_neighbors, (linkaddr_t*)lladdr);
 }
 
+#if UIP_ND6_6LOWPAN
+/*---------------------------------------------------------------------------*/
+/*
+ * 6LoWPAN-ND address resolution (RFC 6775, 5.6): the link-layer address of
+ * a link-local neighbor is derived from its interface identifier instead
+ * of being solicited. An entry already holding that link-layer address
+ * belongs to the same node and is used as is.
+ */
+uip_ds6_nbr_t *
+uip_ds6_nbr_from_iid(const uip_ipaddr_t *ipaddr)
+{
+  uip_lladdr_t lladdr;
+  uip_ds6_nbr_t *nbr;
+
+  uip_ds6_set_lladdr_from_iid(&lladdr, ipaddr);
+  nbr = uip_ds6_nbr_ll_lookup(&lladdr);
+  if(nbr == NULL) {
+    nbr = uip_ds6_nbr_add(ipaddr, &lladdr, 0, NBR_REACHABLE);
+    if(nbr != NULL) {
+      stimer_set(&nbr->reachable, uip_ds6_if.reachable_time / 1000);
+      uip_ds6_nbr_schedule(nbr);
+    }
+  }
+  return nbr;
+}
+#endif /* UIP_ND6_6LOWPAN */
+
 /*---------------------------------------------------------------------------*/
 uip_ipaddr_t *
 uip_ds6_nbr_ipaddr_from_lladdr(const uip_lladdr_t *lladdr)
@@ -190,6 +229,27 @@ uip_ds6_nbr_lladdr_from_ipaddr(const uip_ipaddr_t *ipaddr)
   return nbr ? uip_ds6_nbr_get_ll(nbr) : NULL;
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * Reachability confirmed outside of ND (RFC 4861, 7.3.1), by a link-layer
+ * acknowledgement or an upper-layer hint. This ends a pending DELAY or
+ * PROBE without sending NS. An entry that is already REACHABLE keeps its
+ * queued deadline, which is now early and requeues it when it fires: a
+ * confirmation per packet then costs no queue insertion.
+ */
+void
+uip_ds6_nbr_confirm_reachable(uip_ds6_nbr_t *nbr)
+{
+  if(nbr->state == NBR_INCOMPLETE) {
+    return;
+  }
+  stimer_set(&nbr->reachable, uip_ds6_if.reachable_time / 1000);
+  if(nbr->state != NBR_REACHABLE || !nbr->deadline.queued) {
+    nbr->state = NBR_REACHABLE;
+    nbr->nscount = 0;
+    uip_ds6_nbr_schedule(nbr);
+  }
+}
+/*---------------------------------------------------------------------------*/
 void
 uip_ds6_link_neighbor_callback(int status, int numtx)
 {
@@ -220,8 +280,7 @@ uip_ds6_link_neighbor_callback(int status, int numtx)
     uip_ds6_nbr_t *nbr;
     nbr = uip_ds6_nbr_ll_lookup((uip_lladdr_t *)dest);
     if(nbr != NULL && nbr->state != NBR_INCOMPLETE) {
-      nbr->state = NBR_REACHABLE;
-      stimer_set(&nbr->reachable, UIP_ND6_REACHABLE_TIME / 1000);
+      uip_ds6_nbr_confirm_reachable(nbr);
       PRINTF("uip-ds6-neighbor : received a link layer ACK : ");
       PRINTLLADDR((uip_lladdr_t *)dest);
       PRINTF(" is reachable.\n");
@@ -232,84 +291,124 @@ uip_ds6_link_neighbor_callback(int status, int numtx)
 }
 /*---------------------------------------------------------------------------*/
 void
-uip_ds6_neighbor_periodic(void)
+uip_ds6_nbr_schedule(uip_ds6_nbr_t *nbr)
 {
-  /* Periodic processing on neighbors */
-  uip_ds6_nbr_t *nbr = nbr_table_head(ds6_neighbors);
-  while(nbr != NULL) {
-    switch(nbr->state) {
-    case NBR_REACHABLE:
-      if(stimer_expired(&nbr->reachable)) {
+  clock_time_t next = UIP_DS6_DEADLINE_INFINITE;
+  clock_time_t t;
+
+#if UIP_ND6_6LOWPAN && UIP_CONF_ROUTER
+  if(nbr->regstate != NBR_REG_NONE) {
+    next = uip_ds6_deadline_stimer(&nbr->reglifetime);
+  }
+#endif /* UIP_ND6_6LOWPAN && UIP_CONF_ROUTER */
+  switch(nbr->state) {
+  case NBR_REACHABLE:
+  case NBR_DELAY:
+    t = uip_ds6_deadline_stimer(&nbr->reachable);
+    break;
+#if UIP_ND6_SEND_NA
+  case NBR_INCOMPLETE:
+  case NBR_PROBE:
+    t = uip_ds6_deadline_stimer(&nbr->sendns);
+    break;
+#endif /* UIP_ND6_SEND_NA */
+  default:
+    /* STALE entries wait for traffic */
+    t = UIP_DS6_DEADLINE_INFINITE;
+    break;
+  }
+  if(t < next) {
+    next = t;
+  }
+  uip_ds6_deadline_set(&nbr->deadline, UIP_DS6_DL_NBR, next);
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_nbr_expired(uip_ds6_nbr_t *nbr)
+{
+#if UIP_ND6_6LOWPAN && UIP_CONF_ROUTER
+  if(nbr->regstate != NBR_REG_NONE && stimer_expired(&nbr->reglifetime)) {
+    PRINTF("Registration expired (");
+    PRINT6ADDR(&nbr->ipaddr);
+    PRINTF(")\n");
+    uip_ds6_nbr_rm(nbr);
+    return;
+  }
+#endif /* UIP_ND6_6LOWPAN && UIP_CONF_ROUTER */
+  switch(nbr->state) {
+  case NBR_REACHABLE:
+    if(stimer_expired(&nbr->reachable)) {
 #if UIP_CONF_IPV6_RPL
-        /* when a neighbor leave it's REACHABLE state and is a default router,
-           instead of going to STALE state it enters DELAY state in order to
-           force a NUD on it. Otherwise, if there is no upward traffic, the
-           node never knows if the default router is still reachable. This
-           mimics the 6LoWPAN-ND behavior.
-         */
-        if(uip_ds6_defrt_lookup(&nbr->ipaddr) != NULL) {
-          PRINTF("REACHABLE: defrt moving to DELAY (");
-          PRINT6ADDR(&nbr->ipaddr);
-          PRINTF(")\n");
-          nbr->state = NBR_DELAY;
-          stimer_set(&nbr->reachable, UIP_ND6_DELAY_FIRST_PROBE_TIME);
-          nbr->nscount = 0;
-        } else {
-          PRINTF("REACHABLE: moving to STALE (");
-          PRINT6ADDR(&nbr->ipaddr);
-          PRINTF(")\n");
-          nbr->state = NBR_STALE;
-        }
-#else /* UIP_CONF_IPV6_RPL */
+      /* when a neighbor leave it's REACHABLE state and is a default router,
+         instead of going to STALE state it enters DELAY state in order to
+         force a NUD on it. Otherwise, if there is no upward traffic, the
+         node never knows if the default router is still reachable. This
+         mimics the 6LoWPAN-ND behavior.
+       */
+      if(uip_ds6_defrt_lookup(&nbr->ipaddr) != NULL) {
+        PRINTF("REACHABLE: defrt moving to DELAY (");
+        PRINT6ADDR(&nbr->ipaddr);
+        PRINTF(")\n");
+        nbr->state = NBR_DELAY;
+        stimer_set(&nbr->reachable, UIP_ND6_DELAY_FIRST_PROBE_TIME);
+        nbr->nscount = 0;
+      } else {
         PRINTF("REACHABLE: moving to STALE (");
         PRINT6ADDR(&nbr->ipaddr);
         PRINTF(")\n");
         nbr->state = NBR_STALE;
-#endif /* UIP_CONF_IPV6_RPL */
       }
-      break;
+#else /* UIP_CONF_IPV6_RPL */
+      PRINTF("REACHABLE: moving to STALE (");
+      PRINT6ADDR(&nbr->ipaddr);
+      PRINTF(")\n");
+      nbr->state = NBR_STALE;
+#endif /* UIP_CONF_IPV6_RPL */
+    }
+    break;
 #if UIP_ND6_SEND_NA
-    case NBR_INCOMPLETE:
-      if(nbr->nscount >= UIP_ND6_MAX_MULTICAST_SOLICIT) {
-        uip_ds6_nbr_rm(nbr);
-      } else if(stimer_expired(&nbr->sendns) && (uip_len == 0)) {
-        nbr->nscount++;
-        PRINTF("NBR_INCOMPLETE: NS %u\n", nbr->nscount);
-        uip_nd6_ns_output(NULL, NULL, &nbr->ipaddr);
-        stimer_set(&nbr->sendns, uip_ds6_if.retrans_timer / 1000);
-      }
-      break;
-    case NBR_DELAY:
-      if(stimer_expired(&nbr->reachable)) {
-        nbr->state = NBR_PROBE;
-        nbr->nscount = 0;
-        PRINTF("DELAY: moving to PROBE\n");
-        stimer_set(&nbr->sendns, 0);
-      }
-      break;
-    case NBR_PROBE:
-      if(nbr->nscount >= UIP_ND6_MAX_UNICAST_SOLICIT) {
-        uip_ds6_defrt_t *locdefrt;
-        PRINTF("PROBE END\n");
-        if((locdefrt = uip_ds6_defrt_lookup(&nbr->ipaddr)) != NULL) {
-          if (!locdefrt->isinfinite) {
-            uip_ds6_defrt_rm(locdefrt);
-          }
+  case NBR_INCOMPLETE:
+    if(nbr->nscount >= UIP_ND6_MAX_MULTICAST_SOLICIT) {
+      uip_ds6_nbr_rm(nbr);
+      return;
+    } else if(stimer_expired(&nbr->sendns) && (uip_len == 0)) {
+      nbr->nscount++;
+      PRINTF("NBR_INCOMPLETE: NS %u\n", nbr->nscount);
+      uip_nd6_ns_output(NULL, NULL, &nbr->ipaddr);
+      stimer_set(&nbr->sendns, uip_ds6_if.retrans_timer / 1000);
+    }
+    break;
+  case NBR_DELAY:
+    if(stimer_expired(&nbr->reachable)) {
+      nbr->state = NBR_PROBE;
+      nbr->nscount = 0;
+      PRINTF("DELAY: moving to PROBE\n");
+      stimer_set(&nbr->sendns, 0);
+    }
+    break;
+  case NBR_PROBE:
+    if(nbr->nscount >= UIP_ND6_MAX_UNICAST_SOLICIT) {
+      uip_ds6_defrt_t *locdefrt;
+      PRINTF("PROBE END\n");
+      if((locdefrt = uip_ds6_defrt_lookup(&nbr->ipaddr)) != NULL) {
+        if (!locdefrt->isinfinite) {
+          uip_ds6_defrt_rm(locdefrt);
         }
-        uip_ds6_nbr_rm(nbr);
-      } else if(stimer_expired(&nbr->sendns) && (uip_len == 0)) {
-        nbr->nscount++;
-        PRINTF("PROBE: NS %u\n", nbr->nscount);
-        uip_nd6_ns_output(NULL, &nbr->ipaddr, &nbr->ipaddr);
-        stimer_set(&nbr->sendns, uip_ds6_if.retrans_timer / 1000);
       }
-      break;
-#endif /* UIP_ND6_SEND_NA */
-    default:
-      break;
+      uip_ds6_nbr_rm(nbr);
+      return;
+    } else if(stimer_expired(&nbr->sendns) && (uip_len == 0)) {
+      nbr->nscount++;
+      PRINTF("PROBE: NS %u\n", nbr->nscount);
+      uip_nd6_ns_output(NULL, &nbr->ipaddr, &nbr->ipaddr);
+      stimer_set(&nbr->sendns, uip_ds6_if.retrans_timer / 1000);
     }
-    nbr = nbr_table_next(ds6_neighbors, nbr);
+    break;
+#endif /* UIP_ND6_SEND_NA */
+  default:
+    break;
   }
+  uip_ds6_nbr_schedule(nbr);
 }
 /*---------------------------------------------------------------------------*/
 uip_ds6_nbr_t *
@@ -71,6 +71,24 @@ MEMB(defaultroutermemb, uip_ds6_defrt_t, UIP_DS6_DEFRT_NB);
 LIST(notificationlist);
 #endif
 
+/* Routes are also indexed for lookups. Host routes (/128) are kept in a
+   hash table, chained through their hash_next field. Other routes are
+   kept in a path-compressed binary trie: every node holds a prefix, the
+   nodes below it extend that prefix, and the bit following the prefix
+   selects the child. Nodes without a route join two subtries. */
+struct route_trie_node {
+  struct route_trie_node *child[2];
+  struct route_trie_node *parent;
+  uip_ds6_route_t *route;
+  uip_ipaddr_t prefix;
+  uint8_t length;
+};
+MEMB(routetriememb, struct route_trie_node, UIP_DS6_ROUTE_TRIE_NB);
+static struct route_trie_node *route_trie;
+static uip_ds6_route_t *hostroutes[UIP_DS6_ROUTE_HASH_SIZE];
+
+#define ADDR_BIT(a, i) (((a)->u8[(i) >> 3] >> (7 - ((i) & 7))) & 1)
+
 static int num_routes = 0;
 
 #undef DEBUG
@@ -79,6 +97,216 @@ static int num_routes = 0;
 
 static void rm_routelist_callback(nbr_table_item_t *ptr);
 /*---------------------------------------------------------------------------*/
+/* Number of leading bits, up to max, that two addresses have in common */
+static uint8_t
+prefix_common(const uip_ipaddr_t *a, const uip_ipaddr_t *b, uint8_t max)
+{
+  uint8_t i;
+  uint8_t bits;
+  uint8_t x;
+
+  for(i = 0; i < sizeof(uip_ipaddr_t) && (i << 3) < max; i++) {
+    x = a->u8[i] ^ b->u8[i];
+    if(x != 0) {
+      bits = i << 3;
+      while(!(x & 0x80)) {
+        x <<= 1;
+        bits++;
+      }
+      return bits < max ? bits : max;
+    }
+  }
+  return max;
+}
+/*---------------------------------------------------------------------------*/
+static uip_ds6_route_t **
+host_bucket(const uip_ipaddr_t *addr)
+{
+  uint16_t hash = 0;
+  uint8_t i;
+
+  for(i = 0; i < sizeof(uip_ipaddr_t); i += 2) {
+    hash = (hash << 3) + (hash >> 13) + ((addr->u8[i] << 8) | addr->u8[i + 1]);
+  }
+  return &hostroutes[hash % UIP_DS6_ROUTE_HASH_SIZE];
+}
+/*---------------------------------------------------------------------------*/
+/* Find the trie node of an exact prefix */
+static struct route_trie_node *
+trie_find(const uip_ipaddr_t *prefix, uint8_t length)
+{
+  struct route_trie_node *n = route_trie;
+
+  while(n != NULL && n->length <= length &&
+        prefix_common(prefix, &n->prefix, n->length) == n->length) {
+    if(n->length == length) {
+      return n;
+    }
+    n = n->child[ADDR_BIT(prefix, n->length)];
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static struct route_trie_node *
+trie_node_new(const uip_ipaddr_t *prefix, uint8_t length,
+              uip_ds6_route_t *route)
+{
+  struct route_trie_node *n = memb_alloc(&routetriememb);
+
+  if(n != NULL) {
+    memset(n, 0, sizeof(*n));
+    uip_ipaddr_copy(&n->prefix, prefix);
+    n->length = length;
+    n->route = route;
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+static int
+trie_insert(uip_ds6_route_t *route)
+{
+  struct route_trie_node **link = &route_trie;
+  struct route_trie_node *parent = NULL;
+  struct route_trie_node *n;
+  struct route_trie_node *leaf;
+  struct route_trie_node *glue;
+  uint8_t common;
+
+  /* Walk down as long as the node prefix covers the new one */
+  while((n = *link) != NULL) {
+    common = prefix_common(&route->ipaddr, &n->prefix,
+                           n->length < route->length ? n->length : route->length);
+    if(common < n->length) {
+      break;
+    }
+    if(n->length == route->length) {
+      n->route = route;
+      return 1;
+    }
+    parent = n;
+    link = &n->child[ADDR_BIT(&route->ipaddr, n->length)];
+  }
+
+  if(n == NULL) {
+    leaf = trie_node_new(&route->ipaddr, route->length, route);
+    if(leaf == NULL) {
+      return 0;
+    }
+    leaf->parent = parent;
+    *link = leaf;
+    return 1;
+  }
+
+  if(common == route->length) {
+    /* The new prefix covers n: insert it above n */
+    leaf = trie_node_new(&route->ipaddr, route->length, route);
+    if(leaf == NULL) {
+      return 0;
+    }
+    leaf->child[ADDR_BIT(&n->prefix, common)] = n;
+  } else {
+    /* The prefixes diverge: join them under a node without route */
+    glue = trie_node_new(&route->ipaddr, common, NULL);
+    leaf = trie_node_new(&route->ipaddr, route->length, route);
+    if(glue == NULL || leaf == NULL) {
+      memb_free(&routetriememb, glue);
+      memb_free(&routetriememb, leaf);
+      return 0;
+    }
+    leaf->parent = glue;
+    glue->child[ADDR_BIT(&route->ipaddr, common)] = leaf;
+    glue->child[ADDR_BIT(&n->prefix, common)] = n;
+    leaf = glue;
+  }
+  leaf->parent = parent;
+  n->parent = leaf;
+  *link = leaf;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+trie_remove(uip_ds6_route_t *route)
+{
+  struct route_trie_node *n = trie_find(&route->ipaddr, route->length);
+  struct route_trie_node *parent;
+  struct route_trie_node *child;
+
+  if(n == NULL || n->route != route) {
+    return;
+  }
+  n->route = NULL;
+
+  /* Remove the nodes that no longer hold a route nor join two subtries */
+  while(n != NULL && n->route == NULL &&
+        (n->child[0] == NULL || n->child[1] == NULL)) {
+    child = n->child[0] != NULL ? n->child[0] : n->child[1];
+    parent = n->parent;
+    if(parent == NULL) {
+      route_trie = child;
+    } else {
+      parent->child[parent->child[1] == n] = child;
+    }
+    if(child != NULL) {
+      child->parent = parent;
+    }
+    memb_free(&routetriememb, n);
+    n = parent;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Add a route to the lookup indexes */
+static int
+route_index_add(uip_ds6_route_t *route)
+{
+  uip_ds6_route_t **bucket;
+
+  if(route->length == 128) {
+    bucket = host_bucket(&route->ipaddr);
+    route->hash_next = *bucket;
+    *bucket = route;
+    return 1;
+  }
+  return trie_insert(route);
+}
+/*---------------------------------------------------------------------------*/
+/* Remove a route from the lookup indexes */
+static void
+route_index_rm(uip_ds6_route_t *route)
+{
+  uip_ds6_route_t **prev;
+
+  if(route->length == 128) {
+    for(prev = host_bucket(&route->ipaddr); *prev != NULL;
+        prev = &(*prev)->hash_next) {
+      if(*prev == route) {
+        *prev = route->hash_next;
+        break;
+      }
+    }
+  } else {
+    trie_remove(route);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Get the route of an exact prefix */
+static uip_ds6_route_t *
+route_index_find(uip_ipaddr_t *ipaddr, uint8_t length)
+{
+  uip_ds6_route_t *r;
+  struct route_trie_node *n;
+
+  if(length == 128) {
+    for(r = *host_bucket(ipaddr); r != NULL; r = r->hash_next) {
+      if(uip_ipaddr_cmp(&r->ipaddr, ipaddr)) {
+        return r;
+      }
+    }
+    return NULL;
+  }
+  n = trie_find(ipaddr, length);
+  return n != NULL ? n->route : NULL;
+}
+/*---------------------------------------------------------------------------*/
 #if DEBUG != DEBUG_NONE
 static void
 assert_nbr_routes_list_sane(void)
@@ -149,6 +377,9 @@ uip_ds6_route_init(void)
 {
   memb_init(&routememb);
   list_init(routelist);
+  memb_init(&routetriememb);
+  route_trie = NULL;
+  memset(hostroutes, 0, sizeof(hostroutes));
   nbr_table_register(nbr_routes,
                      (nbr_table_callback *)rm_routelist_callback);
 
@@ -207,31 +438,29 @@ uip_ds6_route_num_routes(void)
 uip_ds6_route_t *
 uip_ds6_route_lookup(uip_ipaddr_t *addr)
 {
-  uip_ds6_route_t *r;
   uip_ds6_route_t *found_route;
-  uint8_t longestmatch;
+  struct route_trie_node *n;
 
   PRINTF("uip-ds6-route: Looking up route for ");
   PRINT6ADDR(addr);
   PRINTF("\n\r");
 
-
-  found_route = NULL;
-  longestmatch = 0;
-  for(r = uip_ds6_route_head();
-      r != NULL;
-      r = uip_ds6_route_next(r)) {
-            PRINT6ADDR(&r->ipaddr);
-            PRINTF("\n\r");
-            if(r->length >= longestmatch &&
-              uip_ipaddr_prefixcmp(addr, &r->ipaddr, r->length)) {
-                longestmatch = r->length;
-                found_route = r;
-            /* check if total match - e.g. all 128 bits do match */
-            if(longestmatch == 128) {
-                 break;
-            }
-        }
+  /* A host route is the longest possible match */
+  found_route = route_index_find(addr, 128);
+
+  if(found_route == NULL) {
+    /* Walk down the trie, remembering the last route whose prefix
+       matched */
+    for(n = route_trie;
+        n != NULL && prefix_common(addr, &n->prefix, n->length) == n->length;
+        n = n->child[ADDR_BIT(addr, n->length)]) {
+      if(n->route != NULL) {
+        found_route = n->route;
+      }
+      if(n->length == 128) {
+        break;
+      }
+    }
   }
 
   if(found_route != NULL) {
@@ -244,15 +473,6 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
     PRINTF("uip-ds6-route: No route found\n\r");
   }
 
-  if(found_route != NULL && found_route != list_head(routelist)) {
-      /* If we found a route, we put it at the start of the routeslist
-         list. The list is ordered by how recently we looked them up:
-         the least recently used route will be at the end of the
-         list - for fast lookups (assuming multiple packets to the same node). */
-      list_remove(routelist, found_route);
-      list_push(routelist, found_route);
-  }
-
   return found_route;
 }
 /*---------------------------------------------------------------------------*/
@@ -280,16 +500,10 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
   PRINT6ADDR(ipaddr);
   PRINTF("\n\r");
 
-  r = uip_ds6_route_lookup(ipaddr);
-
-  if ((r != NULL) && (!uip_ipaddr_cmp(nexthop,uip_ds6_route_nexthop(r)))) {
-      uip_ds6_route_rm(r);
-  }
-
   /* First make sure that we don't add a route twice. If we find an
      existing route for our destination, we'll delete the old
      one first. */
-  r = uip_ds6_route_lookup(ipaddr);
+  r = route_index_find(ipaddr, length);
   if(r != NULL) {
       uip_ipaddr_t *current_nexthop;
       current_nexthop = uip_ds6_route_nexthop(r);
@@ -310,8 +524,8 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
           least recently used one we have. */
 
     if(uip_ds6_route_num_routes() == UIP_DS6_ROUTE_NB) {
-        /* Removing the oldest route entry from the route table. The
-             least recently used route is the first route on the list. */
+        /* Removing the oldest route entry from the route table. New
+             routes are pushed on the list, so the oldest is the last one. */
         uip_ds6_route_t *oldest;
 
         oldest = list_tail(routelist); /* uip_ds6_route_head(); */
@@ -384,6 +598,12 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
 
   uip_ipaddr_copy(&(r->ipaddr), ipaddr);
   r->length = length;
+  if(!route_index_add(r)) {
+    PRINTF("uip_ds6_route_add: could not allocate route trie node\n");
+    uip_ds6_route_rm(r);
+    return NULL;
+  }
+  UIP_DS6_ROUTE_GEN_BUMP();
 
 #ifdef UIP_DS6_ROUTE_STATE_TYPE
   memset(&r->state, 0, sizeof(UIP_DS6_ROUTE_STATE_TYPE));
@@ -420,8 +640,10 @@ uip_ds6_route_rm(uip_ds6_route_t *route)
     PRINT6ADDR(&route->ipaddr);
     PRINTF("\n\r");
 
-    /* Remove the route from the route list */
+    /* Remove the route from the route list and the lookup indexes */
     list_remove(routelist, route);
+    route_index_rm(route);
+    UIP_DS6_ROUTE_GEN_BUMP();
 
     /* Find the corresponding neighbor_route and remove it. */
     for(neighbor_route = list_head(route->neighbor_routes->route_list);
@@ -542,7 +764,9 @@ uip_ds6_defrt_add(uip_ipaddr_t *ipaddr, unsigned long interval)
       PRINTF("\n\r");
     }
 
+    d->deadline.queued = 0;
     list_push(defaultrouterlist, d);
+    UIP_DS6_ROUTE_GEN_BUMP();
   }
 
   uip_ipaddr_copy(&d->ipaddr, ipaddr);
@@ -552,6 +776,7 @@ uip_ds6_defrt_add(uip_ipaddr_t *ipaddr, unsigned long interval)
   } else {
     d->isinfinite = 1;
   }
+  uip_ds6_defrt_schedule(d);
 
   ANNOTATE("#L %u 1\n\r", ipaddr->u8[sizeof(uip_ipaddr_t) - 1]);
 
@@ -582,7 +807,9 @@ uip_ds6_defrt_rm(uip_ds6_defrt_t *defrt)
     if(d == defrt) {
       PRINTF("Removing default route\n\r");
       list_remove(defaultrouterlist, defrt);
+      uip_ds6_deadline_stop(&defrt->deadline);
       memb_free(&defaultroutermemb, defrt);
+      UIP_DS6_ROUTE_GEN_BUMP();
       ANNOTATE("#L %u 0\n\r", defrt->ipaddr.u8[sizeof(uip_ipaddr_t) - 1]);
 #if UIP_DS6_NOTIFICATIONS
       call_route_callback(UIP_DS6_NOTIFICATION_DEFRT_RM,
@@ -642,20 +869,11 @@ uip_ds6_defrt_choose(void)
 }
 /*---------------------------------------------------------------------------*/
 void
-uip_ds6_defrt_periodic(void)
+uip_ds6_defrt_schedule(uip_ds6_defrt_t *defrt)
 {
-  uip_ds6_defrt_t *d;
-  d = list_head(defaultrouterlist);
-  while(d != NULL) {
-    if(!d->isinfinite &&
-       stimer_expired(&d->lifetime)) {
-      PRINTF("uip_ds6_defrt_periodic: defrt lifetime expired\n\r");
-      uip_ds6_defrt_rm(d);
-      d = list_head(defaultrouterlist);
-    } else {
-      d = list_item_next(d);
-    }
-  }
+  uip_ds6_deadline_set(&defrt->deadline, UIP_DS6_DL_DEFRT,
+                       defrt->isinfinite ? UIP_DS6_DEADLINE_INFINITE :
+                       uip_ds6_deadline_stimer(&defrt->lifetime));
 }
 /*---------------------------------------------------------------------------*/
 /** @} */
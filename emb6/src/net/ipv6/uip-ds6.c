@@ -65,6 +65,7 @@ struct stimer uip_ds6_timer_ra;                                 /** \brief RA ti
 #if UIP_ND6_SEND_RA
 static uint8_t racount;                                         /** \brief number of RA already sent */
 static uint16_t rand_time;                                      /** \brief random time value for timers */
+static uip_ds6_deadline_t ra_deadline;                          /** \brief uip_ds6_timer_ra in the expiry queue */
 #endif
 #else /* UIP_CONF_ROUTER */
 struct etimer uip_ds6_timer_rs;                                 /** \brief RS timer, to schedule RS sending */
@@ -76,6 +77,8 @@ static uint8_t rscount;                                         /** \brief numbe
 uip_ds6_netif_t uip_ds6_if;                                       /** \brief The single interface */
 uip_ds6_prefix_t uip_ds6_prefix_list[UIP_DS6_PREFIX_NB];          /** \brief Prefix list */
 
+uint32_t uip_ds6_route_gen = 1;                                   /** \brief Next hop state generation */
+
 /* Used by Cooja to enable extraction of addresses from memory.*/
 uint8_t uip_ds6_addr_size;
 uint8_t uip_ds6_netif_addr_list_offset;
@@ -96,6 +99,7 @@ void
 uip_ds6_init(void)
 {
 
+  uip_ds6_deadline_init();
   uip_ds6_neighbors_init();
   uip_ds6_route_init();
 
@@ -133,74 +137,104 @@ uip_ds6_init(void)
   uip_ds6_maddr_add(&loc_fipaddr);
 #if UIP_ND6_SEND_RA
   stimer_set(&uip_ds6_timer_ra, 2);     /* wait to have a link local IP address */
+  uip_ds6_deadline_set(&ra_deadline, UIP_DS6_DL_RA,
+                       uip_ds6_deadline_stimer(&uip_ds6_timer_ra));
 #endif /* UIP_ND6_SEND_RA */
 #else /* UIP_CONF_ROUTER */
   etimer_set(&uip_ds6_timer_rs,
              random_rand() % (UIP_ND6_MAX_RTR_SOLICITATION_DELAY *
                      bsp_get(E_BSP_GET_TRES)), tcpip_gethandler());
 #endif /* UIP_CONF_ROUTER */
-  etimer_set(&uip_ds6_timer_periodic, UIP_DS6_PERIOD, (pfn_callback_t) tcpip_gethandler());
 
   return;
 }
 
 
 /*---------------------------------------------------------------------------*/
-void
-uip_ds6_periodic(void)
+static void
+addr_expired(uip_ds6_addr_t *addr)
 {
-
-  /* Periodic processing on unicast addresses */
-  for(locaddr = uip_ds6_if.addr_list;
-      locaddr < uip_ds6_if.addr_list + UIP_DS6_ADDR_NB; locaddr++) {
-    if(locaddr->isused) {
-      if((!locaddr->isinfinite) && (stimer_expired(&locaddr->vlifetime))) {
-        PRINTF("Delete neighbour in periodic procedure %lu",locaddr->vlifetime.interval);
-        PRINT6ADDR(&(locaddr->ipaddr));
-        PRINTF("\n\r");
-        uip_ds6_addr_rm(locaddr);
+  if((!addr->isinfinite) && (stimer_expired(&addr->vlifetime))) {
+    PRINTF("Delete address in periodic procedure %lu", addr->vlifetime.interval);
+    PRINT6ADDR(&(addr->ipaddr));
+    PRINTF("\n\r");
+    uip_ds6_addr_rm(addr);
+    return;
 #if UIP_ND6_DEF_MAXDADNS > 0
-      } else if((locaddr->state == ADDR_TENTATIVE)
-                && (locaddr->dadnscount <= uip_ds6_if.maxdadns)
-                && (timer_expired(&locaddr->dadtimer))
-                && (uip_len == 0)) {
-        uip_ds6_dad(locaddr);
+  } else if((addr->state == ADDR_TENTATIVE)
+            && (addr->dadnscount <= uip_ds6_if.maxdadns)
+            && (timer_expired(&addr->dadtimer))) {
+    /* Retried by uip_ds6_addr_schedule() if a packet is pending */
+    if(uip_len == 0) {
+      uip_ds6_dad(addr);
+    }
 #endif /* UIP_ND6_DEF_MAXDADNS > 0 */
-      }
+#if UIP_ND6_6LOWPAN && !UIP_CONF_ROUTER
+  } else if(!uip_is_addr_link_local(&addr->ipaddr)
+            && (stimer_expired(&addr->regtimer))) {
+    if(uip_len == 0) {
+      uip_ds6_reg(addr);
     }
+#endif /* UIP_ND6_6LOWPAN && !UIP_CONF_ROUTER */
   }
+  if(addr->isused) {
+    uip_ds6_addr_schedule(addr);
+  }
+}
 
-  /* Periodic processing on default routers */
-  uip_ds6_defrt_periodic();
-  /*  for(locdefrt = uip_ds6_defrt_list;
-      locdefrt < uip_ds6_defrt_list + UIP_DS6_DEFRT_NB; locdefrt++) {
-    if((locdefrt->isused) && (!locdefrt->isinfinite) &&
-       (stimer_expired(&(locdefrt->lifetime)))) {
-      uip_ds6_defrt_rm(locdefrt);
-    }
-    }*/
-
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_periodic(void)
+{
+  uip_ds6_deadline_t *dl;
 #if !UIP_CONF_ROUTER
-  /* Periodic processing on prefixes */
-  for(locprefix = uip_ds6_prefix_list;
-      locprefix < uip_ds6_prefix_list + UIP_DS6_PREFIX_NB;
-      locprefix++) {
-    if(locprefix->isused && !locprefix->isinfinite
-       && stimer_expired(&(locprefix->vlifetime))) {
-      uip_ds6_prefix_rm(locprefix);
-    }
-  }
+  uip_ds6_prefix_t *prefix;
 #endif /* !UIP_CONF_ROUTER */
+  uip_ds6_defrt_t *defrt;
 
-  uip_ds6_neighbor_periodic();
-
+  /* Only the entries whose deadline passed are visited */
+  while((dl = uip_ds6_deadline_next_due()) != NULL) {
+    switch(dl->type) {
+    case UIP_DS6_DL_ADDR:
+      addr_expired(UIP_DS6_DEADLINE_OWNER(dl, uip_ds6_addr_t, deadline));
+      break;
+#if !UIP_CONF_ROUTER
+    case UIP_DS6_DL_PREFIX:
+      prefix = UIP_DS6_DEADLINE_OWNER(dl, uip_ds6_prefix_t, deadline);
+      if(!prefix->isinfinite && stimer_expired(&prefix->vlifetime)) {
+        uip_ds6_prefix_rm(prefix);
+      } else {
+        uip_ds6_prefix_schedule(prefix);
+      }
+      break;
+#endif /* !UIP_CONF_ROUTER */
+    case UIP_DS6_DL_DEFRT:
+      defrt = UIP_DS6_DEADLINE_OWNER(dl, uip_ds6_defrt_t, deadline);
+      if(!defrt->isinfinite && stimer_expired(&defrt->lifetime)) {
+        PRINTF("uip_ds6_periodic: defrt lifetime expired\n\r");
+        uip_ds6_defrt_rm(defrt);
+      } else {
+        uip_ds6_defrt_schedule(defrt);
+      }
+      break;
+    case UIP_DS6_DL_NBR:
+      uip_ds6_nbr_expired(UIP_DS6_DEADLINE_OWNER(dl, uip_ds6_nbr_t, deadline));
+      break;
 #if UIP_CONF_ROUTER && UIP_ND6_SEND_RA
-  /* Periodic RA sending */
-  if(stimer_expired(&uip_ds6_timer_ra) && (uip_len == 0)) {
-    uip_ds6_send_ra_periodic();
-  }
+    case UIP_DS6_DL_RA:
+      /* Periodic RA sending */
+      if(stimer_expired(&uip_ds6_timer_ra) && (uip_len == 0)) {
+        uip_ds6_send_ra_periodic();
+      } else {
+        uip_ds6_deadline_set(&ra_deadline, UIP_DS6_DL_RA,
+                             uip_ds6_deadline_stimer(&uip_ds6_timer_ra));
+      }
+      break;
 #endif /* UIP_CONF_ROUTER && UIP_ND6_SEND_RA */
-  etimer_reset(&uip_ds6_timer_periodic);
+    default:
+      break;
+    }
+  }
   return;
 }
 
@@ -250,6 +284,7 @@ uip_ds6_prefix_add(uip_ipaddr_t *ipaddr, uint8_t ipaddrlen,
     locprefix->l_a_reserved = flags;
     locprefix->vlifetime = vtime;
     locprefix->plifetime = ptime;
+    UIP_DS6_ROUTE_GEN_BUMP();
     PRINTF("Adding prefix ");
     PRINT6ADDR(&locprefix->ipaddr);
     PRINTF("length %u, flags %x, Valid lifetime %lx, Preffered lifetime %lx\n\r",
@@ -280,12 +315,23 @@ uip_ds6_prefix_add(uip_ipaddr_t *ipaddr, uint8_t ipaddrlen,
     } else {
       locprefix->isinfinite = 1;
     }
+    uip_ds6_prefix_schedule(locprefix);
+    UIP_DS6_ROUTE_GEN_BUMP();
     PRINTF("Adding prefix ");
     PRINT6ADDR(&locprefix->ipaddr);
     PRINTF("length %u, vlifetime%lu\n\r", ipaddrlen, interval);
   }
   return NULL;
 }
+
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_prefix_schedule(uip_ds6_prefix_t *prefix)
+{
+  uip_ds6_deadline_set(&prefix->deadline, UIP_DS6_DL_PREFIX,
+                       prefix->isinfinite ? UIP_DS6_DEADLINE_INFINITE :
+                       uip_ds6_deadline_stimer(&prefix->vlifetime));
+}
 #endif /* UIP_CONF_ROUTER */
 
 /*---------------------------------------------------------------------------*/
@@ -293,7 +339,11 @@ void
 uip_ds6_prefix_rm(uip_ds6_prefix_t *prefix)
 {
   if(prefix != NULL) {
+#if !UIP_CONF_ROUTER
+    uip_ds6_deadline_stop(&prefix->deadline);
+#endif /* !UIP_CONF_ROUTER */
     prefix->isused = 0;
+    UIP_DS6_ROUTE_GEN_BUMP();
   }
   return;
 }
@@ -350,6 +400,11 @@ uip_ds6_addr_add(uip_ipaddr_t *ipaddr, unsigned long vlifetime, uint8_t type)
 #else /* UIP_ND6_DEF_MAXDADNS > 0 */
     locaddr->state = ADDR_PREFERRED;
 #endif /* UIP_ND6_DEF_MAXDADNS > 0 */
+#if UIP_ND6_6LOWPAN && !UIP_CONF_ROUTER
+    stimer_set(&locaddr->regtimer, 0);
+    locaddr->regcount = 0;
+#endif /* UIP_ND6_6LOWPAN && !UIP_CONF_ROUTER */
+    uip_ds6_addr_schedule(locaddr);
     uip_create_solicited_node(ipaddr, &loc_fipaddr);
     uip_ds6_maddr_add(&loc_fipaddr);
     return locaddr;
@@ -366,11 +421,42 @@ uip_ds6_addr_rm(uip_ds6_addr_t *addr)
     if((locmaddr = uip_ds6_maddr_lookup(&loc_fipaddr)) != NULL) {
       uip_ds6_maddr_rm(locmaddr);
     }
+    uip_ds6_deadline_stop(&addr->deadline);
     addr->isused = 0;
   }
   return;
 }
 
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_addr_schedule(uip_ds6_addr_t *addr)
+{
+  clock_time_t next = UIP_DS6_DEADLINE_INFINITE;
+
+  if(!addr->isinfinite) {
+    next = uip_ds6_deadline_stimer(&addr->vlifetime);
+  }
+#if UIP_ND6_DEF_MAXDADNS > 0
+  if((addr->state == ADDR_TENTATIVE)
+     && (addr->dadnscount <= uip_ds6_if.maxdadns)) {
+    clock_time_t dad = timer_expired(&addr->dadtimer) ?
+      0 : timer_remaining(&addr->dadtimer);
+    if(dad < next) {
+      next = dad;
+    }
+  }
+#endif /* UIP_ND6_DEF_MAXDADNS > 0 */
+#if UIP_ND6_6LOWPAN && !UIP_CONF_ROUTER
+  if(!uip_is_addr_link_local(&addr->ipaddr)) {
+    clock_time_t reg = uip_ds6_deadline_stimer(&addr->regtimer);
+    if(reg < next) {
+      next = reg;
+    }
+  }
+#endif /* UIP_ND6_6LOWPAN && !UIP_CONF_ROUTER */
+  uip_ds6_deadline_set(&addr->deadline, UIP_DS6_DL_ADDR, next);
+}
+
 /*---------------------------------------------------------------------------*/
 uip_ds6_addr_t *
 uip_ds6_addr_lookup(uip_ipaddr_t *ipaddr)
@@ -520,7 +606,7 @@ uip_ds6_select_src(uip_ipaddr_t *src, uip_ipaddr_t *dst)
         }
       }
     }
-#if UIP_IPV6_MULTICAST
+#if UIP_CONF_IPV6_MULTICAST
   } else if(uip_is_addr_mcast_routable(dst)) {
       matchaddr = uip_ds6_get_global(ADDR_PREFERRED);
 #endif
@@ -556,6 +642,23 @@ uip_ds6_set_addr_iid(uip_ipaddr_t *ipaddr, uip_lladdr_t *lladdr)
 #endif
 }
 
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_set_lladdr_from_iid(uip_lladdr_t *lladdr, const uip_ipaddr_t *ipaddr)
+{
+  /* Inverse of uip_ds6_set_addr_iid() */
+#if (UIP_LLADDR_LEN == 8)
+  memcpy(lladdr, ipaddr->u8 + 8, UIP_LLADDR_LEN);
+  lladdr->addr[0] ^= 0x02;
+#elif (UIP_LLADDR_LEN == 6)
+  memcpy(lladdr, ipaddr->u8 + 8, 3);
+  memcpy((uint8_t *)lladdr + 3, ipaddr->u8 + 13, 3);
+  lladdr->addr[0] ^= 0x02;
+#else
+#error uip-ds6.c cannot derive a MAC address when UIP_LLADDR_LEN is not 6 or 8
+#endif
+}
+
 /*---------------------------------------------------------------------------*/
 uint8_t
 get_match_length(uip_ipaddr_t *src, uip_ipaddr_t *dst)
@@ -624,6 +727,34 @@ uip_ds6_dad_failed(uip_ds6_addr_t *addr)
 }
 #endif /*UIP_ND6_DEF_MAXDADNS > 0 */
 
+/*---------------------------------------------------------------------------*/
+#if UIP_ND6_6LOWPAN && !UIP_CONF_ROUTER
+void
+uip_ds6_reg(uip_ds6_addr_t *addr)
+{
+  uip_ipaddr_t *router;
+
+  router = uip_ds6_defrt_choose();
+  if(router == NULL) {
+    stimer_set(&addr->regtimer, UIP_ND6_RTR_SOLICITATION_INTERVAL);
+    return;
+  }
+  if(addr->regcount >= UIP_ND6_MAX_UNICAST_SOLICIT) {
+    /* The router does not answer, try again later */
+    PRINTF("Registration unanswered, ipaddr:");
+    PRINT6ADDR(&addr->ipaddr);
+    PRINTF("\n\r");
+    addr->regcount = 0;
+    stimer_set(&addr->regtimer, UIP_ND6_RTR_SOLICITATION_INTERVAL);
+    return;
+  }
+  uip_ipaddr_copy(&addr->regrouter, router);
+  uip_nd6_ns_aro_output(&addr->ipaddr, router, UIP_ND6_REGISTRATION_LIFETIME);
+  addr->regcount++;
+  stimer_set(&addr->regtimer, uip_ds6_if.retrans_timer / 1000);
+}
+#endif /* UIP_ND6_6LOWPAN && !UIP_CONF_ROUTER */
+
 /*---------------------------------------------------------------------------*/
 #if UIP_CONF_ROUTER
 #if UIP_ND6_SEND_RA
@@ -647,6 +778,8 @@ uip_ds6_send_ra_sollicited(void)
                  stimer_elapsed(&uip_ds6_timer_ra));
   */ } else {
       stimer_set(&uip_ds6_timer_ra, rand_time);
+      uip_ds6_deadline_set(&ra_deadline, UIP_DS6_DL_RA,
+                           uip_ds6_deadline_stimer(&uip_ds6_timer_ra));
     }
   }
 }
@@ -674,6 +807,8 @@ uip_ds6_send_ra_periodic(void)
   }
   PRINTF("Random time 3 = %u\n\r", rand_time);
   stimer_set(&uip_ds6_timer_ra, rand_time);
+  uip_ds6_deadline_set(&ra_deadline, UIP_DS6_DL_RA,
+                       uip_ds6_deadline_stimer(&uip_ds6_timer_ra));
 }
 
 #endif /* UIP_ND6_SEND_RA */
@@ -123,6 +123,7 @@ echo_request_input(void)
 #if UIP_CONF_IPV6_RPL
   uint8_t temp_ext_len;
 #endif /* UIP_CONF_IPV6_RPL */
+  uint16_t chksum;
   /*
    * we send an echo reply. It is trivial if there was no extension
    * headers in the request otherwise we need to remove the extension
@@ -134,12 +135,24 @@ echo_request_input(void)
   PRINT6ADDR(&UIP_IP_BUF->destipaddr);
   PRINTF("\n");
 
+  /*
+   * The reply carries the same payload, so its checksum is derived from
+   * the one of the request (RFC 1624): only the type changes and, for a
+   * multicast request, the address we answer from.
+   */
+  chksum = uip_chksum_update16(uip_ntohs(UIP_ICMP_BUF->icmpchksum),
+                               (UIP_ICMP_BUF->type << 8) | UIP_ICMP_BUF->icode,
+                               ICMP6_ECHO_REPLY << 8);
+
   /* IP header */
   UIP_IP_BUF->ttl = uip_ds6_if.cur_hop_limit;
 
   if(uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)){
+    uip_ipaddr_copy(&tmp_ipaddr, &UIP_IP_BUF->destipaddr);
     uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &UIP_IP_BUF->srcipaddr);
     uip_ds6_select_src(&UIP_IP_BUF->srcipaddr, &UIP_IP_BUF->destipaddr);
+    chksum = uip_chksum_update(chksum, tmp_ipaddr.u8,
+                               UIP_IP_BUF->srcipaddr.u8, sizeof(uip_ipaddr_t));
   } else {
     uip_ipaddr_copy(&tmp_ipaddr, &UIP_IP_BUF->srcipaddr);
     uip_ipaddr_copy(&UIP_IP_BUF->srcipaddr, &UIP_IP_BUF->destipaddr);
@@ -192,8 +205,7 @@ echo_request_input(void)
   /* Note: now UIP_ICMP_BUF points to the beginning of the echo reply */
   UIP_ICMP_BUF->type = ICMP6_ECHO_REPLY;
   UIP_ICMP_BUF->icode = 0;
-  UIP_ICMP_BUF->icmpchksum = 0;
-  UIP_ICMP_BUF->icmpchksum = ~uip_icmp6chksum();
+  UIP_ICMP_BUF->icmpchksum = uip_htons(chksum);
 
   PRINTF("Sending Echo Reply to");
   PRINT6ADDR(&UIP_IP_BUF->destipaddr);
@@ -77,6 +77,7 @@
 #include "uip-nd6.h"
 #include "uip-ds6.h"
 #include "uip-nameserver.h"
+#include "sicslowpan.h"
 #include "bsp.h"
 #include "random.h"
 
@@ -113,6 +114,7 @@ void uip_log(char *msg);
 #define UIP_ND6_RA_BUF            ((uip_nd6_ra *)&uip_buf[uip_l2_l3_icmp_hdr_len])
 #define UIP_ND6_NS_BUF            ((uip_nd6_ns *)&uip_buf[uip_l2_l3_icmp_hdr_len])
 #define UIP_ND6_NA_BUF            ((uip_nd6_na *)&uip_buf[uip_l2_l3_icmp_hdr_len])
+#define UIP_ND6_DAR_BUF           ((uip_nd6_dar *)&uip_buf[uip_l2_l3_icmp_hdr_len])
 /** @} */
 /** Pointer to ND option */
 #define UIP_ND6_OPT_HDR_BUF  ((uip_nd6_opt_hdr *)&uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset])
@@ -132,6 +134,25 @@ static uip_ds6_prefix_t *prefix; /**  Pointer to a prefix list entry */
 static uip_ds6_nbr_t *nbr; /**  Pointer to a nbr cache entry*/
 static uip_ds6_defrt_t *defrt; /**  Pointer to a router list entry */
 static uip_ds6_addr_t *addr; /**  Pointer to an interface address */
+#if UIP_ND6_6LOWPAN
+static uip_nd6_opt_aro *nd6_opt_aro; /**  Pointer to aro option in uip_buf */
+#if !UIP_CONF_ROUTER
+static uint8_t nd6_tid; /**  Transaction ID of our last registration */
+#else /* !UIP_CONF_ROUTER */
+/** Border router checking global registrations, unspecified until we
+    join a DODAG */
+static uip_ipaddr_t nd6_6lbr;
+
+/** A registration known to the border router */
+typedef struct nd6_reg {
+  uint8_t isused;
+  uip_ipaddr_t ipaddr;
+  uint8_t rovr[8];
+  struct stimer lifetime;
+} nd6_reg_t;
+static nd6_reg_t nd6_regs[UIP_ND6_REG_NB];
+#endif /* !UIP_CONF_ROUTER */
+#endif /* UIP_ND6_6LOWPAN */
 /*------------------------------------------------------------------*/
 /* create a llao */ 
 static void
@@ -144,6 +165,275 @@ create_llao(uint8_t *llao, uint8_t type) {
          UIP_ND6_OPT_LLAO_LEN - 2 - UIP_LLADDR_LEN);
 }
 
+#if UIP_ND6_6LOWPAN
+/*------------------------------------------------------------------*/
+/* create an (extended) aro */
+static void
+create_aro(uint8_t *buf, uint8_t status, uint16_t lifetime,
+           const uint8_t *rovr, uint8_t tid)
+{
+  uip_nd6_opt_aro *aro = (uip_nd6_opt_aro *)buf;
+
+  aro->type = UIP_ND6_OPT_ARO;
+  aro->len = UIP_ND6_OPT_ARO_LEN >> 3;
+  aro->status = status;
+  aro->opaque = 0;
+  aro->flags = UIP_ND6_EARO_FLAG_T;
+  aro->tid = tid;
+  aro->lifetime = uip_htons(lifetime);
+  memcpy(aro->rovr, rovr, sizeof(aro->rovr));
+}
+/*------------------------------------------------------------------*/
+/* The ROVR of a registration is the link-layer address of its owner */
+static void
+create_rovr(uint8_t *rovr, const uip_lladdr_t *lladdr)
+{
+  memset(rovr, 0, 8);
+  memcpy(rovr, lladdr, UIP_LLADDR_LEN < 8 ? UIP_LLADDR_LEN : 8);
+}
+/*------------------------------------------------------------------*/
+/* The (extended) aro at the current option offset has its fixed length
+   and lies within the packet */
+static uint8_t
+nd6_opt_aro_valid(void)
+{
+  return UIP_ND6_OPT_HDR_BUF->len == (UIP_ND6_OPT_ARO_LEN >> 3) &&
+    uip_l3_icmp_hdr_len + nd6_opt_offset + UIP_ND6_OPT_ARO_LEN <= uip_len;
+}
+#endif /* UIP_ND6_6LOWPAN */
+
+#if UIP_ND6_6LOWPAN && UIP_CONF_ROUTER
+/*------------------------------------------------------------------*/
+static uint8_t
+nd6_is_6lbr(void)
+{
+  return !uip_is_addr_unspecified(&nd6_6lbr) && uip_ds6_is_my_addr(&nd6_6lbr);
+}
+/*------------------------------------------------------------------*/
+/*
+ * Duplicate detection at the border router: check a registration against
+ * the ones we know and record it. A lifetime of 0 removes it.
+ */
+static uint8_t
+nd6_reg_check(const uip_ipaddr_t *ipaddr, const uint8_t *rovr,
+              uint16_t lifetime)
+{
+  nd6_reg_t *reg;
+  nd6_reg_t *free_reg = NULL;
+
+  for(reg = nd6_regs; reg < nd6_regs + UIP_ND6_REG_NB; reg++) {
+    if(reg->isused && stimer_expired(&reg->lifetime)) {
+      reg->isused = 0;
+    }
+    if(!reg->isused) {
+      if(free_reg == NULL) {
+        free_reg = reg;
+      }
+      continue;
+    }
+    if(uip_ipaddr_cmp(&reg->ipaddr, ipaddr)) {
+      if(memcmp(reg->rovr, rovr, sizeof(reg->rovr)) != 0) {
+        return UIP_ND6_ARO_STATUS_DUPLICATE;
+      }
+      if(lifetime == 0) {
+        reg->isused = 0;
+      } else {
+        stimer_set(&reg->lifetime, lifetime * 60UL);
+      }
+      return UIP_ND6_ARO_STATUS_SUCCESS;
+    }
+  }
+  if(lifetime == 0) {
+    return UIP_ND6_ARO_STATUS_SUCCESS;
+  }
+  if(free_reg == NULL) {
+    return UIP_ND6_ARO_STATUS_CACHE_FULL;
+  }
+  free_reg->isused = 1;
+  uip_ipaddr_copy(&free_reg->ipaddr, ipaddr);
+  memcpy(free_reg->rovr, rovr, sizeof(free_reg->rovr));
+  stimer_set(&free_reg->lifetime, lifetime * 60UL);
+  return UIP_ND6_ARO_STATUS_SUCCESS;
+}
+/*------------------------------------------------------------------*/
+/* Install or refresh the nbr cache entry of a registered address */
+static uip_ds6_nbr_t *
+nd6_reg_nbr(uip_ipaddr_t *ipaddr, uip_lladdr_t *lladdr, uint8_t regstate,
+            unsigned long lifetime)
+{
+  nbr = uip_ds6_nbr_lookup(ipaddr);
+  if(nbr == NULL) {
+    nbr = uip_ds6_nbr_add(ipaddr, lladdr, 0, NBR_REACHABLE);
+  } else if(memcmp(uip_ds6_nbr_get_ll(nbr), lladdr, UIP_LLADDR_LEN) != 0) {
+    uip_ds6_nbr_set_ll(nbr, lladdr);
+  }
+  if(nbr != NULL) {
+    nbr->state = NBR_REACHABLE;
+    stimer_set(&nbr->reachable, uip_ds6_if.reachable_time / 1000);
+    nbr->regstate = regstate;
+    stimer_set(&nbr->reglifetime, lifetime);
+    uip_ds6_nbr_schedule(nbr);
+  }
+  return nbr;
+}
+/*------------------------------------------------------------------*/
+/* Answer a registration with a NA carrying its status */
+static void
+na_aro_output(const uip_ipaddr_t *dest, const uip_ipaddr_t *tgt,
+              uint8_t status, uint16_t lifetime, const uint8_t *rovr,
+              uint8_t tid)
+{
+  uip_ext_len = 0;
+  UIP_IP_BUF->vtc = 0x60;
+  UIP_IP_BUF->tcflow = 0;
+  UIP_IP_BUF->flow = 0;
+  UIP_IP_BUF->len[0] = 0;       /* length will not be more than 255 */
+  UIP_IP_BUF->len[1] = UIP_ICMPH_LEN + UIP_ND6_NA_LEN + UIP_ND6_OPT_ARO_LEN;
+  UIP_IP_BUF->proto = UIP_PROTO_ICMP6;
+  UIP_IP_BUF->ttl = UIP_ND6_HOP_LIMIT;
+  uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, dest);
+  uip_ds6_select_src(&UIP_IP_BUF->srcipaddr, &UIP_IP_BUF->destipaddr);
+
+  UIP_ICMP_BUF->type = ICMP6_NA;
+  UIP_ICMP_BUF->icode = 0;
+
+  UIP_ND6_NA_BUF->flagsreserved = UIP_ND6_NA_FLAG_SOLICITED |
+                                  UIP_ND6_NA_FLAG_ROUTER;
+  memset(UIP_ND6_NA_BUF->reserved, 0, sizeof(UIP_ND6_NA_BUF->reserved));
+  uip_ipaddr_copy(&UIP_ND6_NA_BUF->tgtipaddr, tgt);
+
+  create_aro(&uip_buf[uip_l2_l3_icmp_hdr_len + UIP_ND6_NA_LEN],
+             status, lifetime, rovr, tid);
+
+  UIP_ICMP_BUF->icmpchksum = 0;
+  UIP_ICMP_BUF->icmpchksum = ~uip_icmp6chksum();
+
+  uip_len =
+    UIP_IPH_LEN + UIP_ICMPH_LEN + UIP_ND6_NA_LEN + UIP_ND6_OPT_ARO_LEN;
+
+  UIP_STAT(++uip_stat.nd6.sent);
+  PRINTF("Sending NA with ARO status %u to ", status);
+  PRINT6ADDR(&UIP_IP_BUF->destipaddr);
+  PRINTF("\n");
+}
+/*------------------------------------------------------------------*/
+/* Send a DAR to the border router, or a DAC back to a router */
+static void
+dar_output(uint8_t type, const uip_ipaddr_t *dest, uint8_t status,
+           uint8_t tid, uint16_t lifetime, const uint8_t *rovr,
+           const uip_ipaddr_t *regaddr)
+{
+  uip_ext_len = 0;
+  UIP_IP_BUF->vtc = 0x60;
+  UIP_IP_BUF->tcflow = 0;
+  UIP_IP_BUF->flow = 0;
+  UIP_IP_BUF->len[0] = 0;
+  UIP_IP_BUF->len[1] = UIP_ICMPH_LEN + UIP_ND6_DAR_LEN;
+  UIP_IP_BUF->proto = UIP_PROTO_ICMP6;
+  UIP_IP_BUF->ttl = UIP_ND6_MULTIHOP_HOPLIMIT;
+  uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, dest);
+  uip_ds6_select_src(&UIP_IP_BUF->srcipaddr, &UIP_IP_BUF->destipaddr);
+
+  UIP_ICMP_BUF->type = type;
+  UIP_ICMP_BUF->icode = 0;
+
+  UIP_ND6_DAR_BUF->status = status;
+  UIP_ND6_DAR_BUF->tid = tid;
+  UIP_ND6_DAR_BUF->lifetime = uip_htons(lifetime);
+  memcpy(UIP_ND6_DAR_BUF->rovr, rovr, sizeof(UIP_ND6_DAR_BUF->rovr));
+  uip_ipaddr_copy(&UIP_ND6_DAR_BUF->regipaddr, regaddr);
+
+  UIP_ICMP_BUF->icmpchksum = 0;
+  UIP_ICMP_BUF->icmpchksum = ~uip_icmp6chksum();
+
+  uip_len = UIP_IPH_LEN + UIP_ICMPH_LEN + UIP_ND6_DAR_LEN;
+
+  UIP_STAT(++uip_stat.nd6.sent);
+  PRINTF("Sending %s for ", type == ICMP6_DAR ? "DAR" : "DAC");
+  PRINT6ADDR(regaddr);
+  PRINTF(" to ");
+  PRINT6ADDR(dest);
+  PRINTF("\n");
+}
+/*------------------------------------------------------------------*/
+/**
+ * Address registration (RFC 6775, 6.5)
+ *
+ * A host registers an address with a NS whose source and target are that
+ * address, carrying a SLLAO and an ARO. Link-local addresses and, on the
+ * border router, global ones are checked locally. Other global addresses
+ * are confirmed by the border router first: we keep a tentative entry,
+ * send a DAR and answer the host once the DAC arrives.
+ *
+ * The NA goes to the link-local address derived from the SLLAO, so that
+ * it reaches the host even if the registration is refused.
+ */
+static void
+ns_aro_input(void)
+{
+  uip_ipaddr_t regaddr;
+  uip_ipaddr_t dest;
+  uip_lladdr_t lladdr;
+  uint8_t rovr[8];
+  uint16_t lifetime;
+  uint8_t tid;
+  uint8_t status;
+
+  if(nd6_opt_llao == NULL ||
+     uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr) ||
+     !uip_ipaddr_cmp(&UIP_IP_BUF->srcipaddr, &UIP_ND6_NS_BUF->tgtipaddr)) {
+    PRINTF("NS with ARO received is bad\n");
+    uip_len = 0;
+    return;
+  }
+  uip_ipaddr_copy(&regaddr, &UIP_IP_BUF->srcipaddr);
+  memcpy(&lladdr, &nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET], UIP_LLADDR_LEN);
+  memcpy(rovr, nd6_opt_aro->rovr, sizeof(rovr));
+  lifetime = uip_ntohs(nd6_opt_aro->lifetime);
+  tid = nd6_opt_aro->tid;
+
+  uip_create_linklocal_prefix(&dest);
+  uip_ds6_set_addr_iid(&dest, &lladdr);
+
+  nbr = uip_ds6_nbr_lookup(&regaddr);
+  if(nbr != NULL && nbr->regstate != NBR_REG_NONE &&
+     memcmp(uip_ds6_nbr_get_ll(nbr), &lladdr, UIP_LLADDR_LEN) != 0) {
+    /* Registered by another node */
+    status = UIP_ND6_ARO_STATUS_DUPLICATE;
+  } else if(lifetime == 0) {
+    /* Deregistration, the border router entry times out by itself */
+    if(nbr != NULL) {
+      uip_ds6_nbr_rm(nbr);
+    }
+    status = UIP_ND6_ARO_STATUS_SUCCESS;
+  } else if(!uip_is_addr_link_local(&regaddr) &&
+            uip_is_addr_unspecified(&nd6_6lbr)) {
+    /* No border router to check it with yet, the host tries again later */
+    status = UIP_ND6_ARO_STATUS_CACHE_FULL;
+  } else if(!uip_is_addr_link_local(&regaddr) && !nd6_is_6lbr()) {
+    if(nd6_reg_nbr(&regaddr, &lladdr, NBR_REG_TENTATIVE,
+                   UIP_ND6_TENTATIVE_NCE_LIFETIME) != NULL) {
+      nbr->regtid = tid;
+      dar_output(ICMP6_DAR, &nd6_6lbr, UIP_ND6_ARO_STATUS_SUCCESS, tid,
+                 lifetime, rovr, &regaddr);
+      return;
+    }
+    status = UIP_ND6_ARO_STATUS_CACHE_FULL;
+  } else {
+    status = UIP_ND6_ARO_STATUS_SUCCESS;
+    if(!uip_is_addr_link_local(&regaddr)) {
+      status = nd6_reg_check(&regaddr, rovr, lifetime);
+    }
+    if(status == UIP_ND6_ARO_STATUS_SUCCESS &&
+       nd6_reg_nbr(&regaddr, &lladdr, NBR_REG_REGISTERED,
+                   lifetime * 60UL) == NULL) {
+      status = UIP_ND6_ARO_STATUS_CACHE_FULL;
+    }
+  }
+  na_aro_output(&dest, &regaddr, status, lifetime, rovr, tid);
+}
+#endif /* UIP_ND6_6LOWPAN && UIP_CONF_ROUTER */
+
 /*------------------------------------------------------------------*/
 
 
@@ -171,6 +461,9 @@ ns_input(void)
 
   /* Options processing */
   nd6_opt_llao = NULL;
+#if UIP_ND6_6LOWPAN
+  nd6_opt_aro = NULL;
+#endif /* UIP_ND6_6LOWPAN */
   nd6_opt_offset = UIP_ND6_NS_LEN;
   while(uip_l3_icmp_hdr_len + nd6_opt_offset < uip_len) {
 #if UIP_CONF_IPV6_CHECKS
@@ -182,35 +475,16 @@ ns_input(void)
     switch (UIP_ND6_OPT_HDR_BUF->type) {
     case UIP_ND6_OPT_SLLAO:
       nd6_opt_llao = &uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset];
-#if UIP_CONF_IPV6_CHECKS
-      /* There must be NO option in a DAD NS */
-      if(uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr)) {
+      break;
+#if UIP_ND6_6LOWPAN && UIP_CONF_ROUTER
+    case UIP_ND6_OPT_ARO:
+      if(!nd6_opt_aro_valid()) {
         PRINTF("NS received is bad\n");
         goto discard;
-      } else {
-#endif /*UIP_CONF_IPV6_CHECKS */
-        nbr = uip_ds6_nbr_lookup(&UIP_IP_BUF->srcipaddr);
-        if(nbr == NULL) {
-          uip_ds6_nbr_add(&UIP_IP_BUF->srcipaddr,
-              (uip_lladdr_t *)&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
-              0, NBR_STALE);
-        } else {
-          uip_lladdr_t *lladdr = (uip_lladdr_t *)uip_ds6_nbr_get_ll(nbr);
-          if(memcmp(&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
-            lladdr, UIP_LLADDR_LEN) != 0) {
-            memcpy(lladdr, &nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
-           UIP_LLADDR_LEN);
-            nbr->state = NBR_STALE;
-          } else {
-            if(nbr->state == NBR_INCOMPLETE) {
-              nbr->state = NBR_STALE;
-            }
-          }
-        }
-#if UIP_CONF_IPV6_CHECKS
       }
-#endif /*UIP_CONF_IPV6_CHECKS */
+      nd6_opt_aro = (uip_nd6_opt_aro *)UIP_ND6_OPT_HDR_BUF;
       break;
+#endif /* UIP_ND6_6LOWPAN && UIP_CONF_ROUTER */
     default:
       PRINTF("ND option not supported in NS");
       break;
@@ -218,6 +492,44 @@ ns_input(void)
     nd6_opt_offset += (UIP_ND6_OPT_HDR_BUF->len << 3);
   }
 
+#if UIP_ND6_6LOWPAN && UIP_CONF_ROUTER
+  if(nd6_opt_aro != NULL) {
+    ns_aro_input();
+    return;
+  }
+#endif /* UIP_ND6_6LOWPAN && UIP_CONF_ROUTER */
+
+  if(nd6_opt_llao != NULL) {
+#if UIP_CONF_IPV6_CHECKS
+    /* There must be NO option in a DAD NS */
+    if(uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr)) {
+      PRINTF("NS received is bad\n");
+      goto discard;
+    } else {
+#endif /*UIP_CONF_IPV6_CHECKS */
+      nbr = uip_ds6_nbr_lookup(&UIP_IP_BUF->srcipaddr);
+      if(nbr == NULL) {
+        uip_ds6_nbr_add(&UIP_IP_BUF->srcipaddr,
+            (uip_lladdr_t *)&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
+            0, NBR_STALE);
+      } else {
+        uip_lladdr_t *lladdr = (uip_lladdr_t *)uip_ds6_nbr_get_ll(nbr);
+        if(memcmp(&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
+          lladdr, UIP_LLADDR_LEN) != 0) {
+          uip_ds6_nbr_set_ll(nbr,
+            (uip_lladdr_t *)&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET]);
+          nbr->state = NBR_STALE;
+        } else {
+          if(nbr->state == NBR_INCOMPLETE) {
+            nbr->state = NBR_STALE;
+          }
+        }
+      }
+#if UIP_CONF_IPV6_CHECKS
+    }
+#endif /*UIP_CONF_IPV6_CHECKS */
+  }
+
   addr = uip_ds6_addr_lookup(&UIP_ND6_NS_BUF->tgtipaddr);
   if(addr != NULL) {
 #if UIP_ND6_DEF_MAXDADNS > 0
@@ -392,6 +704,87 @@ uip_nd6_ns_output(uip_ipaddr_t * src, uip_ipaddr_t * dest, uip_ipaddr_t * tgt)
   PRINTF("\n");
   return;
 }
+#if UIP_ND6_6LOWPAN && !UIP_CONF_ROUTER
+/*------------------------------------------------------------------*/
+void
+uip_nd6_ns_aro_output(uip_ipaddr_t *tgt, uip_ipaddr_t *dest,
+                      uint16_t lifetime)
+{
+  uint8_t rovr[8];
+
+  uip_ext_len = 0;
+  UIP_IP_BUF->vtc = 0x60;
+  UIP_IP_BUF->tcflow = 0;
+  UIP_IP_BUF->flow = 0;
+  UIP_IP_BUF->proto = UIP_PROTO_ICMP6;
+  UIP_IP_BUF->ttl = UIP_ND6_HOP_LIMIT;
+  uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, dest);
+  uip_ipaddr_copy(&UIP_IP_BUF->srcipaddr, tgt);
+
+  UIP_ICMP_BUF->type = ICMP6_NS;
+  UIP_ICMP_BUF->icode = 0;
+  UIP_ND6_NS_BUF->reserved = 0;
+  uip_ipaddr_copy((uip_ipaddr_t *) &UIP_ND6_NS_BUF->tgtipaddr, tgt);
+
+  UIP_IP_BUF->len[0] = 0;       /* length will not be more than 255 */
+  UIP_IP_BUF->len[1] = UIP_ICMPH_LEN + UIP_ND6_NS_LEN +
+                       UIP_ND6_OPT_LLAO_LEN + UIP_ND6_OPT_ARO_LEN;
+
+  create_llao(&uip_buf[uip_l2_l3_icmp_hdr_len + UIP_ND6_NS_LEN],
+              UIP_ND6_OPT_SLLAO);
+
+  /* Our link-layer address identifies the owner of the registration */
+  create_rovr(rovr, &uip_lladdr);
+  create_aro(&uip_buf[uip_l2_l3_icmp_hdr_len + UIP_ND6_NS_LEN +
+                      UIP_ND6_OPT_LLAO_LEN],
+             UIP_ND6_ARO_STATUS_SUCCESS, lifetime, rovr, ++nd6_tid);
+
+  uip_len = UIP_IPH_LEN + UIP_ICMPH_LEN + UIP_ND6_NS_LEN +
+            UIP_ND6_OPT_LLAO_LEN + UIP_ND6_OPT_ARO_LEN;
+
+  UIP_ICMP_BUF->icmpchksum = 0;
+  UIP_ICMP_BUF->icmpchksum = ~uip_icmp6chksum();
+
+  UIP_STAT(++uip_stat.nd6.sent);
+  PRINTF("Sending NS with ARO to ");
+  PRINT6ADDR(&UIP_IP_BUF->destipaddr);
+  PRINTF(" for ");
+  PRINT6ADDR(tgt);
+  PRINTF("\n");
+}
+/*------------------------------------------------------------------*/
+/* Result of one of our registrations, addr points to the address */
+static void
+na_aro_input(void)
+{
+  uint16_t lifetime;
+
+  PRINTF("Registration of ");
+  PRINT6ADDR(&addr->ipaddr);
+  PRINTF(" returned status %u\n", nd6_opt_aro->status);
+
+  switch(nd6_opt_aro->status) {
+  case UIP_ND6_ARO_STATUS_SUCCESS:
+    lifetime = uip_ntohs(nd6_opt_aro->lifetime);
+    if(lifetime == 0) {
+      lifetime = UIP_ND6_REGISTRATION_LIFETIME;
+    }
+    /* Refresh well before the registration runs out */
+    addr->regcount = 0;
+    stimer_set(&addr->regtimer, lifetime * 45UL);
+    uip_ds6_addr_schedule(addr);
+    break;
+  case UIP_ND6_ARO_STATUS_DUPLICATE:
+    uip_ds6_addr_rm(addr);
+    break;
+  default:
+    addr->regcount = 0;
+    stimer_set(&addr->regtimer, UIP_ND6_RTR_SOLICITATION_INTERVAL);
+    uip_ds6_addr_schedule(addr);
+    break;
+  }
+}
+#endif /* UIP_ND6_6LOWPAN && !UIP_CONF_ROUTER */
 /*------------------------------------------------------------------*/
 /**
  * Neighbor Advertisement Processing
@@ -451,6 +844,9 @@ na_input(void)
   /* Options processing: we handle TLLAO, and must ignore others */
   nd6_opt_offset = UIP_ND6_NA_LEN;
   nd6_opt_llao = NULL;
+#if UIP_ND6_6LOWPAN
+  nd6_opt_aro = NULL;
+#endif /* UIP_ND6_6LOWPAN */
   while(uip_l3_icmp_hdr_len + nd6_opt_offset < uip_len) {
 #if UIP_CONF_IPV6_CHECKS
     if(UIP_ND6_OPT_HDR_BUF->len == 0) {
@@ -462,6 +858,15 @@ na_input(void)
     case UIP_ND6_OPT_TLLAO:
       nd6_opt_llao = (uint8_t *)UIP_ND6_OPT_HDR_BUF;
       break;
+#if UIP_ND6_6LOWPAN && !UIP_CONF_ROUTER
+    case UIP_ND6_OPT_ARO:
+      if(!nd6_opt_aro_valid()) {
+        PRINTF("NA received is bad\n");
+        goto discard;
+      }
+      nd6_opt_aro = (uip_nd6_opt_aro *)UIP_ND6_OPT_HDR_BUF;
+      break;
+#endif /* UIP_ND6_6LOWPAN && !UIP_CONF_ROUTER */
     default:
       PRINTF("ND option not supported in NA\n");
       break;
@@ -471,6 +876,15 @@ na_input(void)
   addr = uip_ds6_addr_lookup(&UIP_ND6_NA_BUF->tgtipaddr);
   /* Message processing, including TLLAO if any */
   if(addr != NULL) {
+#if UIP_ND6_6LOWPAN && !UIP_CONF_ROUTER
+    if(nd6_opt_aro != NULL) {
+      /* Only the router we registered with can answer */
+      if(uip_ipaddr_cmp(&UIP_IP_BUF->srcipaddr, &addr->regrouter)) {
+        na_aro_input();
+      }
+      goto discard;
+    }
+#endif /* UIP_ND6_6LOWPAN && !UIP_CONF_ROUTER */
 #if UIP_ND6_DEF_MAXDADNS > 0
     if(addr->state == ADDR_TENTATIVE) {
       uip_ds6_dad_failed(addr);
@@ -494,8 +908,8 @@ na_input(void)
       if(nd6_opt_llao == NULL) {
         goto discard;
       }
-      memcpy(lladdr, &nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
-         UIP_LLADDR_LEN);
+      uip_ds6_nbr_set_ll(nbr,
+              (uip_lladdr_t *)&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET]);
       if(is_solicited) {
         nbr->state = NBR_REACHABLE;
         nbr->nscount = 0;
@@ -517,8 +931,8 @@ na_input(void)
         if(is_override || (!is_override && nd6_opt_llao != 0 && !is_llchange)
            || nd6_opt_llao == 0) {
           if(nd6_opt_llao != 0) {
-            memcpy(lladdr, &nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
-           UIP_LLADDR_LEN);
+            uip_ds6_nbr_set_ll(nbr,
+              (uip_lladdr_t *)&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET]);
           }
           if(is_solicited) {
             nbr->state = NBR_REACHABLE;
@@ -539,6 +953,7 @@ na_input(void)
       }
       nbr->isrouter = is_router;
     }
+    uip_ds6_nbr_schedule(nbr);
   }
 #if UIP_CONF_IPV6_QUEUE_PKT
   /* The nbr is now reachable, check if we had buffered a pkt for it */
@@ -551,7 +966,7 @@ na_input(void)
   if(uip_packetqueue_buflen(&nbr->packethandle) != 0) {
     uip_len = uip_packetqueue_buflen(&nbr->packethandle);
     memcpy(UIP_IP_BUF, uip_packetqueue_buf(&nbr->packethandle), uip_len);
-    uip_packetqueue_free(&nbr->packethandle);
+    uip_packetqueue_pop(&nbr->packethandle);
     return;
   }
   
@@ -635,6 +1050,7 @@ rs_input(void)
           nbr->reachable = nbr_data.reachable;
           nbr->sendns = nbr_data.sendns;
           nbr->nscount = nbr_data.nscount;
+          uip_ds6_nbr_schedule(nbr);
         }
         nbr->isrouter = 0;
       }
@@ -745,6 +1161,20 @@ uip_nd6_ra_output(uip_ipaddr_t * dest)
     }
   #endif /* UIP_ND6_RA_RDNSS */
 
+#if UIP_ND6_RA_6CO
+  {
+    struct sicslowpan_addr_context *ctx = NULL;
+    while((ctx = sicslowpan_context_next(ctx)) != NULL) {
+      UIP_ND6_OPT_HDR_BUF->type = UIP_ND6_OPT_6CO;
+      UIP_ND6_OPT_HDR_BUF->len = UIP_ND6_OPT_6CO_LEN >> 3;
+      sicslowpan_context_6co_write((uint8_t *)UIP_ND6_OPT_HDR_BUF +
+                                   UIP_ND6_OPT_DATA_OFFSET, ctx);
+      uip_len += UIP_ND6_OPT_6CO_LEN;
+      nd6_opt_offset += UIP_ND6_OPT_6CO_LEN;
+    }
+  }
+#endif /* UIP_ND6_RA_6CO */
+
   UIP_IP_BUF->len[0] = ((uip_len - UIP_IPH_LEN) >> 8);
   UIP_IP_BUF->len[1] = ((uip_len - UIP_IPH_LEN) & 0xff);
 
@@ -870,8 +1300,8 @@ ra_input(void)
         }
         if(memcmp(&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
           lladdr, UIP_LLADDR_LEN) != 0) {
-          memcpy(lladdr, &nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET],
-         UIP_LLADDR_LEN);
+          uip_ds6_nbr_set_ll(nbr,
+              (uip_lladdr_t *)&nd6_opt_llao[UIP_ND6_OPT_DATA_OFFSET]);
           nbr->state = NBR_STALE;
         }
         nbr->isrouter = 1;
@@ -922,6 +1352,9 @@ ra_input(void)
               prefix->isinfinite = 0;
               break;
             }
+            if(prefix->isused) {
+              uip_ds6_prefix_schedule(prefix);
+            }
           }
         }
         /* End of on-link flag related processing */
@@ -955,6 +1388,7 @@ ra_input(void)
             } else {
               addr->isinfinite = 1;
             }
+            uip_ds6_addr_schedule(addr);
           } else {
             if(uip_ntohl(nd6_opt_prefix_info->validlt) ==
                UIP_ND6_INFINITE_LIFETIME) {
@@ -985,6 +1419,14 @@ ra_input(void)
             }
              break;
       #endif /* UIP_ND6_RA_RDNSS */
+#if UIP_ND6_RA_6CO
+    case UIP_ND6_OPT_6CO:
+      sicslowpan_context_6co_input((uint8_t *)UIP_ND6_OPT_HDR_BUF +
+                                   UIP_ND6_OPT_DATA_OFFSET,
+                                   (UIP_ND6_OPT_HDR_BUF->len << 3) -
+                                   UIP_ND6_OPT_DATA_OFFSET);
+      break;
+#endif /* UIP_ND6_RA_6CO */
     default:
       PRINTF("ND option not supported in RA");
       break;
@@ -1004,6 +1446,7 @@ ra_input(void)
     } else {
       stimer_set(&(defrt->lifetime),
                  (unsigned long)(uip_ntohs(UIP_ND6_RA_BUF->router_lifetime)));
+      uip_ds6_defrt_schedule(defrt);
     }
   } else {
     if(defrt != NULL) {
@@ -1023,7 +1466,7 @@ ra_input(void)
   if(nbr != NULL && uip_packetqueue_buflen(&nbr->packethandle) != 0) {
     uip_len = uip_packetqueue_buflen(&nbr->packethandle);
     memcpy(UIP_IP_BUF, uip_packetqueue_buf(&nbr->packethandle), uip_len);
-    uip_packetqueue_free(&nbr->packethandle);
+    uip_packetqueue_pop(&nbr->packethandle);
     return;
   }
 
@@ -1034,6 +1477,96 @@ discard:
   return;
 }
 #endif /* !UIP_CONF_ROUTER */
+#if UIP_ND6_6LOWPAN && UIP_CONF_ROUTER
+/*------------------------------------------------------------------*/
+/* Border router: check a registration relayed by a router */
+static void
+dar_input(void)
+{
+  uip_ipaddr_t src;
+
+  PRINTF("Received DAR from ");
+  PRINT6ADDR(&UIP_IP_BUF->srcipaddr);
+  PRINTF("\n");
+  UIP_STAT(++uip_stat.nd6.recv);
+
+  if(!nd6_is_6lbr() || UIP_ICMP_BUF->icode != 0 ||
+     uip_l3_icmp_hdr_len + UIP_ND6_DAR_LEN > uip_len) {
+    PRINTF("DAR received is bad\n");
+    uip_len = 0;
+    return;
+  }
+  uip_ipaddr_copy(&src, &UIP_IP_BUF->srcipaddr);
+  UIP_ND6_DAR_BUF->status = nd6_reg_check(&UIP_ND6_DAR_BUF->regipaddr,
+                                          UIP_ND6_DAR_BUF->rovr,
+                                          uip_ntohs(UIP_ND6_DAR_BUF->lifetime));
+  /* The DAC is the DAR with its status filled in */
+  dar_output(ICMP6_DAC, &src, UIP_ND6_DAR_BUF->status, UIP_ND6_DAR_BUF->tid,
+             uip_ntohs(UIP_ND6_DAR_BUF->lifetime), UIP_ND6_DAR_BUF->rovr,
+             &UIP_ND6_DAR_BUF->regipaddr);
+}
+/*------------------------------------------------------------------*/
+/* Router: the border router answered, complete the registration */
+static void
+dac_input(void)
+{
+  uip_ipaddr_t regaddr;
+  uip_ipaddr_t dest;
+  uint8_t rovr[8];
+  uint16_t lifetime;
+  uint8_t status;
+  uint8_t tid;
+
+  PRINTF("Received DAC from ");
+  PRINT6ADDR(&UIP_IP_BUF->srcipaddr);
+  PRINTF("\n");
+  UIP_STAT(++uip_stat.nd6.recv);
+
+  if(UIP_ICMP_BUF->icode != 0 ||
+     uip_l3_icmp_hdr_len + UIP_ND6_DAR_LEN > uip_len ||
+     uip_is_addr_unspecified(&nd6_6lbr) ||
+     !uip_ipaddr_cmp(&UIP_IP_BUF->srcipaddr, &nd6_6lbr)) {
+    PRINTF("DAC received is bad\n");
+    goto discard;
+  }
+  uip_ipaddr_copy(&regaddr, &UIP_ND6_DAR_BUF->regipaddr);
+  nbr = uip_ds6_nbr_lookup(&regaddr);
+  if(nbr == NULL || nbr->regstate != NBR_REG_TENTATIVE) {
+    goto discard;
+  }
+  /* It has to answer the DAR we sent for this very registration */
+  create_rovr(rovr, uip_ds6_nbr_get_ll(nbr));
+  if(UIP_ND6_DAR_BUF->tid != nbr->regtid ||
+     memcmp(UIP_ND6_DAR_BUF->rovr, rovr, sizeof(rovr)) != 0) {
+    PRINTF("DAC does not match the registration\n");
+    goto discard;
+  }
+  status = UIP_ND6_DAR_BUF->status;
+  tid = UIP_ND6_DAR_BUF->tid;
+  lifetime = uip_ntohs(UIP_ND6_DAR_BUF->lifetime);
+
+  uip_create_linklocal_prefix(&dest);
+  uip_ds6_set_addr_iid(&dest, (uip_lladdr_t *)uip_ds6_nbr_get_ll(nbr));
+  if(status == UIP_ND6_ARO_STATUS_SUCCESS) {
+    nbr->regstate = NBR_REG_REGISTERED;
+    stimer_set(&nbr->reglifetime, lifetime * 60UL);
+    uip_ds6_nbr_schedule(nbr);
+  } else {
+    uip_ds6_nbr_rm(nbr);
+  }
+  na_aro_output(&dest, &regaddr, status, lifetime, rovr, tid);
+  return;
+
+discard:
+  uip_len = 0;
+}
+/*------------------------------------------------------------------*/
+void
+uip_nd6_set_6lbr(const uip_ipaddr_t *addr)
+{
+  uip_ipaddr_copy(&nd6_6lbr, addr);
+}
+#endif /* UIP_ND6_6LOWPAN && UIP_CONF_ROUTER */
 /*------------------------------------------------------------------*/
 /* ICMPv6 input handlers */
 #if UIP_ND6_SEND_NA
@@ -1052,6 +1585,13 @@ UIP_ICMP6_HANDLER(rs_input_handler, ICMP6_RS, UIP_ICMP6_HANDLER_CODE_ANY,
 UIP_ICMP6_HANDLER(ra_input_handler, ICMP6_RA, UIP_ICMP6_HANDLER_CODE_ANY,
                   ra_input);
 #endif
+
+#if UIP_ND6_6LOWPAN && UIP_CONF_ROUTER
+UIP_ICMP6_HANDLER(dar_input_handler, ICMP6_DAR, UIP_ICMP6_HANDLER_CODE_ANY,
+                  dar_input);
+UIP_ICMP6_HANDLER(dac_input_handler, ICMP6_DAC, UIP_ICMP6_HANDLER_CODE_ANY,
+                  dac_input);
+#endif
 /*---------------------------------------------------------------------------*/
 void
 uip_nd6_init()
@@ -1079,6 +1619,12 @@ uip_nd6_init()
   /* Only process RAs if we are not a router */
   uip_icmp6_register_input_handler(&ra_input_handler);
 #endif
+
+#if UIP_ND6_6LOWPAN && UIP_CONF_ROUTER
+  /* Duplicate address detection through the border router */
+  uip_icmp6_register_input_handler(&dar_input_handler);
+  uip_icmp6_register_input_handler(&dac_input_handler);
+#endif
 }
 /*---------------------------------------------------------------------------*/
  /** @} */
@@ -1,6 +1,6 @@
 /**
  * \file
- *         A brief description the file
+ *         Per-neighbor queues of IPv6 packets awaiting address resolution.
  */
 #include <stdio.h>
 
@@ -10,8 +10,7 @@
 
 #include "uip-packetqueue.h"
 
-#define MAX_NUM_QUEUED_PACKETS 1
-MEMB(packets_memb, struct uip_packetqueue_packet, MAX_NUM_QUEUED_PACKETS);
+MEMB(packets_memb, struct uip_packetqueue_packet, UIP_PACKETQUEUE_NUM);
 
 #define DEBUG DEBUG_NONE
 #if DEBUG
@@ -21,15 +20,30 @@ MEMB(packets_memb, struct uip_packetqueue_packet, MAX_NUM_QUEUED_PACKETS);
 #define PRINTF(...)
 #endif
 
+/*---------------------------------------------------------------------------*/
+static void
+packet_unlink(struct uip_packetqueue_packet *p)
+{
+  struct uip_packetqueue_handle *h = p->handle;
+  struct uip_packetqueue_packet **pp;
+
+  for(pp = &h->packet; *pp != NULL; pp = &(*pp)->next) {
+    if(*pp == p) {
+      *pp = p->next;
+      h->count--;
+      break;
+    }
+  }
+  memb_free(&packets_memb, p);
+}
 /*---------------------------------------------------------------------------*/
 static void
 packet_timedout(void *ptr)
 {
-  struct uip_packetqueue_handle *h = ptr;
+  struct uip_packetqueue_packet *p = ptr;
 
-  PRINTF("uip_packetqueue_free timed out %p\n", h);
-  memb_free(&packets_memb, h->packet);
-  h->packet = NULL;
+  PRINTF("uip_packetqueue_free timed out %p\n", p->handle);
+  packet_unlink(p);
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -37,34 +51,52 @@ uip_packetqueue_new(struct uip_packetqueue_handle *handle)
 {
   PRINTF("uip_packetqueue_new %p\n", handle);
   handle->packet = NULL;
+  handle->count = 0;
 }
 /*---------------------------------------------------------------------------*/
 struct uip_packetqueue_packet *
 uip_packetqueue_alloc(struct uip_packetqueue_handle *handle, clock_time_t lifetime)
 {
+  struct uip_packetqueue_packet *p;
+  struct uip_packetqueue_packet **tail;
+
   PRINTF("uip_packetqueue_alloc %p\n", handle);
-  if(handle->packet != NULL) {
-    PRINTF("alloced\n");
-    return NULL;
+  if(handle->count >= UIP_PACKETQUEUE_PER_HANDLE) {
+    PRINTF("full, dropping oldest\n");
+    uip_packetqueue_pop(handle);
   }
-  handle->packet = memb_alloc(&packets_memb);
-  if(handle->packet != NULL) {
-    ctimer_set(&handle->packet->lifetimer, lifetime,
-               packet_timedout, handle);
-  } else {
+  p = memb_alloc(&packets_memb);
+  if(p == NULL) {
     PRINTF("uip_packetqueue_alloc failed\n");
+    return NULL;
+  }
+  p->next = NULL;
+  p->queue_buf_len = 0;
+  p->handle = handle;
+  for(tail = &handle->packet; *tail != NULL; tail = &(*tail)->next);
+  *tail = p;
+  handle->count++;
+  ctimer_set(&p->lifetimer, lifetime, packet_timedout, p);
+  return p;
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_packetqueue_pop(struct uip_packetqueue_handle *handle)
+{
+  struct uip_packetqueue_packet *p = handle->packet;
+
+  if(p != NULL) {
+    ctimer_stop(&p->lifetimer);
+    packet_unlink(p);
   }
-  return handle->packet;
 }
 /*---------------------------------------------------------------------------*/
 void
 uip_packetqueue_free(struct uip_packetqueue_handle *handle)
 {
   PRINTF("uip_packetqueue_free %p\n", handle);
-  if(handle->packet != NULL) {
-    ctimer_stop(&handle->packet->lifetimer);
-    memb_free(&packets_memb, handle->packet);
-    handle->packet = NULL;
+  while(handle->packet != NULL) {
+    uip_packetqueue_pop(handle);
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -41,23 +41,36 @@
 #include "emb6.h"
 
 extern uint16_t uip_slen;
+extern void *uip_sappdata;
 
 #include "uip-udp-packet.h"
 #if UIP_CONF_IPV6_MULTICAST
 #include "uip-mcast6.h"
 #endif
+#if UIP_CONF_IPV6_RPL
+#include "rpl.h"
+#endif
 
 /*---------------------------------------------------------------------------*/
 void
 uip_udp_packet_send(struct uip_udp_conn *c, const void *data, int len)
 {
 #if UIP_UDP
+  uint8_t room = 0;
+
   if(data != NULL) {
     uip_udp_conn = c;
+#if UIP_CONF_IPV6_RPL
+    /* Leave room for the RPL option so that inserting it does not move
+       the payload */
+    room = rpl_header_room(&c->ripaddr);
+#endif /* UIP_CONF_IPV6_RPL */
+    if(len > UIP_BUFSIZE - UIP_LLH_LEN - UIP_IPUDPH_LEN - room) {
+      len = UIP_BUFSIZE - UIP_LLH_LEN - UIP_IPUDPH_LEN - room;
+    }
     uip_slen = len;
-    memcpy(&uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN], data,
-           len > UIP_BUFSIZE - UIP_LLH_LEN - UIP_IPUDPH_LEN?
-           UIP_BUFSIZE - UIP_LLH_LEN - UIP_IPUDPH_LEN: len);
+    uip_sappdata = &uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN + room];
+    memcpy(uip_sappdata, data, len);
     uip_process(UIP_UDP_SEND_CONN);
 
     #if UIP_CONF_IPV6_MULTICAST
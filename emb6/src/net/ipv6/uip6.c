@@ -93,10 +93,21 @@
 #define DEBUG DEBUG_NONE
 #include "uip-debug.h"
 
+#if UIP_CONF_IPV6_REASSEMBLY
+#include "bsp.h"
+#include "clist.h"
+#include "memb.h"
+#include "mmem.h"
+#endif /* UIP_CONF_IPV6_REASSEMBLY */
+
 #if UIP_CONF_IPV6_RPL
 #include "rpl.h"
 #endif /* UIP_CONF_IPV6_RPL */
 
+#if UIP_UDP && UIP_UDP_CONNS_DYNAMIC
+#include <stdlib.h>
+#endif /* UIP_UDP && UIP_UDP_CONNS_DYNAMIC */
+
 #if UIP_LOGGING == 1
 #include <stdio.h>
 void uip_log(char *msg);
@@ -146,6 +157,13 @@ uint8_t uip_ext_bitmap = 0;
  * a header
  */
 uint8_t uip_ext_len = 0;
+/**
+ * \brief room left free after the IPv6 header of an outgoing packet for
+ * extension headers that are yet to be inserted
+ */
+uint8_t uip_ext_room = 0;
+/** Partial checksum of the received packet, set by the lower layer */
+uip_rx_chksum_t uip_rx_chksum;
 /** \brief length of the header options read */
 uint8_t uip_ext_opt_offset = 0;
 /** @} */
@@ -157,11 +175,12 @@ uint8_t uip_ext_opt_offset = 0;
  * \name Buffer defines
  *  @{
  */
-#define FBUF                             ((struct uip_tcpip_hdr *)&uip_reassbuf[0])
 #define UIP_IP_BUF                          ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
 #define UIP_ICMP_BUF                      ((struct uip_icmp_hdr *)&uip_buf[uip_l2_l3_hdr_len])
 #define UIP_UDP_BUF                        ((struct uip_udp_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN])
 #define UIP_TCP_BUF                        ((struct uip_tcp_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN])
+#define UIP_UDP_EXT_BUF                    ((struct uip_udp_hdr *)&uip_buf[uip_l2_l3_hdr_len])
+#define UIP_UDP_ROOM_BUF                   ((struct uip_udp_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN + uip_ext_room])
 #define UIP_EXT_BUF                        ((struct uip_ext_hdr *)&uip_buf[uip_l2_l3_hdr_len])
 #define UIP_ROUTING_BUF                ((struct uip_routing_hdr *)&uip_buf[uip_l2_l3_hdr_len])
 #define UIP_FRAG_BUF                      ((struct uip_frag_hdr *)&uip_buf[uip_l2_l3_hdr_len])
@@ -221,6 +240,12 @@ static uint8_t c;
 /* Keeps track of the last port used for a new connection. */
 static uint16_t lastport;
 #endif /* UIP_ACTIVE_OPEN || UIP_UDP */
+
+#if UIP_TCP || UIP_UDP
+/* Bucket of a port, given in either byte order, in the port hashes. */
+#define UIP_PORT_HASH(port) \
+  ((uint8_t)((port) ^ ((port) >> 8)) % UIP_PORT_HASH_SIZE)
+#endif /* UIP_TCP || UIP_UDP */
 /** @} */
 
 /*---------------------------------------------------------------------------*/
@@ -256,6 +281,11 @@ struct uip_conn uip_conns[UIP_CONNS];
 /* The uip_listenports list all currently listning ports. */
 uint16_t uip_listenports[UIP_LISTENPORTS];
 
+/* Listening ports hashed by port number. Chains hold indexes into
+   uip_listenports plus one, so that zero ends a chain. */
+static uint8_t listen_hash[UIP_PORT_HASH_SIZE];
+static uint8_t listen_next[UIP_LISTENPORTS];
+
 /* The iss variable is used for the TCP initial sequence number. */
 static uint8_t iss[4];
 
@@ -275,6 +305,12 @@ static uint16_t tmp16;
 #if UIP_UDP
 struct uip_udp_conn *uip_udp_conn;
 struct uip_udp_conn uip_udp_conns[UIP_UDP_CONNS];
+
+/* Connections bound to a local port, hashed by that port. */
+static struct uip_udp_conn *udp_hash[UIP_PORT_HASH_SIZE];
+
+/* Connections not in use, linked through hash_next. */
+static struct uip_udp_conn *udp_free;
 #endif /* UIP_UDP */
 /** @} */
 
@@ -323,40 +359,180 @@ uip_add32(uint8_t *op32, uint16_t op16)
 
 #endif /* UIP_ARCH_ADD32 && UIP_TCP */
 
-#if ! UIP_ARCH_CHKSUM
 /*---------------------------------------------------------------------------*/
+/*
+ * The one's complement sum is computed on native-endian words loaded
+ * from aligned addresses into an accumulator wider than the word, so
+ * that carries are only folded back once at the end (RFC 1071, 2.).
+ * Targets with 32-bit pointers load 32-bit words into a 64-bit
+ * accumulator, smaller targets 16-bit words into a 32-bit one.
+ */
+#if UINTPTR_MAX > 0xffff
+typedef uint64_t chksum_acc_t;
+typedef uint32_t chksum_word_t;
+#else
+typedef uint32_t chksum_acc_t;
+typedef uint16_t chksum_word_t;
+#endif
+
+/* Sum of one word at p, optionally copied to d */
+#define CHKSUM_WORD(type, d, p, i) do {              \
+    type w_ = ((const type *)(p))[i];               \
+    if((d) != NULL) {                               \
+      ((type *)(d))[i] = w_;                        \
+    }                                               \
+    acc += w_;                                      \
+  } while(0)
+
 static uint16_t
-chksum(uint16_t sum, const uint8_t *data, uint16_t len)
+chksum_copy(uint16_t sum, uint8_t *dst, const uint8_t *data, uint16_t len)
 {
-  uint16_t t;
-  const uint8_t *dataptr;
-  const uint8_t *last_byte;
+  chksum_acc_t acc = 0;
+  uint8_t swapped = 0;
+  uint16_t res;
 
-  dataptr = data;
-  last_byte = data + len - 1;
-  
-  while(dataptr < last_byte) {   /* At least two more bytes */
-    t = (dataptr[0] << 8) + dataptr[1];
-    sum += t;
-    if(sum < t) {
-      sum++;      /* carry */
+  if(len == 0) {
+    return sum;
+  }
+
+  /*
+   * Get the source aligned. A leading odd byte shifts all the following
+   * words by one byte, which byte-swaps their sum.
+   */
+  if((uintptr_t)data & 1) {
+    acc = UIP_HTONS(*data);
+    if(dst != NULL) {
+      *dst++ = *data;
     }
-    dataptr += 2;
+    data++;
+    len--;
+    swapped = 1;
   }
-  
-  if(dataptr == last_byte) {
-    t = (dataptr[0] << 8) + 0;
-    sum += t;
-    if(sum < t) {
-      sum++;      /* carry */
+  if((sizeof(chksum_word_t) > 2) && ((uintptr_t)data & 2) && len >= 2) {
+    if(dst != NULL && ((uintptr_t)dst & 1)) {
+      memcpy(dst, data, 2);
+      acc += *(const uint16_t *)data;
+      dst += 2;
+    } else {
+      CHKSUM_WORD(uint16_t, dst, data, 0);
+      if(dst != NULL) {
+        dst += 2;
+      }
     }
+    data += 2;
+    len -= 2;
   }
 
-  /* Return sum in host byte order. */
+  if(dst == NULL || ((uintptr_t)dst & (sizeof(chksum_word_t) - 1)) == 0) {
+    /* Unrolled main loop, the destination (if any) is aligned too */
+    while(len >= 4 * sizeof(chksum_word_t)) {
+      CHKSUM_WORD(chksum_word_t, dst, data, 0);
+      CHKSUM_WORD(chksum_word_t, dst, data, 1);
+      CHKSUM_WORD(chksum_word_t, dst, data, 2);
+      CHKSUM_WORD(chksum_word_t, dst, data, 3);
+      if(dst != NULL) {
+        dst += 4 * sizeof(chksum_word_t);
+      }
+      data += 4 * sizeof(chksum_word_t);
+      len -= 4 * sizeof(chksum_word_t);
+    }
+    while(len >= sizeof(chksum_word_t)) {
+      CHKSUM_WORD(chksum_word_t, dst, data, 0);
+      if(dst != NULL) {
+        dst += sizeof(chksum_word_t);
+      }
+      data += sizeof(chksum_word_t);
+      len -= sizeof(chksum_word_t);
+    }
+  } else {
+    /* Misaligned destination: plain copy, then sum the aligned source */
+    memcpy(dst, data, len & ~(sizeof(chksum_word_t) - 1));
+    dst += len & ~(sizeof(chksum_word_t) - 1);
+    while(len >= sizeof(chksum_word_t)) {
+      CHKSUM_WORD(chksum_word_t, NULL, data, 0);
+      data += sizeof(chksum_word_t);
+      len -= sizeof(chksum_word_t);
+    }
+  }
+
+  if(len >= 2) {
+    acc += *(const uint16_t *)data;
+    if(dst != NULL) {
+      memcpy(dst, data, 2);
+      dst += 2;
+    }
+    data += 2;
+    len -= 2;
+  }
+  if(len == 1) {
+    /* A trailing byte is padded with zero */
+    acc += UIP_HTONS((uint16_t)*data << 8);
+    if(dst != NULL) {
+      *dst = *data;
+    }
+  }
+
+  /* Fold the carries back in */
+  while(acc >> 16) {
+    acc = (acc & 0xffff) + (acc >> 16);
+  }
+  res = uip_ntohs((uint16_t)acc);
+  if(swapped) {
+    res = (res << 8) | (res >> 8);
+  }
+
+  return uip_chksum_add(sum, res);
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_chksum_add(uint16_t sum, uint16_t val)
+{
+  sum += val;
+  if(sum < val) {
+    sum++;      /* carry */
+  }
   return sum;
 }
 /*---------------------------------------------------------------------------*/
 uint16_t
+uip_chksum_copy(uint8_t *dst, const uint8_t *src, uint16_t len, uint16_t sum)
+{
+  return chksum_copy(sum, dst, src, len);
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_chksum_update16(uint16_t chksum, uint16_t old_val, uint16_t new_val)
+{
+  /* RFC 1624, eqn. 3: HC' = ~(~HC + ~m + m') */
+  uint16_t sum;
+
+  sum = uip_chksum_add((uint16_t)~chksum, (uint16_t)~old_val);
+  sum = uip_chksum_add(sum, new_val);
+  return (uint16_t)~sum;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_chksum_update(uint16_t chksum, const uint8_t *old_data,
+                  const uint8_t *new_data, uint16_t len)
+{
+  uint16_t sum;
+
+  sum = uip_chksum_add((uint16_t)~chksum,
+                       (uint16_t)~chksum_copy(0, NULL, old_data, len));
+  sum = chksum_copy(sum, NULL, new_data, len);
+  return (uint16_t)~sum;
+}
+/*---------------------------------------------------------------------------*/
+#if ! UIP_ARCH_CHKSUM
+/*---------------------------------------------------------------------------*/
+static uint16_t
+chksum(uint16_t sum, const uint8_t *data, uint16_t len)
+{
+  /* Return sum in host byte order. */
+  return chksum_copy(sum, NULL, data, len);
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
 uip_chksum(uint16_t *data, uint16_t len)
 {
   return uip_htons(chksum(0, (uint8_t *)data, len));
@@ -375,7 +551,7 @@ uip_ipchksum(void)
 #endif
 /*---------------------------------------------------------------------------*/
 static uint16_t
-upper_layer_chksum(uint8_t proto)
+upper_layer_chksum(uint8_t proto, uint8_t rx)
 {
 /* gcc 4.4.0 - 4.6.1 (maybe 4.3...) with -Os on 8 bit CPUS incorrectly compiles:
  * int bar (int);
@@ -388,6 +564,13 @@ upper_layer_chksum(uint8_t proto)
  */
   volatile uint16_t upper_layer_len;
   uint16_t sum;
+  uint16_t start;
+
+  if(rx && uip_rx_chksum.state == UIP_RX_CHKSUM_VERIFIED) {
+    /* Checked by the driver already */
+    uip_rx_chksum.state = UIP_RX_CHKSUM_NONE;
+    return 0xffff;
+  }
   
   upper_layer_len = (((uint16_t)(UIP_IP_BUF->len[0]) << 8) + UIP_IP_BUF->len[1] - uip_ext_len);
   
@@ -401,8 +584,21 @@ upper_layer_chksum(uint8_t proto)
   sum = chksum(sum, (uint8_t *)&UIP_IP_BUF->srcipaddr, 2 * sizeof(uip_ipaddr_t));
 
   /* Sum TCP header and data. */
-  sum = chksum(sum, &uip_buf[UIP_IPH_LEN + UIP_LLH_LEN + uip_ext_len],
-               upper_layer_len);
+  start = UIP_IPH_LEN + uip_ext_len;
+  if(rx && uip_rx_chksum.state == UIP_RX_CHKSUM_PARTIAL &&
+     uip_rx_chksum.offset >= start &&
+     uip_rx_chksum.end == start + upper_layer_len) {
+    /* Reuse the sum the lower layer computed while copying the payload,
+       headers are at even offsets so no byte swap is needed. */
+    sum = chksum(sum, &uip_buf[UIP_LLH_LEN + start],
+                 uip_rx_chksum.offset - start);
+    sum = uip_chksum_add(sum, uip_rx_chksum.sum);
+  } else {
+    sum = chksum(sum, &uip_buf[UIP_LLH_LEN + start], upper_layer_len);
+  }
+  if(rx) {
+    uip_rx_chksum.state = UIP_RX_CHKSUM_NONE;
+  }
     
   return (sum == 0) ? 0xffff : uip_htons(sum);
 }
@@ -410,7 +606,7 @@ upper_layer_chksum(uint8_t proto)
 uint16_t
 uip_icmp6chksum(void)
 {
-  return upper_layer_chksum(UIP_PROTO_ICMP6);
+  return upper_layer_chksum(UIP_PROTO_ICMP6, 0);
   
 }
 /*---------------------------------------------------------------------------*/
@@ -418,7 +614,7 @@ uip_icmp6chksum(void)
 uint16_t
 uip_tcpchksum(void)
 {
-  return upper_layer_chksum(UIP_PROTO_TCP);
+  return upper_layer_chksum(UIP_PROTO_TCP, 0);
 }
 #endif /* UIP_TCP */
 /*---------------------------------------------------------------------------*/
@@ -426,22 +622,38 @@ uip_tcpchksum(void)
 uint16_t
 uip_udpchksum(void)
 {
-  return upper_layer_chksum(UIP_PROTO_UDP);
+  return upper_layer_chksum(UIP_PROTO_UDP, 0);
 }
 #endif /* UIP_UDP && UIP_UDP_CHECKSUMS */
+/* Checksums verified on input, which may use uip_rx_chksum */
+#define UIP_RX_ICMP6CHKSUM()  upper_layer_chksum(UIP_PROTO_ICMP6, 1)
+#define UIP_RX_TCPCHKSUM()    upper_layer_chksum(UIP_PROTO_TCP, 1)
+#define UIP_RX_UDPCHKSUM()    upper_layer_chksum(UIP_PROTO_UDP, 1)
+#else /* UIP_ARCH_CHKSUM */
+#define UIP_RX_ICMP6CHKSUM()  uip_icmp6chksum()
+#define UIP_RX_TCPCHKSUM()    uip_tcpchksum()
+#define UIP_RX_UDPCHKSUM()    uip_udpchksum()
 #endif /* UIP_ARCH_CHKSUM */
 /*---------------------------------------------------------------------------*/
+#if UIP_CONF_IPV6_REASSEMBLY
+static void uip_reass_init(void);
+#endif /* UIP_CONF_IPV6_REASSEMBLY */
+
 void
 uip_init(void)
 {
   uip_ds6_init();
   uip_icmp6_init();
   uip_nd6_init();
+#if UIP_CONF_IPV6_REASSEMBLY
+  uip_reass_init();
+#endif /* UIP_CONF_IPV6_REASSEMBLY */
 
 #if UIP_TCP
   for(c = 0; c < UIP_LISTENPORTS; ++c) {
     uip_listenports[c] = 0;
   }
+  memset(listen_hash, 0, sizeof(listen_hash));
   for(c = 0; c < UIP_CONNS; ++c) {
     uip_conns[c].tcpstateflags = UIP_CLOSED;
   }
@@ -452,8 +664,13 @@ uip_init(void)
 #endif /* UIP_ACTIVE_OPEN || UIP_UDP */
 
 #if UIP_UDP
-  for(c = 0; c < UIP_UDP_CONNS; ++c) {
-    uip_udp_conns[c].lport = 0;
+  memset(udp_hash, 0, sizeof(udp_hash));
+  udp_free = NULL;
+  for(c = UIP_UDP_CONNS; c > 0; --c) {
+    uip_udp_conns[c - 1].lport = 0;
+    uip_udp_conns[c - 1].used = 0;
+    uip_udp_conns[c - 1].hash_next = udp_free;
+    udp_free = &uip_udp_conns[c - 1];
   }
 #endif /* UIP_UDP */
 
@@ -559,38 +776,161 @@ remove_ext_hdr(void)
 }
 /*---------------------------------------------------------------------------*/
 #if UIP_UDP
-struct uip_udp_conn *
-uip_udp_new(const uip_ipaddr_t *ripaddr, uint16_t rport)
+/* Cut the extension headers of a UDP datagram by moving the UDP header
+   in front of them. The payload stays where it is and uip_appdata points
+   to it. Returns 0 if the datagram is malformed. */
+static int
+udp_cut_ext_hdr(void)
 {
-  register struct uip_udp_conn *conn;
-  
-  /* Find an unused local port. */
- again:
-  ++lastport;
+  uint16_t len;
 
-  if(lastport >= 32000) {
-    lastport = 4096;
+  if(uip_len < UIP_IPH_LEN + uip_ext_len + UIP_UDPH_LEN) {
+    PRINTF("ERROR: uip_len too short compared to ext len\n\r");
+    return 0;
   }
-  
-  for(c = 0; c < UIP_UDP_CONNS; ++c) {
-    if(uip_udp_conns[c].lport == uip_htons(lastport)) {
-      goto again;
+  len = uip_len - UIP_IPH_LEN - uip_ext_len;
+  uip_appdata = &uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN + uip_ext_len];
+
+  if(uip_ext_len > 0) {
+    PRINTF("Cutting ext-header before processing (extlen: %d, uiplen: %d)\n\r",
+       uip_ext_len, uip_len);
+    memmove(UIP_UDP_BUF, UIP_UDP_EXT_BUF, UIP_UDPH_LEN);
+    UIP_IP_BUF->proto = UIP_PROTO_UDP;
+    UIP_IP_BUF->len[0] = len >> 8;
+    UIP_IP_BUF->len[1] = len & 0xff;
+    uip_ext_len = 0;
+  }
+  uip_len = len - UIP_UDPH_LEN;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+udp_hash_unlink(struct uip_udp_conn *conn)
+{
+  struct uip_udp_conn **pp;
+
+  if(conn->lport != 0) {
+    for(pp = &udp_hash[UIP_PORT_HASH(conn->lport)];
+        *pp != NULL;
+        pp = &(*pp)->hash_next) {
+      if(*pp == conn) {
+        *pp = conn->hash_next;
+        break;
+      }
     }
   }
+  conn->lport = 0;
+  conn->hash_next = NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+udp_hash_link(struct uip_udp_conn *conn, uint16_t port)
+{
+  uint8_t h;
 
-  conn = 0;
-  for(c = 0; c < UIP_UDP_CONNS; ++c) {
-    if(uip_udp_conns[c].lport == 0) {
-      conn = &uip_udp_conns[c];
-      break;
+  conn->lport = port;
+  if(port != 0) {
+    h = UIP_PORT_HASH(port);
+    conn->hash_next = udp_hash[h];
+    udp_hash[h] = conn;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+udp_port_used(uint16_t port)
+{
+  struct uip_udp_conn *conn;
+
+  for(conn = udp_hash[UIP_PORT_HASH(port)];
+      conn != NULL;
+      conn = conn->hash_next) {
+    if(conn->lport == port) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Find the connection an incoming datagram in uip_buf is for. Only the
+ * connections bound to its destination port are looked at. A
+ * connection bound to the remote port and address of the datagram is
+ * preferred over one leaving either of them unspecified.
+ */
+static struct uip_udp_conn *
+udp_conn_lookup(void)
+{
+  struct uip_udp_conn *conn;
+  struct uip_udp_conn *best;
+  uint8_t score;
+  uint8_t best_score;
+
+  best = NULL;
+  best_score = 0;
+  for(conn = udp_hash[UIP_PORT_HASH(UIP_UDP_BUF->destport)];
+      conn != NULL;
+      conn = conn->hash_next) {
+    if(conn->lport != UIP_UDP_BUF->destport) {
+      continue;
+    }
+    score = 1;
+    if(conn->rport != 0) {
+      if(UIP_UDP_BUF->srcport != conn->rport) {
+        continue;
+      }
+      score++;
+    }
+    if(!uip_is_addr_unspecified(&conn->ripaddr)) {
+      if(!uip_ipaddr_cmp(&UIP_IP_BUF->srcipaddr, &conn->ripaddr)) {
+        continue;
+      }
+      score++;
+    }
+    if(score == 3) {
+      return conn;
+    }
+    if(score > best_score) {
+      best = conn;
+      best_score = score;
     }
   }
+  return best;
+}
+/*---------------------------------------------------------------------------*/
+struct uip_udp_conn *
+uip_udp_new(const uip_ipaddr_t *ripaddr, uint16_t rport)
+{
+  register struct uip_udp_conn *conn;
+
+  conn = udp_free;
+  if(conn != NULL) {
+    udp_free = conn->hash_next;
+  }
+#if UIP_UDP_CONNS_DYNAMIC
+  else {
+    conn = malloc(sizeof(struct uip_udp_conn));
+    if(conn != NULL) {
+      memset(conn, 0, sizeof(struct uip_udp_conn));
+    }
+  }
+#endif /* UIP_UDP_CONNS_DYNAMIC */
 
   if(conn == 0) {
     return 0;
   }
-  
-  conn->lport = UIP_HTONS(lastport);
+
+  /* Find an unused local port. Only the hash bucket of each candidate
+     has to be checked. */
+  do {
+    ++lastport;
+    if(lastport >= 32000) {
+      lastport = 4096;
+    }
+  } while(udp_port_used(UIP_HTONS(lastport)));
+
+  conn->used = 1;
+  conn->hash_next = NULL;
+  udp_hash_link(conn, UIP_HTONS(lastport));
   conn->rport = rport;
   if(ripaddr == NULL) {
     memset(&conn->ripaddr, 0, sizeof(uip_ipaddr_t));
@@ -601,14 +941,41 @@ uip_udp_new(const uip_ipaddr_t *ripaddr, uint16_t rport)
   
   return conn;
 }
+/*---------------------------------------------------------------------------*/
+void
+uip_udp_remove(struct uip_udp_conn *conn)
+{
+  if(conn == NULL || !conn->used) {
+    return;
+  }
+  udp_hash_unlink(conn);
+  conn->used = 0;
+  conn->hash_next = udp_free;
+  udp_free = conn;
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_udp_bind(struct uip_udp_conn *conn, uint16_t port)
+{
+  if(conn == NULL || !conn->used) {
+    return;
+  }
+  udp_hash_unlink(conn);
+  udp_hash_link(conn, port);
+}
 #endif /* UIP_UDP */
 /*---------------------------------------------------------------------------*/
 #if UIP_TCP
 void
 uip_unlisten(uint16_t port)
 {
-  for(c = 0; c < UIP_LISTENPORTS; ++c) {
+  uint8_t *pc;
+
+  for(pc = &listen_hash[UIP_PORT_HASH(port)]; *pc != 0;
+      pc = &listen_next[*pc - 1]) {
+    c = *pc - 1;
     if(uip_listenports[c] == port) {
+      *pc = listen_next[c];
       uip_listenports[c] = 0;
       return;
     }
@@ -618,9 +985,14 @@ uip_unlisten(uint16_t port)
 void
 uip_listen(uint16_t port)
 {
+  uint8_t h;
+
   for(c = 0; c < UIP_LISTENPORTS; ++c) {
     if(uip_listenports[c] == 0) {
       uip_listenports[c] = port;
+      h = UIP_PORT_HASH(port);
+      listen_next[c] = listen_hash[h];
+      listen_hash[h] = c + 1;
       return;
     }
   }
@@ -629,23 +1001,6 @@ uip_listen(uint16_t port)
 /*---------------------------------------------------------------------------*/
 
 #if UIP_CONF_IPV6_REASSEMBLY
-#define UIP_REASS_BUFSIZE (UIP_BUFSIZE - UIP_LLH_LEN)
-
-static uint8_t uip_reassbuf[UIP_REASS_BUFSIZE];
-
-static uint8_t uip_reassbitmap[UIP_REASS_BUFSIZE / (8 * 8)];
-/*the first byte of an IP fragment is aligned on an 8-byte boundary */
-
-static const uint8_t bitmap_bits[8] = {0xff, 0x7f, 0x3f, 0x1f,
-                                    0x0f, 0x07, 0x03, 0x01};
-static uint16_t uip_reasslen;
-static uint8_t uip_reassflags;
-
-#define UIP_REASS_FLAG_LASTFRAG 0x01
-#define UIP_REASS_FLAG_FIRSTFRAG 0x02
-#define UIP_REASS_FLAG_ERROR_MSG 0x04
-
-
 /*
  * See RFC 2460 for a description of fragmentation in IPv6
  * A typical Ipv6 fragment
@@ -653,172 +1008,335 @@ static uint8_t uip_reassflags;
  *  |  Unfragmentable  |Fragment|    first     |
  *  |       Part       | Header |   fragment   |
  *  +------------------+--------+--------------+
+ *
+ * Several datagrams can be reassembled at the same time. Each one has its
+ * own context, identified by (source, destination, identification). The
+ * unfragmentable part and the fragment payloads are kept in blocks of the
+ * managed memory pool (mmem), so a context only uses as much memory as it
+ * has received so far. Fragments are kept in a list sorted by offset.
  */
+#define UIP_REASS_BUFSIZE (UIP_BUFSIZE - UIP_LLH_LEN)
 
+#define UIP_REASS_FLAG_LASTFRAG 0x01
+#define UIP_REASS_FLAG_FIRSTFRAG 0x02
+#define UIP_REASS_FLAG_ERROR_MSG 0x04
 
-struct etimer uip_reass_timer; /* timer for reassembly */
-uint8_t uip_reass_on; /* equal to 1 if we are currently reassembling a packet */
+/** A fragment payload stored in a reassembly context */
+struct uip_reass_frag {
+  struct uip_reass_frag *next;
+  uint16_t offset;
+  uint16_t len;
+  struct mmem data;
+};
+
+/** A datagram being reassembled */
+struct uip_reass_ctx {
+  struct uip_reass_ctx *next;
+  uip_ipaddr_t srcipaddr;
+  uip_ipaddr_t destipaddr;
+  uint32_t id;
+  LIST_STRUCT(frags);
+  struct mmem hdr;      /* unfragmentable part */
+  uint16_t hdrlen;
+  uint16_t reasslen;    /* payload length, known once the last fragment came */
+  uint16_t rcvdlen;     /* payload bytes received so far */
+  uint8_t flags;
+  struct timer expire;
+};
+
+MEMB(reass_ctx_memb, struct uip_reass_ctx, UIP_REASS_CONTEXTS);
+MEMB(reass_frag_memb, struct uip_reass_frag, UIP_REASS_FRAGMENTS);
+LIST(reass_ctx_list);
+
+struct etimer uip_reass_timer; /* fires at the earliest context deadline */
+uint8_t uip_reass_on; /* number of datagrams currently being reassembled */
+
+/* Flags of the last call to uip_reass(), checked by uip_process() */
+static uint8_t uip_reassflags;
 
-static uint32_t uip_id; /* For every packet that is to be fragmented, the source
-                        node generates an Identification value that is present
-                        in all the fragments */
 #define IP_MF   0x0001
 
+/*---------------------------------------------------------------------------*/
+static void
+reass_timer_update(void)
+{
+  struct uip_reass_ctx *ctx;
+  clock_time_t next;
+  clock_time_t rem;
+
+  ctx = list_head(reass_ctx_list);
+  if(ctx == NULL) {
+    etimer_stop(&uip_reass_timer);
+    return;
+  }
+  next = timer_remaining(&ctx->expire);
+  for(; ctx != NULL; ctx = list_item_next(ctx)) {
+    rem = timer_expired(&ctx->expire) ? 0 : timer_remaining(&ctx->expire);
+    if(rem < next) {
+      next = rem;
+    }
+  }
+  etimer_set(&uip_reass_timer, next, (pfn_callback_t) tcpip_gethandler());
+}
+/*---------------------------------------------------------------------------*/
+static void
+reass_ctx_free(struct uip_reass_ctx *ctx)
+{
+  struct uip_reass_frag *frag;
+
+  while((frag = list_pop(ctx->frags)) != NULL) {
+    mmem_free(&frag->data);
+    memb_free(&reass_frag_memb, frag);
+  }
+  if(ctx->hdrlen > 0) {
+    mmem_free(&ctx->hdr);
+  }
+  list_remove(reass_ctx_list, ctx);
+  memb_free(&reass_ctx_memb, ctx);
+  uip_reass_on--;
+  reass_timer_update();
+}
+/*---------------------------------------------------------------------------*/
+static struct uip_reass_ctx *
+reass_ctx_lookup(void)
+{
+  struct uip_reass_ctx *ctx;
+
+  for(ctx = list_head(reass_ctx_list); ctx != NULL; ctx = list_item_next(ctx)) {
+    if(ctx->id == UIP_FRAG_BUF->id &&
+       uip_ipaddr_cmp(&ctx->srcipaddr, &UIP_IP_BUF->srcipaddr) &&
+       uip_ipaddr_cmp(&ctx->destipaddr, &UIP_IP_BUF->destipaddr)) {
+      return ctx;
+    }
+  }
+
+  ctx = memb_alloc(&reass_ctx_memb);
+  if(ctx == NULL) {
+    PRINTF("No free reassembly context\n\r");
+    return NULL;
+  }
+  PRINTF("Starting reassembly\n\r");
+  memset(ctx, 0, sizeof(*ctx));
+  LIST_STRUCT_INIT(ctx, frags);
+  uip_ipaddr_copy(&ctx->srcipaddr, &UIP_IP_BUF->srcipaddr);
+  uip_ipaddr_copy(&ctx->destipaddr, &UIP_IP_BUF->destipaddr);
+  ctx->id = UIP_FRAG_BUF->id;
+  timer_set(&ctx->expire, UIP_REASS_MAXAGE * bsp_get(E_BSP_GET_TRES));
+  list_add(reass_ctx_list, ctx);
+  uip_reass_on++;
+  reass_timer_update();
+  return ctx;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+reass_ctx_set_hdr(struct uip_reass_ctx *ctx)
+{
+  uint16_t hdrlen = UIP_IPH_LEN + uip_ext_len;
+
+  if(ctx->hdrlen != hdrlen) {
+    if(ctx->hdrlen > 0) {
+      mmem_free(&ctx->hdr);
+      ctx->hdrlen = 0;
+    }
+    if(mmem_alloc(&ctx->hdr, hdrlen) == 0) {
+      return 0;
+    }
+    ctx->hdrlen = hdrlen;
+  }
+  memcpy(MMEM_PTR(&ctx->hdr), UIP_IP_BUF, hdrlen);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
 static uint16_t
 uip_reass(void)
 {
-  uint16_t offset=0;
+  struct uip_reass_ctx *ctx;
+  struct uip_reass_frag *frag;
+  struct uip_reass_frag *prev;
+  struct uip_reass_frag *f;
+  uint16_t offset;
   uint16_t len;
-  uint16_t i;
-  
-  /* If ip_reasstmr is zero, no packet is present in the buffer */
-  /* We first write the unfragmentable part of IP header into the reassembly
-     buffer. The reset the other reassembly variables. */
-  if(uip_reass_on == 0) {
-    PRINTF("Starting reassembly\n\r");
-    memcpy(FBUF, UIP_IP_BUF, uip_ext_len + UIP_IPH_LEN);
-    /* temporary in case we do not receive the fragment with offset 0 first */
-    etimer_set(&uip_reass_timer, UIP_REASS_MAXAGE*bsp_get(E_BSP_GET_TRES));
-    uip_reass_on = 1;
-    uip_reassflags = 0;
-    uip_id = UIP_FRAG_BUF->id;
-    /* Clear the bitmap. */
-    memset(uip_reassbitmap, 0, sizeof(uip_reassbitmap));
+  uint16_t end;
+  uint16_t reasslen;
+  uint8_t *ptr;
+
+  uip_reassflags = 0;
+
+  ctx = reass_ctx_lookup();
+  if(ctx == NULL) {
+    UIP_STAT(++uip_stat.ip.fragerr);
+    return 0;
   }
-  /*
-   * Check if the incoming fragment matches the one currently present
-   * in the reasembly buffer. If so, we proceed with copying the fragment
-   * into the buffer.
-   */
-  if(uip_ipaddr_cmp(&FBUF->srcipaddr, &UIP_IP_BUF->srcipaddr) &&
-     uip_ipaddr_cmp(&FBUF->destipaddr, &UIP_IP_BUF->destipaddr) &&
-     UIP_FRAG_BUF->id == uip_id) {
-    len = uip_len - uip_ext_len - UIP_IPH_LEN - UIP_FRAGH_LEN;
-    offset = (uip_ntohs(UIP_FRAG_BUF->offsetresmore) & 0xfff8);
-    /* in byte, originaly in multiple of 8 bytes*/
-    PRINTF("len %d\n\r", len);
-    PRINTF("offset %d\n\r", offset);
-    if(offset == 0){
-      uip_reassflags |= UIP_REASS_FLAG_FIRSTFRAG;
-      /*
-       * The Next Header field of the last header of the Unfragmentable
-       * Part is obtained from the Next Header field of the first
-       * fragment's Fragment header.
-       */
-      *uip_next_hdr = UIP_FRAG_BUF->next;
-      memcpy(FBUF, UIP_IP_BUF, uip_ext_len + UIP_IPH_LEN);
-      PRINTF("src ");
-      PRINT6ADDR(&FBUF->srcipaddr);
-      PRINTF("dest ");
-      PRINT6ADDR(&FBUF->destipaddr);
-      PRINTF("next %d\n\r", UIP_IP_BUF->proto);
-      
+
+  len = uip_len - uip_ext_len - UIP_IPH_LEN - UIP_FRAGH_LEN;
+  offset = (uip_ntohs(UIP_FRAG_BUF->offsetresmore) & 0xfff8);
+  /* in byte, originaly in multiple of 8 bytes*/
+  PRINTF("len %d\n\r", len);
+  PRINTF("offset %d\n\r", offset);
+
+  /* If the offset or the offset + fragment length overflows the
+     reassembly buffer, we discard the entire packet. */
+  if(offset > UIP_REASS_BUFSIZE ||
+     offset + len + UIP_IPH_LEN + uip_ext_len > UIP_REASS_BUFSIZE) {
+    goto discard;
+  }
+
+  /* If this fragment has the More Fragments flag set to zero, it is the
+     last fragment*/
+  if((uip_ntohs(UIP_FRAG_BUF->offsetresmore) & IP_MF) == 0) {
+    if((ctx->flags & UIP_REASS_FLAG_LASTFRAG) &&
+       ctx->reasslen != offset + len) {
+      goto discard;
     }
-    
-    /* If the offset or the offset + fragment length overflows the
-       reassembly buffer, we discard the entire packet. */
-    if(offset > UIP_REASS_BUFSIZE ||
-       offset + len > UIP_REASS_BUFSIZE) {
-      uip_reass_on = 0;
-      etimer_stop(&uip_reass_timer);
+    ctx->flags |= UIP_REASS_FLAG_LASTFRAG;
+    /*calculate the size of the entire packet*/
+    ctx->reasslen = offset + len;
+    PRINTF("LAST FRAGMENT reasslen %d\n\r", ctx->reasslen);
+  } else {
+    /* If len is not a multiple of 8 octets and the M flag of that fragment
+       is 1, then that fragment must be discarded and an ICMP Parameter
+       Problem, Code 0, message should be sent to the source of the fragment,
+       pointing to the Payload Length field of the fragment packet. */
+    if(len % 8 != 0) {
+      reass_ctx_free(ctx);
+      uip_icmp6_error_output(ICMP6_PARAM_PROB, ICMP6_PARAMPROB_HEADER, 4);
+      uip_reassflags |= UIP_REASS_FLAG_ERROR_MSG;
+      return uip_len;
+    }
+  }
+  if((ctx->flags & UIP_REASS_FLAG_LASTFRAG) &&
+     offset + len > ctx->reasslen) {
+    goto discard;
+  }
+
+  /* Find the insertion point. A fragment overlapping another one makes
+     the whole datagram invalid (RFC 5722), an exact duplicate is ignored. */
+  prev = NULL;
+  for(f = list_head(ctx->frags); f != NULL; f = list_item_next(f)) {
+    if(f->offset == offset && f->len == len) {
       return 0;
     }
+    if(f->offset >= offset + len) {
+      break;
+    }
+    if(f->offset + f->len > offset) {
+      PRINTF("Overlapping fragment\n\r");
+      goto discard;
+    }
+    prev = f;
+  }
+  if(len == 0) {
+    return 0;
+  }
 
-    /* If this fragment has the More Fragments flag set to zero, it is the
-       last fragment*/
-    if((uip_ntohs(UIP_FRAG_BUF->offsetresmore) & IP_MF) == 0) {
-      uip_reassflags |= UIP_REASS_FLAG_LASTFRAG;
-      /*calculate the size of the entire packet*/
-      uip_reasslen = offset + len;
-      PRINTF("LAST FRAGMENT reasslen %d\n\r", uip_reasslen);
-    } else {
-      /* If len is not a multiple of 8 octets and the M flag of that fragment
-         is 1, then that fragment must be discarded and an ICMP Parameter
-         Problem, Code 0, message should be sent to the source of the fragment,
-         pointing to the Payload Length field of the fragment packet. */
-      if(len % 8 != 0){
-        uip_icmp6_error_output(ICMP6_PARAM_PROB, ICMP6_PARAMPROB_HEADER, 4);
-        uip_reassflags |= UIP_REASS_FLAG_ERROR_MSG;
-        /* not clear if we should interrupt reassembly, but it seems so from
-           the conformance tests */
-        uip_reass_on = 0;
-        etimer_stop(&uip_reass_timer);
-        return uip_len;
-      }
+  if(offset == 0) {
+    ctx->flags |= UIP_REASS_FLAG_FIRSTFRAG;
+    /*
+     * The Next Header field of the last header of the Unfragmentable
+     * Part is obtained from the Next Header field of the first
+     * fragment's Fragment header.
+     */
+    *uip_next_hdr = UIP_FRAG_BUF->next;
+    if(reass_ctx_set_hdr(ctx) == 0) {
+      goto discard;
     }
-    
-    /* Copy the fragment into the reassembly buffer, at the right
-       offset. */
-    memcpy((uint8_t *)FBUF + UIP_IPH_LEN + uip_ext_len + offset,
-           (uint8_t *)UIP_FRAG_BUF + UIP_FRAGH_LEN, len);
-    
-    /* Update the bitmap. */
-    if(offset >> 6 == (offset + len) >> 6) {
-      uip_reassbitmap[offset >> 6] |=
-        bitmap_bits[(offset >> 3) & 7] &
-        ~bitmap_bits[((offset + len) >> 3)  & 7];
-    } else {
-      /* If the two endpoints are in different bytes, we update the
-         bytes in the endpoints and fill the stuff inbetween with
-         0xff. */
-      uip_reassbitmap[offset >> 6] |= bitmap_bits[(offset >> 3) & 7];
- 
-      for(i = (1 + (offset >> 6)); i < ((offset + len) >> 6); ++i) {
-        uip_reassbitmap[i] = 0xff;
-      }
-      uip_reassbitmap[(offset + len) >> 6] |=
-        ~bitmap_bits[((offset + len) >> 3) & 7];
+    PRINTF("src ");
+    PRINT6ADDR(&ctx->srcipaddr);
+    PRINTF("dest ");
+    PRINT6ADDR(&ctx->destipaddr);
+    PRINTF("next %d\n\r", UIP_IP_BUF->proto);
+  } else if(ctx->hdrlen == 0) {
+    /* temporary in case we do not receive the fragment with offset 0 first */
+    if(reass_ctx_set_hdr(ctx) == 0) {
+      goto discard;
     }
-  
-    /* Finally, we check if we have a full packet in the buffer. We do
-       this by checking if we have the last fragment and if all bits
-       in the bitmap are set. */
-    
-    if(uip_reassflags & UIP_REASS_FLAG_LASTFRAG) {
-      /* Check all bytes up to and including all but the last byte in
-         the bitmap. */
-      for(i = 0; i < (uip_reasslen >> 6); ++i) {
-        if(uip_reassbitmap[i] != 0xff) {
-          return 0;
-        }
-      }
-      /* Check the last byte in the bitmap. It should contain just the
-         right amount of bits. */
-      if(uip_reassbitmap[uip_reasslen >> 6] !=
-         (uint8_t)~bitmap_bits[(uip_reasslen >> 3) & 7]) {
-        return 0;
-      }
+  }
 
-     /* If we have come this far, we have a full packet in the
-         buffer, so we copy it to uip_buf. We also reset the timer. */
-      uip_reass_on = 0;
-      etimer_stop(&uip_reass_timer);
-
-      uip_reasslen += UIP_IPH_LEN + uip_ext_len;
-      memcpy(UIP_IP_BUF, FBUF, uip_reasslen);
-      UIP_IP_BUF->len[0] = ((uip_reasslen - UIP_IPH_LEN) >> 8);
-      UIP_IP_BUF->len[1] = ((uip_reasslen - UIP_IPH_LEN) & 0xff);
-      PRINTF("REASSEMBLED PAQUET %d (%d)\n\r", uip_reasslen,
-             (UIP_IP_BUF->len[0] << 8) | UIP_IP_BUF->len[1]);
-   
-      return uip_reasslen;
-      
+  /* A late first fragment may bring a longer header chain than the one
+     the other fragments were checked with, and the last fragment fixes
+     the payload length: the whole datagram must still fit */
+  end = offset + len;
+  f = list_tail(ctx->frags);
+  if(f != NULL && f->offset + f->len > end) {
+    end = f->offset + f->len;
+  }
+  if(ctx->flags & UIP_REASS_FLAG_LASTFRAG) {
+    if(end > ctx->reasslen) {
+      goto discard;
     }
-  } else {
-    PRINTF("Already reassembling another paquet\n\r");
+    end = ctx->reasslen;
   }
+  if(ctx->hdrlen + end > UIP_REASS_BUFSIZE) {
+    goto discard;
+  }
+
+  frag = memb_alloc(&reass_frag_memb);
+  if(frag == NULL) {
+    goto discard;
+  }
+  if(mmem_alloc(&frag->data, len) == 0) {
+    memb_free(&reass_frag_memb, frag);
+    goto discard;
+  }
+  frag->offset = offset;
+  frag->len = len;
+  memcpy(MMEM_PTR(&frag->data), (uint8_t *)UIP_FRAG_BUF + UIP_FRAGH_LEN, len);
+  list_insert(ctx->frags, prev, frag);
+  ctx->rcvdlen += len;
+
+  /* Since fragments do not overlap, the datagram is complete once the
+     last fragment is known and the received bytes add up to its length. */
+  if(!(ctx->flags & UIP_REASS_FLAG_LASTFRAG) ||
+     !(ctx->flags & UIP_REASS_FLAG_FIRSTFRAG) ||
+     ctx->rcvdlen != ctx->reasslen) {
+    return 0;
+  }
+
+  /* We have a full packet, so we copy it to uip_buf and release the
+     context. */
+  memcpy(UIP_IP_BUF, MMEM_PTR(&ctx->hdr), ctx->hdrlen);
+  ptr = (uint8_t *)UIP_IP_BUF + ctx->hdrlen;
+  for(f = list_head(ctx->frags); f != NULL; f = list_item_next(f)) {
+    memcpy(ptr + f->offset, MMEM_PTR(&f->data), f->len);
+  }
+  reasslen = ctx->reasslen + ctx->hdrlen;
+  reass_ctx_free(ctx);
+
+  UIP_IP_BUF->len[0] = ((reasslen - UIP_IPH_LEN) >> 8);
+  UIP_IP_BUF->len[1] = ((reasslen - UIP_IPH_LEN) & 0xff);
+  /* the partial checksum of the lower layer covered the last fragment only */
+  uip_rx_chksum.state = UIP_RX_CHKSUM_NONE;
+  PRINTF("REASSEMBLED PAQUET %d (%d)\n\r", reasslen,
+         (UIP_IP_BUF->len[0] << 8) | UIP_IP_BUF->len[1]);
+  return reasslen;
+
+discard:
+  PRINTF("Discarding datagram\n\r");
+  UIP_STAT(++uip_stat.ip.fragerr);
+  reass_ctx_free(ctx);
   return 0;
 }
-
+/*---------------------------------------------------------------------------*/
 void
 uip_reass_over(void)
 {
-   /* to late, we abandon the reassembly of the packet */
+  struct uip_reass_ctx *ctx;
 
-  uip_reass_on = 0;
-  etimer_stop(&uip_reass_timer);
+  /* to late, we abandon the reassembly of the first expired packet. If
+     several expired at once, the timer is rearmed to fire immediately and
+     the next one is handled on the following call. */
+  uip_len = 0;
+  for(ctx = list_head(reass_ctx_list); ctx != NULL; ctx = list_item_next(ctx)) {
+    if(timer_expired(&ctx->expire)) {
+      break;
+    }
+  }
+  if(ctx == NULL) {
+    reass_timer_update();
+    return;
+  }
 
-  if(uip_reassflags & UIP_REASS_FLAG_FIRSTFRAG){
+  if((ctx->flags & UIP_REASS_FLAG_FIRSTFRAG) && ctx->hdrlen > 0) {
     PRINTF("FRAG INTERRUPTED TOO LATE\n\r");
     /* If the first fragment has been received, an ICMP Time Exceeded
        -- Fragment Reassembly Time Exceeded message should be sent to the
@@ -829,17 +1347,28 @@ uip_reass_over(void)
      * any RFC, we decided not to include it as it reduces the size of
      * the packet.
      */
-    uip_len = 0;
     uip_ext_len = 0;
-    memcpy(UIP_IP_BUF, FBUF, UIP_IPH_LEN); /* copy the header for src
-                                              and dest address*/
+    memcpy(UIP_IP_BUF, MMEM_PTR(&ctx->hdr), UIP_IPH_LEN); /* copy the header
+                                              for src and dest address*/
+    reass_ctx_free(ctx);
     uip_icmp6_error_output(ICMP6_E_TIME_EXCEEDED, ICMP6_E_TIME_EXCEED_REASSEMBLY, 0);
-    
+
     UIP_STAT(++uip_stat.ip.sent);
     uip_flags = 0;
+  } else {
+    reass_ctx_free(ctx);
   }
 }
-
+/*---------------------------------------------------------------------------*/
+static void
+uip_reass_init(void)
+{
+  memb_init(&reass_ctx_memb);
+  memb_init(&reass_frag_memb);
+  list_init(reass_ctx_list);
+  mmem_init();
+  uip_reass_on = 0;
+}
 #endif /* UIP_CONF_IPV6_REASSEMBLY */
 
 /*---------------------------------------------------------------------------*/
@@ -901,6 +1430,15 @@ ext_hdr_options_process(void)
 #endif /* UIP_CONF_IPV6_RPL */
         uip_ext_opt_offset += (UIP_EXT_HDR_OPT_BUF->len) + 2;
         return 0;
+#if UIP_CONF_IPV6_MPL
+      case UIP_EXT_HDR_OPT_MPL:
+        /* The MPL engine parses its option when the datagram reaches it.
+         * Without this case, the option type (0x6D & 0xC0 = 0x40) would
+         * make us discard the datagram */
+        PRINTF("Processing MPL option\n\r");
+        uip_ext_opt_offset += (UIP_EXT_HDR_OPT_BUF->len) + 2;
+        break;
+#endif /* UIP_CONF_IPV6_MPL */
       default:
         /*
          * check the two highest order bits of the option
@@ -1368,6 +1906,20 @@ uip_process(uint8_t flag)
 
         PRINTF("Processing Routing header\n\r");
         if(UIP_ROUTING_BUF->seg_left > 0) {
+#if UIP_CONF_IPV6_RPL && RPL_WITH_NON_STORING
+          if(rpl_process_srh_header()) {
+            /* On to the next hop of the source route */
+            if(UIP_IP_BUF->ttl <= 1) {
+              uip_icmp6_error_output(ICMP6_E_TIME_EXCEEDED,
+                                     ICMP6_E_TIME_EXCEED_TRANSIT, 0);
+              UIP_STAT(++uip_stat.ip.drop);
+              goto send;
+            }
+            UIP_IP_BUF->ttl = UIP_IP_BUF->ttl - 1;
+            UIP_STAT(++uip_stat.ip.forwarded);
+            goto send;
+          }
+#endif /* UIP_CONF_IPV6_RPL && RPL_WITH_NON_STORING */
           uip_icmp6_error_output(ICMP6_PARAM_PROB, ICMP6_PARAMPROB_HEADER, UIP_IPH_LEN + uip_ext_len + 2);
           UIP_STAT(++uip_stat.ip.drop);
           UIP_LOG("ip6: unrecognized routing type");
@@ -1425,7 +1977,7 @@ uip_process(uint8_t flag)
 
 #if UIP_CONF_IPV6_CHECKS
   /* Compute and check the ICMP header checksum */
-  if(uip_icmp6chksum() != 0xffff) {
+  if(UIP_RX_ICMP6CHKSUM() != 0xffff) {
     UIP_STAT(++uip_stat.icmp.drop);
     UIP_STAT(++uip_stat.icmp.chkerr);
     UIP_LOG("icmpv6: bad checksum.");
@@ -1472,8 +2024,6 @@ uip_process(uint8_t flag)
   /* UDP input processing. */
  udp_input:
 
-  remove_ext_hdr();
-
   PRINTF("Receiving UDP packet\n\r");
  
   /* UDP processing is really just a hack. We don't do anything to the
@@ -1481,24 +2031,27 @@ uip_process(uint8_t flag)
      work. If the application sets uip_slen, it has a packet to
      send. */
 #if UIP_UDP_CHECKSUMS
-  uip_len = uip_len - UIP_UDPH_LEN;
-  uip_appdata = &uip_buf[UIP_IPUDPH_LEN + UIP_LLH_LEN];
   /* XXX hack: UDP/IPv6 receivers should drop packets with UDP
      checksum 0. Here, we explicitly receive UDP packets with checksum
      0. This is to be able to debug code that for one reason or
      another miscomputes UDP checksums. The reception of zero UDP
      checksums should be turned into a configration option. */
-  if(UIP_UDP_BUF->udpchksum != 0 && uip_udpchksum() != 0xffff) {
+  if(UIP_UDP_EXT_BUF->udpchksum != 0 && UIP_RX_UDPCHKSUM() != 0xffff) {
     UIP_STAT(++uip_stat.udp.drop);
     UIP_STAT(++uip_stat.udp.chkerr);
-    PRINTF("udp: bad checksum 0x%04x 0x%04x\n\r", UIP_UDP_BUF->udpchksum,
+    PRINTF("udp: bad checksum 0x%04x 0x%04x\n\r", UIP_UDP_EXT_BUF->udpchksum,
            uip_udpchksum());
     goto drop;
   }
-#else /* UIP_UDP_CHECKSUMS */
-  uip_len = uip_len - UIP_IPUDPH_LEN;
 #endif /* UIP_UDP_CHECKSUMS */
 
+  /* The checksum covers the datagram as received, the extension headers
+     are cut afterwards */
+  if(!udp_cut_ext_hdr()) {
+    UIP_STAT(++uip_stat.udp.drop);
+    goto drop;
+  }
+
   /* Make sure that the UDP destination port number is not zero. */
   if(UIP_UDP_BUF->destport == 0) {
     PRINTF("udp: zero port.\n\r");
@@ -1506,24 +2059,9 @@ uip_process(uint8_t flag)
   }
 
   /* Demultiplex this UDP packet between the UDP "connections". */
-  for(uip_udp_conn = &uip_udp_conns[0];
-      uip_udp_conn < &uip_udp_conns[UIP_UDP_CONNS];
-      ++uip_udp_conn) {
-    /* If the local UDP port is non-zero, the connection is considered
-       to be used. If so, the local port number is checked against the
-       destination port number in the received packet. If the two port
-       numbers match, the remote port number is checked if the
-       connection is bound to a remote port. Finally, if the
-       connection is bound to a remote IP address, the source IP
-       address of the packet is checked. */
-    if(uip_udp_conn->lport != 0 &&
-       UIP_UDP_BUF->destport == uip_udp_conn->lport &&
-       (uip_udp_conn->rport == 0 ||
-        UIP_UDP_BUF->srcport == uip_udp_conn->rport) &&
-       (uip_is_addr_unspecified(&uip_udp_conn->ripaddr) ||
-        uip_ipaddr_cmp(&UIP_IP_BUF->srcipaddr, &uip_udp_conn->ripaddr))) {
-      goto udp_found;
-    }
+  uip_udp_conn = udp_conn_lookup();
+  if(uip_udp_conn != NULL) {
+    goto udp_found;
   }
   PRINTF("udp: no matching connection found\n\r");
   UIP_STAT(++uip_stat.udp.drop);
@@ -1541,7 +2079,8 @@ uip_process(uint8_t flag)
  
   uip_conn = NULL;
   uip_flags = UIP_NEWDATA;
-  uip_sappdata = uip_appdata = &uip_buf[UIP_IPUDPH_LEN + UIP_LLH_LEN];
+  /* A reply written in place reuses the room of the extension headers */
+  uip_sappdata = uip_appdata;
   uip_slen = 0;
   UIP_UDP_APPCALL();
 
@@ -1551,6 +2090,23 @@ uip_process(uint8_t flag)
   if(uip_slen == 0) {
     goto drop;
   }
+
+  /* uip_sappdata may lie behind room for extension headers, left by
+     uip_udp_packet_send() or by the datagram replied to. The payload
+     moves only if that room does not fit the headers inserted now. */
+#if UIP_CONF_IPV6_RPL
+  uip_ext_room = rpl_header_room(&uip_udp_conn->ripaddr);
+  if(uip_slen > UIP_BUFSIZE - UIP_LLH_LEN - UIP_IPUDPH_LEN - uip_ext_room) {
+    uip_ext_room = 0;
+  }
+#else /* UIP_CONF_IPV6_RPL */
+  uip_ext_room = 0;
+#endif /* UIP_CONF_IPV6_RPL */
+  if((uint8_t *)uip_sappdata !=
+     &uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN + uip_ext_room]) {
+    memmove(&uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN + uip_ext_room],
+            uip_sappdata, uip_slen);
+  }
   uip_len = uip_slen + UIP_IPUDPH_LEN;
 
   /* For IPv6, the IP length field does not include the IPv6 IP header
@@ -1561,29 +2117,38 @@ uip_process(uint8_t flag)
   UIP_IP_BUF->ttl = uip_udp_conn->ttl;
   UIP_IP_BUF->proto = UIP_PROTO_UDP;
 
-  UIP_UDP_BUF->udplen = UIP_HTONS(uip_slen + UIP_UDPH_LEN);
-  UIP_UDP_BUF->udpchksum = 0;
+  UIP_UDP_ROOM_BUF->udplen = UIP_HTONS(uip_slen + UIP_UDPH_LEN);
+  UIP_UDP_ROOM_BUF->udpchksum = 0;
 
-  UIP_UDP_BUF->srcport  = uip_udp_conn->lport;
-  UIP_UDP_BUF->destport = uip_udp_conn->rport;
+  UIP_UDP_ROOM_BUF->srcport  = uip_udp_conn->lport;
+  UIP_UDP_ROOM_BUF->destport = uip_udp_conn->rport;
 
   uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &uip_udp_conn->ripaddr);
   uip_ds6_select_src(&UIP_IP_BUF->srcipaddr, &UIP_IP_BUF->destipaddr);
 
   uip_appdata = &uip_buf[UIP_LLH_LEN + UIP_IPTCPH_LEN];
-
-#if UIP_UDP_CHECKSUMS
   uip_ext_len = 0;
 
-  /* Calculate UDP checksum. */
-  UIP_UDP_BUF->udpchksum = ~(uip_udpchksum());
-  if(UIP_UDP_BUF->udpchksum == 0) {
-    UIP_UDP_BUF->udpchksum = 0xffff;
-  }
-#endif /* UIP_UDP_CHECKSUMS */
 #if UIP_CONF_IPV6_RPL
+  /* RPL picks the instance from the traffic class and flow label */
+  UIP_IP_BUF->vtc = 0x60;
+  UIP_IP_BUF->tcflow = 0x00;
+  UIP_IP_BUF->flow = 0x00;
   rpl_insert_header();
 #endif /* UIP_CONF_IPV6_RPL */
+  if(uip_ext_room > 0) {
+    /* No header took the room after all */
+    memmove(UIP_UDP_BUF, UIP_UDP_ROOM_BUF, uip_len - UIP_IPH_LEN);
+    uip_ext_room = 0;
+  }
+
+#if UIP_UDP_CHECKSUMS
+  /* Calculate UDP checksum, behind the headers inserted above. */
+  UIP_UDP_EXT_BUF->udpchksum = ~(uip_udpchksum());
+  if(UIP_UDP_EXT_BUF->udpchksum == 0) {
+    UIP_UDP_EXT_BUF->udpchksum = 0xffff;
+  }
+#endif /* UIP_UDP_CHECKSUMS */
 
   UIP_STAT(++uip_stat.udp.sent);
   goto ip_send_nolen;
@@ -1599,7 +2164,7 @@ uip_process(uint8_t flag)
   PRINTF("Receiving TCP packet\n\r");
   /* Start of TCP input header processing code. */
   
-  if(uip_tcpchksum() != 0xffff) {   /* Compute and check the TCP
+  if(UIP_RX_TCPCHKSUM() != 0xffff) {   /* Compute and check the TCP
                                        checksum. */
     UIP_STAT(++uip_stat.tcp.drop);
     UIP_STAT(++uip_stat.tcp.chkerr);
@@ -1636,8 +2201,8 @@ uip_process(uint8_t flag)
   
   tmp16 = UIP_TCP_BUF->destport;
   /* Next, check listening connections. */
-  for(c = 0; c < UIP_LISTENPORTS; ++c) {
-    if(tmp16 == uip_listenports[c]) {
+  for(c = listen_hash[UIP_PORT_HASH(tmp16)]; c != 0; c = listen_next[c - 1]) {
+    if(tmp16 == uip_listenports[c - 1]) {
       goto found_listen;
     }
   }
@@ -1894,6 +2459,8 @@ uip_process(uint8_t flag)
       }
       /* Set the acknowledged flag. */
       uip_flags = UIP_ACKDATA;
+      /* New data got through, no need to probe the next hop */
+      tcpip_ipv6_confirm_reachable(&UIP_IP_BUF->srcipaddr);
       /* Reset the retransmission timer. */
       uip_connr->timer = uip_connr->rto;
 
@@ -43,6 +43,9 @@
  */
 
 #include "rpl-private.h"
+#if RPL_WITH_NON_STORING
+#include "rpl-ns.h"
+#endif /* RPL_WITH_NON_STORING */
 #include "uip.h"
 #include "uip-nd6.h"
 #include "uip-ds6-nbr.h"
@@ -62,7 +65,7 @@
 
 /*---------------------------------------------------------------------------*/
 extern rpl_of_t RPL_OF;
-static rpl_of_t * const objective_functions[] = {&RPL_OF};
+static rpl_of_t * const objective_functions[] = {&RPL_OF, &rpl_mrhof, &rpl_of0};
 
 /*---------------------------------------------------------------------------*/
 /* RPL definitions. */
@@ -144,6 +147,45 @@ rpl_get_parent_ipaddr(rpl_parent_t *p)
   return uip_ds6_nbr_ipaddr_from_lladdr((uip_lladdr_t *)lladdr);
 }
 /*---------------------------------------------------------------------------*/
+int
+rpl_get_parent_stats(rpl_parent_stats_t *stats, int max)
+{
+  rpl_parent_t *p;
+  uip_ipaddr_t *addr;
+  uip_ds6_nbr_t *nbr;
+  int n;
+#if RPL_BACKUP_PARENTS
+  int i;
+#endif /* RPL_BACKUP_PARENTS */
+
+  n = 0;
+  for(p = nbr_table_head(rpl_parents); p != NULL && n < max;
+      p = nbr_table_next(rpl_parents, p)) {
+    addr = rpl_get_parent_ipaddr(p);
+    if(p->dag == NULL || addr == NULL) {
+      continue;
+    }
+    uip_ipaddr_copy(&stats[n].addr, addr);
+    stats[n].instance_id = p->dag->instance->instance_id;
+    stats[n].rank = p->rank;
+    nbr = rpl_get_nbr(p);
+    stats[n].link_metric = nbr != NULL ? nbr->link_metric : 0;
+    stats[n].flags = 0;
+    if(p == p->dag->preferred_parent) {
+      stats[n].flags |= RPL_PARENT_STATS_PREFERRED;
+    }
+#if RPL_BACKUP_PARENTS
+    for(i = 0; i < RPL_BACKUP_PARENTS; i++) {
+      if(p == p->dag->backup_parents[i]) {
+        stats[n].flags |= RPL_PARENT_STATS_BACKUP;
+      }
+    }
+#endif /* RPL_BACKUP_PARENTS */
+    n++;
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
 static void
 rpl_set_preferred_parent(rpl_dag_t *dag, rpl_parent_t *p)
 {
@@ -167,6 +209,8 @@ rpl_set_preferred_parent(rpl_dag_t *dag, rpl_parent_t *p)
     nbr_table_unlock(rpl_parents, dag->preferred_parent);
     nbr_table_lock(rpl_parents, p);
     dag->preferred_parent = p;
+    /* Upward next hops of the instance changed */
+    UIP_DS6_ROUTE_GEN_BUMP();
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -296,16 +340,19 @@ rpl_set_root(uint8_t instance_id, uip_ipaddr_t *dag_id)
   dag->preference = RPL_PREFERENCE;
   instance->mop = RPL_MOP_DEFAULT;
   instance->of = &RPL_OF;
+  instance->mc.type = RPL_DAG_MC;
   rpl_set_preferred_parent(dag, NULL);
 
   memcpy(&dag->dag_id, dag_id, sizeof(dag->dag_id));
+#if UIP_ND6_6LOWPAN && UIP_CONF_ROUTER
+  uip_nd6_set_6lbr(&dag->dag_id);
+#endif /* UIP_ND6_6LOWPAN && UIP_CONF_ROUTER */
 
   instance->dio_intdoubl = RPL_DIO_INTERVAL_DOUBLINGS;
   instance->dio_intmin = RPL_DIO_INTERVAL_MIN;
-  /* The current interval must differ from the minimum interval in order to
-     trigger a DIO timer reset. */
-  instance->dio_intcurrent = RPL_DIO_INTERVAL_MIN +
-    RPL_DIO_INTERVAL_DOUBLINGS;
+  /* Stop the DIO timer so that the reset below starts it afresh at the
+     new minimum interval. */
+  trickle_timer_stop(&instance->dio_timer);
   instance->dio_redundancy = RPL_DIO_REDUNDANCY;
   instance->max_rankinc = RPL_MAX_RANKINC;
   instance->min_hoprankinc = RPL_MIN_HOPRANKINC;
@@ -324,7 +371,9 @@ rpl_set_root(uint8_t instance_id, uip_ipaddr_t *dag_id)
   instance->current_dag = dag;
   instance->dtsn_out = RPL_LOLLIPOP_INIT;
   instance->of->update_metric_container(instance);
-  default_instance = instance;
+  if(default_instance == NULL || instance_id == RPL_DEFAULT_INSTANCE) {
+    default_instance = instance;
+  }
 
   PRINTF("RPL: Node set to be a DAG root with DAG ID ");
   PRINT6ADDR(&dag->dag_id);
@@ -357,6 +406,40 @@ rpl_repair_root(uint8_t instance_id)
   return 1;
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * Select the objective function and the metric container of a DODAG we
+ * are root of. A joined network follows through a global repair.
+ */
+int
+rpl_set_objective(uint8_t instance_id, rpl_ocp_t ocp, uint8_t mc_type)
+{
+  rpl_instance_t *instance;
+  rpl_of_t *of;
+
+  instance = rpl_get_instance(instance_id);
+  if(instance == NULL || instance->current_dag == NULL ||
+     instance->current_dag->rank != ROOT_RANK(instance)) {
+    PRINTF("RPL: rpl_set_objective called but not root\n\r");
+    return 0;
+  }
+
+  of = rpl_find_of(ocp);
+  if(of == NULL ||
+     (mc_type != RPL_DAG_MC_NONE &&
+      (RPL_DAG_MC == RPL_DAG_MC_NONE || rpl_find_metric(mc_type) == NULL))) {
+    PRINTF("RPL: Unsupported OF %u or metric container %u\n\r",
+           ocp, mc_type);
+    return 0;
+  }
+
+  instance->of = of;
+  instance->mc.type = mc_type;
+  of->reset(instance->current_dag);
+  of->update_metric_container(instance);
+
+  return rpl_repair_root(instance_id);
+}
+/*---------------------------------------------------------------------------*/
 static void
 set_ip_from_prefix(uip_ipaddr_t *ipaddr, rpl_prefix_t *prefix)
 {
@@ -534,15 +617,24 @@ rpl_free_instance(rpl_instance_t *instance)
 
   rpl_set_default_route(instance, NULL);
 
-  ctimer_stop(&instance->dio_timer);
+  trickle_timer_stop(&instance->dio_timer);
   ctimer_stop(&instance->dao_timer);
   ctimer_stop(&instance->dao_lifetime_timer);
 
+  instance->used = 0;
+
   if(default_instance == instance) {
+    /* Fall back to another instance we are part of */
     default_instance = NULL;
+    for(instance = &instance_table[0];
+        instance < &instance_table[RPL_MAX_INSTANCES]; ++instance) {
+      if(instance->used && instance->current_dag != NULL &&
+         instance->current_dag->joined) {
+        default_instance = instance;
+        break;
+      }
+    }
   }
-
-  instance->used = 0;
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -556,6 +648,9 @@ rpl_free_dag(rpl_dag_t *dag)
 
     /* Remove routes installed by DAOs. */
     rpl_remove_routes(dag);
+#if RPL_WITH_NON_STORING
+    rpl_ns_free_dag(dag);
+#endif /* RPL_WITH_NON_STORING */
 
    /* Remove autoconfigured address */
     if((dag->prefix_info.flags & UIP_ND6_RA_FLAG_AUTONOMOUS)) {
@@ -590,6 +685,7 @@ rpl_add_parent(rpl_dag_t *dag, rpl_dio_t *dio, uip_ipaddr_t *addr)
         p->dag = dag;
         p->rank = dio->rank;
         p->dtsn = dio->dtsn;
+        p->failures = 0;
 
         /* Check whether we have a neighbor that has not gotten a link metric yet */
         if(nbr != NULL && nbr->link_metric == 0) {
@@ -736,26 +832,78 @@ rpl_select_dag(rpl_instance_t *instance, rpl_parent_t *p)
   return best_dag;
 }
 /*---------------------------------------------------------------------------*/
+#if RPL_BACKUP_PARENTS
+static void
+forget_backup_parent(rpl_dag_t *dag, rpl_parent_t *p)
+{
+  int i;
+
+  for(i = 0; i < RPL_BACKUP_PARENTS; i++) {
+    if(dag->backup_parents[i] == p) {
+      memmove(&dag->backup_parents[i], &dag->backup_parents[i + 1],
+              (RPL_BACKUP_PARENTS - 1 - i) * sizeof(rpl_parent_t *));
+      dag->backup_parents[RPL_BACKUP_PARENTS - 1] = NULL;
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* The best backup that can replace the preferred parent right away */
+static rpl_parent_t *
+usable_backup_parent(rpl_dag_t *dag)
+{
+  rpl_parent_t *p;
+  int i;
+
+  for(i = 0; i < RPL_BACKUP_PARENTS; i++) {
+    p = dag->backup_parents[i];
+    if(p != NULL && p->dag == dag && p != dag->preferred_parent &&
+       p->rank != INFINITE_RANK &&
+       (RPL_PARENT_MAX_FAILURES == 0 || p->failures < RPL_PARENT_MAX_FAILURES) &&
+       acceptable_rank(dag, dag->instance->of->calculate_rank(p, 0))) {
+      return p;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+#endif /* RPL_BACKUP_PARENTS */
 static rpl_parent_t *
 best_parent(rpl_dag_t *dag)
 {
-  rpl_parent_t *p, *best;
+  rpl_parent_t *p;
+  /* Candidates ranked by the OF, best first */
+  rpl_parent_t *ranked[RPL_BACKUP_PARENTS + 1];
+  int n, i;
 
-  best = NULL;
+  n = 0;
 
   p = nbr_table_head(rpl_parents);
   while(p != NULL) {
     if(p->dag != dag || p->rank == INFINITE_RANK) {
       /* ignore this neighbor */
-    } else if(best == NULL) {
-      best = p;
     } else {
-      best = dag->instance->of->best_parent(best, p);
+      for(i = n; i > 0 && dag->instance->of->best_parent(ranked[i - 1], p) == p; i--);
+      if(i <= RPL_BACKUP_PARENTS) {
+        memmove(&ranked[i + 1], &ranked[i],
+                ((n < RPL_BACKUP_PARENTS ? n : RPL_BACKUP_PARENTS) - i) *
+                sizeof(rpl_parent_t *));
+        ranked[i] = p;
+        if(n <= RPL_BACKUP_PARENTS) {
+          n++;
+        }
+      }
     }
     p = nbr_table_next(rpl_parents, p);
 
   }
-  return best;
+
+#if RPL_BACKUP_PARENTS
+  for(i = 0; i < RPL_BACKUP_PARENTS; i++) {
+    dag->backup_parents[i] = i + 1 < n ? ranked[i + 1] : NULL;
+  }
+#endif /* RPL_BACKUP_PARENTS */
+  return n > 0 ? ranked[0] : NULL;
 }
 /*---------------------------------------------------------------------------*/
 rpl_parent_t *
@@ -771,6 +919,32 @@ rpl_select_parent(rpl_dag_t *dag)
 }
 /*---------------------------------------------------------------------------*/
 void
+rpl_parent_failover(rpl_parent_t *parent)
+{
+  rpl_dag_t *dag = parent->dag;
+  uip_ds6_nbr_t *nbr;
+
+  /* Make the link look as bad as it gets, the OF then ranks the parent
+     behind every backup and the ETX average has to earn it back. */
+  nbr = rpl_get_nbr(parent);
+  if(nbr != NULL) {
+    nbr->link_metric = RPL_MAX_LINK_METRIC * RPL_DAG_MC_ETX_DIVISOR;
+    parent->flags |= RPL_PARENT_FLAG_LINK_METRIC_VALID;
+  }
+
+  if(parent != dag->preferred_parent || !dag->joined) {
+    return;
+  }
+
+  PRINTF("RPL: Preferred parent ");
+  PRINT6ADDR(rpl_get_parent_ipaddr(parent));
+  PRINTF(" lost %u packets, failing over\n\r", parent->failures);
+  RPL_STAT(rpl_stats.parent_failovers++);
+  parent->flags &= ~RPL_PARENT_FLAG_UPDATED;
+  rpl_process_parent_event(dag->instance, parent);
+}
+/*---------------------------------------------------------------------------*/
+void
 rpl_remove_parent(rpl_parent_t *parent)
 {
   PRINTF("RPL: Removing parent ");
@@ -786,6 +960,34 @@ void
 rpl_nullify_parent(rpl_parent_t *parent)
 {
   rpl_dag_t *dag = parent->dag;
+#if RPL_BACKUP_PARENTS
+  rpl_parent_t *backup;
+
+  forget_backup_parent(dag, parent);
+  if(parent == dag->preferred_parent && dag->joined &&
+     (backup = usable_backup_parent(dag)) != NULL) {
+    /* Hand over to the best backup without ever losing the upward route. */
+    PRINTF("RPL: Nullifying preferred parent ");
+    PRINT6ADDR(rpl_get_parent_ipaddr(parent));
+    PRINTF(", backup ");
+    PRINT6ADDR(rpl_get_parent_ipaddr(backup));
+    PRINTF(" takes over\n\r");
+    RPL_STAT(rpl_stats.parent_failovers++);
+    RPL_STAT(rpl_stats.parent_switch++);
+    rpl_set_preferred_parent(dag, backup);
+    dag->instance->of->update_metric_container(dag->instance);
+    dag->rank = dag->instance->of->calculate_rank(backup, 0);
+    rpl_set_default_route(dag->instance, rpl_get_parent_ipaddr(backup));
+    if(dag->instance->mop != RPL_MOP_NO_DOWNWARD_ROUTES) {
+      dao_output(parent, RPL_ZERO_LIFETIME);
+      RPL_LOLLIPOP_INCREMENT(dag->instance->dtsn_out);
+      rpl_schedule_dao(dag->instance);
+    }
+    rpl_reset_dio_timer(dag->instance);
+    return;
+  }
+#endif /* RPL_BACKUP_PARENTS */
+
   /* This function can be called when the preferred parent is NULL, so we
      need to handle this condition in order to trigger uip_ds6_defrt_rm. */
   if(parent == dag->preferred_parent || dag->preferred_parent == NULL) {
@@ -814,6 +1016,9 @@ rpl_nullify_parent(rpl_parent_t *parent)
 void
 rpl_move_parent(rpl_dag_t *dag_src, rpl_dag_t *dag_dst, rpl_parent_t *parent)
 {
+#if RPL_BACKUP_PARENTS
+  forget_backup_parent(dag_src, parent);
+#endif /* RPL_BACKUP_PARENTS */
   if(parent == dag_src->preferred_parent) {
       rpl_set_preferred_parent(dag_src, NULL);
       dag_src->rank = INFINITE_RANK;
@@ -930,6 +1135,10 @@ rpl_join_instance(uip_ipaddr_t *from, rpl_dio_t *dio)
   dag->version = dio->version;
 
   instance->of = of;
+#if RPL_DAG_MC != RPL_DAG_MC_NONE
+  /* Advertise the metric the root selected, if we support it */
+  instance->mc.type = dio->mc.type;
+#endif /* RPL_DAG_MC != RPL_DAG_MC_NONE */
   instance->mop = dio->mop;
   instance->current_dag = dag;
   instance->dtsn_out = RPL_LOLLIPOP_INIT;
@@ -938,12 +1147,15 @@ rpl_join_instance(uip_ipaddr_t *from, rpl_dio_t *dio)
   instance->min_hoprankinc = dio->dag_min_hoprankinc;
   instance->dio_intdoubl = dio->dag_intdoubl;
   instance->dio_intmin = dio->dag_intmin;
-  instance->dio_intcurrent = instance->dio_intmin + instance->dio_intdoubl;
+  trickle_timer_stop(&instance->dio_timer);
   instance->dio_redundancy = dio->dag_redund;
   instance->default_lifetime = dio->default_lifetime;
   instance->lifetime_unit = dio->lifetime_unit;
 
   memcpy(&dag->dag_id, &dio->dag_id, sizeof(dio->dag_id));
+#if UIP_ND6_6LOWPAN && UIP_CONF_ROUTER
+  uip_nd6_set_6lbr(&dag->dag_id);
+#endif /* UIP_ND6_6LOWPAN && UIP_CONF_ROUTER */
 
   /* Copy prefix information from the DIO into the DAG object. */
   memcpy(&dag->prefix_info, &dio->prefix_info, sizeof(rpl_prefix_t));
@@ -1037,6 +1249,9 @@ rpl_add_dag(uip_ipaddr_t *from, rpl_dio_t *dio)
   dag->version = dio->version;
 
   memcpy(&dag->dag_id, &dio->dag_id, sizeof(dio->dag_id));
+#if UIP_ND6_6LOWPAN && UIP_CONF_ROUTER
+  uip_nd6_set_6lbr(&dag->dag_id);
+#endif /* UIP_ND6_6LOWPAN && UIP_CONF_ROUTER */
 
   /* copy prefix information into the dag */
   memcpy(&dag->prefix_info, &dio->prefix_info, sizeof(rpl_prefix_t));
@@ -1062,10 +1277,20 @@ static void
 global_repair(uip_ipaddr_t *from, rpl_dag_t *dag, rpl_dio_t *dio)
 {
   rpl_parent_t *p;
+  rpl_of_t *of;
 
   remove_parents(dag, 0);
   dag->version = dio->version;
 
+  /* the root may have changed the objective, see rpl_set_objective() */
+  of = rpl_find_of(dio->ocp);
+  if(of != NULL) {
+    dag->instance->of = of;
+  }
+#if RPL_DAG_MC != RPL_DAG_MC_NONE
+  dag->instance->mc.type = dio->mc.type;
+#endif /* RPL_DAG_MC != RPL_DAG_MC_NONE */
+
   /* copy parts of the configuration so that it propagates in the network */
   dag->instance->dio_intdoubl = dio->dag_intdoubl;
   dag->instance->dio_intmin = dio->dag_intmin;
@@ -1201,7 +1426,8 @@ rpl_process_dio(uip_ipaddr_t *from, rpl_dio_t *dio)
    * In that scenario, we suppress DAOs for multicast targets */
   if(dio->mop < RPL_MOP_STORING_NO_MULTICAST) {
 #else
-  if(dio->mop != RPL_MOP_DEFAULT) {
+  if(dio->mop != RPL_MOP_DEFAULT &&
+     !(RPL_WITH_NON_STORING && dio->mop == RPL_MOP_NON_STORING)) {
 #endif
     PRINTF("RPL: Ignoring a DIO with an unsupported MOP: %d\n\r", dio->mop);
     return;
@@ -1287,7 +1513,7 @@ rpl_process_dio(uip_ipaddr_t *from, rpl_dio_t *dio)
 
   if(dag->rank == ROOT_RANK(instance)) {
     if(dio->rank != INFINITE_RANK) {
-      instance->dio_counter++;
+      trickle_timer_consistency(&instance->dio_timer);
     }
     return;
   }
@@ -1324,7 +1550,7 @@ rpl_process_dio(uip_ipaddr_t *from, rpl_dio_t *dio)
     if(p->rank == dio->rank) {
       PRINTF("RPL: Received consistent DIO\n\r");
       if(dag->joined) {
-        instance->dio_counter++;
+        trickle_timer_consistency(&instance->dio_timer);
       }
     } else {
       p->rank=dio->rank;
@@ -47,6 +47,9 @@
 #include "tcpip.h"
 #include "uip-ds6.h"
 #include "rpl-private.h"
+#if RPL_WITH_NON_STORING
+#include "rpl-ns.h"
+#endif /* RPL_WITH_NON_STORING */
 #include "packetbuf.h"
 
 #define DEBUG DEBUG_NONE
@@ -63,6 +66,20 @@
 #define UIP_EXT_HDR_OPT_BUF       ((struct uip_ext_hdr_opt *)&uip_buf[uip_l2_l3_hdr_len + uip_ext_opt_offset])
 #define UIP_EXT_HDR_OPT_PADN_BUF  ((struct uip_ext_hdr_opt_padn *)&uip_buf[uip_l2_l3_hdr_len + uip_ext_opt_offset])
 #define UIP_EXT_HDR_OPT_RPL_BUF   ((struct uip_ext_hdr_opt_rpl *)&uip_buf[uip_l2_l3_hdr_len + uip_ext_opt_offset])
+#define UIP_EXT_BUF_AT(off)       (&uip_buf[uip_l2_l3_hdr_len + (off)])
+#define UIP_RH_BUF                ((struct uip_routing_hdr *)&uip_buf[uip_l2_l3_hdr_len])
+#define UIP_RPL_SRH_BUF           ((struct uip_rpl_srh_hdr *)&uip_buf[uip_l2_l3_hdr_len + RPL_RH_LEN])
+#define UIP_UDP_ROOM_BUF          ((struct uip_udp_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN + uip_ext_room])
+/*---------------------------------------------------------------------------*/
+#if RPL_FLOW_MAP_NUM
+struct rpl_flow {
+  uint32_t value;
+  uint8_t selector;
+  uint8_t instance_id;
+  uint8_t used;
+};
+static struct rpl_flow flow_map[RPL_FLOW_MAP_NUM];
+#endif /* RPL_FLOW_MAP_NUM */
 /*---------------------------------------------------------------------------*/
 int
 rpl_verify_header(int uip_ext_opt_offset)
@@ -159,7 +176,12 @@ set_rpl_opt(unsigned uip_ext_opt_offset)
 {
   uint8_t temp_len;
 
-  memmove(UIP_HBHO_NEXT_BUF, UIP_EXT_BUF, uip_len - UIP_IPH_LEN);
+  if(uip_ext_room == RPL_HOP_BY_HOP_LEN) {
+    /* The packet was built with room for the option */
+    uip_ext_room = 0;
+  } else {
+    memmove(UIP_HBHO_NEXT_BUF, UIP_EXT_BUF, uip_len - UIP_IPH_LEN);
+  }
   memset(UIP_HBHO_BUF, 0, RPL_HOP_BY_HOP_LEN);
   UIP_HBHO_BUF->next = UIP_IP_BUF->proto;
   UIP_IP_BUF->proto = UIP_PROTO_HBHO;
@@ -178,6 +200,135 @@ set_rpl_opt(unsigned uip_ext_opt_offset)
 }
 /*---------------------------------------------------------------------------*/
 int
+rpl_map_flow(uint8_t selector, uint32_t value, uint8_t instance_id)
+{
+#if RPL_FLOW_MAP_NUM
+  struct rpl_flow *f;
+  struct rpl_flow *unused;
+
+  unused = NULL;
+  for(f = flow_map; f < flow_map + RPL_FLOW_MAP_NUM; f++) {
+    if(f->used && f->selector == selector && f->value == value) {
+      f->instance_id = instance_id;
+      return 1;
+    }
+    if(!f->used && unused == NULL) {
+      unused = f;
+    }
+  }
+  if(unused == NULL) {
+    PRINTF("RPL: No room to map flow %u/%lu\n", selector, (unsigned long)value);
+    return 0;
+  }
+  unused->selector = selector;
+  unused->value = value;
+  unused->instance_id = instance_id;
+  unused->used = 1;
+  return 1;
+#else
+  return 0;
+#endif /* RPL_FLOW_MAP_NUM */
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_unmap_flow(uint8_t selector, uint32_t value)
+{
+#if RPL_FLOW_MAP_NUM
+  struct rpl_flow *f;
+
+  for(f = flow_map; f < flow_map + RPL_FLOW_MAP_NUM; f++) {
+    if(f->used && f->selector == selector && f->value == value) {
+      f->used = 0;
+    }
+  }
+#endif /* RPL_FLOW_MAP_NUM */
+}
+/*---------------------------------------------------------------------------*/
+/* Instance of a packet that enters RPL here, from its flow */
+static rpl_instance_t *
+flow_instance(void)
+{
+#if RPL_FLOW_MAP_NUM
+  struct rpl_flow *f;
+  rpl_instance_t *instance;
+  uint8_t tclass;
+  uint32_t label;
+  int match;
+
+  tclass = (UIP_IP_BUF->vtc << 4) | (UIP_IP_BUF->tcflow >> 4);
+  label = ((uint32_t)(UIP_IP_BUF->tcflow & 0x0f) << 16) |
+    UIP_HTONS(UIP_IP_BUF->flow);
+
+  for(f = flow_map; f < flow_map + RPL_FLOW_MAP_NUM; f++) {
+    if(!f->used) {
+      continue;
+    }
+    switch(f->selector) {
+    case RPL_FLOW_UDP_PORT:
+      match = UIP_IP_BUF->proto == UIP_PROTO_UDP &&
+        UIP_UDP_ROOM_BUF->srcport == UIP_HTONS(f->value) &&
+        uip_ds6_is_my_addr(&UIP_IP_BUF->srcipaddr);
+      break;
+    case RPL_FLOW_DSCP:
+      match = (tclass >> 2) == f->value;
+      break;
+    case RPL_FLOW_LABEL:
+      match = label == f->value;
+      break;
+    default:
+      match = 0;
+    }
+    if(match) {
+      instance = rpl_get_instance(f->instance_id);
+      if(instance != NULL && instance->current_dag != NULL &&
+         instance->current_dag->joined) {
+        return instance;
+      }
+      PRINTF("RPL: Instance %u of the flow not joined\n", f->instance_id);
+      break;
+    }
+  }
+#endif /* RPL_FLOW_MAP_NUM */
+  return default_instance;
+}
+/*---------------------------------------------------------------------------*/
+rpl_instance_t *
+rpl_get_packet_instance(void)
+{
+  int uip_ext_opt_offset;
+  int last_uip_ext_len;
+  rpl_instance_t *instance;
+
+  last_uip_ext_len = uip_ext_len;
+  uip_ext_len = 0;
+  uip_ext_opt_offset = 2;
+
+  instance = NULL;
+  if(UIP_IP_BUF->proto == UIP_PROTO_HBHO &&
+     UIP_HBHO_BUF->len == RPL_HOP_BY_HOP_LEN - 8 &&
+     UIP_EXT_HDR_OPT_RPL_BUF->opt_type == UIP_EXT_HDR_OPT_RPL) {
+    instance = rpl_get_instance(UIP_EXT_HDR_OPT_RPL_BUF->instance);
+  }
+  uip_ext_len = last_uip_ext_len;
+  return instance;
+}
+/*---------------------------------------------------------------------------*/
+uip_ipaddr_t *
+rpl_get_upward_nexthop(rpl_instance_t *instance)
+{
+  rpl_dag_t *dag;
+
+  if(instance == NULL || !instance->used) {
+    return NULL;
+  }
+  dag = instance->current_dag;
+  if(dag == NULL || !dag->joined || dag->preferred_parent == NULL) {
+    return NULL;
+  }
+  return rpl_get_parent_ipaddr(dag->preferred_parent);
+}
+/*---------------------------------------------------------------------------*/
+int
 rpl_update_header_empty(void)
 {
   rpl_instance_t *instance;
@@ -221,7 +372,11 @@ rpl_update_header_empty(void)
       uip_ext_len = last_uip_ext_len;
       return 0;
     }
+    instance = flow_instance();
     set_rpl_opt(uip_ext_opt_offset);
+    if(instance != NULL) {
+      UIP_EXT_HDR_OPT_RPL_BUF->instance = instance->instance_id;
+    }
     uip_ext_len = last_uip_ext_len + RPL_HOP_BY_HOP_LEN;
     return 0;
   }
@@ -277,6 +432,7 @@ rpl_update_header_empty(void)
 int
 rpl_update_header_final(uip_ipaddr_t *addr)
 {
+  rpl_instance_t *instance;
   rpl_parent_t *parent;
   int uip_ext_opt_offset;
   int last_uip_ext_len;
@@ -295,16 +451,17 @@ rpl_update_header_final(uip_ipaddr_t *addr)
     if(UIP_EXT_HDR_OPT_BUF->type == UIP_EXT_HDR_OPT_RPL) {
       if(UIP_EXT_HDR_OPT_RPL_BUF->senderrank == 0) {
         PRINTF("RPL: Updating RPL option\n");
-        if(default_instance == NULL || !default_instance->used || !default_instance->current_dag->joined) {
-          PRINTF("RPL: Unable to add hop-by-hop extension header: incorrect default instance\n");
+        /* The instance was chosen from the flow when the option was added */
+        instance = rpl_get_instance(UIP_EXT_HDR_OPT_RPL_BUF->instance);
+        if(instance == NULL || !instance->used || !instance->current_dag->joined) {
+          PRINTF("RPL: Unable to add hop-by-hop extension header: incorrect instance\n");
           return 1;
         }
-        parent = rpl_find_parent(default_instance->current_dag, addr);
+        parent = rpl_find_parent(instance->current_dag, addr);
         if(parent == NULL || parent != parent->dag->preferred_parent) {
           UIP_EXT_HDR_OPT_RPL_BUF->flags = RPL_HDR_OPT_DOWN;
         }
-        UIP_EXT_HDR_OPT_RPL_BUF->instance = default_instance->instance_id;
-        UIP_EXT_HDR_OPT_RPL_BUF->senderrank = UIP_HTONS(default_instance->current_dag->rank);
+        UIP_EXT_HDR_OPT_RPL_BUF->senderrank = UIP_HTONS(instance->current_dag->rank);
       }
     }
   }
@@ -374,9 +531,267 @@ rpl_invert_header(void)
 void
 rpl_insert_header(void)
 {
-    if(default_instance != NULL && !uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
-        rpl_update_header_empty();
+  if(rpl_header_room(&UIP_IP_BUF->destipaddr)) {
+    rpl_update_header_empty();
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Room a packet originated to addr reserves after its IPv6 header for the
+   RPL option, see rpl_insert_header() */
+uint8_t
+rpl_header_room(const uip_ipaddr_t *addr)
+{
+  if(default_instance != NULL && !uip_is_addr_mcast(addr)) {
+    return RPL_HOP_BY_HOP_LEN;
   }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+#if RPL_WITH_NON_STORING
+/* Our DAG if we are the root of a non-storing one, in the instance of
+   the packet */
+static rpl_dag_t *
+srh_root_dag(void)
+{
+  rpl_instance_t *instance;
+  rpl_dag_t *dag;
+
+  instance = rpl_get_packet_instance();
+  if(instance == NULL) {
+    instance = default_instance;
+  }
+  if(instance == NULL || !instance->used ||
+     !RPL_IS_NON_STORING(instance)) {
+    return NULL;
+  }
+  dag = instance->current_dag;
+  if(dag == NULL || !dag->joined || dag->rank != ROOT_RANK(instance)) {
+    return NULL;
+  }
+  return dag;
+}
+/*---------------------------------------------------------------------------*/
+/* Number of leading bytes two addresses share, as far as an SRH can elide */
+static uint8_t
+srh_common_prefix(const uip_ipaddr_t *a, const uip_ipaddr_t *b)
+{
+  uint8_t n;
+
+  for(n = 0; n < 15 && a->u8[n] == b->u8[n]; n++);
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_srh_get_next_hop(uip_ipaddr_t *ipaddr)
+{
+  rpl_dag_t *dag;
+  rpl_ns_node_t *node;
+  uip_ipaddr_t root;
+
+  if(UIP_IP_BUF->proto != UIP_PROTO_ROUTING ||
+     ((struct uip_routing_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN])->routing_type != RPL_RH_TYPE_SRH) {
+    /* The root reaches its children without source route */
+    dag = srh_root_dag();
+    if(dag == NULL) {
+      return 0;
+    }
+    node = rpl_ns_get_node(dag, &UIP_IP_BUF->destipaddr);
+    if(node == NULL || node->parent == NULL || node->parent->parent != NULL) {
+      return 0;
+    }
+    rpl_ns_get_node_global_addr(&root, node->parent);
+    if(!uip_ds6_is_my_addr(&root)) {
+      return 0;
+    }
+  }
+
+  /* The destination is a neighbor, known by its link-local address */
+  uip_ip6addr(ipaddr, 0xfe80, 0, 0, 0, 0, 0, 0, 0);
+  memcpy(&ipaddr->u8[8], &UIP_IP_BUF->destipaddr.u8[8], 8);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_insert_srh_header(void)
+{
+  rpl_dag_t *dag;
+  rpl_ns_node_t *dest_node;
+  rpl_ns_node_t *node;
+  uip_ipaddr_t addr;
+  uint8_t *hop_ptr;
+  uint8_t path_len;
+  uint8_t cmpri;
+  uint8_t cmpre;
+  uint8_t cmpr;
+  uint8_t pad;
+  uint16_t addr_len;
+  uint16_t srh_len;
+  uint16_t plen;
+  int uip_ext_opt_offset;
+
+  dag = srh_root_dag();
+  if(dag == NULL) {
+    return 0;
+  }
+
+  uip_ext_len = 0;
+  uip_ext_opt_offset = 2;
+
+  /* The RPL option of packets we forward into the DODAG is useless once
+     they are source routed */
+  if(UIP_IP_BUF->proto == UIP_PROTO_HBHO &&
+     UIP_HBHO_BUF->len == RPL_HOP_BY_HOP_LEN - 8 &&
+     UIP_EXT_HDR_OPT_BUF->type == UIP_EXT_HDR_OPT_RPL &&
+     rpl_ns_is_node_reachable(dag, &UIP_IP_BUF->destipaddr)) {
+    rpl_remove_header();
+  }
+  if(UIP_IP_BUF->proto == UIP_PROTO_HBHO ||
+     UIP_IP_BUF->proto == UIP_PROTO_ROUTING ||
+     uip_is_addr_link_local(&UIP_IP_BUF->destipaddr) ||
+     !rpl_ns_is_node_reachable(dag, &UIP_IP_BUF->destipaddr)) {
+    return 0;
+  }
+
+  /* Hops below us, and how much of their addresses the SRH elides. Each
+     hop is the IPv6 destination that provides the elided bytes of the
+     next address, all of them share cmpri bytes with the destination */
+  dest_node = rpl_ns_get_node(dag, &UIP_IP_BUF->destipaddr);
+  cmpri = 15;
+  cmpre = 15;
+  path_len = 1;
+  for(node = dest_node->parent; node->parent != NULL; node = node->parent) {
+    rpl_ns_get_node_global_addr(&addr, node);
+    cmpr = srh_common_prefix(&addr, &UIP_IP_BUF->destipaddr);
+    if(path_len == 1) {
+      cmpre = cmpr;
+    }
+    if(cmpr < cmpri) {
+      cmpri = cmpr;
+    }
+    path_len++;
+  }
+  if(path_len == 1) {
+    /* A child of ours, see rpl_srh_get_next_hop() */
+    return 0;
+  }
+
+  addr_len = (path_len - 2) * (16 - cmpri) + (16 - cmpre);
+  pad = (8 - (RPL_RH_LEN + RPL_SRH_LEN + addr_len) % 8) % 8;
+  srh_len = RPL_RH_LEN + RPL_SRH_LEN + addr_len + pad;
+  if(uip_len + srh_len > UIP_BUFSIZE - UIP_LLH_LEN) {
+    PRINTF("RPL: Packet too long: impossible to add source routing header\n");
+    return 1;
+  }
+
+  memmove(UIP_EXT_BUF_AT(srh_len), UIP_EXT_BUF_AT(0), uip_len - UIP_IPH_LEN);
+  UIP_RH_BUF->next = UIP_IP_BUF->proto;
+  UIP_RH_BUF->len = srh_len / 8 - 1;
+  UIP_RH_BUF->routing_type = RPL_RH_TYPE_SRH;
+  UIP_RH_BUF->seg_left = path_len - 1;
+  UIP_RPL_SRH_BUF->cmpr = (cmpri << 4) | cmpre;
+  UIP_RPL_SRH_BUF->pad = pad << 4;
+  UIP_RPL_SRH_BUF->reserved[0] = 0;
+  UIP_RPL_SRH_BUF->reserved[1] = 0;
+
+  /* Fill the addresses backwards, from the destination up to the second
+     hop; the first hop becomes the IPv6 destination */
+  hop_ptr = UIP_EXT_BUF_AT(RPL_RH_LEN + RPL_SRH_LEN + addr_len);
+  memset(hop_ptr, 0, pad);
+  hop_ptr -= 16 - cmpre;
+  memcpy(hop_ptr, &UIP_IP_BUF->destipaddr.u8[cmpre], 16 - cmpre);
+  for(node = dest_node->parent; node->parent->parent != NULL;
+      node = node->parent) {
+    rpl_ns_get_node_global_addr(&addr, node);
+    hop_ptr -= 16 - cmpri;
+    memcpy(hop_ptr, &addr.u8[cmpri], 16 - cmpri);
+  }
+  rpl_ns_get_node_global_addr(&UIP_IP_BUF->destipaddr, node);
+
+  UIP_IP_BUF->proto = UIP_PROTO_ROUTING;
+  plen = ((UIP_IP_BUF->len[0] << 8) | UIP_IP_BUF->len[1]) + srh_len;
+  UIP_IP_BUF->len[0] = plen >> 8;
+  UIP_IP_BUF->len[1] = plen & 0xff;
+  uip_len += srh_len;
+  uip_ext_len = srh_len;
+
+  PRINTF("RPL: Source routing over %u hops, first hop ", path_len);
+  PRINT6ADDR(&UIP_IP_BUF->destipaddr);
+  PRINTF("\n");
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_process_srh_header(void)
+{
+  uip_ipaddr_t addr;
+  uint8_t *addr_ptr;
+  uint8_t cmpri;
+  uint8_t cmpre;
+  uint8_t cmpr;
+  uint8_t pad;
+  uint8_t seg_left;
+  uint16_t i;
+  uint16_t j;
+  uint16_t n;
+  uint16_t ext_len;
+
+  if(UIP_RH_BUF->routing_type != RPL_RH_TYPE_SRH) {
+    return 0;
+  }
+
+  /* RFC 6554, 4.2. The header must fit in what we received before any
+     of its addresses is touched */
+  ext_len = (UIP_RH_BUF->len + 1) * 8;
+  if(UIP_IPH_LEN + uip_ext_len + ext_len > uip_len) {
+    PRINTF("RPL: Source routing header longer than the packet\n");
+    return 0;
+  }
+  cmpri = UIP_RPL_SRH_BUF->cmpr >> 4;
+  cmpre = UIP_RPL_SRH_BUF->cmpr & 0x0f;
+  pad = UIP_RPL_SRH_BUF->pad >> 4;
+  if(ext_len < RPL_RH_LEN + RPL_SRH_LEN + pad + (16 - cmpre)) {
+    PRINTF("RPL: Malformed source routing header\n");
+    return 0;
+  }
+  n = (ext_len - RPL_RH_LEN - RPL_SRH_LEN - pad - (16 - cmpre)) /
+      (16 - cmpri) + 1;
+  seg_left = UIP_RH_BUF->seg_left;
+  if(seg_left == 0 || seg_left > n) {
+    PRINTF("RPL: Source routing header with %u of %u segments left\n",
+           seg_left, n);
+    return 0;
+  }
+
+  seg_left--;
+  i = n - seg_left;
+  addr_ptr = UIP_EXT_BUF_AT(RPL_RH_LEN + RPL_SRH_LEN + (i - 1) * (16 - cmpri));
+
+  /* None of the hops left may be multicast or one of ours, that would
+     be a loop */
+  uip_ipaddr_copy(&addr, &UIP_IP_BUF->destipaddr);
+  for(j = i; j <= n; j++) {
+    cmpr = j == n ? cmpre : cmpri;
+    memcpy(&addr.u8[cmpr],
+           UIP_EXT_BUF_AT(RPL_RH_LEN + RPL_SRH_LEN + (j - 1) * (16 - cmpri)),
+           16 - cmpr);
+    if(uip_is_addr_mcast(&addr) || uip_ds6_is_my_addr(&addr)) {
+      PRINTF("RPL: Bad hop in source routing header\n");
+      return 0;
+    }
+  }
+
+  /* Swap the destination with the next address of the route */
+  cmpr = seg_left == 0 ? cmpre : cmpri;
+  uip_ipaddr_copy(&addr, &UIP_IP_BUF->destipaddr);
+  memcpy(&UIP_IP_BUF->destipaddr.u8[cmpr], addr_ptr, 16 - cmpr);
+  memcpy(addr_ptr, &addr.u8[cmpr], 16 - cmpr);
+  UIP_RH_BUF->seg_left = seg_left;
+
+  PRINTF("RPL: Source routing to ");
+  PRINT6ADDR(&UIP_IP_BUF->destipaddr);
+  PRINTF(", %u segments left\n", seg_left);
+  return 1;
 }
+#endif /* RPL_WITH_NON_STORING */
 /*---------------------------------------------------------------------------*/
 /** @} */
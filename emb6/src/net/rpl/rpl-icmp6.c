@@ -47,10 +47,16 @@
 #include "tcpip.h"
 #include "uip.h"
 #include "uip-ds6.h"
+#include "uip-ds6-deadline.h"
 #include "uip-nd6.h"
 #include "uip-icmp6.h"
 #include "rpl-private.h"
+#if RPL_WITH_NON_STORING
+#include "rpl-ns.h"
+#endif /* RPL_WITH_NON_STORING */
 #include "packetbuf.h"
+#include "random.h"
+#include "sicslowpan.h"
 #if UIP_CONF_IPV6_MULTICAST
 #include "uip-mcast6.h"
 #endif
@@ -87,6 +93,24 @@ void RPL_DEBUG_DAO_OUTPUT(rpl_parent_t *);
 #endif
 
 static uint8_t dao_sequence = RPL_LOLLIPOP_INIT;
+static uint8_t dao_path_sequence = RPL_LOLLIPOP_INIT;
+
+/* Targets of our DAOs, oldest first. Those already sent stay until
+   their DAO is acknowledged. */
+struct dao_agg_target {
+  rpl_instance_t *instance;
+  rpl_parent_t *parent;         /* sent to, NULL while queued */
+  uip_ipaddr_t prefix;
+  clock_time_t due;             /* of the retransmission */
+  uint8_t prefixlen;
+  uint8_t lifetime;
+  uint8_t path_sequence;
+  uint8_t sequence;             /* of the DAO that carried it */
+  uint8_t retries;
+};
+static struct dao_agg_target dao_agg[RPL_DAO_AGGREGATION_TARGETS];
+static uint16_t dao_agg_num;
+static struct ctimer dao_agg_timer;
 
 extern rpl_of_t RPL_OF;
 
@@ -119,6 +143,24 @@ get_global_addr(uip_ipaddr_t *addr)
   return 0;
 }
 /*---------------------------------------------------------------------------*/
+#if RPL_WITH_NON_STORING
+/* Address of a parent in the DAG prefix, for the root to build source
+   routes from */
+static int
+get_parent_global_addr(uip_ipaddr_t *addr, rpl_parent_t *p)
+{
+  uip_ipaddr_t *ll;
+
+  ll = rpl_get_parent_ipaddr(p);
+  if(ll == NULL || p->dag->prefix_info.length == 0) {
+    return 0;
+  }
+  memcpy(addr, &p->dag->prefix_info.prefix, 8);
+  memcpy(&addr->u8[8], &ll->u8[8], 8);
+  return 1;
+}
+#endif /* RPL_WITH_NON_STORING */
+/*---------------------------------------------------------------------------*/
 static uint32_t
 get32(uint8_t *buffer, int pos)
 {
@@ -158,6 +200,7 @@ dis_input(void)
   PRINTF("RPL: Received a DIS from ");
   PRINT6ADDR(&UIP_IP_BUF->srcipaddr);
   PRINTF("\n\r");
+  RPL_STAT(rpl_stats.dis_recv++);
 
   for(instance = &instance_table[0], end = instance + RPL_MAX_INSTANCES;
           instance < end; ++instance) {
@@ -207,6 +250,7 @@ dis_output(uip_ipaddr_t *addr)
   PRINTF("\n\r");
 
   uip_icmp6_send(addr, ICMP6_RPL, RPL_CODE_DIS, 2);
+  RPL_STAT(rpl_stats.dis_sent++);
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -220,6 +264,11 @@ dio_input(void)
   int len;
   uip_ipaddr_t from;
   uip_ds6_nbr_t *nbr;
+  const rpl_metric_t *metric;
+#if RPL_DIO_6CO
+  rpl_instance_t *instance;
+  uint8_t ctx_from_parent;
+#endif /* RPL_DIO_6CO */
 
   memset(&dio, 0, sizeof(dio));
 
@@ -239,6 +288,7 @@ dio_input(void)
   PRINTF("RPL: Received a DIO from ");
   PRINT6ADDR(&from);
   PRINTF("\n\r");
+  RPL_STAT(rpl_stats.dio_recv++);
 
   if((nbr = uip_ds6_nbr_lookup(&from)) == NULL) {
     if((nbr = uip_ds6_nbr_add(&from, (uip_lladdr_t *)
@@ -246,6 +296,7 @@ dio_input(void)
                               0, NBR_REACHABLE)) != NULL) {
       /* set reachable timer */
       stimer_set(&nbr->reachable, UIP_ND6_REACHABLE_TIME / 1000);
+      uip_ds6_nbr_schedule(nbr);
       PRINTF("RPL: Neighbor added to neighbor cache \n\r");
       PRINT6ADDR(&from);
       PRINTF(", ");
@@ -294,6 +345,16 @@ dio_input(void)
   PRINT6ADDR(&dio.dag_id);
   PRINTF(", %u)\n\r", dio.preference);
 
+#if RPL_DIO_6CO
+  /* Contexts are only taken over from the preferred parent in our DAG */
+  instance = rpl_get_instance(dio.instance_id);
+  ctx_from_parent = instance != NULL && instance->current_dag != NULL &&
+    instance->current_dag->preferred_parent != NULL &&
+    uip_ipaddr_cmp(&instance->current_dag->dag_id, &dio.dag_id) &&
+    uip_ipaddr_cmp(rpl_get_parent_ipaddr(instance->current_dag->preferred_parent),
+                   &from);
+#endif /* RPL_DIO_6CO */
+
   /* Check if there are any DIO suboptions. */
   for(; i < buffer_length; i += len) {
     subopt_type = buffer[i];
@@ -326,21 +387,18 @@ dio_input(void)
       dio.mc.prec = buffer[i + 4] & 0xf;
       dio.mc.length = buffer[i + 5];
 
+      metric = rpl_find_metric(dio.mc.type);
       if(dio.mc.type == RPL_DAG_MC_NONE) {
         /* No metric container: do nothing */
-      } else if(dio.mc.type == RPL_DAG_MC_ETX) {
-        dio.mc.obj.etx = get16(buffer, i + 6);
+      } else if(metric != NULL && len >= 6 + metric->length) {
+        metric->read(&dio.mc, buffer + i + 6);
 
-        PRINTF("RPL: DAG MC: type %u, flags %u, aggr %u, prec %u, length %u, ETX %u\n\r",
+        PRINTF("RPL: DAG MC: type %u, flags %u, aggr %u, prec %u, length %u\n\r",
            (unsigned)dio.mc.type,
            (unsigned)dio.mc.flags,
            (unsigned)dio.mc.aggr,
            (unsigned)dio.mc.prec,
-           (unsigned)dio.mc.length,
-           (unsigned)dio.mc.obj.etx);
-      } else if(dio.mc.type == RPL_DAG_MC_ENERGY) {
-        dio.mc.obj.energy.flags = buffer[i + 6];
-        dio.mc.obj.energy.energy_est = buffer[i + 7];
+           (unsigned)dio.mc.length);
       } else {
        PRINTF("RPL: Unhandled DAG MC type: %u\n\r", (unsigned)dio.mc.type);
        return;
@@ -407,6 +465,18 @@ dio_input(void)
       PRINTF("RPL: Copying prefix information\n\r");
       memcpy(&dio.prefix_info.prefix, &buffer[i + 16], 16);
       break;
+#if RPL_DIO_6CO
+    case RPL_OPTION_6CO:
+      if(len < 2 + SICSLOWPAN_CONTEXT_6CO_LEN) {
+        PRINTF("RPL: Invalid 6CO, len = %d\n\r", len);
+        RPL_STAT(rpl_stats.malformed_msgs++);
+        return;
+      }
+      if(ctx_from_parent) {
+        sicslowpan_context_6co_input(&buffer[i + 2], len - 2);
+      }
+      break;
+#endif /* RPL_DIO_6CO */
     default:
       PRINTF("RPL: Unsupported suboption type in DIO: %u\n\r",
     (unsigned)subopt_type);
@@ -429,6 +499,7 @@ dio_output(rpl_instance_t *instance, uip_ipaddr_t *uc_addr)
   rpl_dag_t *dag = instance->current_dag;
 #if !RPL_LEAF_ONLY
   uip_ipaddr_t addr;
+  const rpl_metric_t *metric;
 #endif /* !RPL_LEAF_ONLY */
 
 #if RPL_LEAF_ONLY
@@ -479,26 +550,22 @@ dio_output(rpl_instance_t *instance, uip_ipaddr_t *uc_addr)
 #if !RPL_LEAF_ONLY
   if(instance->mc.type != RPL_DAG_MC_NONE) {
     instance->of->update_metric_container(instance);
-
+  }
+  metric = rpl_find_metric(instance->mc.type);
+  if(metric != NULL) {
     buffer[pos++] = RPL_OPTION_DAG_METRIC_CONTAINER;
-    buffer[pos++] = 6;
+    buffer[pos++] = 4 + metric->length;
     buffer[pos++] = instance->mc.type;
     buffer[pos++] = instance->mc.flags >> 1;
     buffer[pos] = (instance->mc.flags & 1) << 7;
     buffer[pos++] |= (instance->mc.aggr << 4) | instance->mc.prec;
-    if(instance->mc.type == RPL_DAG_MC_ETX) {
-      buffer[pos++] = 2;
-      set16(buffer, pos, instance->mc.obj.etx);
-      pos += 2;
-    } else if(instance->mc.type == RPL_DAG_MC_ENERGY) {
-      buffer[pos++] = 2;
-      buffer[pos++] = instance->mc.obj.energy.flags;
-      buffer[pos++] = instance->mc.obj.energy.energy_est;
-    } else {
-      PRINTF("RPL: Unable to send DIO because of unhandled DAG MC type %u\n\r",
+    buffer[pos++] = metric->length;
+    metric->write(&instance->mc, buffer + pos);
+    pos += metric->length;
+  } else if(instance->mc.type != RPL_DAG_MC_NONE) {
+    PRINTF("RPL: Unable to send DIO because of unhandled DAG MC type %u\n\r",
     (unsigned)instance->mc.type);
-      return;
-    }
+    return;
   }
 #endif /* !RPL_LEAF_ONLY */
 
@@ -543,6 +610,17 @@ dio_output(rpl_instance_t *instance, uip_ipaddr_t *uc_addr)
            dag->prefix_info.length);
   }
 
+#if RPL_DIO_6CO
+  {
+    struct sicslowpan_addr_context *ctx = NULL;
+    while((ctx = sicslowpan_context_next(ctx)) != NULL) {
+      buffer[pos++] = RPL_OPTION_6CO;
+      buffer[pos++] = SICSLOWPAN_CONTEXT_6CO_LEN;
+      pos += sicslowpan_context_6co_write(&buffer[pos], ctx);
+    }
+  }
+#endif /* RPL_DIO_6CO */
+
 #if RPL_LEAF_ONLY
 #if (DEBUG) & DEBUG_PRINT
   if(uc_addr == NULL) {
@@ -569,36 +647,674 @@ dio_output(rpl_instance_t *instance, uip_ipaddr_t *uc_addr)
     uip_icmp6_send(uc_addr, ICMP6_RPL, RPL_CODE_DIO, pos);
   }
 #endif /* RPL_LEAF_ONLY */
+  RPL_STAT(rpl_stats.dio_sent++);
+}
+/*---------------------------------------------------------------------------*/
+/* The DAO base object, returns where the options start */
+static int
+dao_header(unsigned char *buffer, rpl_instance_t *instance, rpl_dag_t *dag)
+{
+  int pos;
+
+  RPL_LOLLIPOP_INCREMENT(dao_sequence);
+  pos = 0;
+
+  buffer[pos++] = instance->instance_id;
+  buffer[pos] = 0;
+#if RPL_DAO_SPECIFY_DAG
+  buffer[pos] |= RPL_DAO_D_FLAG;
+#endif /* RPL_DAO_SPECIFY_DAG */
+#if RPL_WITH_DAO_ACK
+  buffer[pos] |= RPL_DAO_K_FLAG;
+#endif /* RPL_WITH_DAO_ACK */
+  ++pos;
+  buffer[pos++] = 0; /* reserved */
+  buffer[pos++] = dao_sequence;
+#if RPL_DAO_SPECIFY_DAG
+  memcpy(buffer + pos, &dag->dag_id, sizeof(dag->dag_id));
+  pos+=sizeof(dag->dag_id);
+#endif /* RPL_DAO_SPECIFY_DAG */
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static int
+dao_target(unsigned char *buffer, int pos, const uip_ipaddr_t *prefix,
+           uint8_t prefixlen)
+{
+  buffer[pos++] = RPL_OPTION_TARGET;
+  buffer[pos++] = 2 + ((prefixlen + 7) / CHAR_BIT);
+  buffer[pos++] = 0; /* reserved */
+  buffer[pos++] = prefixlen;
+  memcpy(buffer + pos, prefix, (prefixlen + 7) / CHAR_BIT);
+  return pos + ((prefixlen + 7) / CHAR_BIT);
+}
+/*---------------------------------------------------------------------------*/
+static int
+dao_transit(unsigned char *buffer, int pos, uint8_t path_sequence,
+            uint8_t lifetime, const uip_ipaddr_t *parent)
+{
+  buffer[pos++] = RPL_OPTION_TRANSIT;
+  buffer[pos++] = parent != NULL ? 20 : 4;
+  buffer[pos++] = 0; /* flags - ignored */
+  buffer[pos++] = 0; /* path control - ignored */
+  buffer[pos++] = path_sequence;
+  buffer[pos++] = lifetime;
+  if(parent != NULL) {
+    memcpy(buffer + pos, parent, 16);
+    pos += 16;
+  }
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static void
+dao_agg_timeout(void *ptr)
+{
+  dao_output_flush();
+}
+/*---------------------------------------------------------------------------*/
+#if RPL_WITH_DAO_ACK
+static struct ctimer dao_rtx_timer;
+static void dao_rtx_timeout(void *ptr);
+/*---------------------------------------------------------------------------*/
+static clock_time_t
+dao_rtx_interval(uint8_t retries)
+{
+  clock_time_t interval;
+
+  /* Some jitter keeps the children of a parent from retrying in step */
+  interval = (clock_time_t)RPL_DAO_RETRANSMISSION_TIMEOUT << retries;
+  return interval -
+    ((uint32_t)(interval / 4) * random_rand()) / RANDOM_RAND_MAX;
+}
+/*---------------------------------------------------------------------------*/
+static void
+dao_rtx_arm(void)
+{
+  clock_time_t now;
+  clock_time_t due;
+  uint16_t i;
+  uint8_t pending;
+
+  pending = 0;
+  due = 0;
+  for(i = 0; i < dao_agg_num; i++) {
+    if(dao_agg[i].parent != NULL &&
+       (!pending || UIP_DS6_DEADLINE_BEFORE(dao_agg[i].due, due))) {
+      due = dao_agg[i].due;
+      pending = 1;
+    }
+  }
+  if(!pending) {
+    ctimer_stop(&dao_rtx_timer);
+    return;
+  }
+  now = bsp_getTick();
+  ctimer_set(&dao_rtx_timer,
+             UIP_DS6_DEADLINE_BEFORE(now, due) ? due - now : 0,
+             dao_rtx_timeout, NULL);
+}
+/*---------------------------------------------------------------------------*/
+/* Let the objective function pick another parent */
+static void
+dao_parent_failed(rpl_instance_t *instance, rpl_parent_t *parent)
+{
+  PRINTF("RPL: No DAO-ACK from parent ");
+  PRINT6ADDR(rpl_get_parent_ipaddr(parent));
+  PRINTF(", dropping it\n\r");
+  RPL_STAT(rpl_stats.dao_parent_failures++);
+  parent->rank = INFINITE_RANK;
+  rpl_process_parent_event(instance, parent);
+}
+/*---------------------------------------------------------------------------*/
+static void
+dao_rtx_timeout(void *ptr)
+{
+  struct dao_agg_target *t;
+  rpl_dag_t *dag;
+  clock_time_t now;
+  uint16_t i;
+
+  now = bsp_getTick();
+  for(i = 0; i < dao_agg_num; i++) {
+    t = &dao_agg[i];
+    if(t->parent == NULL || UIP_DS6_DEADLINE_BEFORE(now, t->due) ||
+       !t->instance->used) {
+      continue;
+    }
+    dag = t->instance->current_dag;
+    if(dag == NULL || t->parent != dag->preferred_parent) {
+      /* Sent to a former parent, start over with the current one */
+      t->retries = 0;
+    } else if(t->retries++ == RPL_DAO_MAX_RETRANSMISSIONS) {
+      t->retries = 0;
+      /* Missing DAO-ACKs alone may be a busy parent, only give it up if
+         the link layer loses frames to it as well */
+      if(t->parent->failures > 0) {
+        dao_parent_failed(t->instance, t->parent);
+      }
+    } else {
+      RPL_STAT(rpl_stats.dao_retransmissions++);
+    }
+    t->parent = NULL;
+  }
+  /* Sends the targets again, and drops those of an unused instance */
+  dao_output_flush();
+}
+/*---------------------------------------------------------------------------*/
+/* Only the node the DAO was sent to may acknowledge it: the parent, or
+   the root in non-storing mode */
+static int
+dao_ack_sender_valid(rpl_instance_t *instance, struct dao_agg_target *t,
+                     const uip_ipaddr_t *from)
+{
+  uip_ipaddr_t *addr;
+
+#if RPL_WITH_NON_STORING
+  if(RPL_IS_NON_STORING(instance)) {
+    return instance->current_dag != NULL &&
+      uip_ipaddr_cmp(&instance->current_dag->dag_id, from);
+  }
+#endif /* RPL_WITH_NON_STORING */
+  addr = rpl_get_parent_ipaddr(t->parent);
+  return addr != NULL && uip_ipaddr_cmp(addr, from);
+}
+/*---------------------------------------------------------------------------*/
+static void
+dao_ack_received(rpl_instance_t *instance, const uip_ipaddr_t *from,
+                 uint8_t sequence, uint8_t status)
+{
+  struct dao_agg_target *t;
+  rpl_parent_t *failed;
+  uint16_t i;
+  uint16_t j;
+  uint8_t requeued;
+
+  failed = NULL;
+  requeued = 0;
+  for(i = 0, j = 0; i < dao_agg_num; i++) {
+    t = &dao_agg[i];
+    if(t->instance == instance && t->parent != NULL &&
+       t->sequence == sequence && dao_ack_sender_valid(instance, t, from)) {
+      if(status == RPL_DAO_ACK_UNCONDITIONAL_ACCEPT) {
+        continue;
+      }
+      if(status < RPL_DAO_ACK_UNABLE_TO_ACCEPT) {
+        /* The parent is there but short of room, send again later
+           without counting this as a lost DAO */
+        t->retries = 0;
+        t->due = bsp_getTick() + dao_rtx_interval(0);
+      } else {
+        /* Rejected, the parent wants us to find another one */
+        if(instance->current_dag != NULL &&
+           t->parent == instance->current_dag->preferred_parent) {
+          failed = t->parent;
+        }
+        t->parent = NULL;
+        t->retries = 0;
+        requeued = 1;
+      }
+    }
+    if(i != j) {
+      dao_agg[j] = *t;
+    }
+    j++;
+  }
+  if(j < dao_agg_num) {
+    RPL_STAT(rpl_stats.dao_acked++);
+  }
+  dao_agg_num = j;
+
+  if(failed != NULL) {
+    dao_parent_failed(instance, failed);
+  }
+  if(requeued) {
+    /* uip_buf still holds the DAO-ACK */
+    ctimer_set(&dao_agg_timer, 0, dao_agg_timeout, NULL);
+  }
+  dao_rtx_arm();
+}
+#endif /* RPL_WITH_DAO_ACK */
+/*---------------------------------------------------------------------------*/
+/* Queue a target for the next DAO. Unless may_flush is set, uip_buf is
+   in use and a full queue cannot be sent right away. */
+static int
+dao_agg_add(rpl_instance_t *instance, const uip_ipaddr_t *prefix,
+            uint8_t prefixlen, uint8_t lifetime, uint8_t path_sequence,
+            int may_flush)
+{
+  struct dao_agg_target *t;
+  uint16_t i;
+
+  /* A newer announcement of a queued or unacknowledged target
+     replaces it */
+  for(i = 0; i < dao_agg_num; i++) {
+    t = &dao_agg[i];
+    if(t->instance == instance && t->prefixlen == prefixlen &&
+       uip_ipaddr_cmp(&t->prefix, prefix)) {
+      break;
+    }
+  }
+
+  if(i == dao_agg_num) {
+    if(dao_agg_num == RPL_DAO_AGGREGATION_TARGETS) {
+      if(!may_flush) {
+        PRINTF("RPL: DAO aggregation queue full\n\r");
+        RPL_STAT(rpl_stats.mem_overflows++);
+        ctimer_set(&dao_agg_timer, 0, dao_agg_timeout, NULL);
+        return 0;
+      }
+      /* Only targets waiting for an acknowledgement leave room */
+      dao_output_flush();
+      if(dao_agg_num == RPL_DAO_AGGREGATION_TARGETS) {
+        PRINTF("RPL: DAO aggregation queue full\n\r");
+        RPL_STAT(rpl_stats.mem_overflows++);
+        return 0;
+      }
+    }
+    t = &dao_agg[dao_agg_num++];
+    t->instance = instance;
+    uip_ipaddr_copy(&t->prefix, prefix);
+    t->prefixlen = prefixlen;
+  } else if(t->parent == NULL) {
+    /* The queued announcement is never sent */
+    RPL_STAT(rpl_stats.dao_suppressed++);
+  }
+  t->parent = NULL;
+  t->retries = 0;
+  t->lifetime = lifetime;
+  t->path_sequence = path_sequence;
+
+  /* The delay runs from the first target, later ones do not extend it */
+  if(ctimer_expired(&dao_agg_timer)) {
+    ctimer_set(&dao_agg_timer, RPL_DAO_AGGREGATION_DELAY,
+               dao_agg_timeout, NULL);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+dao_output_queue(rpl_instance_t *instance, uip_ipaddr_t *target,
+                 uint8_t lifetime)
+{
+  uip_ipaddr_t prefix;
+
+  /* Our own address starts a new path sequence */
+  if(target == NULL) {
+    if(get_global_addr(&prefix) == 0) {
+      PRINTF("RPL: No global address set for this node - suppressing DAO\n\r");
+      return;
+    }
+    target = &prefix;
+    RPL_LOLLIPOP_INCREMENT(dao_path_sequence);
+  }
+  dao_agg_add(instance, target, sizeof(*target) * CHAR_BIT, lifetime,
+              dao_path_sequence, 1);
+}
+/*---------------------------------------------------------------------------*/
+void
+dao_output_flush(void)
+{
+  struct dao_agg_target *t;
+  rpl_instance_t *instance;
+  rpl_dag_t *dag;
+  rpl_parent_t *parent;
+  uip_ipaddr_t *dest;
+  uip_ipaddr_t *transit_parent;
+#if RPL_WITH_NON_STORING
+  uip_ipaddr_t parent_addr;
+#endif /* RPL_WITH_NON_STORING */
+  unsigned char *buffer;
+  uint8_t lifetime;
+  uint8_t path_sequence;
+  uint8_t group;
+  uint8_t same;
+  uint16_t first;
+  uint16_t i;
+  uint16_t j;
+  int transit_len;
+  int pos;
+
+  ctimer_stop(&dao_agg_timer);
+  buffer = UIP_ICMP_PAYLOAD;
+  lifetime = 0;
+  path_sequence = 0;
+
+  /* One DAO per round, for the instance of the oldest target still to
+     send. Targets with the same transit information share one transit
+     option. */
+  for(;;) {
+    first = 0;
+    while(first < dao_agg_num && dao_agg[first].parent != NULL) {
+      first++;
+    }
+    if(first == dao_agg_num) {
+      break;
+    }
+    instance = dao_agg[first].instance;
+    dag = instance->used ? instance->current_dag : NULL;
+    parent = NULL;
+    if(rpl_get_mode() != RPL_MODE_FEATHER && dag != NULL) {
+      parent = dag->preferred_parent;
+    }
+    dest = NULL;
+    transit_parent = NULL;
+    if(parent != NULL) {
+#if RPL_WITH_NON_STORING
+      /* The root learns our parent from the DAO sent directly to it */
+      if(RPL_IS_NON_STORING(instance)) {
+        if(get_parent_global_addr(&parent_addr, parent)) {
+          transit_parent = &parent_addr;
+          dest = &dag->dag_id;
+        }
+      } else
+#endif /* RPL_WITH_NON_STORING */
+      {
+        dest = rpl_get_parent_ipaddr(parent);
+      }
+    }
+    if(dest == NULL) {
+      PRINTF("RPL: No DAO parent, dropping queued targets\n\r");
+    }
+    transit_len = transit_parent != NULL ? 22 : 6;
+
+    pos = dest != NULL ? dao_header(buffer, instance, dag) : 0;
+    group = 0;
+    for(i = first, j = first; i < dao_agg_num; i++) {
+      t = &dao_agg[i];
+      if(t->instance == instance && t->parent == NULL) {
+        if(dest == NULL) {
+          continue;
+        }
+        same = group && t->lifetime == lifetime &&
+          t->path_sequence == path_sequence;
+        /* Leave room to close the group with a transit option */
+        if(pos + 4 + (t->prefixlen + 7) / CHAR_BIT + transit_len +
+           (group && !same ? transit_len : 0) <= RPL_DAO_MAX_LEN) {
+          if(group && !same) {
+            pos = dao_transit(buffer, pos, path_sequence, lifetime,
+                              transit_parent);
+          }
+          pos = dao_target(buffer, pos, &t->prefix, t->prefixlen);
+          lifetime = t->lifetime;
+          path_sequence = t->path_sequence;
+          group = 1;
+#if RPL_WITH_DAO_ACK
+          /* Kept until the parent acknowledges this DAO */
+          t->parent = parent;
+          t->sequence = dao_sequence;
+          t->due = bsp_getTick() + dao_rtx_interval(t->retries);
+#else /* RPL_WITH_DAO_ACK */
+          continue;
+#endif /* RPL_WITH_DAO_ACK */
+        }
+      }
+      if(i != j) {
+        dao_agg[j] = *t;
+      }
+      j++;
+    }
+    dao_agg_num = j;
+
+    if(group) {
+      pos = dao_transit(buffer, pos, path_sequence, lifetime, transit_parent);
+      PRINTF("RPL: Sending aggregated DAO of %d bytes to ", pos);
+      PRINT6ADDR(dest);
+      PRINTF("\n\r");
+      RPL_STAT(rpl_stats.dao_sent++);
+      uip_icmp6_send(dest, ICMP6_RPL, RPL_CODE_DAO, pos);
+    }
+  }
+#if RPL_WITH_DAO_ACK
+  dao_rtx_arm();
+#endif /* RPL_WITH_DAO_ACK */
+}
+/*---------------------------------------------------------------------------*/
+/* A DAO being processed, shared by its targets */
+struct dao_in {
+  rpl_instance_t *instance;
+  rpl_dag_t *dag;
+  rpl_parent_t *parent;
+  uip_ipaddr_t *sender;
+  int learned_from;
+  uint8_t lifetime;
+  uint8_t path_sequence;
+#if RPL_WITH_NON_STORING
+  uip_ipaddr_t *transit_parent;
+#endif /* RPL_WITH_NON_STORING */
+};
+/*---------------------------------------------------------------------------*/
+/* Pass a target of the sub-DODAG on to our parent */
+static int
+dao_forward(struct dao_in *in, uip_ipaddr_t *prefix, uint8_t prefixlen)
+{
+  if(in->learned_from != RPL_ROUTE_FROM_UNICAST_DAO ||
+     in->dag->preferred_parent == NULL) {
+    return 1;
+  }
+  return dao_agg_add(in->instance, prefix, prefixlen, in->lifetime,
+                     in->path_sequence, 0);
+}
+/*---------------------------------------------------------------------------*/
+#if RPL_WITH_NON_STORING
+/* The DAO came straight to us, the root, record the link it announces */
+static int
+dao_ns_target_input(struct dao_in *in, uip_ipaddr_t *prefix)
+{
+  uip_ipaddr_t lladdr;
+  uip_ds6_nbr_t *nbr;
+
+  if(in->transit_parent == NULL) {
+    PRINTF("RPL: Dropping non-storing target without parent\n\r");
+    return 0;
+  }
+  if(in->lifetime == RPL_ZERO_LIFETIME) {
+    PRINTF("RPL: No-Path DAO received\n\r");
+    rpl_ns_expire_parent(in->dag, prefix, in->transit_parent);
+    return 1;
+  }
+  if(rpl_ns_update_node(in->dag, prefix, in->transit_parent,
+                        RPL_LIFETIME(in->instance, in->lifetime)) == NULL) {
+    RPL_STAT(rpl_stats.mem_overflows++);
+    PRINTF("RPL: Could not add a node after receiving a DAO\n\r");
+    return 0;
+  }
+  /* A child of ours sent it over the last hop, learn its link-layer
+     address as we would in storing mode */
+  if(uip_ds6_is_my_addr(in->transit_parent)) {
+    uip_ip6addr(&lladdr, 0xfe80, 0, 0, 0, 0, 0, 0, 0);
+    memcpy(&lladdr.u8[8], &prefix->u8[8], 8);
+    if(uip_ds6_nbr_lookup(&lladdr) == NULL &&
+       (nbr = uip_ds6_nbr_add(&lladdr,
+          (uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER),
+          0, NBR_REACHABLE)) != NULL) {
+      stimer_set(&nbr->reachable, UIP_ND6_REACHABLE_TIME / 1000);
+      uip_ds6_nbr_schedule(nbr);
+    }
+  }
+  return 1;
+}
+#endif /* RPL_WITH_NON_STORING */
+/*---------------------------------------------------------------------------*/
+static int
+dao_target_input(struct dao_in *in, uip_ipaddr_t *prefix, uint8_t prefixlen)
+{
+  uip_ds6_route_t *rep;
+  uip_ds6_nbr_t *nbr;
+
+  PRINTF("RPL: DAO lifetime: %u, prefix length: %u prefix: ",
+          (unsigned)in->lifetime, (unsigned)prefixlen);
+  PRINT6ADDR(prefix);
+  PRINTF("\n\r");
+
+#if RPL_WITH_NON_STORING
+  if(RPL_IS_NON_STORING(in->instance)) {
+    return dao_ns_target_input(in, prefix);
+  }
+#endif /* RPL_WITH_NON_STORING */
+
+#if RPL_CONF_MULTICAST
+  if(uip_is_addr_mcast_global(prefix)) {
+      mcast_group = uip_mcast6_route_add(prefix);
+      if(mcast_group) {
+          mcast_group->dag = in->dag;
+          mcast_group->lifetime = RPL_LIFETIME(in->instance, in->lifetime);
+      }
+      return dao_forward(in, prefix, prefixlen);
+  }
+#endif
+
+  rep = uip_ds6_route_lookup(prefix);
+
+  if(in->lifetime == RPL_ZERO_LIFETIME) {
+    PRINTF("RPL: No-Path DAO received\n\r");
+    /* No-Path DAO received; invoke the route purging routine. */
+    if(rep != NULL &&
+       rep->state.nopath_received == 0 &&
+       rep->length == prefixlen &&
+       uip_ds6_route_nexthop(rep) != NULL &&
+       uip_ipaddr_cmp(uip_ds6_route_nexthop(rep), in->sender)) {
+      PRINTF("RPL: Setting expiration timer for prefix ");
+      PRINT6ADDR(prefix);
+      PRINTF("\n\r");
+      rep->state.nopath_received = 1;
+      rep->state.lifetime = DAO_EXPIRATION_TIMEOUT;
+      /* The no-path goes on to our parent, if we have one. */
+      return dao_forward(in, prefix, prefixlen);
+    }
+    return 1;
+  }
+
+  PRINTF("RPL: adding DAO route\n\r");
+
+  if((nbr = uip_ds6_nbr_lookup(in->sender)) == NULL) {
+      if((nbr = uip_ds6_nbr_add(in->sender,
+              (uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER),
+              0, NBR_REACHABLE)) != NULL) {
+          /* set reachable timer */
+          stimer_set(&nbr->reachable, UIP_ND6_REACHABLE_TIME / 1000);
+          uip_ds6_nbr_schedule(nbr);
+          PRINTF("RPL: Neighbor added to neighbor cache ");
+          PRINT6ADDR(in->sender);
+          PRINTF(", ");
+          PRINTLLADDR((uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER));
+          PRINTF("\n");
+      } else {
+          PRINTF("RPL: Out of Memory, dropping DAO from ");
+          PRINT6ADDR(in->sender);
+          PRINTF(", ");
+          PRINTLLADDR((uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER));
+          PRINTF("\n");
+          return 0;
+      }
+  }
+
+  rpl_lock_parent(in->parent);
+
+  rep = rpl_add_route(in->dag, prefix, prefixlen, in->sender);
+  if(rep == NULL) {
+    RPL_STAT(rpl_stats.mem_overflows++);
+    PRINTF("RPL: Could not add a route after receiving a DAO\n\r");
+    return 0;
+  }
+
+  rep->state.lifetime = RPL_LIFETIME(in->instance, in->lifetime);
+  rep->state.learned_from = in->learned_from;
+  rep->state.nopath_received = 0;
+
+  return dao_forward(in, prefix, prefixlen);
+}
+/*---------------------------------------------------------------------------*/
+/* Every option must fit in the DAO, and targets and transit information
+   in their own option, before any of them is acted upon */
+static int
+dao_options_valid(const unsigned char *buffer, int pos, int buffer_length)
+{
+  int len;
+  int i;
+
+  for(i = pos; i < buffer_length; i += len) {
+    if(buffer[i] == RPL_OPTION_PAD1) {
+      len = 1;
+      continue;
+    }
+    if(i + 2 > buffer_length) {
+      return 0;
+    }
+    len = 2 + buffer[i + 1];
+    if(i + len > buffer_length) {
+      return 0;
+    }
+    switch(buffer[i]) {
+    case RPL_OPTION_TARGET:
+      if(len < 4 || 4 + (buffer[i + 3] + 7) / CHAR_BIT > len) {
+        return 0;
+      }
+      break;
+    case RPL_OPTION_TRANSIT:
+      if(len < 6) {
+        return 0;
+      }
+      break;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* The targets between first and last share the transit information
+   that follows them. The options were checked by dao_options_valid() */
+static int
+dao_targets_input(struct dao_in *in, unsigned char *buffer, int first,
+                  int last)
+{
+  uip_ipaddr_t prefix;
+  uint8_t prefixlen;
+  int ok;
+  int len;
+  int i;
+
+  ok = 1;
+  for(i = first; i < last; i += len) {
+    len = buffer[i] == RPL_OPTION_PAD1 ? 1 : 2 + buffer[i + 1];
+    if(buffer[i] != RPL_OPTION_TARGET) {
+      continue;
+    }
+    prefixlen = buffer[i + 3];
+    if(prefixlen > sizeof(prefix) * CHAR_BIT) {
+      ok = 0;
+      continue;
+    }
+    memset(&prefix, 0, sizeof(prefix));
+    memcpy(&prefix, buffer + i + 4, (prefixlen + 7) / CHAR_BIT);
+    if(!dao_target_input(in, &prefix, prefixlen)) {
+      ok = 0;
+    }
+  }
+  return ok;
 }
 /*---------------------------------------------------------------------------*/
 static void
 dao_input(void)
 {
   uip_ipaddr_t dao_sender_addr;
+  struct dao_in in;
   rpl_dag_t *dag;
   rpl_instance_t *instance;
   unsigned char *buffer;
   uint16_t sequence;
   uint8_t instance_id;
-  uint8_t lifetime;
-  uint8_t prefixlen;
   uint8_t flags;
   uint8_t subopt_type;
-  /*
-  uint8_t pathcontrol;
-  uint8_t pathsequence;
-  */
-  uip_ipaddr_t prefix;
-  uip_ds6_route_t *rep;
-  uint8_t buffer_length;
+#if RPL_WITH_NON_STORING
+  uip_ipaddr_t dao_parent_addr;
+#endif /* RPL_WITH_NON_STORING */
+  uint16_t buffer_length;
   int pos;
   int len;
   int i;
-  int learned_from;
+  int first_target;
+  int ok;
   rpl_parent_t *parent;
-  uip_ds6_nbr_t *nbr;
 
-  prefixlen = 0;
   parent = NULL;
 
   uip_ipaddr_copy(&dao_sender_addr, &UIP_IP_BUF->srcipaddr);
@@ -607,9 +1323,16 @@ dao_input(void)
   PRINTF("RPL: Received a DAO from ");
   PRINT6ADDR(&dao_sender_addr);
   PRINTF("\n\r");
+  RPL_STAT(rpl_stats.dao_recv++);
 
   buffer = UIP_ICMP_PAYLOAD;
   buffer_length = uip_len - uip_l3_icmp_hdr_len;
+  if(buffer_length < 4 ||
+     ((buffer[1] & RPL_DAO_D_FLAG) && buffer_length < 4 + 16)) {
+    PRINTF("RPL: Truncated DAO\n\r");
+    uip_len = 0;
+    return;
+  }
 
   pos = 0;
   instance_id = buffer[pos++];
@@ -621,8 +1344,6 @@ dao_input(void)
     return;
   }
 
-  lifetime = instance->default_lifetime;
-
   flags = buffer[pos++];
   /* reserved */
   pos++;
@@ -638,12 +1359,18 @@ dao_input(void)
     pos += 16;
   }
 
-  learned_from = uip_is_addr_mcast(&dao_sender_addr) ?
+  if(!dao_options_valid(buffer, pos, buffer_length)) {
+    PRINTF("RPL: Dropping a DAO with a truncated option\n\r");
+    uip_len = 0;
+    return;
+  }
+
+  in.learned_from = uip_is_addr_mcast(&dao_sender_addr) ?
           RPL_ROUTE_FROM_MULTICAST_DAO : RPL_ROUTE_FROM_UNICAST_DAO;
 
   PRINTF("RPL: DAO from %s\n",
-          learned_from == RPL_ROUTE_FROM_UNICAST_DAO? "unicast": "multicast");
-  if(learned_from == RPL_ROUTE_FROM_UNICAST_DAO) {
+          in.learned_from == RPL_ROUTE_FROM_UNICAST_DAO? "unicast": "multicast");
+  if(in.learned_from == RPL_ROUTE_FROM_UNICAST_DAO) {
       /* Check whether this is a DAO forwarding loop. */
       parent = rpl_find_parent(dag, &dao_sender_addr);
       /* check if this is a new DAO registration with an "illegal" rank */
@@ -666,7 +1393,24 @@ dao_input(void)
       }
   }
 
-  /* Check if there are any RPL options present. */
+#if RPL_WITH_NON_STORING
+  if(RPL_IS_NON_STORING(instance) && dag->rank != ROOT_RANK(instance)) {
+    PRINTF("RPL: Dropping non-storing DAO, we are not root\n\r");
+    uip_len = 0;
+    return;
+  }
+#endif /* RPL_WITH_NON_STORING */
+
+  in.instance = instance;
+  in.dag = dag;
+  in.parent = parent;
+  in.sender = &dao_sender_addr;
+
+  /* Targets come in groups, each followed by the transit information
+     that applies to all of them. Nothing is sent before the whole DAO
+     is parsed, it is still in uip_buf. */
+  ok = 1;
+  first_target = -1;
   for(i = pos; i < buffer_length; i += len) {
     subopt_type = buffer[i];
     if(subopt_type == RPL_OPTION_PAD1) {
@@ -678,124 +1422,50 @@ dao_input(void)
 
     switch(subopt_type) {
     case RPL_OPTION_TARGET:
-      /* Handle the target option. */
-      prefixlen = buffer[i + 3];
-      memset(&prefix, 0, sizeof(prefix));
-      memcpy(&prefix, buffer + i + 4, (prefixlen + 7) / CHAR_BIT);
+      if(first_target < 0) {
+        first_target = i;
+      }
       break;
     case RPL_OPTION_TRANSIT:
-      /* The path sequence and control are ignored. */
-      /*      pathcontrol = buffer[i + 3];
-              pathsequence = buffer[i + 4];*/
-      lifetime = buffer[i + 5];
-      /* The parent address is also ignored. */
-      break;
-    }
-  }
-
-  PRINTF("RPL: DAO lifetime: %u, prefix length: %u prefix: ",
-          (unsigned)lifetime, (unsigned)prefixlen);
-  PRINT6ADDR(&prefix);
-  PRINTF("\n\r");
-
-#if RPL_CONF_MULTICAST
-  if(uip_is_addr_mcast_global(&prefix)) {
-      mcast_group = uip_mcast6_route_add(&prefix);
-      if(mcast_group) {
-          mcast_group->dag = dag;
-          mcast_group->lifetime = RPL_LIFETIME(instance, lifetime);
+      if(first_target < 0) {
+        break;
       }
-      goto fwd_dao;
-  }
-#endif
-
-  rep = uip_ds6_route_lookup(&prefix);
-
-  if(lifetime == RPL_ZERO_LIFETIME) {
-    PRINTF("RPL: No-Path DAO received\n\r");
-    /* No-Path DAO received; invoke the route purging routine. */
-    if(rep != NULL &&
-       rep->state.nopath_received == 0 &&
-       rep->length == prefixlen &&
-       uip_ds6_route_nexthop(rep) != NULL &&
-       uip_ipaddr_cmp(uip_ds6_route_nexthop(rep), &dao_sender_addr)) {
-      PRINTF("RPL: Setting expiration timer for prefix ");
-      PRINT6ADDR(&prefix);
-      PRINTF("\n\r");
-      rep->state.nopath_received = 1;
-      rep->state.lifetime = DAO_EXPIRATION_TIMEOUT;
-      /* We forward the incoming no-path DAO to our parent, if we have
-           one. */
-      if(dag->preferred_parent != NULL &&
-              rpl_get_parent_ipaddr(dag->preferred_parent) != NULL) {
-          PRINTF("RPL: Forwarding no-path DAO to parent ");
-          PRINT6ADDR(rpl_get_parent_ipaddr(dag->preferred_parent));
-          PRINTF("\n");
-          uip_icmp6_send(rpl_get_parent_ipaddr(dag->preferred_parent),
-                  ICMP6_RPL, RPL_CODE_DAO, buffer_length);
+      in.path_sequence = buffer[i + 4];
+      in.lifetime = buffer[i + 5];
+#if RPL_WITH_NON_STORING
+      /* The parent address is only used in non-storing mode */
+      in.transit_parent = NULL;
+      if(buffer[i + 1] >= 20) {
+        memcpy(&dao_parent_addr, buffer + i + 6, 16);
+        in.transit_parent = &dao_parent_addr;
       }
-      if(flags & RPL_DAO_K_FLAG) {
-          dao_ack_output(instance, &dao_sender_addr, sequence);
+#endif /* RPL_WITH_NON_STORING */
+      if(!dao_targets_input(&in, buffer, first_target, i)) {
+        ok = 0;
       }
+      first_target = -1;
+      break;
     }
-    return;
   }
-
-
-  PRINTF("RPL: adding DAO route\n\r");
-
-  if((nbr = uip_ds6_nbr_lookup(&dao_sender_addr)) == NULL) {
-      if((nbr = uip_ds6_nbr_add(&dao_sender_addr,
-              (uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER),
-              0, NBR_REACHABLE)) != NULL) {
-          /* set reachable timer */
-          stimer_set(&nbr->reachable, UIP_ND6_REACHABLE_TIME / 1000);
-          PRINTF("RPL: Neighbor added to neighbor cache ");
-          PRINT6ADDR(&dao_sender_addr);
-          PRINTF(", ");
-          PRINTLLADDR((uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER));
-          PRINTF("\n");
-      } else {
-          PRINTF("RPL: Out of Memory, dropping DAO from ");
-          PRINT6ADDR(&dao_sender_addr);
-          PRINTF(", ");
-          PRINTLLADDR((uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER));
-          PRINTF("\n");
-          return;
-      }
-  } else {
-      PRINTF("RPL: Neighbor already in neighbor cache\n");
-  }
-
-  rpl_lock_parent(parent);
-
-  rep = rpl_add_route(dag, &prefix, prefixlen, &dao_sender_addr);
-  if(rep == NULL) {
-    RPL_STAT(rpl_stats.mem_overflows++);
-    PRINTF("RPL: Could not add a route after receiving a DAO\n\r");
-    return;
+  if(first_target >= 0) {
+    /* No transit information, use the defaults */
+    in.path_sequence = 0;
+    in.lifetime = instance->default_lifetime;
+#if RPL_WITH_NON_STORING
+    in.transit_parent = NULL;
+#endif /* RPL_WITH_NON_STORING */
+    if(!dao_targets_input(&in, buffer, first_target, buffer_length)) {
+      ok = 0;
+    }
   }
 
-  rep->state.lifetime = RPL_LIFETIME(instance, lifetime);
-  rep->state.learned_from = learned_from;
-  rep->state.nopath_received = 0;
-
-#if RPL_CONF_MULTICAST
-  fwd_dao:
-#endif
-
-  if(learned_from == RPL_ROUTE_FROM_UNICAST_DAO) {
-    if(dag->preferred_parent != NULL &&
-       rpl_get_parent_ipaddr(dag->preferred_parent) != NULL) {
-      PRINTF("RPL: Forwarding DAO to parent ");
-      PRINT6ADDR(rpl_get_parent_ipaddr(dag->preferred_parent));
-      PRINTF("\n\r");
-      uip_icmp6_send(rpl_get_parent_ipaddr(dag->preferred_parent),
-                     ICMP6_RPL, RPL_CODE_DAO, buffer_length);
-    }
-    if(flags & RPL_DAO_K_FLAG) {
-      dao_ack_output(instance, &dao_sender_addr, sequence);
-    }
+  /* A target we could not take, e.g. with our DAO queue full, is sent
+     again by the child after a while */
+  if((flags & RPL_DAO_K_FLAG) &&
+     in.learned_from == RPL_ROUTE_FROM_UNICAST_DAO) {
+    dao_ack_output(instance, &dao_sender_addr, sequence,
+                   ok ? RPL_DAO_ACK_UNCONDITIONAL_ACCEPT :
+                   RPL_DAO_ACK_TRY_LATER);
   }
   uip_len = 0;
 }
@@ -822,6 +1492,7 @@ dao_output_target(rpl_parent_t *parent, uip_ipaddr_t *prefix, uint8_t lifetime)
   rpl_instance_t *instance;
   unsigned char *buffer;
   uint8_t prefixlen;
+  uip_ipaddr_t *dest;
   int pos;
 
   /* Destination Advertisement Object */
@@ -857,66 +1528,65 @@ dao_output_target(rpl_parent_t *parent, uip_ipaddr_t *prefix, uint8_t lifetime)
 #endif
 
   buffer = UIP_ICMP_PAYLOAD;
-
-  RPL_LOLLIPOP_INCREMENT(dao_sequence);
-  pos = 0;
-
-  buffer[pos++] = instance->instance_id;
-  buffer[pos] = 0;
-#if RPL_DAO_SPECIFY_DAG
-  buffer[pos] |= RPL_DAO_D_FLAG;
-#endif /* RPL_DAO_SPECIFY_DAG */
-#if RPL_CONF_DAO_ACK
-  buffer[pos] |= RPL_DAO_K_FLAG;
-#endif /* RPL_CONF_DAO_ACK */
-  ++pos;
-  buffer[pos++] = 0; /* reserved */
-  buffer[pos++] = dao_sequence;
-#if RPL_DAO_SPECIFY_DAG
-  memcpy(buffer + pos, &dag->dag_id, sizeof(dag->dag_id));
-  pos+=sizeof(dag->dag_id);
-#endif /* RPL_DAO_SPECIFY_DAG */
+  pos = dao_header(buffer, instance, dag);
 
   /* create target subopt */
   prefixlen = sizeof(*prefix) * CHAR_BIT;
-  buffer[pos++] = RPL_OPTION_TARGET;
-  buffer[pos++] = 2 + ((prefixlen + 7) / CHAR_BIT);
-  buffer[pos++] = 0; /* reserved */
-  buffer[pos++] = prefixlen;
-  memcpy(buffer + pos, prefix, (prefixlen + 7) / CHAR_BIT);
-  pos += ((prefixlen + 7) / CHAR_BIT);
+  pos = dao_target(buffer, pos, prefix, prefixlen);
 
   /* Create a transit information sub-option. */
   buffer[pos++] = RPL_OPTION_TRANSIT;
-  buffer[pos++] = 4;
+  buffer[pos++] = RPL_IS_NON_STORING(instance) ? 20 : 4;
   buffer[pos++] = 0; /* flags - ignored */
   buffer[pos++] = 0; /* path control - ignored */
   buffer[pos++] = 0; /* path seq - ignored */
   buffer[pos++] = lifetime;
 
+#if RPL_WITH_NON_STORING
+  if(RPL_IS_NON_STORING(instance)) {
+    /* The root learns our parent from the DAO sent directly to it */
+    if(!get_parent_global_addr((uip_ipaddr_t *)(buffer + pos), parent)) {
+      PRINTF("RPL dao_output_target error no parent address\n\r");
+      return;
+    }
+    pos += 16;
+    dest = &dag->dag_id;
+  } else
+#endif /* RPL_WITH_NON_STORING */
+  {
+    dest = rpl_get_parent_ipaddr(parent);
+  }
+
   PRINTF("RPL: Sending DAO with prefix ");
   PRINT6ADDR(prefix);
   PRINTF(" to ");
-  PRINT6ADDR(rpl_get_parent_ipaddr(parent));
+  PRINT6ADDR(dest);
   PRINTF("\n\r");
 
-  if(rpl_get_parent_ipaddr(parent) != NULL) {
-    uip_icmp6_send(rpl_get_parent_ipaddr(parent), ICMP6_RPL, RPL_CODE_DAO, pos);
+  if(dest != NULL) {
+    uip_icmp6_send(dest, ICMP6_RPL, RPL_CODE_DAO, pos);
   }
 }
 /*---------------------------------------------------------------------------*/
 static void
 dao_ack_input(void)
 {
-#if DEBUG
+#if DEBUG || RPL_WITH_DAO_ACK
   unsigned char *buffer;
-  uint8_t buffer_length;
   uint8_t instance_id;
   uint8_t sequence;
   uint8_t status;
+#if RPL_WITH_DAO_ACK
+  rpl_instance_t *instance;
+#endif /* RPL_WITH_DAO_ACK */
+
+  if(uip_len < uip_l3_icmp_hdr_len + 4) {
+    PRINTF("RPL: Truncated DAO-ACK\n\r");
+    uip_len = 0;
+    return;
+  }
 
   buffer = UIP_ICMP_PAYLOAD;
-  buffer_length = uip_len - uip_l3_icmp_hdr_len;
 
   instance_id = buffer[0];
   sequence = buffer[2];
@@ -926,16 +1596,25 @@ dao_ack_input(void)
     sequence, status);
   PRINT6ADDR(&UIP_IP_BUF->srcipaddr);
   PRINTF("\n\r");
-#endif /* DEBUG */
+
+#if RPL_WITH_DAO_ACK
+  instance = rpl_get_instance(instance_id);
+  if(instance != NULL) {
+    dao_ack_received(instance, &UIP_IP_BUF->srcipaddr, sequence, status);
+  }
+#endif /* RPL_WITH_DAO_ACK */
+#endif /* DEBUG || RPL_WITH_DAO_ACK */
   uip_len = 0;
 }
 /*---------------------------------------------------------------------------*/
 void
-dao_ack_output(rpl_instance_t *instance, uip_ipaddr_t *dest, uint8_t sequence)
+dao_ack_output(rpl_instance_t *instance, uip_ipaddr_t *dest, uint8_t sequence,
+               uint8_t status)
 {
   unsigned char *buffer;
 
-  PRINTF("RPL: Sending a DAO ACK with sequence number %d to ", sequence);
+  PRINTF("RPL: Sending a DAO ACK with sequence number %d and status %d to ",
+         sequence, status);
   PRINT6ADDR(dest);
   PRINTF("\n\r");
 
@@ -944,7 +1623,7 @@ dao_ack_output(rpl_instance_t *instance, uip_ipaddr_t *dest, uint8_t sequence)
   buffer[0] = instance->instance_id;
   buffer[1] = 0;
   buffer[2] = sequence;
-  buffer[3] = 0;
+  buffer[3] = status;
 
   uip_icmp6_send(dest, ICMP6_RPL, RPL_CODE_DAO_ACK, 4);
 }
@@ -0,0 +1,443 @@
+/*
+ * emb6 is licensed under the 3-clause BSD license. This license gives everyone
+ * the right to use and distribute the code, either in binary or source code
+ * format, as long as the copyright license is retained in the source code.
+ *
+ * The emb6 is derived from the Contiki OS platform with the explicit approval
+ * from Adam Dunkels. However, emb6 is made independent from the OS through the
+ * removal of protothreads. In addition, APIs are made more flexible to gain
+ * more adaptivity during run-time.
+ *
+ * The license text is:
+ *
+ * Copyright (c) 2015,
+ * Hochschule Offenburg, University of Applied Sciences
+ * Laboratory Embedded Systems and Communications Electronics.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+/**
+ * \file
+ *         Routing metrics (RFC 6551) for the metric-based objective
+ *         functions: ETX, node energy, hop count, latency and link
+ *         quality level, and the ETX estimation of the links.
+ *
+ *         A DODAG uses the metric its root puts in the metric
+ *         container. Further metrics are added to the metrics[] table.
+ */
+
+/**
+ * \addtogroup uip6
+ * @{
+ */
+
+#include "rpl-private.h"
+#include "nbr-table.h"
+
+#define DEBUG DEBUG_NONE
+#include "uip-debug.h"
+
+/* Constants for the ETX moving average */
+#define ETX_SCALE   100
+#define ETX_ALPHA   90
+
+#define MAX_COST                   0xffff
+
+/* Hysteresis h of a metric, scaled like RPL_PARENT_SWITCH_THRESHOLD is */
+#define SWITCH_THRESHOLD(h) \
+  ((uint32_t)(h) * RPL_PARENT_SWITCH_THRESHOLD / (RPL_DAG_MC_ETX_DIVISOR / 2))
+
+/* Energy of this node, see rpl_set_node_energy() */
+static uint8_t node_energy_type = RPL_DAG_MC_ENERGY_TYPE_BATTERY;
+static uint8_t node_energy_level = 0xff;
+static uint8_t node_energy_set;
+
+static uint16_t
+cost_add(uint32_t a, uint32_t b)
+{
+  return a + b > MAX_COST ? MAX_COST : a + b;
+}
+/*---------------------------------------------------------------------------*/
+/* Expected Transmission Count, additive */
+static uint16_t
+etx_cost(const rpl_metric_container_t *mc, uint16_t link_metric)
+{
+  return cost_add(mc->obj.etx, link_metric);
+}
+
+static void
+etx_update(rpl_metric_container_t *mc, const rpl_metric_container_t *parent,
+           uint16_t link_metric)
+{
+  mc->obj.etx = parent == NULL ? 0 : etx_cost(parent, link_metric);
+
+  PRINTF("RPL: My path ETX to the root is %u.%u\n\r",
+    mc->obj.etx / RPL_DAG_MC_ETX_DIVISOR,
+    (mc->obj.etx % RPL_DAG_MC_ETX_DIVISOR * 100) /
+     RPL_DAG_MC_ETX_DIVISOR);
+}
+
+static void
+etx_read(rpl_metric_container_t *mc, const uint8_t *buf)
+{
+  mc->obj.etx = (buf[0] << 8) | buf[1];
+}
+
+static void
+etx_write(const rpl_metric_container_t *mc, uint8_t *buf)
+{
+  buf[0] = mc->obj.etx >> 8;
+  buf[1] = mc->obj.etx & 0xff;
+}
+
+static const rpl_metric_t metric_etx = {
+  RPL_DAG_MC_ETX,
+  RPL_DAG_MC_AGGR_ADDITIVE,
+  2,
+  RPL_PARENT_SWITCH_THRESHOLD,
+  etx_cost,
+  etx_update,
+  etx_read,
+  etx_write
+};
+/*---------------------------------------------------------------------------*/
+/*
+ * Node energy: the estimate accumulates what relaying costs the nodes on
+ * the path, in eighths of a transmission. Mains powered nodes are free,
+ * scavenging ones cost half a transmission, a battery one when full and
+ * up to nine when empty, which steers traffic around depleted relays.
+ */
+static uint8_t
+energy_own_cost(void)
+{
+  switch(node_energy_type) {
+  case RPL_DAG_MC_ENERGY_TYPE_MAINS:
+    return 0;
+  case RPL_DAG_MC_ENERGY_TYPE_SCAVENGING:
+    return 4;
+  default:
+    return 8 + ((0xff - node_energy_level) >> 2);
+  }
+}
+
+static uint16_t
+energy_cost(const rpl_metric_container_t *mc, uint16_t link_metric)
+{
+  return cost_add((uint32_t)mc->obj.energy.energy_est *
+                  (RPL_DAG_MC_ETX_DIVISOR / 8), link_metric);
+}
+
+static void
+energy_update(rpl_metric_container_t *mc, const rpl_metric_container_t *parent,
+              uint16_t link_metric)
+{
+  uint16_t est;
+
+  if(!node_energy_set) {
+    node_energy_type = parent == NULL ? RPL_DAG_MC_ENERGY_TYPE_MAINS :
+      RPL_DAG_MC_ENERGY_TYPE_BATTERY;
+  }
+  est = energy_own_cost();
+  if(parent != NULL) {
+    est += parent->obj.energy.energy_est;
+  }
+  mc->obj.energy.flags = node_energy_type << RPL_DAG_MC_ENERGY_TYPE;
+  mc->obj.energy.energy_est = est > 0xff ? 0xff : est;
+}
+
+static void
+energy_read(rpl_metric_container_t *mc, const uint8_t *buf)
+{
+  mc->obj.energy.flags = buf[0];
+  mc->obj.energy.energy_est = buf[1];
+}
+
+static void
+energy_write(const rpl_metric_container_t *mc, uint8_t *buf)
+{
+  buf[0] = mc->obj.energy.flags;
+  buf[1] = mc->obj.energy.energy_est;
+}
+
+static const rpl_metric_t metric_energy = {
+  RPL_DAG_MC_ENERGY,
+  RPL_DAG_MC_AGGR_ADDITIVE,
+  2,
+  RPL_PARENT_SWITCH_THRESHOLD,
+  energy_cost,
+  energy_update,
+  energy_read,
+  energy_write
+};
+/*---------------------------------------------------------------------------*/
+/*
+ * Hop count. The ETX of the link only breaks ties, it is less than one
+ * hop, and the preferred parent is kept unless a shorter path exists.
+ */
+static uint16_t
+hopcount_cost(const rpl_metric_container_t *mc, uint16_t link_metric)
+{
+  uint16_t hops;
+
+  hops = mc->obj.hopcount < 0xfe ? mc->obj.hopcount + 1 : 0xff;
+  if(link_metric > RPL_MAX_LINK_METRIC * RPL_DAG_MC_ETX_DIVISOR) {
+    link_metric = RPL_MAX_LINK_METRIC * RPL_DAG_MC_ETX_DIVISOR;
+  }
+  return (hops << 8) + (link_metric >> 4);
+}
+
+static void
+hopcount_update(rpl_metric_container_t *mc,
+                const rpl_metric_container_t *parent, uint16_t link_metric)
+{
+  if(parent == NULL) {
+    mc->obj.hopcount = 0;
+  } else {
+    mc->obj.hopcount = parent->obj.hopcount < 0xff ?
+      parent->obj.hopcount + 1 : 0xff;
+  }
+}
+
+static void
+hopcount_read(rpl_metric_container_t *mc, const uint8_t *buf)
+{
+  /* buf[0] holds reserved bits and flags */
+  mc->obj.hopcount = buf[1];
+}
+
+static void
+hopcount_write(const rpl_metric_container_t *mc, uint8_t *buf)
+{
+  buf[0] = 0;
+  buf[1] = mc->obj.hopcount;
+}
+
+static const rpl_metric_t metric_hopcount = {
+  RPL_DAG_MC_HOPCOUNT,
+  RPL_DAG_MC_AGGR_ADDITIVE,
+  2,
+  SWITCH_THRESHOLD(1 << 8),
+  hopcount_cost,
+  hopcount_update,
+  hopcount_read,
+  hopcount_write
+};
+/*---------------------------------------------------------------------------*/
+/*
+ * Latency in microseconds, additive. The cost counts units of 100
+ * microseconds so that paths up to 6.5 seconds compare.
+ */
+#define LATENCY_UNIT     100
+
+static uint32_t
+latency_path(const rpl_metric_container_t *mc, uint16_t link_metric)
+{
+  return mc->obj.latency +
+    (uint32_t)link_metric * RPL_LINK_TX_LATENCY / RPL_DAG_MC_ETX_DIVISOR;
+}
+
+static uint16_t
+latency_cost(const rpl_metric_container_t *mc, uint16_t link_metric)
+{
+  uint32_t cost;
+
+  cost = latency_path(mc, link_metric) / LATENCY_UNIT;
+  return cost > MAX_COST ? MAX_COST : cost;
+}
+
+static void
+latency_update(rpl_metric_container_t *mc,
+               const rpl_metric_container_t *parent, uint16_t link_metric)
+{
+  mc->obj.latency = RPL_NODE_LATENCY;
+  if(parent != NULL) {
+    mc->obj.latency += latency_path(parent, link_metric);
+  }
+}
+
+static void
+latency_read(rpl_metric_container_t *mc, const uint8_t *buf)
+{
+  mc->obj.latency = ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) |
+    ((uint32_t)buf[2] << 8) | buf[3];
+}
+
+static void
+latency_write(const rpl_metric_container_t *mc, uint8_t *buf)
+{
+  buf[0] = mc->obj.latency >> 24;
+  buf[1] = mc->obj.latency >> 16;
+  buf[2] = mc->obj.latency >> 8;
+  buf[3] = mc->obj.latency;
+}
+
+static const rpl_metric_t metric_latency = {
+  RPL_DAG_MC_LATENCY,
+  RPL_DAG_MC_AGGR_ADDITIVE,
+  4,
+  SWITCH_THRESHOLD(RPL_LINK_TX_LATENCY / LATENCY_UNIT / 2),
+  latency_cost,
+  latency_update,
+  latency_read,
+  latency_write
+};
+/*---------------------------------------------------------------------------*/
+/*
+ * Link quality level of the worst link on the path: 1 for an ETX of one,
+ * one level more for every half transmission, at most 7. 0 at the root
+ * means undetermined. The ETX of the link only breaks ties.
+ */
+static uint8_t
+lql_of_link(uint16_t link_metric)
+{
+  uint16_t level;
+
+  if(link_metric < RPL_DAG_MC_ETX_DIVISOR) {
+    return 1;
+  }
+  level = 1 + (link_metric - RPL_DAG_MC_ETX_DIVISOR) /
+    (RPL_DAG_MC_ETX_DIVISOR / 2);
+  return level > 7 ? 7 : level;
+}
+
+static uint8_t
+lql_path(const rpl_metric_container_t *mc, uint16_t link_metric)
+{
+  uint8_t link;
+
+  link = lql_of_link(link_metric);
+  return mc->obj.lql > link ? mc->obj.lql : link;
+}
+
+static uint16_t
+lql_cost(const rpl_metric_container_t *mc, uint16_t link_metric)
+{
+  if(link_metric > RPL_MAX_LINK_METRIC * RPL_DAG_MC_ETX_DIVISOR) {
+    link_metric = RPL_MAX_LINK_METRIC * RPL_DAG_MC_ETX_DIVISOR;
+  }
+  return (lql_path(mc, link_metric) << 8) + (link_metric >> 4);
+}
+
+static void
+lql_update(rpl_metric_container_t *mc, const rpl_metric_container_t *parent,
+           uint16_t link_metric)
+{
+  mc->obj.lql = parent == NULL ? 0 : lql_path(parent, link_metric);
+}
+
+static void
+lql_read(rpl_metric_container_t *mc, const uint8_t *buf)
+{
+  /* buf[0] is reserved, buf[1] holds the value and a counter */
+  mc->obj.lql = buf[1] >> 5;
+}
+
+static void
+lql_write(const rpl_metric_container_t *mc, uint8_t *buf)
+{
+  buf[0] = 0;
+  buf[1] = (mc->obj.lql << 5) | 1;
+}
+
+static const rpl_metric_t metric_lql = {
+  RPL_DAG_MC_LQL,
+  RPL_DAG_MC_AGGR_MAXIMUM,
+  2,
+  SWITCH_THRESHOLD(1 << 8),
+  lql_cost,
+  lql_update,
+  lql_read,
+  lql_write
+};
+/*---------------------------------------------------------------------------*/
+static const rpl_metric_t * const metrics[] = {
+  &metric_etx,
+  &metric_energy,
+  &metric_hopcount,
+  &metric_latency,
+  &metric_lql
+};
+/*---------------------------------------------------------------------------*/
+const rpl_metric_t *
+rpl_find_metric(uint8_t type)
+{
+  unsigned int i;
+
+  for(i = 0; i < sizeof(metrics) / sizeof(metrics[0]); i++) {
+    if(metrics[i]->type == type) {
+      return metrics[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_set_node_energy(uint8_t type, uint8_t level)
+{
+  node_energy_type = type;
+  node_energy_level = level;
+  node_energy_set = 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_update_link_metric(rpl_parent_t *p, int status, int numtx)
+{
+  uint16_t recorded_etx = 0;
+  uint16_t packet_etx = numtx * RPL_DAG_MC_ETX_DIVISOR;
+  uint16_t new_etx;
+  uip_ds6_nbr_t *nbr = NULL;
+
+  nbr = rpl_get_nbr(p);
+  if(nbr == NULL) {
+      /* No neighbor for this parent - something bad has occurred */
+      return;
+  }
+  recorded_etx = nbr->link_metric;
+
+  /* Do not penalize the ETX when collisions or transmission errors occur. */
+  if(status == MAC_TX_OK || status == MAC_TX_NOACK) {
+    if(status == MAC_TX_NOACK) {
+      packet_etx = RPL_MAX_LINK_METRIC * RPL_DAG_MC_ETX_DIVISOR;
+    }
+
+  if(p->flags & RPL_PARENT_FLAG_LINK_METRIC_VALID) {
+      /* We already have a valid link metric, use weighted moving average to update it */
+      new_etx = ((uint32_t)recorded_etx * ETX_ALPHA +
+              (uint32_t)packet_etx * (ETX_SCALE - ETX_ALPHA)) / ETX_SCALE;
+  } else {
+      /* We don't have a valid link metric, set it to the current packet's ETX */
+      new_etx = packet_etx;
+      /* Set link metric as valid */
+      p->flags |= RPL_PARENT_FLAG_LINK_METRIC_VALID;
+  }
+
+    PRINTF("RPL: ETX changed from %u to %u (packet ETX = %u)\n\r",
+        (unsigned)(recorded_etx / RPL_DAG_MC_ETX_DIVISOR),
+        (unsigned)(new_etx  / RPL_DAG_MC_ETX_DIVISOR),
+        (unsigned)(packet_etx / RPL_DAG_MC_ETX_DIVISOR));
+    /* update the link metric for this nbr */
+    nbr->link_metric = new_etx;
+  }
+}
+/** @} */
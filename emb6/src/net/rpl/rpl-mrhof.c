@@ -33,9 +33,9 @@
  * \file
  *         The Minimum Rank with Hysteresis Objective Function (MRHOF)
  *
- *         This implementation uses the estimated number of 
- *         transmissions (ETX) as the additive routing metric,
- *         and also provides stubs for the energy metric.
+ *         The path cost comes from the metric container the DODAG
+ *         root selected (see rpl-metric.c), or from the rank and the
+ *         ETX of the link when the DODAG runs without one.
  *
  * \author Joakim Eriksson <joakime@sics.se>, Nicolas Tsiftes <nvt@sics.se>
  */
@@ -52,7 +52,6 @@
 #include "uip-debug.h"
 
 static void reset(rpl_dag_t *);
-static void neighbor_link_callback(rpl_parent_t *, int, int);
 static rpl_parent_t *best_parent(rpl_parent_t *, rpl_parent_t *);
 static rpl_dag_t *best_dag(rpl_dag_t *, rpl_dag_t *);
 static rpl_rank_t calculate_rank(rpl_parent_t *, rpl_rank_t);
@@ -60,7 +59,7 @@ static void update_metric_container(rpl_instance_t *);
 
 rpl_of_t rpl_mrhof = {
   reset,
-  neighbor_link_callback,
+  rpl_update_link_metric,
   best_parent,
   best_dag,
   calculate_rank,
@@ -68,22 +67,9 @@ rpl_of_t rpl_mrhof = {
   1
 };
 
-/* Constants for the ETX moving average */
-#define ETX_SCALE   100
-#define ETX_ALPHA   90
-
-/* Reject parents that have a higher link metric than the following. */
-#define MAX_LINK_METRIC            10
-
 /* Reject parents that have a higher path cost than the following. */
 #define MAX_PATH_COST            100
 
-/*
- * The rank must differ more than 1/PARENT_SWITCH_THRESHOLD_DIV in order
- * to switch preferred parent.
- */
-#define PARENT_SWITCH_THRESHOLD_DIV    2
-
 typedef uint16_t rpl_path_metric_t;
 
 static rpl_path_metric_t
@@ -97,17 +83,21 @@ calculate_path_metric(rpl_parent_t *p)
   if(nbr == NULL) {
       return MAX_PATH_COST * RPL_DAG_MC_ETX_DIVISOR;
   }
-#if RPL_DAG_MC == RPL_DAG_MC_NONE
+#if RPL_DAG_MC != RPL_DAG_MC_NONE
   {
-      return p->rank + (uint16_t)nbr->link_metric;
+    const rpl_metric_t *metric;
+
+    metric = rpl_find_metric(p->dag->instance->mc.type);
+    if(metric != NULL) {
+      if(p->mc.type != metric->type) {
+        /* The parent does not advertise the metric of the DODAG */
+        return 0xffff;
+      }
+      return metric->path_cost(&p->mc, nbr->link_metric);
+    }
   }
-#elif RPL_DAG_MC == RPL_DAG_MC_ETX
-  return p->mc.obj.etx + (uint16_t)nbr->link_metric;
-#elif RPL_DAG_MC == RPL_DAG_MC_ENERGY
-  return p->mc.obj.energy.energy_est + (uint16_t)nbr->link_metric;
-#else
-#error "Unsupported RPL_DAG_MC configured. See rpl.h."
-#endif /* RPL_DAG_MC */
+#endif /* RPL_DAG_MC != RPL_DAG_MC_NONE */
+  return p->rank + (uint16_t)nbr->link_metric;
 }
 
 static void
@@ -116,47 +106,6 @@ reset(rpl_dag_t *dag)
   PRINTF("RPL: Reset MRHOF\n\r");
 }
 
-static void
-neighbor_link_callback(rpl_parent_t *p, int status, int numtx)
-{
-  uint16_t recorded_etx = 0;
-  uint16_t packet_etx = numtx * RPL_DAG_MC_ETX_DIVISOR;
-  uint16_t new_etx;
-  uip_ds6_nbr_t *nbr = NULL;
-
-  nbr = rpl_get_nbr(p);
-  if(nbr == NULL) {
-      /* No neighbor for this parent - something bad has occurred */
-      return;
-  }
-  recorded_etx = nbr->link_metric;
-
-  /* Do not penalize the ETX when collisions or transmission errors occur. */
-  if(status == MAC_TX_OK || status == MAC_TX_NOACK) {
-    if(status == MAC_TX_NOACK) {
-      packet_etx = MAX_LINK_METRIC * RPL_DAG_MC_ETX_DIVISOR;
-    }
-
-  if(p->flags & RPL_PARENT_FLAG_LINK_METRIC_VALID) {
-      /* We already have a valid link metric, use weighted moving average to update it */
-      new_etx = ((uint32_t)recorded_etx * ETX_ALPHA +
-              (uint32_t)packet_etx * (ETX_SCALE - ETX_ALPHA)) / ETX_SCALE;
-  } else {
-      /* We don't have a valid link metric, set it to the current packet's ETX */
-      new_etx = packet_etx;
-      /* Set link metric as valid */
-      p->flags |= RPL_PARENT_FLAG_LINK_METRIC_VALID;
-  }
-
-    PRINTF("RPL: ETX changed from %u to %u (packet ETX = %u)\n\r",
-        (unsigned)(recorded_etx / RPL_DAG_MC_ETX_DIVISOR),
-        (unsigned)(new_etx  / RPL_DAG_MC_ETX_DIVISOR),
-        (unsigned)(packet_etx / RPL_DAG_MC_ETX_DIVISOR));
-    /* update the link metric for this nbr */
-    nbr->link_metric = new_etx;
-  }
-}
-
 static rpl_rank_t
 calculate_rank(rpl_parent_t *p, rpl_rank_t base_rank)
 {
@@ -209,11 +158,16 @@ best_parent(rpl_parent_t *p1, rpl_parent_t *p2)
   rpl_path_metric_t min_diff;
   rpl_path_metric_t p1_metric;
   rpl_path_metric_t p2_metric;
+  const rpl_metric_t *metric;
 
   dag = p1->dag; /* Both parents are in the same DAG. */
 
-  min_diff = RPL_DAG_MC_ETX_DIVISOR /
-             PARENT_SWITCH_THRESHOLD_DIV;
+  metric = rpl_find_metric(dag->instance->mc.type);
+  if(metric != NULL) {
+    min_diff = metric->switch_threshold;
+  } else {
+    min_diff = RPL_PARENT_SWITCH_THRESHOLD;
+  }
 
   p1_metric = calculate_path_metric(p1);
   p2_metric = calculate_path_metric(p2);
@@ -235,26 +189,26 @@ best_parent(rpl_parent_t *p1, rpl_parent_t *p2)
 }
 
 
-#if RPL_DAG_MC == RPL_DAG_MC_NONE
 static void
 update_metric_container(rpl_instance_t *instance)
 {
-  instance->mc.type = RPL_DAG_MC;
-}
-#else
-static void
-update_metric_container(rpl_instance_t *instance)
-{
-  rpl_path_metric_t path_metric;
+#if RPL_DAG_MC != RPL_DAG_MC_NONE
+  const rpl_metric_t *metric;
   rpl_dag_t *dag;
-#if RPL_DAG_MC == RPL_DAG_MC_ENERGY
-  uint8_t type;
-#endif
+  rpl_parent_t *p;
+  uip_ds6_nbr_t *nbr;
+
+  metric = rpl_find_metric(instance->mc.type);
+  if(metric == NULL) {
+    /* The DODAG runs without a metric container. */
+    instance->mc.type = RPL_DAG_MC_NONE;
+    return;
+  }
 
-  instance->mc.type = RPL_DAG_MC;
   instance->mc.flags = RPL_DAG_MC_FLAG_P;
-  instance->mc.aggr = RPL_DAG_MC_AGGR_ADDITIVE;
+  instance->mc.aggr = metric->aggr;
   instance->mc.prec = 0;
+  instance->mc.length = metric->length;
 
   dag = instance->current_dag;
 
@@ -264,31 +218,15 @@ update_metric_container(rpl_instance_t *instance)
   }
 
   if(dag->rank == ROOT_RANK(instance)) {
-    path_metric = 0;
-  } else {
-    path_metric = calculate_path_metric(dag->preferred_parent);
-  }
-
-#if RPL_DAG_MC == RPL_DAG_MC_ETX
-  instance->mc.length = sizeof(instance->mc.obj.etx);
-  instance->mc.obj.etx = path_metric;
-
-  PRINTF("RPL: My path ETX to the root is %u.%u\n\r",
-    instance->mc.obj.etx / RPL_DAG_MC_ETX_DIVISOR,
-    (instance->mc.obj.etx % RPL_DAG_MC_ETX_DIVISOR * 100) /
-     RPL_DAG_MC_ETX_DIVISOR);
-#elif RPL_DAG_MC == RPL_DAG_MC_ENERGY
-  instance->mc.length = sizeof(instance->mc.obj.energy);
-
-  if(dag->rank == ROOT_RANK(instance)) {
-    type = RPL_DAG_MC_ENERGY_TYPE_MAINS;
+    metric->update_object(&instance->mc, NULL, 0);
   } else {
-    type = RPL_DAG_MC_ENERGY_TYPE_BATTERY;
+    p = dag->preferred_parent;
+    if(p != NULL && (nbr = rpl_get_nbr(p)) != NULL) {
+      metric->update_object(&instance->mc, &p->mc, nbr->link_metric);
+    }
   }
-
-  instance->mc.obj.energy.flags = type << RPL_DAG_MC_ENERGY_TYPE;
-  instance->mc.obj.energy.energy_est = path_metric;
-#endif /* RPL_DAG_MC == RPL_DAG_MC_ETX */
+#else
+  instance->mc.type = RPL_DAG_MC_NONE;
+#endif /* RPL_DAG_MC != RPL_DAG_MC_NONE */
 }
-#endif /* RPL_DAG_MC == RPL_DAG_MC_NONE */
 /** @} */
@@ -0,0 +1,454 @@
+/*
+ * emb6 is licensed under the 3-clause BSD license. This license gives everyone
+ * the right to use and distribute the code, either in binary or source code
+ * format, as long as the copyright license is retained in the source code.
+ *
+ * The emb6 is derived from the Contiki OS platform with the explicit approval
+ * from Adam Dunkels. However, emb6 is made independent from the OS through the
+ * removal of protothreads. In addition, APIs are made more flexible to gain
+ * more adaptivity during run-time.
+ *
+ * The license text is:
+ *
+ * Copyright (c) 2015,
+ * Hochschule Offenburg, University of Applied Sciences
+ * Laboratory Embedded Systems and Communications Electronics.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+/**
+ * \file
+ *         DODAG kept by a non-storing mode root. Every node that sent us a
+ *         DAO is linked to the parent it announced, nodes only known as a
+ *         parent stay as long as they have children.
+ *
+ *         Nodes are hashed on their IID, each one lists its children and
+ *         sits in the slot of a lifetime wheel, so a DAO costs the same
+ *         with ten nodes or with thousands. Only a source route walks
+ *         the DODAG, from the destination up to us.
+ */
+
+/**
+ * \addtogroup uip6
+ * @{
+ */
+
+#include "rpl-private.h"
+#include "rpl-ns.h"
+#include "memb.h"
+
+#include <string.h>
+#if RPL_NS_DYNAMIC
+#include <stdlib.h>
+#endif /* RPL_NS_DYNAMIC */
+
+#define DEBUG DEBUG_NONE
+#include "uip-debug.h"
+
+#if RPL_WITH_NON_STORING
+/*---------------------------------------------------------------------------*/
+MEMB(nodememb, rpl_ns_node_t, RPL_NS_LINK_NUM);
+static rpl_ns_node_t *free_nodes;
+static int num_nodes;
+
+static rpl_ns_node_t *hash_static[RPL_NS_HASH_SIZE];
+static rpl_ns_node_t **hash = hash_static;
+static uint32_t hash_size = RPL_NS_HASH_SIZE;
+
+static rpl_ns_node_t *wheel[RPL_NS_WHEEL_SIZE];
+static uint32_t ticks;
+/*---------------------------------------------------------------------------*/
+static uint32_t
+iid_hash(const unsigned char *iid)
+{
+  uint32_t h;
+  int i;
+
+  h = 0;
+  for(i = 0; i < 8; i++) {
+    h = h * 31 + iid[i];
+  }
+  return h ^ (h >> 16);
+}
+/*---------------------------------------------------------------------------*/
+#define HASH_SLOT(iid)  (&hash[iid_hash(iid) & (hash_size - 1)])
+/*---------------------------------------------------------------------------*/
+#if RPL_NS_DYNAMIC
+/* Keep the chains short as the DODAG grows, a failed allocation only
+   leaves them longer */
+static void
+hash_grow(void)
+{
+  rpl_ns_node_t **old;
+  rpl_ns_node_t *l;
+  rpl_ns_node_t *next;
+  uint32_t old_size;
+  uint32_t i;
+
+  old = hash;
+  old_size = hash_size;
+  hash = calloc(old_size * 2, sizeof(rpl_ns_node_t *));
+  if(hash == NULL) {
+    hash = old;
+    return;
+  }
+  hash_size = old_size * 2;
+  for(i = 0; i < old_size; i++) {
+    for(l = old[i]; l != NULL; l = next) {
+      rpl_ns_node_t **slot = HASH_SLOT(l->link_identifier);
+      next = l->next;
+      l->next = *slot;
+      *slot = l;
+    }
+  }
+  if(old != hash_static) {
+    free(old);
+  }
+}
+#endif /* RPL_NS_DYNAMIC */
+/*---------------------------------------------------------------------------*/
+static rpl_ns_node_t *
+node_alloc(rpl_dag_t *dag, const uip_ipaddr_t *addr)
+{
+  rpl_ns_node_t *node;
+  rpl_ns_node_t **slot;
+
+  node = free_nodes;
+  if(node != NULL) {
+    free_nodes = node->next;
+  } else {
+    node = memb_alloc(&nodememb);
+  }
+#if RPL_NS_DYNAMIC
+  if(node == NULL) {
+    node = malloc(sizeof(rpl_ns_node_t));
+  }
+#endif /* RPL_NS_DYNAMIC */
+  if(node == NULL) {
+    PRINTF("RPL: No space for more non-storing nodes\n\r");
+    return NULL;
+  }
+  memset(node, 0, sizeof(rpl_ns_node_t));
+  node->dag = dag;
+  memcpy(node->link_identifier, ((const unsigned char *)addr) + 8, 8);
+  slot = HASH_SLOT(node->link_identifier);
+  node->next = *slot;
+  *slot = node;
+  num_nodes++;
+#if RPL_NS_DYNAMIC
+  if((uint32_t)num_nodes > hash_size * 2) {
+    hash_grow();
+  }
+#endif /* RPL_NS_DYNAMIC */
+  return node;
+}
+/*---------------------------------------------------------------------------*/
+static void
+wheel_remove(rpl_ns_node_t *node)
+{
+  if(node->wheel_pprev != NULL) {
+    *node->wheel_pprev = node->wheel_next;
+    if(node->wheel_next != NULL) {
+      node->wheel_next->wheel_pprev = node->wheel_pprev;
+    }
+    node->wheel_pprev = NULL;
+    node->wheel_next = NULL;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+wheel_insert(rpl_ns_node_t *node, uint32_t lifetime)
+{
+  rpl_ns_node_t **slot;
+
+  wheel_remove(node);
+  node->expires = ticks + lifetime;
+  slot = &wheel[node->expires & (RPL_NS_WHEEL_SIZE - 1)];
+  node->wheel_next = *slot;
+  if(*slot != NULL) {
+    (*slot)->wheel_pprev = &node->wheel_next;
+  }
+  node->wheel_pprev = slot;
+  *slot = node;
+}
+/*---------------------------------------------------------------------------*/
+static void
+parent_unlink(rpl_ns_node_t *node)
+{
+  if(node->parent != NULL) {
+    *node->sibling_pprev = node->sibling;
+    if(node->sibling != NULL) {
+      node->sibling->sibling_pprev = node->sibling_pprev;
+    }
+    node->parent = NULL;
+    node->sibling = NULL;
+    node->sibling_pprev = NULL;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+parent_link(rpl_ns_node_t *node, rpl_ns_node_t *parent)
+{
+  node->parent = parent;
+  node->sibling = parent->children;
+  if(parent->children != NULL) {
+    parent->children->sibling_pprev = &node->sibling;
+  }
+  node->sibling_pprev = &parent->children;
+  parent->children = node;
+}
+/*---------------------------------------------------------------------------*/
+/* Without a DAO of its own, a node only stays for its children. Such a
+   node has no parent either, so nothing further up gets released. */
+static void
+node_release(rpl_ns_node_t *node)
+{
+  rpl_ns_node_t **slot;
+
+  if(node == NULL || node->wheel_pprev != NULL || node->children != NULL) {
+    return;
+  }
+  parent_unlink(node);
+  slot = HASH_SLOT(node->link_identifier);
+  while(*slot != node) {
+    slot = &(*slot)->next;
+  }
+  *slot = node->next;
+  node->next = free_nodes;
+  free_nodes = node;
+  num_nodes--;
+}
+/*---------------------------------------------------------------------------*/
+/* The node no longer has a path, its children stay until they expire */
+static void
+node_expire(rpl_ns_node_t *node)
+{
+  rpl_ns_node_t *parent;
+
+  parent = node->parent;
+  wheel_remove(node);
+  parent_unlink(node);
+  UIP_DS6_ROUTE_GEN_BUMP();
+  node_release(parent);
+  node_release(node);
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_ns_init(void)
+{
+  memb_init(&nodememb);
+  free_nodes = NULL;
+  num_nodes = 0;
+  memset(hash, 0, hash_size * sizeof(rpl_ns_node_t *));
+  memset(wheel, 0, sizeof(wheel));
+  ticks = 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_ns_num_nodes(void)
+{
+  return num_nodes;
+}
+/*---------------------------------------------------------------------------*/
+static rpl_ns_node_t *
+first_from(uint32_t i)
+{
+  for(; i < hash_size; i++) {
+    if(hash[i] != NULL) {
+      return hash[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+rpl_ns_node_t *
+rpl_ns_node_head(void)
+{
+  return first_from(0);
+}
+/*---------------------------------------------------------------------------*/
+rpl_ns_node_t *
+rpl_ns_node_next(rpl_ns_node_t *item)
+{
+  if(item->next != NULL) {
+    return item->next;
+  }
+  return first_from((iid_hash(item->link_identifier) & (hash_size - 1)) + 1);
+}
+/*---------------------------------------------------------------------------*/
+uint32_t
+rpl_ns_node_lifetime(const rpl_ns_node_t *node)
+{
+  return node->wheel_pprev != NULL ? node->expires - ticks : 0;
+}
+/*---------------------------------------------------------------------------*/
+rpl_ns_node_t *
+rpl_ns_get_node(const rpl_dag_t *dag, const uip_ipaddr_t *addr)
+{
+  const unsigned char *iid = ((const unsigned char *)addr) + 8;
+  rpl_ns_node_t *l;
+
+  for(l = *HASH_SLOT(iid); l != NULL; l = l->next) {
+    if(l->dag == dag && memcmp(l->link_identifier, iid, 8) == 0) {
+      return l;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_ns_is_node_reachable(const rpl_dag_t *dag, const uip_ipaddr_t *addr)
+{
+  rpl_ns_node_t *node;
+  uip_ipaddr_t top;
+  int max_depth;
+
+  node = rpl_ns_get_node(dag, addr);
+  /* A loop in the announced parents must not hang us */
+  max_depth = num_nodes;
+  while(node != NULL && node->parent != NULL && max_depth-- > 0) {
+    node = node->parent;
+  }
+  if(node == NULL || node->parent != NULL) {
+    return 0;
+  }
+  rpl_ns_get_node_global_addr(&top, node);
+  return uip_ds6_is_my_addr(&top);
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_ns_get_node_global_addr(uip_ipaddr_t *addr, const rpl_ns_node_t *node)
+{
+  memcpy(addr, &node->dag->prefix_info.prefix, 8);
+  memcpy(((unsigned char *)addr) + 8, node->link_identifier, 8);
+}
+/*---------------------------------------------------------------------------*/
+rpl_ns_node_t *
+rpl_ns_update_node(rpl_dag_t *dag, const uip_ipaddr_t *child,
+                   const uip_ipaddr_t *parent, uint32_t lifetime)
+{
+  rpl_ns_node_t *child_node;
+  rpl_ns_node_t *parent_node;
+  rpl_ns_node_t *old_parent;
+
+  /* Nodes are known by their IID, the same one twice would be a loop */
+  if(memcmp(&child->u8[8], &parent->u8[8], 8) == 0) {
+    PRINTF("RPL: Node announced itself as parent\n\r");
+    return NULL;
+  }
+
+  child_node = rpl_ns_get_node(dag, child);
+  parent_node = rpl_ns_get_node(dag, parent);
+
+  /* An unknown parent is kept for its children, its own parent is set
+     when its DAO arrives */
+  if(parent_node == NULL) {
+    parent_node = node_alloc(dag, parent);
+    if(parent_node == NULL) {
+      return NULL;
+    }
+  }
+  if(child_node == NULL) {
+    child_node = node_alloc(dag, child);
+    if(child_node == NULL) {
+      node_release(parent_node);
+      return NULL;
+    }
+  }
+
+  if(lifetime == 0) {
+    lifetime = 1;
+  }
+  wheel_insert(child_node, lifetime);
+  old_parent = child_node->parent;
+  if(old_parent != parent_node) {
+    parent_unlink(child_node);
+    parent_link(child_node, parent_node);
+    node_release(old_parent);
+    UIP_DS6_ROUTE_GEN_BUMP();
+  }
+
+  PRINTF("RPL: Non-storing node ");
+  PRINT6ADDR(child);
+  PRINTF(" has parent ");
+  PRINT6ADDR(parent);
+  PRINTF(", lifetime %lu\n\r", (unsigned long)lifetime);
+
+  return child_node;
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_ns_expire_parent(rpl_dag_t *dag, const uip_ipaddr_t *child,
+                     const uip_ipaddr_t *parent)
+{
+  rpl_ns_node_t *child_node;
+
+  child_node = rpl_ns_get_node(dag, child);
+  if(child_node != NULL && child_node->parent != NULL &&
+     child_node->parent == rpl_ns_get_node(dag, parent)) {
+    node_expire(child_node);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_ns_periodic(void)
+{
+  rpl_ns_node_t *l;
+  rpl_ns_node_t *next;
+
+  /* Only the current slot is due, the nodes there with a later expiry
+     wait for another turn of the wheel */
+  ticks++;
+  for(l = wheel[ticks & (RPL_NS_WHEEL_SIZE - 1)]; l != NULL; l = next) {
+    next = l->wheel_next;
+    if(l->expires == ticks) {
+      node_expire(l);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_ns_free_dag(rpl_dag_t *dag)
+{
+  rpl_ns_node_t *l;
+  rpl_ns_node_t *next;
+
+  /* Drop the links first, the nodes are then released without children */
+  for(l = rpl_ns_node_head(); l != NULL; l = rpl_ns_node_next(l)) {
+    if(l->dag == dag) {
+      wheel_remove(l);
+      parent_unlink(l);
+    }
+  }
+  for(l = rpl_ns_node_head(); l != NULL; l = next) {
+    next = rpl_ns_node_next(l);
+    if(l->dag == dag) {
+      node_release(l);
+    }
+  }
+  UIP_DS6_ROUTE_GEN_BUMP();
+}
+#endif /* RPL_WITH_NON_STORING */
+/*---------------------------------------------------------------------------*/
+/** @} */
@@ -0,0 +1,175 @@
+/*
+ * emb6 is licensed under the 3-clause BSD license. This license gives everyone
+ * the right to use and distribute the code, either in binary or source code
+ * format, as long as the copyright license is retained in the source code.
+ *
+ * The emb6 is derived from the Contiki OS platform with the explicit approval
+ * from Adam Dunkels. However, emb6 is made independent from the OS through the
+ * removal of protothreads. In addition, APIs are made more flexible to gain
+ * more adaptivity during run-time.
+ *
+ * The license text is:
+ *
+ * Copyright (c) 2015,
+ * Hochschule Offenburg, University of Applied Sciences
+ * Laboratory Embedded Systems and Communications Electronics.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+/**
+ * \file
+ *         Objective Function Zero (OF0, RFC 6552)
+ *
+ *         The rank grows by a step of 1 to 9 per hop, derived from the
+ *         ETX of the link, and the parent giving the lowest rank is
+ *         preferred. OF0 does not use a metric container.
+ */
+
+/**
+ * \addtogroup uip6
+ * @{
+ */
+
+#include "rpl-private.h"
+#include "nbr-table.h"
+
+#define DEBUG DEBUG_NONE
+#include "uip-debug.h"
+
+static void reset(rpl_dag_t *);
+static rpl_parent_t *best_parent(rpl_parent_t *, rpl_parent_t *);
+static rpl_dag_t *best_dag(rpl_dag_t *, rpl_dag_t *);
+static rpl_rank_t calculate_rank(rpl_parent_t *, rpl_rank_t);
+static void update_metric_container(rpl_instance_t *);
+
+rpl_of_t rpl_of0 = {
+  reset,
+  rpl_update_link_metric,
+  best_parent,
+  best_dag,
+  calculate_rank,
+  update_metric_container,
+  0
+};
+
+/* Constants of RFC 6552, section 6.3 */
+#define DEFAULT_STEP_OF_RANK    3
+#define MINIMUM_STEP_OF_RANK    1
+#define MAXIMUM_STEP_OF_RANK    9
+#define DEFAULT_RANK_STRETCH    0
+#define DEFAULT_RANK_FACTOR     1
+
+static void
+reset(rpl_dag_t *dag)
+{
+  PRINTF("RPL: Reset OF0\n\r");
+}
+
+static rpl_rank_t
+step_of_rank(rpl_parent_t *p)
+{
+  uip_ds6_nbr_t *nbr;
+  uint32_t step;
+
+  nbr = rpl_get_nbr(p);
+  if(nbr == NULL || !(p->flags & RPL_PARENT_FLAG_LINK_METRIC_VALID)) {
+    return DEFAULT_STEP_OF_RANK;
+  }
+  /* An ETX of 1 gives the minimum step, 3.67 or more the maximum */
+  step = (3 * (uint32_t)nbr->link_metric) / RPL_DAG_MC_ETX_DIVISOR;
+  step = step > 2 ? step - 2 : MINIMUM_STEP_OF_RANK;
+  return step > MAXIMUM_STEP_OF_RANK ? MAXIMUM_STEP_OF_RANK : step;
+}
+
+static rpl_rank_t
+calculate_rank(rpl_parent_t *p, rpl_rank_t base_rank)
+{
+  rpl_rank_t rank_increase;
+
+  if(p == NULL) {
+    if(base_rank == 0) {
+      return INFINITE_RANK;
+    }
+    rank_increase = (DEFAULT_RANK_FACTOR * DEFAULT_STEP_OF_RANK +
+                     DEFAULT_RANK_STRETCH) * RPL_MIN_HOPRANKINC;
+  } else {
+    rank_increase = (DEFAULT_RANK_FACTOR * step_of_rank(p) +
+                     DEFAULT_RANK_STRETCH) * p->dag->instance->min_hoprankinc;
+    if(base_rank == 0) {
+      base_rank = p->rank;
+    }
+  }
+
+  if(INFINITE_RANK - base_rank < rank_increase) {
+    /* Reached the maximum rank. */
+    return INFINITE_RANK;
+  }
+  return base_rank + rank_increase;
+}
+
+static rpl_dag_t *
+best_dag(rpl_dag_t *d1, rpl_dag_t *d2)
+{
+  if(d1->grounded != d2->grounded) {
+    return d1->grounded ? d1 : d2;
+  }
+
+  if(d1->preference != d2->preference) {
+    return d1->preference > d2->preference ? d1 : d2;
+  }
+
+  return d1->rank < d2->rank ? d1 : d2;
+}
+
+static rpl_parent_t *
+best_parent(rpl_parent_t *p1, rpl_parent_t *p2)
+{
+  rpl_dag_t *dag;
+  rpl_rank_t min_diff;
+  rpl_rank_t r1;
+  rpl_rank_t r2;
+
+  dag = p1->dag; /* Both parents are in the same DAG. */
+
+  r1 = calculate_rank(p1, 0);
+  r2 = calculate_rank(p2, 0);
+
+  /* Keep the preferred parent unless the other is a full step better. */
+  min_diff = dag->instance->min_hoprankinc;
+  if(p1 == dag->preferred_parent || p2 == dag->preferred_parent) {
+    if(r1 < r2 + min_diff && r1 > r2 - min_diff) {
+      PRINTF("RPL: OF0 hysteresis: %u %u\n\r", r1, r2);
+      return dag->preferred_parent;
+    }
+  }
+
+  return r1 < r2 ? p1 : p2;
+}
+
+static void
+update_metric_container(rpl_instance_t *instance)
+{
+  instance->mc.type = RPL_DAG_MC_NONE;
+}
+/** @} */
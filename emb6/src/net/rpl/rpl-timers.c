@@ -43,11 +43,15 @@
 //#include "contiki-conf.h"
 #include "emb6.h"
 #include "rpl-private.h"
+#if RPL_WITH_NON_STORING
+#include "rpl-ns.h"
+#endif /* RPL_WITH_NON_STORING */
 #if UIP_CONF_IPV6_MULTICAST
 #include "uip-mcast6.h"
 #endif
 #include "random.h"
 #include "ctimer.h"
+#include "trickle-timer.h"
 
 #define DEBUG DEBUG_NONE
 #include "uip-debug.h"
@@ -56,8 +60,6 @@
 static struct ctimer periodic_timer;
 
 static void handle_periodic_timer(void *ptr);
-static void new_dio_interval(rpl_instance_t *instance);
-static void handle_dio_timer(void *ptr);
 
 static uint16_t next_dis;
 
@@ -69,6 +71,9 @@ static void
 handle_periodic_timer(void *ptr)
 {
   rpl_purge_routes();
+#if RPL_WITH_NON_STORING
+  rpl_ns_periodic();
+#endif /* RPL_WITH_NON_STORING */
   rpl_recalculate_ranks();
 
   /* handle DIS */
@@ -82,53 +87,17 @@ handle_periodic_timer(void *ptr)
   ctimer_reset(&periodic_timer);
 }
 /*---------------------------------------------------------------------------*/
+/* Trickle parameters of the DIO timer, Imin is 2^dio_intmin ms. */
 static void
-new_dio_interval(rpl_instance_t *instance)
+config_dio_timer(rpl_instance_t *instance)
 {
-  uint32_t time;
-  clock_time_t ticks;
-
-  /* TODO: too small timer intervals for many cases */
-  time = 1UL << instance->dio_intcurrent;
-
-  /* Convert from milliseconds to CLOCK_TICKS. */
-  ticks = (time * bsp_get(E_BSP_GET_TRES)) / 1000;
-  instance->dio_next_delay = ticks;
-
-  /* random number between I/2 and I */
-  ticks = ticks / 2 + (ticks / 2 * (uint32_t)random_rand()) / RANDOM_RAND_MAX;
-
-  /*
-   * The intervals must be equally long among the nodes for Trickle to
-   * operate efficiently. Therefore we need to calculate the delay between
-   * the randomized time and the start time of the next interval.
-   */
-  instance->dio_next_delay -= ticks;
-  instance->dio_send = 1;
-
-#if RPL_CONF_STATS
-  /* keep some stats */
-  instance->dio_totint++;
-  instance->dio_totrecv += instance->dio_counter;
-  ANNOTATE("#A rank=%u.%u(%u),stats=%d %d %d %d,color=%s\n\r",
-       DAG_RANK(instance->current_dag->rank, instance),
-           (10 * (instance->current_dag->rank % instance->min_hoprankinc)) / instance->min_hoprankinc,
-           instance->current_dag->version,
-           instance->dio_totint, instance->dio_totsend,
-           instance->dio_totrecv,instance->dio_intcurrent,
-       instance->current_dag->rank == ROOT_RANK(instance) ? "BLUE" : "ORANGE");
-#endif /* RPL_CONF_STATS */
-
-  /* reset the redundancy counter */
-  instance->dio_counter = 0;
-
-  /* schedule the timer */
-  PRINTF("RPL: Scheduling DIO timer %lu ticks in future (Interval)\n\r", ticks);
-  ctimer_set(&instance->dio_timer, ticks, handle_dio_timer, instance);
+  trickle_timer_config(&instance->dio_timer,
+      ((1UL << instance->dio_intmin) * bsp_get(E_BSP_GET_TRES)) / 1000,
+      instance->dio_intdoubl, instance->dio_redundancy);
 }
 /*---------------------------------------------------------------------------*/
 static void
-handle_dio_timer(void *ptr)
+handle_dio_timer(void *ptr, uint8_t suppress)
 {
   rpl_instance_t *instance;
 
@@ -140,36 +109,30 @@ handle_dio_timer(void *ptr)
       dio_send_ok = 1;
     } else {
       PRINTF("RPL: Postponing DIO transmission since link local address is not ok\n\r");
-      ctimer_set(&instance->dio_timer, bsp_get(E_BSP_GET_TRES), handle_dio_timer, instance);
+      trickle_timer_reset_event(&instance->dio_timer);
       return;
     }
   }
 
-  if(instance->dio_send) {
-      PRINTF("RPL: Trying DIO transmission (%d >= %d)\n\r",
-                   instance->dio_counter, instance->dio_redundancy);
-    /* send DIO if counter is less than desired redundancy */
-    if(instance->dio_redundancy != 0 && instance->dio_counter < instance->dio_redundancy) {
-#if RPL_CONF_STATS
-      instance->dio_totsend++;
-#endif /* RPL_CONF_STATS */
-      dio_output(instance, NULL);
-    } else {
-      PRINTF("RPL: Supressing DIO transmission (%d >= %d)\n\r",
-             instance->dio_counter, instance->dio_redundancy);
-    }
-    instance->dio_send = 0;
-    PRINTF("RPL: Scheduling DIO timer %lu ticks in future (sent)\n\r",
-           instance->dio_next_delay);
-    ctimer_set(&instance->dio_timer, instance->dio_next_delay, handle_dio_timer, instance);
+  /* send DIO if counter is less than desired redundancy */
+  if(!suppress) {
+    dio_output(instance, NULL);
   } else {
-    /* check if we need to double interval */
-    if(instance->dio_intcurrent < instance->dio_intmin + instance->dio_intdoubl) {
-      instance->dio_intcurrent++;
-      PRINTF("RPL: DIO Timer interval doubled %d\n\r", instance->dio_intcurrent);
-    }
-    new_dio_interval(instance);
+    PRINTF("RPL: Supressing DIO transmission (%d >= %d)\n\r",
+           instance->dio_timer.c, instance->dio_redundancy);
+    RPL_STAT(rpl_stats.dio_suppressed++);
   }
+
+#if RPL_CONF_STATS && TRICKLE_TIMER_STATS
+  /* keep some stats */
+  ANNOTATE("#A rank=%u.%u(%u),stats=%d %d %d %d,color=%s\n\r",
+       DAG_RANK(instance->current_dag->rank, instance),
+           (10 * (instance->current_dag->rank % instance->min_hoprankinc)) / instance->min_hoprankinc,
+           instance->current_dag->version,
+           instance->dio_timer.stats.intervals, instance->dio_timer.stats.transmissions,
+           instance->dio_timer.stats.consistent, instance->dio_timer.i_cur,
+       instance->current_dag->rank == ROOT_RANK(instance) ? "BLUE" : "ORANGE");
+#endif /* RPL_CONF_STATS && TRICKLE_TIMER_STATS */
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -186,12 +149,12 @@ void
 rpl_reset_dio_timer(rpl_instance_t *instance)
 {
 #if !RPL_LEAF_ONLY
-  /* Do not reset if we are already on the minimum interval,
-     unless forced to do so. */
-  if(instance->dio_intcurrent > instance->dio_intmin) {
-    instance->dio_counter = 0;
-    instance->dio_intcurrent = instance->dio_intmin;
-    new_dio_interval(instance);
+  config_dio_timer(instance);
+  if(!trickle_timer_is_running(&instance->dio_timer)) {
+    trickle_timer_set(&instance->dio_timer, handle_dio_timer, instance);
+  } else {
+    /* Do not reset if we are already on the minimum interval. */
+    trickle_timer_inconsistency(&instance->dio_timer);
   }
 #if RPL_CONF_STATS
   rpl_stats.resets++;
@@ -241,8 +204,10 @@ handle_dao_timer(void *ptr)
   if(instance->current_dag->preferred_parent != NULL) {
     PRINTF("RPL: handle_dao_timer - sending DAO\n\r");
     /* Set the route lifetime to the default value. */
-    dao_output(instance->current_dag->preferred_parent, instance->default_lifetime);
-
+    {
+      /* Our targets go out together with those queued for the
+         sub-DODAG, and are sent again until acknowledged */
+      dao_output_queue(instance, NULL, instance->default_lifetime);
 
     #if RPL_CONF_MULTICAST
         /* Send DAOs for multicast prefixes only if the instance is in MOP 3 */
@@ -251,7 +216,7 @@ handle_dao_timer(void *ptr)
           for(i = 0; i < UIP_DS6_MADDR_NB; i++) {
             if(uip_ds6_if.maddr_list[i].isused
                 && uip_is_addr_mcast_global(&uip_ds6_if.maddr_list[i].ipaddr)) {
-              dao_output_target(instance->current_dag->preferred_parent,
+              dao_output_queue(instance,
                   &uip_ds6_if.maddr_list[i].ipaddr, RPL_MCAST_LIFETIME);
             }
           }
@@ -261,13 +226,15 @@ handle_dao_timer(void *ptr)
           while(mcast_route != NULL) {
             /* Don't send if it's also our own address, done that already */
             if(uip_ds6_maddr_lookup(&mcast_route->group) == NULL) {
-              dao_output_target(instance->current_dag->preferred_parent,
+              dao_output_queue(instance,
                          &mcast_route->group, RPL_MCAST_LIFETIME);
             }
             mcast_route = list_item_next(mcast_route);
           }
         }
     #endif
+      dao_output_flush();
+    }
   } else {
     PRINTF("RPL: No suitable DAO parent\n\r");
   }
@@ -47,6 +47,9 @@
 #include "uip-ds6.h"
 #include "uip-icmp6.h"
 #include "rpl-private.h"
+#if RPL_WITH_NON_STORING
+#include "rpl-ns.h"
+#endif /* RPL_WITH_NON_STORING */
 #if UIP_CONF_IPV6_MULTICAST
 #include "uip-mcast6.h"
 #endif
@@ -59,6 +62,9 @@
 
 #if RPL_CONF_STATS
 rpl_stats_t rpl_stats;
+#if UIP_DS6_NOTIFICATIONS
+static struct uip_ds6_notification route_notification;
+#endif /* UIP_DS6_NOTIFICATIONS */
 #endif
 
 static enum rpl_mode mode = RPL_MODE_MESH;
@@ -73,6 +79,7 @@ enum rpl_mode
 rpl_set_mode(enum rpl_mode m)
 {
     enum rpl_mode oldmode = mode;
+    rpl_instance_t *instance, *end;
 
     /* We need to do different things depending on what mode we are
      switching to. */
@@ -85,15 +92,21 @@ rpl_set_mode(enum rpl_mode m)
         PRINTF("RPL: switching to mesh mode\n");
         mode = m;
 
-        if(default_instance != NULL) {
-            rpl_schedule_dao_immediately(default_instance);
+        for(instance = &instance_table[0], end = instance + RPL_MAX_INSTANCES;
+            instance < end; ++instance) {
+            if(instance->used) {
+                rpl_schedule_dao_immediately(instance);
+            }
         }
     } else if(m == RPL_MODE_FEATHER) {
 
         PRINTF("RPL: switching to feather mode\n");
         mode = m;
-        if(default_instance != NULL) {
-            rpl_cancel_dao(default_instance);
+        for(instance = &instance_table[0], end = instance + RPL_MAX_INSTANCES;
+            instance < end; ++instance) {
+            if(instance->used) {
+                rpl_cancel_dao(instance);
+            }
         }
 
     } else {
@@ -136,13 +149,14 @@ rpl_purge_routes(void)
       /* Routes with lifetime == 1 have only just been decremented from 2 to 1,
        * thus we want to keep them. Hence < and not <= */
       uip_ipaddr_copy(&prefix, &r->ipaddr);
+      dag = (rpl_dag_t *)r->state.dag;
       uip_ds6_route_rm(r);
       r = uip_ds6_route_head();
       PRINTF("No more routes to ");
       PRINT6ADDR(&prefix);
-      dag = default_instance->current_dag;
       /* Propagate this information with a No-Path DAO to preferred parent if we are not an RPL Root */
-      if(dag->rank != ROOT_RANK(default_instance)) {
+      if(dag != NULL && dag->instance->current_dag == dag &&
+         dag->rank != ROOT_RANK(dag->instance)) {
         PRINTF(" -> generate No-Path DAO\n\r");
         dao_output_target(dag->preferred_parent, &prefix, RPL_ZERO_LIFETIME);
         /* Don't schedule more than 1 No-Path DAO, let next iteration handle that */
@@ -266,6 +280,14 @@ rpl_link_neighbor_callback(const linkaddr_t *addr, int status, int numtx)
         if(instance->of->neighbor_link_callback != NULL) {
           instance->of->neighbor_link_callback(parent, status, numtx);
         }
+        if(status == MAC_TX_OK) {
+          parent->failures = 0;
+        } else if(status == MAC_TX_NOACK && parent->failures < 0xff) {
+          parent->failures++;
+          if(parent->failures == RPL_PARENT_MAX_FAILURES) {
+            rpl_parent_failover(parent);
+          }
+        }
       }
     }
   }
@@ -294,6 +316,34 @@ rpl_ipv6_neighbor_callback(uip_ds6_nbr_t *nbr)
   }
 }
 /*---------------------------------------------------------------------------*/
+#if RPL_CONF_STATS
+#if UIP_DS6_NOTIFICATIONS
+static void
+route_callback(int event, uip_ipaddr_t *route, uip_ipaddr_t *nexthop,
+               int num_routes)
+{
+  if(event == UIP_DS6_NOTIFICATION_ROUTE_ADD) {
+    rpl_stats.routes_added++;
+  } else if(event == UIP_DS6_NOTIFICATION_ROUTE_RM) {
+    rpl_stats.routes_removed++;
+  }
+}
+#endif /* UIP_DS6_NOTIFICATIONS */
+/*---------------------------------------------------------------------------*/
+void
+rpl_get_stats(rpl_stats_t *stats)
+{
+  memcpy(stats, &rpl_stats, sizeof(*stats));
+  stats->routes = uip_ds6_route_num_routes();
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_reset_stats(void)
+{
+  memset(&rpl_stats, 0, sizeof(rpl_stats));
+}
+#endif /* RPL_CONF_STATS */
+/*---------------------------------------------------------------------------*/
 void
 rpl_init(void)
 {
@@ -302,6 +352,9 @@ rpl_init(void)
   default_instance = NULL;
 
   rpl_dag_init();
+#if RPL_WITH_NON_STORING
+  rpl_ns_init();
+#endif /* RPL_WITH_NON_STORING */
   rpl_reset_periodic_timer();
   rpl_icmp6_register_handlers();
 
@@ -311,6 +364,9 @@ rpl_init(void)
 
 #if RPL_CONF_STATS
   memset(&rpl_stats, 0, sizeof(rpl_stats));
+#if UIP_DS6_NOTIFICATIONS
+  uip_ds6_notification_add(&route_notification, route_callback);
+#endif /* UIP_DS6_NOTIFICATIONS */
 #endif
   RPL_OF.reset(NULL);
 }
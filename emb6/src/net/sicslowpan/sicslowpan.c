@@ -278,6 +278,9 @@ static struct timer reass_timer;
 
 static int last_rssi;
 
+/** Partial checksum of the payload copied into sicslowpan_buf so far */
+static uip_rx_chksum_t rx_chksum;
+
 static s_ns_t*        p_ns = NULL;
 
 /*-------------------------------------------------------------------------*/
@@ -338,6 +341,29 @@ set_packet_attrs()
 #if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
 static struct sicslowpan_addr_context 
 addr_contexts[SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS];
+
+/** Marks the end of a context chain / an unused index slot */
+#define SICSLOWPAN_CONTEXT_NONE         0xFF
+
+/** Number of prefix hash buckets, must be a power of two */
+#ifdef SICSLOWPAN_CONF_CONTEXT_HASH_SIZE
+#define SICSLOWPAN_CONTEXT_HASH_SIZE    SICSLOWPAN_CONF_CONTEXT_HASH_SIZE
+#else
+#define SICSLOWPAN_CONTEXT_HASH_SIZE    8
+#endif
+
+/** Seconds an expired context is still accepted for decompression */
+#ifdef SICSLOWPAN_CONF_CONTEXT_GRACE
+#define SICSLOWPAN_CONTEXT_GRACE        SICSLOWPAN_CONF_CONTEXT_GRACE
+#else
+#define SICSLOWPAN_CONTEXT_GRACE        600
+#endif
+
+/** Index of the context table by CID */
+static uint8_t addr_context_cid[SICSLOWPAN_CONTEXT_CID_MAX];
+
+/** Index of the context table by /64 prefix (heads of the bucket chains) */
+static uint8_t addr_context_hash[SICSLOWPAN_CONTEXT_HASH_SIZE];
 #endif
 
 /** pointer to an address context. */
@@ -346,6 +372,9 @@ static struct sicslowpan_addr_context *context;
 /** pointer to the byte where to write next inline field. */
 static uint8_t *hc06_ptr;
 
+/** Maximum length of the uncompressed headers (limited by uncomp_hdr_len) */
+#define SICSLOWPAN_NHC_MAX_UNCOMP_LEN   0xFF
+
 /* Uncompression of linklocal */
 /*   0 -> 16 bytes from packet  */
 /*   1 -> 2 bytes from prefix - bunch of zeroes and 8 from packet */
@@ -380,18 +409,85 @@ static const uint8_t ttl_values[] = {0, 1, 64, 255};
 /** \name HC06 related functions
  * @{                                                                 */
 /*--------------------------------------------------------------------*/
+#if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
+/** \brief bucket of a /64 prefix in the context hash */
+static uint8_t
+addr_context_hash_prefix(const uint8_t *prefix)
+{
+  uint8_t h = 0;
+  uint8_t i;
+  for(i = 0; i < 8; i++) {
+    h = (h << 1 | h >> 7) ^ prefix[i];
+  }
+  return (h ^ (h >> 4)) & (SICSLOWPAN_CONTEXT_HASH_SIZE - 1);
+}
+/*--------------------------------------------------------------------*/
+/** \brief insert context i into both indexes */
+static void
+addr_context_link(uint8_t i)
+{
+  uint8_t h = addr_context_hash_prefix(addr_contexts[i].prefix);
+  addr_contexts[i].next = addr_context_hash[h];
+  addr_context_hash[h] = i;
+  addr_context_cid[addr_contexts[i].number] = i;
+}
+/*--------------------------------------------------------------------*/
+/** \brief remove context i from both indexes and free it */
+static void
+addr_context_unlink(uint8_t i)
+{
+  uint8_t *p = &addr_context_hash[addr_context_hash_prefix(addr_contexts[i].prefix)];
+  while(*p != SICSLOWPAN_CONTEXT_NONE) {
+    if(*p == i) {
+      *p = addr_contexts[i].next;
+      break;
+    }
+    p = &addr_contexts[*p].next;
+  }
+  addr_context_cid[addr_contexts[i].number] = SICSLOWPAN_CONTEXT_NONE;
+  addr_contexts[i].used = 0;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief age context i
+ * \return 1 if the context was removed
+ */
+static uint8_t
+addr_context_expire(uint8_t i)
+{
+  struct sicslowpan_addr_context *ctx = &addr_contexts[i];
+  if((ctx->flags & SICSLOWPAN_CONTEXT_FLAG_INFINITE) ||
+     !stimer_expired(&ctx->lifetime)) {
+    return 0;
+  }
+  if(ctx->flags & SICSLOWPAN_CONTEXT_FLAG_COMPRESS) {
+    /* RFC 6775, 7.2: stop compressing, keep decompressing for a while */
+    PRINTF("IPHC: context %u expired, decompression only\n\r", ctx->number);
+    ctx->flags &= ~SICSLOWPAN_CONTEXT_FLAG_COMPRESS;
+    stimer_set(&ctx->lifetime, SICSLOWPAN_CONTEXT_GRACE);
+    return 0;
+  }
+  PRINTF("IPHC: context %u removed\n\r", ctx->number);
+  addr_context_unlink(i);
+  return 1;
+}
+#endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 */
+/*--------------------------------------------------------------------*/
 /** \brief find the context corresponding to prefix ipaddr */
 static struct sicslowpan_addr_context*
 addr_context_lookup_by_prefix(uip_ipaddr_t *ipaddr)
 {
 /* Remove code to avoid warnings and save flash if no context is used */
 #if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
-  int i;
-  for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
-    if((addr_contexts[i].used == 1) &&
-       uip_ipaddr_prefixcmp(&addr_contexts[i].prefix, ipaddr, 64)) {
+  uint8_t i = addr_context_hash[addr_context_hash_prefix(ipaddr->u8)];
+  while(i != SICSLOWPAN_CONTEXT_NONE) {
+    uint8_t next = addr_contexts[i].next;
+    if(memcmp(addr_contexts[i].prefix, ipaddr->u8, 8) == 0 &&
+       !addr_context_expire(i) &&
+       (addr_contexts[i].flags & SICSLOWPAN_CONTEXT_FLAG_COMPRESS)) {
       return &addr_contexts[i];
     }
+    i = next;
   }
 #endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 */
   return NULL;
@@ -403,10 +499,10 @@ addr_context_lookup_by_number(uint8_t number)
 {
 /* Remove code to avoid warnings and save flash if no context is used */ 
 #if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
-  int i;
-  for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
-    if((addr_contexts[i].used == 1) &&
-       addr_contexts[i].number == number) {
+  uint8_t i;
+  if(number < SICSLOWPAN_CONTEXT_CID_MAX) {
+    i = addr_context_cid[number];
+    if(i != SICSLOWPAN_CONTEXT_NONE && !addr_context_expire(i)) {
       return &addr_contexts[i];
     }
   }
@@ -414,10 +510,19 @@ addr_context_lookup_by_number(uint8_t number)
   return NULL;
 }
 /*--------------------------------------------------------------------*/
+/**
+ * \brief Compress the IID of an address
+ *
+ * The IID can be elided if it is derived from the link layer address,
+ * or - for an encapsulated IPv6 header - if it is equal to the IID of
+ * the corresponding address of the encapsulating header (outer_addr).
+ */
 static uint8_t
-compress_addr_64(uint8_t bitpos, uip_ipaddr_t *ipaddr, uip_lladdr_t *lladdr)
+compress_addr_64(uint8_t bitpos, uip_ipaddr_t *ipaddr, uip_lladdr_t *lladdr,
+                 const uip_ipaddr_t *outer_addr)
 {
-  if(uip_is_addr_mac_addr_based(ipaddr, lladdr)) {
+  if((outer_addr == NULL && uip_is_addr_mac_addr_based(ipaddr, lladdr)) ||
+     (outer_addr != NULL && memcmp(&ipaddr->u8[8], &outer_addr->u8[8], 8) == 0)) {
     return 3 << bitpos; /* 0-bits */
   } else if(sicslowpan_is_iid_16_bit_compressable(ipaddr)) {
     /* compress IID to 16 bits xxxx::0000:00ff:fe00:XXXX */
@@ -435,13 +540,15 @@ compress_addr_64(uint8_t bitpos, uip_ipaddr_t *ipaddr, uip_lladdr_t *lladdr)
 /*-------------------------------------------------------------------- */
 /* Uncompress addresses based on a prefix and a postfix with zeroes in
  * between. If the postfix is zero in length it will use the link address
- * to configure the IP address (autoconf style).
+ * to configure the IP address (autoconf style). For an encapsulated IPv6
+ * header the IID is taken from outer_addr instead.
  * pref_post_count takes a byte where the first nibble specify prefix count
  * and the second postfix count (NOTE: 15/0xf => 16 bytes copy).
  */
 static void
 uncompress_addr(uip_ipaddr_t *ipaddr, uint8_t const prefix[],
-                uint8_t pref_post_count, uip_lladdr_t *lladdr)
+                uint8_t pref_post_count, uip_lladdr_t *lladdr,
+                const uip_ipaddr_t *outer_addr)
 {
   uint8_t prefcount = pref_post_count >> 4;
   uint8_t postcount = pref_post_count & 0x0f;
@@ -467,64 +574,316 @@ uncompress_addr(uip_ipaddr_t *ipaddr, uint8_t const prefix[],
     hc06_ptr += postcount;
   } else if (prefcount > 0) {
     /* no IID based configuration if no prefix and no data => unspec */
-    uip_ds6_set_addr_iid(ipaddr, lladdr);
+    if(outer_addr != NULL) {
+      memcpy(&ipaddr->u8[8], &outer_addr->u8[8], 8);
+    } else {
+      uip_ds6_set_addr_iid(ipaddr, lladdr);
+    }
   }
 
   PRINT6ADDR(ipaddr);
   PRINTF("\n\r");
 }
 
+/*--------------------------------------------------------------------*/
+/** \brief map an extension header protocol number to its NHC EID */
+static uint8_t
+nhc_ext_hdr_eid(uint8_t proto)
+{
+  switch(proto) {
+    case UIP_PROTO_HBHO:
+      return SICSLOWPAN_NHC_EXT_HDR_HBHO;
+    case UIP_PROTO_ROUTING:
+      return SICSLOWPAN_NHC_EXT_HDR_ROUTING;
+    case UIP_PROTO_FRAG:
+      return SICSLOWPAN_NHC_EXT_HDR_FRAG;
+    case UIP_PROTO_DESTO:
+      return SICSLOWPAN_NHC_EXT_HDR_DESTO;
+    default:
+      return SICSLOWPAN_NHC_EXT_HDR_IPV6;
+  }
+}
+
 /*--------------------------------------------------------------------*/
 /**
- * \brief Compress IP/UDP header
- *
- * This function is called by the 6lowpan code to create a compressed
- * 6lowpan packet in the packetbuf buffer from a full IPv6 packet in the
- * uip_buf buffer.
+ * \brief Check whether the header of type proto starting at hdr within
+ * uip_buf can be encoded using LOWPAN_NHC
  *
+ * The header must be completely contained in the packet and the
+ * uncompressed header length must still fit into uncomp_hdr_len.
+ * Only a single level of IPv6-in-IPv6 encapsulation is compressed.
  *
- * HC-06 (draft-ietf-6lowpan-hc, version 6)\n
- * http://tools.ietf.org/html/draft-ietf-6lowpan-hc-06
+ * \param outer the encapsulating IPv6 header of the header chain hdr
+ * belongs to, NULL for the outermost chain
+ */
+static uint8_t
+nhc_is_compressable(uint8_t proto, uint8_t *hdr,
+                    const struct uip_ip_hdr *outer)
+{
+  uint16_t offset = hdr - (uint8_t *)UIP_IP_BUF;
+  uint16_t len;
+
+  switch(proto) {
+#if UIP_CONF_UDP || UIP_CONF_ROUTER
+    case UIP_PROTO_UDP:
+      len = UIP_UDPH_LEN;
+      break;
+#endif /*UIP_CONF_UDP*/
+    case UIP_PROTO_FRAG:
+      /* fixed length, its second octet is reserved */
+      len = UIP_FRAGH_LEN;
+      break;
+    case UIP_PROTO_HBHO:
+    case UIP_PROTO_ROUTING:
+    case UIP_PROTO_DESTO:
+      if(offset + sizeof(struct uip_ext_hdr) > uip_len) {
+        return 0;
+      }
+      len = (((struct uip_ext_hdr *)hdr)->len << 3) + 8;
+      break;
+    case UIP_PROTO_IPV6:
+      if(outer != NULL) {
+        return 0;
+      }
+      len = UIP_IPH_LEN;
+      break;
+    default:
+      return 0;
+  }
+
+  return (offset + len <= uip_len) && (offset + len <= SICSLOWPAN_NHC_MAX_UNCOMP_LEN);
+}
+
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Get the number of trailing padding bytes of a hop-by-hop or
+ * destination options header
  *
- * \note We do not support ISA100_UDP header compression
+ * These bytes may be elided by the compressor since the decompressor
+ * restores the 8-octet alignment of the header (RFC6282 4.2). It does so
+ * with a single Pad1 or zero filled PadN option, so only a last option
+ * it rebuilds exactly is elided. The uncompressed header length must not
+ * change either, as fragment offsets refer to it.
+ */
+static uint8_t
+ext_hdr_trailing_pad(uint8_t *hdr, uint16_t len)
+{
+  uint16_t pos = sizeof(struct uip_ext_hdr);
+  uint16_t last = len;
+  uint16_t i;
+
+  while(pos < len) {
+    last = pos;
+    if(hdr[pos] == UIP_EXT_HDR_OPT_PAD1) {
+      pos++;
+    } else {
+      if(pos + 1 >= len) {
+        return 0;
+      }
+      pos += hdr[pos + 1] + 2;
+    }
+  }
+
+  /* malformed option encoding, do not touch the header. Padding of 8 or
+   * more octets is kept since the header would shrink otherwise */
+  if(pos != len || (len - last) > 7) {
+    return 0;
+  }
+  if(hdr[last] == UIP_EXT_HDR_OPT_PAD1) {
+    return 1;
+  }
+  if(hdr[last] != UIP_EXT_HDR_OPT_PADN || (len - last) < 2) {
+    return 0;
+  }
+  for(i = last + 2; i < len; i++) {
+    if(hdr[i] != 0) {
+      return 0;
+    }
+  }
+  return len - last;
+}
+
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Compress a UDP header using LOWPAN_NHC
  *
  * For LOWPAN_UDP compression, we either compress both ports or none.
- * General format with LOWPAN_UDP compression is
+ * The checksum is always carried inline.
+ */
+static void
+compress_nhc_udp(struct uip_udp_hdr *udp_hdr)
+{
+  PRINTF("IPHC: Uncompressed UDP ports on send side: %x, %x\n\r",
+     UIP_HTONS(udp_hdr->srcport), UIP_HTONS(udp_hdr->destport));
+  /* Mask out the last 4 bits can be used as a mask */
+  if(((UIP_HTONS(udp_hdr->srcport) & 0xfff0) == SICSLOWPAN_UDP_4_BIT_PORT_MIN) &&
+     ((UIP_HTONS(udp_hdr->destport) & 0xfff0) == SICSLOWPAN_UDP_4_BIT_PORT_MIN)) {
+    /* we can compress 12 bits of both source and dest */
+    *hc06_ptr = SICSLOWPAN_NHC_UDP_CS_P_11;
+    PRINTF("IPHC: remove 12 b of both source & dest with prefix 0xFOB\n\r");
+    *(hc06_ptr + 1) =
+  (uint8_t)((UIP_HTONS(udp_hdr->srcport) -
+      SICSLOWPAN_UDP_4_BIT_PORT_MIN) << 4) +
+  (uint8_t)((UIP_HTONS(udp_hdr->destport) -
+      SICSLOWPAN_UDP_4_BIT_PORT_MIN));
+    hc06_ptr += 2;
+  } else if((UIP_HTONS(udp_hdr->destport) & 0xff00) == SICSLOWPAN_UDP_8_BIT_PORT_MIN) {
+    /* we can compress 8 bits of dest, leave source. */
+    *hc06_ptr = SICSLOWPAN_NHC_UDP_CS_P_01;
+    PRINTF("IPHC: leave source, remove 8 bits of dest with prefix 0xF0\n\r");
+    memcpy(hc06_ptr + 1, &udp_hdr->srcport, 2);
+    *(hc06_ptr + 3) =
+  (uint8_t)((UIP_HTONS(udp_hdr->destport) -
+      SICSLOWPAN_UDP_8_BIT_PORT_MIN));
+    hc06_ptr += 4;
+  } else if((UIP_HTONS(udp_hdr->srcport) & 0xff00) == SICSLOWPAN_UDP_8_BIT_PORT_MIN) {
+    /* we can compress 8 bits of src, leave dest. Copy compressed port */
+    *hc06_ptr = SICSLOWPAN_NHC_UDP_CS_P_10;
+    PRINTF("IPHC: remove 8 bits of source with prefix 0xF0, leave dest. hch: %i\n\r", *hc06_ptr);
+    *(hc06_ptr + 1) =
+  (uint8_t)((UIP_HTONS(udp_hdr->srcport) -
+      SICSLOWPAN_UDP_8_BIT_PORT_MIN));
+    memcpy(hc06_ptr + 2, &udp_hdr->destport, 2);
+    hc06_ptr += 4;
+  } else {
+    /* we cannot compress. Copy uncompressed ports, full checksum  */
+    *hc06_ptr = SICSLOWPAN_NHC_UDP_CS_P_00;
+    PRINTF("IPHC: cannot compress headers\n\r");
+    memcpy(hc06_ptr + 1, &udp_hdr->srcport, 4);
+    hc06_ptr += 5;
+  }
+  /* always inline the checksum  */
+  if(1) {
+    memcpy(hc06_ptr, &udp_hdr->udpchksum, 2);
+    hc06_ptr += 2;
+  }
+}
+
+static void compress_iphc(struct uip_ip_hdr *ip_hdr, linkaddr_t *link_destaddr,
+                          const struct uip_ip_hdr *outer);
+
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Compress the chain of headers following an IPv6 header using
+ * LOWPAN_NHC (RFC6282 4.2 - 4.3)
+ *
+ * Extension headers (hop-by-hop, routing, fragment, destination options)
+ * are encoded with LOWPAN_NHC_EH, an encapsulated IPv6 header with
+ * EID 7 followed by its own LOWPAN_IPHC encoding and UDP with LOWPAN_UDP.
+ * The next header field of a header is elided whenever the following
+ * header is LOWPAN_NHC encoded as well.
  * \verbatim
- *                      1                   2                   3
- *  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
- * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
- * |0|1|1|TF |N|HLI|C|S|SAM|M|D|DAM| SCI   | DCI   | comp. IPv6 hdr|
- * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
- * | compressed IPv6 fields .....                                  |
- * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
- * | LOWPAN_UDP    | non compressed UDP fields ...                 |
- * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
- * | L4 data ...                                                   |
- * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   0   1   2   3   4   5   6   7
+ * +---+---+---+---+---+---+---+---+
+ * | 1 | 1 | 1 | 0 |    EID    |NH |
+ * +---+---+---+---+---+---+---+---+
  * \endverbatim
- * \note The context number 00 is reserved for the link local prefix.
- * For unicast addresses, if we cannot compress the prefix, we neither
- * compress the IID.
+ * \note This function must only be called if the first header of the
+ * chain is compressable (see nhc_is_compressable()).
+ */
+static void
+compress_nhc(struct uip_ip_hdr *ip_hdr, linkaddr_t *link_destaddr,
+             const struct uip_ip_hdr *outer)
+{
+  uint8_t *next_hdr = &ip_hdr->proto;
+  uint8_t *hdr = (uint8_t *)ip_hdr + UIP_IPH_LEN;
+  uint8_t *nhc;
+  uint16_t len;
+  uint16_t frag_offset = 0;
+  uint8_t behind_frag = 0;
+  uint8_t chain;
+  uint8_t pad;
+
+  while(nhc_is_compressable(*next_hdr, hdr, outer)) {
+    switch(*next_hdr) {
+      case UIP_PROTO_UDP:
+        compress_nhc_udp((struct uip_udp_hdr *)hdr);
+        uncomp_hdr_len += UIP_UDPH_LEN;
+        return;
+
+      case UIP_PROTO_IPV6:
+        /* the encapsulated header follows as LOWPAN_IPHC */
+        PRINTF("IPHC: compressing encapsulated IPv6 header\n\r");
+        *hc06_ptr = SICSLOWPAN_NHC_EXT_HDR |
+          (SICSLOWPAN_NHC_EXT_HDR_IPV6 << 1);
+        hc06_ptr += 1;
+        compress_iphc((struct uip_ip_hdr *)hdr, link_destaddr, ip_hdr);
+        return;
+
+      default:
+        if(*next_hdr == UIP_PROTO_FRAG) {
+          len = UIP_FRAGH_LEN;
+          frag_offset =
+            uip_ntohs(((struct uip_frag_hdr *)hdr)->offsetresmore) & 0xfff8;
+          behind_frag = 1;
+        } else {
+          len = (((struct uip_ext_hdr *)hdr)->len << 3) + 8;
+        }
+        pad = 0;
+        if((*next_hdr == UIP_PROTO_HBHO) || (*next_hdr == UIP_PROTO_DESTO)) {
+          pad = ext_hdr_trailing_pad(hdr, len);
+        }
+        PRINTF("IPHC: compressing extension header %u (len %u, pad %u)\n\r",
+               *next_hdr, len, pad);
+
+        nhc = hc06_ptr;
+        *nhc = SICSLOWPAN_NHC_EXT_HDR | (nhc_ext_hdr_eid(*next_hdr) << 1);
+        hc06_ptr += 1;
+
+        next_hdr = &((struct uip_ext_hdr *)hdr)->next;
+        chain = nhc_is_compressable(*next_hdr, hdr + len, outer);
+        /* Only the first fragment carries the headers that follow the
+         * Fragment header. The length of UDP or IPv6 behind it is not
+         * the one of the fragment, so they are never NHC encoded there */
+        if(behind_frag &&
+           ((frag_offset != 0) || (*next_hdr == UIP_PROTO_UDP) ||
+            (*next_hdr == UIP_PROTO_IPV6))) {
+          chain = 0;
+        }
+        if(chain) {
+          *nhc |= SICSLOWPAN_NHC_BIT;
+        } else {
+          *hc06_ptr = *next_hdr;
+          hc06_ptr += 1;
+        }
+
+        /* the length is given in octets following the length field */
+        *hc06_ptr = len - sizeof(struct uip_ext_hdr) - pad;
+        memcpy(hc06_ptr + 1, hdr + sizeof(struct uip_ext_hdr), *hc06_ptr);
+        hc06_ptr += *hc06_ptr + 1;
+
+        uncomp_hdr_len += len;
+        hdr += len;
+        if(!chain) {
+          return;
+        }
+        break;
+    }
+  }
+}
+
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Compress an IPv6 header using LOWPAN_IPHC
+ *
+ * The IPHC encoding is written at hc06_ptr, followed by the LOWPAN_NHC
+ * encoded header chain if possible.
+ *
+ * \param ip_hdr the IPv6 header to compress
  * \param link_destaddr L2 destination address, needed to compress IP
  * dest
+ * \param outer the encapsulating IPv6 header if ip_hdr is carried
+ * inside of another IPv6 packet, NULL otherwise. IIDs are then derived
+ * from the encapsulating header instead of the link layer addresses.
  */
 static void
-compress_hdr_hc06(linkaddr_t *link_destaddr)
+compress_iphc(struct uip_ip_hdr *ip_hdr, linkaddr_t *link_destaddr,
+              const struct uip_ip_hdr *outer)
 {
   uint8_t tmp, iphc0, iphc1;
-#if DEBUG
-  { uint16_t ndx;
-    PRINTF("before compression (%d): ", UIP_IP_BUF->len[1]);
-    for(ndx = 0; ndx < UIP_IP_BUF->len[1] + 40; ndx++) {
-      uint8_t data = ((uint8_t *) (UIP_IP_BUF))[ndx];
-      PRINTF("%02x", data);
-    }
-    PRINTF("\n\r");
-  }
-#endif
+  uint8_t *iphc = hc06_ptr;
 
-  hc06_ptr = packetbuf_ptr + 2;
+  hc06_ptr = iphc + 2;
   /*
    * As we copy some bit-length fields, in the IPHC encoding bytes,
    * we sometimes use |=
@@ -534,7 +893,7 @@ compress_hdr_hc06(linkaddr_t *link_destaddr)
 
   iphc0 = SICSLOWPAN_DISPATCH_IPHC;
   iphc1 = 0;
-  PACKETBUF_IPHC_BUF[2] = 0; /* might not be used - but needs to be cleared */
+  iphc[2] = 0; /* might not be used - but needs to be cleared */
 
   /*
    * Address handling needs to be made first since it might
@@ -546,8 +905,8 @@ compress_hdr_hc06(linkaddr_t *link_destaddr)
   /* check if dest context exists (for allocating third byte) */
   /* TODO: fix this so that it remembers the looked up values for
      avoiding two lookups - or set the lookup values immediately */
-  if(addr_context_lookup_by_prefix(&UIP_IP_BUF->destipaddr) != NULL ||
-     addr_context_lookup_by_prefix(&UIP_IP_BUF->srcipaddr) != NULL) {
+  if(addr_context_lookup_by_prefix(&ip_hdr->destipaddr) != NULL ||
+     addr_context_lookup_by_prefix(&ip_hdr->srcipaddr) != NULL) {
     /* set context flag and increase hc06_ptr */
     PRINTF("IPHC: compressing dest or src ipaddr - setting CID\n\r");
     iphc1 |= SICSLOWPAN_IPHC_CID;
@@ -562,15 +921,15 @@ compress_hdr_hc06(linkaddr_t *link_destaddr)
    */
 
   /* hc06 format of tc is ECN | DSCP , original is DSCP | ECN */
-  tmp = (UIP_IP_BUF->vtc << 4) | (UIP_IP_BUF->tcflow >> 4);
+  tmp = (ip_hdr->vtc << 4) | (ip_hdr->tcflow >> 4);
   tmp = ((tmp & 0x03) << 6) | (tmp >> 2);
 
-  if(((UIP_IP_BUF->tcflow & 0x0F) == 0) &&
-     (UIP_IP_BUF->flow == 0)) {
+  if(((ip_hdr->tcflow & 0x0F) == 0) &&
+     (ip_hdr->flow == 0)) {
     /* flow label can be compressed */
     iphc0 |= SICSLOWPAN_IPHC_FL_C;
-    if(((UIP_IP_BUF->vtc & 0x0F) == 0) &&
-       ((UIP_IP_BUF->tcflow & 0xF0) == 0)) {
+    if(((ip_hdr->vtc & 0x0F) == 0) &&
+       ((ip_hdr->tcflow & 0xF0) == 0)) {
       /* compress (elide) all */
       iphc0 |= SICSLOWPAN_IPHC_TC_C;
     } else {
@@ -580,17 +939,17 @@ compress_hdr_hc06(linkaddr_t *link_destaddr)
     }
   } else {
     /* Flow label cannot be compressed */
-    if(((UIP_IP_BUF->vtc & 0x0F) == 0) &&
-       ((UIP_IP_BUF->tcflow & 0xF0) == 0)) {
+    if(((ip_hdr->vtc & 0x0F) == 0) &&
+       ((ip_hdr->tcflow & 0xF0) == 0)) {
       /* compress only traffic class */
       iphc0 |= SICSLOWPAN_IPHC_TC_C;
       *hc06_ptr = (tmp & 0xc0) |
-        (UIP_IP_BUF->tcflow & 0x0F);
-      memcpy(hc06_ptr + 1, &UIP_IP_BUF->flow, 2);
+        (ip_hdr->tcflow & 0x0F);
+      memcpy(hc06_ptr + 1, &ip_hdr->flow, 2);
       hc06_ptr += 3;
     } else {
       /* compress nothing */
-      memcpy(hc06_ptr, &UIP_IP_BUF->vtc, 4);
+      memcpy(hc06_ptr, &ip_hdr->vtc, 4);
       /* but replace the top byte with the new ECN | DSCP format*/
       *hc06_ptr = tmp;
       hc06_ptr += 4;
@@ -599,19 +958,20 @@ compress_hdr_hc06(linkaddr_t *link_destaddr)
 
   /* Note that the payload length is always compressed */
 
-  /* Next header. We compress it if UDP */
-#if UIP_CONF_UDP || UIP_CONF_ROUTER
-  if(UIP_IP_BUF->proto == UIP_PROTO_UDP) {
+  /* Next header. We compress it if the header chain can be encoded
+   * using LOWPAN_NHC */
+  if(nhc_is_compressable(ip_hdr->proto,
+                         (uint8_t *)ip_hdr + UIP_IPH_LEN, outer)) {
     iphc0 |= SICSLOWPAN_IPHC_NH_C;
   }
-#endif /*UIP_CONF_UDP*/
 #ifdef SICSLOWPAN_NH_COMPRESSOR
-  if(SICSLOWPAN_NH_COMPRESSOR.is_compressable(UIP_IP_BUF->proto)) {
+  else if((outer == NULL) &&
+          SICSLOWPAN_NH_COMPRESSOR.is_compressable(ip_hdr->proto)) {
     iphc0 |= SICSLOWPAN_IPHC_NH_C;
   }
 #endif
   if ((iphc0 & SICSLOWPAN_IPHC_NH_C) == 0) {
-    *hc06_ptr = UIP_IP_BUF->proto;
+    *hc06_ptr = ip_hdr->proto;
     hc06_ptr += 1;
   }
 
@@ -622,7 +982,7 @@ compress_hdr_hc06(linkaddr_t *link_destaddr)
    * if 255: compress, encoding is 11
    * else do not compress
    */
-  switch(UIP_IP_BUF->ttl) {
+  switch(ip_hdr->ttl) {
     case 1:
       iphc0 |= SICSLOWPAN_IPHC_TTL_1;
       break;
@@ -633,154 +993,170 @@ compress_hdr_hc06(linkaddr_t *link_destaddr)
       iphc0 |= SICSLOWPAN_IPHC_TTL_255;
       break;
     default:
-      *hc06_ptr = UIP_IP_BUF->ttl;
+      *hc06_ptr = ip_hdr->ttl;
       hc06_ptr += 1;
       break;
   }
 
   /* source address - cannot be multicast */
-  if(uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr)) {
+  if(uip_is_addr_unspecified(&ip_hdr->srcipaddr)) {
     PRINTF("IPHC: compressing unspecified - setting SAC\n\r");
     iphc1 |= SICSLOWPAN_IPHC_SAC;
     iphc1 |= SICSLOWPAN_IPHC_SAM_00;
-  } else if((context = addr_context_lookup_by_prefix(&UIP_IP_BUF->srcipaddr))
+  } else if((context = addr_context_lookup_by_prefix(&ip_hdr->srcipaddr))
      != NULL) {
     /* elide the prefix - indicate by CID and set context + SAC */
     PRINTF("IPHC: compressing src with context - setting CID & SAC ctx: %d\n\r",
        context->number);
     iphc1 |= SICSLOWPAN_IPHC_CID | SICSLOWPAN_IPHC_SAC;
-    PACKETBUF_IPHC_BUF[2] |= context->number << 4;
+    iphc[2] |= context->number << 4;
     /* compession compare with this nodes address (source) */
 
     iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_SAM_BIT,
-                              &UIP_IP_BUF->srcipaddr, &uip_lladdr);
+                              &ip_hdr->srcipaddr, &uip_lladdr,
+                              outer != NULL ? &outer->srcipaddr : NULL);
     /* No context found for this address */
-  } else if(uip_is_addr_link_local(&UIP_IP_BUF->srcipaddr) &&
-        UIP_IP_BUF->destipaddr.u16[1] == 0 &&
-        UIP_IP_BUF->destipaddr.u16[2] == 0 &&
-        UIP_IP_BUF->destipaddr.u16[3] == 0) {
+  } else if(uip_is_addr_link_local(&ip_hdr->srcipaddr) &&
+        ip_hdr->srcipaddr.u16[1] == 0 &&
+        ip_hdr->srcipaddr.u16[2] == 0 &&
+        ip_hdr->srcipaddr.u16[3] == 0) {
     iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_SAM_BIT,
-                              &UIP_IP_BUF->srcipaddr, &uip_lladdr);
+                              &ip_hdr->srcipaddr, &uip_lladdr,
+                              outer != NULL ? &outer->srcipaddr : NULL);
   } else {
     /* send the full address => SAC = 0, SAM = 00 */
     iphc1 |= SICSLOWPAN_IPHC_SAM_00; /* 128-bits */
-    memcpy(hc06_ptr, &UIP_IP_BUF->srcipaddr.u16[0], 16);
+    memcpy(hc06_ptr, &ip_hdr->srcipaddr.u16[0], 16);
     hc06_ptr += 16;
   }
 
   /* dest address*/
-  if(uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
+  if(uip_is_addr_mcast(&ip_hdr->destipaddr)) {
     /* Address is multicast, try to compress */
     iphc1 |= SICSLOWPAN_IPHC_M;
-    if(sicslowpan_is_mcast_addr_compressable8(&UIP_IP_BUF->destipaddr)) {
+    if(sicslowpan_is_mcast_addr_compressable8(&ip_hdr->destipaddr)) {
       iphc1 |= SICSLOWPAN_IPHC_DAM_11;
       /* use last byte */
-      *hc06_ptr = UIP_IP_BUF->destipaddr.u8[15];
+      *hc06_ptr = ip_hdr->destipaddr.u8[15];
       hc06_ptr += 1;
-    } else if(sicslowpan_is_mcast_addr_compressable32(&UIP_IP_BUF->destipaddr)) {
+    } else if(sicslowpan_is_mcast_addr_compressable32(&ip_hdr->destipaddr)) {
       iphc1 |= SICSLOWPAN_IPHC_DAM_10;
       /* second byte + the last three */
-      *hc06_ptr = UIP_IP_BUF->destipaddr.u8[1];
-      memcpy(hc06_ptr + 1, &UIP_IP_BUF->destipaddr.u8[13], 3);
+      *hc06_ptr = ip_hdr->destipaddr.u8[1];
+      memcpy(hc06_ptr + 1, &ip_hdr->destipaddr.u8[13], 3);
       hc06_ptr += 4;
-    } else if(sicslowpan_is_mcast_addr_compressable48(&UIP_IP_BUF->destipaddr)) {
+    } else if(sicslowpan_is_mcast_addr_compressable48(&ip_hdr->destipaddr)) {
       iphc1 |= SICSLOWPAN_IPHC_DAM_01;
       /* second byte + the last five */
-      *hc06_ptr = UIP_IP_BUF->destipaddr.u8[1];
-      memcpy(hc06_ptr + 1, &UIP_IP_BUF->destipaddr.u8[11], 5);
+      *hc06_ptr = ip_hdr->destipaddr.u8[1];
+      memcpy(hc06_ptr + 1, &ip_hdr->destipaddr.u8[11], 5);
       hc06_ptr += 6;
     } else {
       iphc1 |= SICSLOWPAN_IPHC_DAM_00;
       /* full address */
-      memcpy(hc06_ptr, &UIP_IP_BUF->destipaddr.u8[0], 16);
+      memcpy(hc06_ptr, &ip_hdr->destipaddr.u8[0], 16);
       hc06_ptr += 16;
     }
   } else {
     /* Address is unicast, try to compress */
-    if((context = addr_context_lookup_by_prefix(&UIP_IP_BUF->destipaddr)) != NULL) {
+    if((context = addr_context_lookup_by_prefix(&ip_hdr->destipaddr)) != NULL) {
       /* elide the prefix */
       iphc1 |= SICSLOWPAN_IPHC_DAC;
-      PACKETBUF_IPHC_BUF[2] |= context->number;
+      iphc[2] |= context->number;
       /* compession compare with link adress (destination) */
 
       iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_DAM_BIT,
-           &UIP_IP_BUF->destipaddr, (uip_lladdr_t *)link_destaddr);
+           &ip_hdr->destipaddr, (uip_lladdr_t *)link_destaddr,
+           outer != NULL ? &outer->destipaddr : NULL);
       /* No context found for this address */
-    } else if(uip_is_addr_link_local(&UIP_IP_BUF->destipaddr) &&
-          UIP_IP_BUF->destipaddr.u16[1] == 0 &&
-          UIP_IP_BUF->destipaddr.u16[2] == 0 &&
-          UIP_IP_BUF->destipaddr.u16[3] == 0) {
+    } else if(uip_is_addr_link_local(&ip_hdr->destipaddr) &&
+          ip_hdr->destipaddr.u16[1] == 0 &&
+          ip_hdr->destipaddr.u16[2] == 0 &&
+          ip_hdr->destipaddr.u16[3] == 0) {
       iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_DAM_BIT,
-               &UIP_IP_BUF->destipaddr, (uip_lladdr_t *)link_destaddr);
+               &ip_hdr->destipaddr, (uip_lladdr_t *)link_destaddr,
+               outer != NULL ? &outer->destipaddr : NULL);
     } else {
       /* send the full address */
       iphc1 |= SICSLOWPAN_IPHC_DAM_00; /* 128-bits */
-      memcpy(hc06_ptr, &UIP_IP_BUF->destipaddr.u16[0], 16);
+      memcpy(hc06_ptr, &ip_hdr->destipaddr.u16[0], 16);
       hc06_ptr += 16;
     }
   }
 
-  uncomp_hdr_len = UIP_IPH_LEN;
+  iphc[0] = iphc0;
+  iphc[1] = iphc1;
 
-#if UIP_CONF_UDP || UIP_CONF_ROUTER
-  /* UDP header compression */
-  if(UIP_IP_BUF->proto == UIP_PROTO_UDP) {
-    PRINTF("IPHC: Uncompressed UDP ports on send side: %x, %x\n\r",
-       UIP_HTONS(UIP_UDP_BUF->srcport), UIP_HTONS(UIP_UDP_BUF->destport));
-    /* Mask out the last 4 bits can be used as a mask */
-    if(((UIP_HTONS(UIP_UDP_BUF->srcport) & 0xfff0) == SICSLOWPAN_UDP_4_BIT_PORT_MIN) &&
-       ((UIP_HTONS(UIP_UDP_BUF->destport) & 0xfff0) == SICSLOWPAN_UDP_4_BIT_PORT_MIN)) {
-      /* we can compress 12 bits of both source and dest */
-      *hc06_ptr = SICSLOWPAN_NHC_UDP_CS_P_11;
-      PRINTF("IPHC: remove 12 b of both source & dest with prefix 0xFOB\n\r");
-      *(hc06_ptr + 1) =
-    (uint8_t)((UIP_HTONS(UIP_UDP_BUF->srcport) -
-        SICSLOWPAN_UDP_4_BIT_PORT_MIN) << 4) +
-    (uint8_t)((UIP_HTONS(UIP_UDP_BUF->destport) -
-        SICSLOWPAN_UDP_4_BIT_PORT_MIN));
-      hc06_ptr += 2;
-    } else if((UIP_HTONS(UIP_UDP_BUF->destport) & 0xff00) == SICSLOWPAN_UDP_8_BIT_PORT_MIN) {
-      /* we can compress 8 bits of dest, leave source. */
-      *hc06_ptr = SICSLOWPAN_NHC_UDP_CS_P_01;
-      PRINTF("IPHC: leave source, remove 8 bits of dest with prefix 0xF0\n\r");
-      memcpy(hc06_ptr + 1, &UIP_UDP_BUF->srcport, 2);
-      *(hc06_ptr + 3) =
-    (uint8_t)((UIP_HTONS(UIP_UDP_BUF->destport) -
-        SICSLOWPAN_UDP_8_BIT_PORT_MIN));
-      hc06_ptr += 4;
-    } else if((UIP_HTONS(UIP_UDP_BUF->srcport) & 0xff00) == SICSLOWPAN_UDP_8_BIT_PORT_MIN) {
-      /* we can compress 8 bits of src, leave dest. Copy compressed port */
-      *hc06_ptr = SICSLOWPAN_NHC_UDP_CS_P_10;
-      PRINTF("IPHC: remove 8 bits of source with prefix 0xF0, leave dest. hch: %i\n\r", *hc06_ptr);
-      *(hc06_ptr + 1) =
-    (uint8_t)((UIP_HTONS(UIP_UDP_BUF->srcport) -
-        SICSLOWPAN_UDP_8_BIT_PORT_MIN));
-      memcpy(hc06_ptr + 2, &UIP_UDP_BUF->destport, 2);
-      hc06_ptr += 4;
-    } else {
-      /* we cannot compress. Copy uncompressed ports, full checksum  */
-      *hc06_ptr = SICSLOWPAN_NHC_UDP_CS_P_00;
-      PRINTF("IPHC: cannot compress headers\n\r");
-      memcpy(hc06_ptr + 1, &UIP_UDP_BUF->srcport, 4);
-      hc06_ptr += 5;
-    }
-    /* always inline the checksum  */
-    if(1) {
-      memcpy(hc06_ptr, &UIP_UDP_BUF->udpchksum, 2);
-      hc06_ptr += 2;
-    }
-    uncomp_hdr_len += UIP_UDPH_LEN;
-  }
-#endif /*UIP_CONF_UDP*/
+  uncomp_hdr_len += UIP_IPH_LEN;
 
+  /* UDP, extension headers and encapsulated IPv6 */
+  if(nhc_is_compressable(ip_hdr->proto,
+                         (uint8_t *)ip_hdr + UIP_IPH_LEN, outer)) {
+    compress_nhc(ip_hdr, link_destaddr, outer);
+  }
 #ifdef SICSLOWPAN_NH_COMPRESSOR
-  /* if nothing to compress just return zero  */
-  hc06_ptr += SICSLOWPAN_NH_COMPRESSOR.compress(hc06_ptr, &uncomp_hdr_len);
+  else if(iphc0 & SICSLOWPAN_IPHC_NH_C) {
+    /* if nothing to compress just return zero  */
+    hc06_ptr += SICSLOWPAN_NH_COMPRESSOR.compress(hc06_ptr, &uncomp_hdr_len);
+  }
 #endif
+}
 
-  /* before the packetbuf_hdr_len operation */
-  PACKETBUF_IPHC_BUF[0] = iphc0;
-  PACKETBUF_IPHC_BUF[1] = iphc1;
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Compress IP/UDP header
+ *
+ * This function is called by the 6lowpan code to create a compressed
+ * 6lowpan packet in the packetbuf buffer from a full IPv6 packet in the
+ * uip_buf buffer.
+ *
+ *
+ * HC-06 (draft-ietf-6lowpan-hc, version 6)\n
+ * http://tools.ietf.org/html/draft-ietf-6lowpan-hc-06
+ *
+ * \note We do not support ISA100_UDP header compression
+ *
+ * For LOWPAN_UDP compression, we either compress both ports or none.
+ * UDP, IPv6 extension headers and an encapsulated IPv6 header are
+ * compressed using LOWPAN_NHC (see compress_nhc()).
+ * General format with LOWPAN_UDP compression is
+ * \verbatim
+ *                      1                   2                   3
+ *  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |0|1|1|TF |N|HLI|C|S|SAM|M|D|DAM| SCI   | DCI   | comp. IPv6 hdr|
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * | compressed IPv6 fields .....                                  |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * | LOWPAN_NHC_EH | compressed extension header fields (optional)  |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * | LOWPAN_UDP    | non compressed UDP fields ...                 |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * | L4 data ...                                                   |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * \endverbatim
+ * \note The context number 00 is reserved for the link local prefix.
+ * For unicast addresses, if we cannot compress the prefix, we neither
+ * compress the IID.
+ * \param link_destaddr L2 destination address, needed to compress IP
+ * dest
+ */
+static void
+compress_hdr_hc06(linkaddr_t *link_destaddr)
+{
+#if DEBUG
+  { uint16_t ndx;
+    PRINTF("before compression (%d): ", UIP_IP_BUF->len[1]);
+    for(ndx = 0; ndx < UIP_IP_BUF->len[1] + 40; ndx++) {
+      uint8_t data = ((uint8_t *) (UIP_IP_BUF))[ndx];
+      PRINTF("%02x", data);
+    }
+    PRINTF("\n\r");
+  }
+#endif
+
+  hc06_ptr = packetbuf_ptr;
+  compress_iphc(UIP_IP_BUF, link_destaddr, NULL);
 
   packetbuf_hdr_len = hc06_ptr - packetbuf_ptr;
   return;
@@ -788,29 +1164,213 @@ compress_hdr_hc06(linkaddr_t *link_destaddr)
 
 /*--------------------------------------------------------------------*/
 /**
- * \brief Uncompress HC06 (i.e., IPHC and LOWPAN_UDP) headers and put
- * them in sicslowpan_buf
+ * \brief Uncompress a LOWPAN_UDP header
+ * \return 1 on success, 0 if the encoding is not supported
+ */
+static uint8_t
+uncompress_nhc_udp(struct uip_udp_hdr *udp_hdr)
+{
+  uint8_t checksum_compressed;
+  checksum_compressed = *hc06_ptr & SICSLOWPAN_NHC_UDP_CHECKSUMC;
+  PRINTF("IPHC: Incoming header value: %i\n\r", *hc06_ptr);
+  switch(*hc06_ptr & SICSLOWPAN_NHC_UDP_CS_P_11) {
+  case SICSLOWPAN_NHC_UDP_CS_P_00:
+    /* 1 byte for NHC, 4 byte for ports, 2 bytes chksum */
+    memcpy(&udp_hdr->srcport, hc06_ptr + 1, 2);
+    memcpy(&udp_hdr->destport, hc06_ptr + 3, 2);
+    PRINTF("IPHC: Uncompressed UDP ports (ptr+5): %x, %x\n\r",
+           UIP_HTONS(udp_hdr->srcport), UIP_HTONS(udp_hdr->destport));
+    hc06_ptr += 5;
+    break;
+
+  case SICSLOWPAN_NHC_UDP_CS_P_01:
+    /* 1 byte for NHC + source 16bit inline, dest = 0xF0 + 8 bit inline */
+    PRINTF("IPHC: Decompressing destination\n\r");
+    memcpy(&udp_hdr->srcport, hc06_ptr + 1, 2);
+    udp_hdr->destport = UIP_HTONS(SICSLOWPAN_UDP_8_BIT_PORT_MIN + (*(hc06_ptr + 3)));
+    PRINTF("IPHC: Uncompressed UDP ports (ptr+4): %x, %x\n\r",
+           UIP_HTONS(udp_hdr->srcport), UIP_HTONS(udp_hdr->destport));
+    hc06_ptr += 4;
+    break;
+
+  case SICSLOWPAN_NHC_UDP_CS_P_10:
+    /* 1 byte for NHC + source = 0xF0 + 8bit inline, dest = 16 bit inline*/
+    PRINTF("IPHC: Decompressing source\n\r");
+    udp_hdr->srcport = UIP_HTONS(SICSLOWPAN_UDP_8_BIT_PORT_MIN +
+                                 (*(hc06_ptr + 1)));
+    memcpy(&udp_hdr->destport, hc06_ptr + 2, 2);
+    PRINTF("IPHC: Uncompressed UDP ports (ptr+4): %x, %x\n\r",
+           UIP_HTONS(udp_hdr->srcport), UIP_HTONS(udp_hdr->destport));
+    hc06_ptr += 4;
+    break;
+
+  case SICSLOWPAN_NHC_UDP_CS_P_11:
+    /* 1 byte for NHC, 1 byte for ports */
+    udp_hdr->srcport = UIP_HTONS(SICSLOWPAN_UDP_4_BIT_PORT_MIN +
+                                 (*(hc06_ptr + 1) >> 4));
+    udp_hdr->destport = UIP_HTONS(SICSLOWPAN_UDP_4_BIT_PORT_MIN +
+                                  ((*(hc06_ptr + 1)) & 0x0F));
+    PRINTF("IPHC: Uncompressed UDP ports (ptr+2): %x, %x\n\r",
+           UIP_HTONS(udp_hdr->srcport), UIP_HTONS(udp_hdr->destport));
+    hc06_ptr += 2;
+    break;
+
+  default:
+    PRINTF("sicslowpan uncompress_hdr: error unsupported UDP compression\n\r");
+    return 0;
+  }
+  if(!checksum_compressed) { /* has_checksum, default  */
+    memcpy(&udp_hdr->udpchksum, hc06_ptr, 2);
+    hc06_ptr += 2;
+    PRINTF("IPHC: sicslowpan uncompress_hdr: checksum included\n\r");
+  } else {
+    PRINTF("IPHC: sicslowpan uncompress_hdr: checksum *NOT* included\n\r");
+  }
+  return 1;
+}
+
+static uint8_t uncompress_iphc(struct uip_ip_hdr *ip_hdr,
+                               const struct uip_ip_hdr *outer);
+
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Uncompress the LOWPAN_NHC encoded header chain following an
+ * IPv6 header
  *
- * This function is called by the input function when the dispatch is
- * HC06.
- * We %process the packet in the packetbuf buffer, uncompress the header
- * fields, and copy the result in the sicslowpan buffer.
- * At the end of the decompression, packetbuf_hdr_len and uncompressed_hdr_len
- * are set to the appropriate values
+ * Trailing padding of hop-by-hop and destination options headers that
+ * was elided by the sender is restored as Pad1/PadN option.
+ * \return 1 on success, 0 if the packet must be dropped
+ */
+static uint8_t
+uncompress_nhc(struct uip_ip_hdr *ip_hdr, const struct uip_ip_hdr *outer)
+{
+  uint8_t *last_next = &ip_hdr->proto;
+  uint8_t *hdr = (uint8_t *)ip_hdr + UIP_IPH_LEN;
+  struct uip_ext_hdr *ext_hdr;
+  uint8_t behind_frag = 0;
+  uint8_t nh = 1;
+  uint8_t eid;
+  uint8_t len;
+  uint8_t pad;
+
+  while(nh && (*hc06_ptr & SICSLOWPAN_NHC_MASK) == SICSLOWPAN_NHC_EXT_HDR) {
+    eid = (*hc06_ptr & SICSLOWPAN_NHC_EXT_EID_MASK) >> 1;
+    nh = *hc06_ptr & SICSLOWPAN_NHC_BIT;
+    hc06_ptr += 1;
+
+    if(eid == SICSLOWPAN_NHC_EXT_HDR_IPV6) {
+      /* encapsulated IPv6 header, the LOWPAN_IPHC encoding follows */
+      if((outer != NULL) || behind_frag ||
+         (uncomp_hdr_len + UIP_IPH_LEN > SICSLOWPAN_NHC_MAX_UNCOMP_LEN)) {
+        PRINTF("sicslowpan uncompress_hdr: nested IPv6 header not supported\n\r");
+        return 0;
+      }
+      *last_next = UIP_PROTO_IPV6;
+      return uncompress_iphc((struct uip_ip_hdr *)hdr, ip_hdr);
+    }
+
+    switch(eid) {
+      case SICSLOWPAN_NHC_EXT_HDR_HBHO:
+        *last_next = UIP_PROTO_HBHO;
+        break;
+      case SICSLOWPAN_NHC_EXT_HDR_ROUTING:
+        *last_next = UIP_PROTO_ROUTING;
+        break;
+      case SICSLOWPAN_NHC_EXT_HDR_FRAG:
+        *last_next = UIP_PROTO_FRAG;
+        behind_frag = 1;
+        break;
+      case SICSLOWPAN_NHC_EXT_HDR_DESTO:
+        *last_next = UIP_PROTO_DESTO;
+        break;
+      default:
+        PRINTF("sicslowpan uncompress_hdr: unsupported extension header %u\n\r", eid);
+        return 0;
+    }
+
+    ext_hdr = (struct uip_ext_hdr *)hdr;
+    if(!nh) {
+      ext_hdr->next = *hc06_ptr;
+      hc06_ptr += 1;
+    }
+    len = *hc06_ptr;
+    hc06_ptr += 1;
+    if((*last_next == UIP_PROTO_FRAG) &&
+       (len != UIP_FRAGH_LEN - sizeof(struct uip_ext_hdr))) {
+      PRINTF("sicslowpan uncompress_hdr: bad fragment header length\n\r");
+      return 0;
+    }
+
+    /* restore the alignment to a multiple of 8 octets */
+    pad = (8 - ((len + sizeof(struct uip_ext_hdr)) & 0x07)) & 0x07;
+    if((pad != 0) &&
+       (*last_next != UIP_PROTO_HBHO) && (*last_next != UIP_PROTO_DESTO)) {
+      PRINTF("sicslowpan uncompress_hdr: misaligned extension header\n\r");
+      return 0;
+    }
+    if(uncomp_hdr_len + sizeof(struct uip_ext_hdr) + len + pad >
+       SICSLOWPAN_NHC_MAX_UNCOMP_LEN) {
+      PRINTF("sicslowpan uncompress_hdr: extension header too long\n\r");
+      return 0;
+    }
+    memcpy(hdr + sizeof(struct uip_ext_hdr), hc06_ptr, len);
+    hc06_ptr += len;
+    len += sizeof(struct uip_ext_hdr);
+    if(pad == 1) {
+      hdr[len] = UIP_EXT_HDR_OPT_PAD1;
+    } else if(pad > 1) {
+      hdr[len] = UIP_EXT_HDR_OPT_PADN;
+      hdr[len + 1] = pad - 2;
+      memset(&hdr[len + 2], 0, pad - 2);
+    }
+    len += pad;
+    ext_hdr->len = (len >> 3) - 1;
+
+    uncomp_hdr_len += len;
+    last_next = &ext_hdr->next;
+    hdr += len;
+  }
+
+  if(nh && !behind_frag &&
+     (*hc06_ptr & SICSLOWPAN_NHC_UDP_MASK) == SICSLOWPAN_NHC_UDP_ID) {
+    *last_next = UIP_PROTO_UDP;
+    if(!uncompress_nhc_udp((struct uip_udp_hdr *)hdr)) {
+      return 0;
+    }
+    uncomp_hdr_len += UIP_UDPH_LEN;
+    return 1;
+  }
+#ifdef SICSLOWPAN_NH_COMPRESSOR
+  if(nh && (outer == NULL) && (last_next == &ip_hdr->proto)) {
+    hc06_ptr += SICSLOWPAN_NH_COMPRESSOR.uncompress(hc06_ptr, sicslowpan_buf, &uncomp_hdr_len);
+    return 1;
+  }
+#endif
+
+  /* the next header of the last extension header must be inline */
+  return !nh;
+}
+
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Uncompress a LOWPAN_IPHC encoded IPv6 header located at
+ * hc06_ptr into ip_hdr
  *
- * \param ip_len Equal to 0 if the packet is not a fragment (IP length
- * is then inferred from the L2 length), non 0 if the packet is a 1st
- * fragment.
+ * \param ip_hdr where to put the uncompressed IPv6 header
+ * \param outer the already uncompressed encapsulating IPv6 header or
+ * NULL if ip_hdr is the outermost header
+ * \return 1 on success, 0 if the packet must be dropped
  */
-static void
-uncompress_hdr_hc06(uint16_t ip_len)
+static uint8_t
+uncompress_iphc(struct uip_ip_hdr *ip_hdr, const struct uip_ip_hdr *outer)
 {
   uint8_t tmp, iphc0, iphc1;
+  uint8_t *iphc = hc06_ptr;
   /* at least two byte will be used for the encoding */
-  hc06_ptr = packetbuf_ptr + packetbuf_hdr_len + 2;
+  hc06_ptr = iphc + 2;
 
-  iphc0 = PACKETBUF_IPHC_BUF[0];
-  iphc1 = PACKETBUF_IPHC_BUF[1];
+  iphc0 = iphc[0];
+  iphc1 = iphc[1];
 
   /* another if the CID flag is set */
   if(iphc1 & SICSLOWPAN_IPHC_CID) {
@@ -823,22 +1383,22 @@ uncompress_hdr_hc06(uint16_t ip_len)
       /* Flow label are carried inline */
       if((iphc0 & SICSLOWPAN_IPHC_TC_C) == 0) {
         /* Traffic class is carried inline */
-        memcpy(&SICSLOWPAN_IP_BUF->tcflow, hc06_ptr + 1, 3);
+        memcpy(&ip_hdr->tcflow, hc06_ptr + 1, 3);
         tmp = *hc06_ptr;
         hc06_ptr += 4;
         /* hc06 format of tc is ECN | DSCP , original is DSCP | ECN */
         /* set version, pick highest DSCP bits and set in vtc */
-        SICSLOWPAN_IP_BUF->vtc = 0x60 | ((tmp >> 2) & 0x0f);
+        ip_hdr->vtc = 0x60 | ((tmp >> 2) & 0x0f);
         /* ECN rolled down two steps + lowest DSCP bits at top two bits */
-        SICSLOWPAN_IP_BUF->tcflow = ((tmp >> 2) & 0x30) | (tmp << 6) |
-      (SICSLOWPAN_IP_BUF->tcflow & 0x0f);
+        ip_hdr->tcflow = ((tmp >> 2) & 0x30) | (tmp << 6) |
+      (ip_hdr->tcflow & 0x0f);
       } else {
         /* Traffic class is compressed (set version and no TC)*/
-        SICSLOWPAN_IP_BUF->vtc = 0x60;
+        ip_hdr->vtc = 0x60;
         /* highest flow label bits + ECN bits */
-        SICSLOWPAN_IP_BUF->tcflow = (*hc06_ptr & 0x0F) |
+        ip_hdr->tcflow = (*hc06_ptr & 0x0F) |
       ((*hc06_ptr >> 2) & 0x30);
-        memcpy(&SICSLOWPAN_IP_BUF->flow, hc06_ptr + 1, 2);
+        memcpy(&ip_hdr->flow, hc06_ptr + 1, 2);
         hc06_ptr += 3;
       }
     } else {
@@ -846,31 +1406,31 @@ uncompress_hdr_hc06(uint16_t ip_len)
       /* Version and flow label are compressed */
       if((iphc0 & SICSLOWPAN_IPHC_TC_C) == 0) {
         /* Traffic class is inline */
-          SICSLOWPAN_IP_BUF->vtc = 0x60 | ((*hc06_ptr >> 2) & 0x0f);
-          SICSLOWPAN_IP_BUF->tcflow = ((*hc06_ptr << 6) & 0xC0) | ((*hc06_ptr >> 2) & 0x30);
-          SICSLOWPAN_IP_BUF->flow = 0;
+          ip_hdr->vtc = 0x60 | ((*hc06_ptr >> 2) & 0x0f);
+          ip_hdr->tcflow = ((*hc06_ptr << 6) & 0xC0) | ((*hc06_ptr >> 2) & 0x30);
+          ip_hdr->flow = 0;
           hc06_ptr += 1;
       } else {
         /* Traffic class is compressed */
-        SICSLOWPAN_IP_BUF->vtc = 0x60;
-        SICSLOWPAN_IP_BUF->tcflow = 0;
-        SICSLOWPAN_IP_BUF->flow = 0;
+        ip_hdr->vtc = 0x60;
+        ip_hdr->tcflow = 0;
+        ip_hdr->flow = 0;
       }
     }
 
   /* Next Header */
   if((iphc0 & SICSLOWPAN_IPHC_NH_C) == 0) {
     /* Next header is carried inline */
-    SICSLOWPAN_IP_BUF->proto = *hc06_ptr;
-    PRINTF("IPHC: next header inline: %d\n\r", SICSLOWPAN_IP_BUF->proto);
+    ip_hdr->proto = *hc06_ptr;
+    PRINTF("IPHC: next header inline: %d\n\r", ip_hdr->proto);
     hc06_ptr += 1;
   }
 
   /* Hop limit */
   if((iphc0 & 0x03) != SICSLOWPAN_IPHC_TTL_I) {
-    SICSLOWPAN_IP_BUF->ttl = ttl_values[iphc0 & 0x03];
+    ip_hdr->ttl = ttl_values[iphc0 & 0x03];
   } else {
-    SICSLOWPAN_IP_BUF->ttl = *hc06_ptr;
+    ip_hdr->ttl = *hc06_ptr;
     hc06_ptr += 1;
   }
 
@@ -880,24 +1440,26 @@ uncompress_hdr_hc06(uint16_t ip_len)
   /* context based compression */
   if(iphc1 & SICSLOWPAN_IPHC_SAC) {
     uint8_t sci = (iphc1 & SICSLOWPAN_IPHC_CID) ?
-      PACKETBUF_IPHC_BUF[2] >> 4 : 0;
+      iphc[2] >> 4 : 0;
 
     /* Source address - check context != NULL only if SAM bits are != 0*/
     if (tmp != 0) {
       context = addr_context_lookup_by_number(sci);
       if(context == NULL) {
         PRINTF("sicslowpan uncompress_hdr: error context not found\n\r");
-        return;
+        return 0;
       }
     }
     /* if tmp == 0 we do not have a context and therefore no prefix */
-    uncompress_addr(&SICSLOWPAN_IP_BUF->srcipaddr,
+    uncompress_addr(&ip_hdr->srcipaddr,
                     tmp != 0 ? context->prefix : NULL, unc_ctxconf[tmp],
-                    (uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER));
+                    (uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER),
+                    outer != NULL ? &outer->srcipaddr : NULL);
   } else {
     /* no compression and link local */
-    uncompress_addr(&SICSLOWPAN_IP_BUF->srcipaddr, llprefix, unc_llconf[tmp],
-                    (uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER));
+    uncompress_addr(&ip_hdr->srcipaddr, llprefix, unc_llconf[tmp],
+                    (uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER),
+                    outer != NULL ? &outer->srcipaddr : NULL);
   }
 
   /* Destination address */
@@ -921,30 +1483,32 @@ uncompress_hdr_hc06(uint16_t ip_len)
         hc06_ptr++;
       }
 
-      uncompress_addr(&SICSLOWPAN_IP_BUF->destipaddr, prefix,
-                      unc_mxconf[tmp], NULL);
+      uncompress_addr(&ip_hdr->destipaddr, prefix,
+                      unc_mxconf[tmp], NULL, NULL);
     }
   } else {
     /* no multicast */
     /* Context based */
     if(iphc1 & SICSLOWPAN_IPHC_DAC) {
       uint8_t dci = (iphc1 & SICSLOWPAN_IPHC_CID) ?
-    PACKETBUF_IPHC_BUF[2] & 0x0f : 0;
+    iphc[2] & 0x0f : 0;
       context = addr_context_lookup_by_number(dci);
 
       /* all valid cases below need the context! */
       if(context == NULL) {
     PRINTF("sicslowpan uncompress_hdr: error context not found\n\r");
-    return;
+    return 0;
       }
-      uncompress_addr(&SICSLOWPAN_IP_BUF->destipaddr, context->prefix,
+      uncompress_addr(&ip_hdr->destipaddr, context->prefix,
                       unc_ctxconf[tmp],
-                      (uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
+                      (uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
+                      outer != NULL ? &outer->destipaddr : NULL);
     } else {
       /* not context based => link local M = 0, DAC = 0 - same as SAC */
-      uncompress_addr(&SICSLOWPAN_IP_BUF->destipaddr, llprefix,
+      uncompress_addr(&ip_hdr->destipaddr, llprefix,
                       unc_llconf[tmp],
-                      (uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
+                      (uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
+                      outer != NULL ? &outer->destipaddr : NULL);
     }
   }
   uncomp_hdr_len += UIP_IPH_LEN;
@@ -952,93 +1516,98 @@ uncompress_hdr_hc06(uint16_t ip_len)
   /* Next header processing - continued */
   if((iphc0 & SICSLOWPAN_IPHC_NH_C)) {
     /* The next header is compressed, NHC is following */
-    if((*hc06_ptr & SICSLOWPAN_NHC_UDP_MASK) == SICSLOWPAN_NHC_UDP_ID) {
-      uint8_t checksum_compressed;
-      SICSLOWPAN_IP_BUF->proto = UIP_PROTO_UDP;
-      checksum_compressed = *hc06_ptr & SICSLOWPAN_NHC_UDP_CHECKSUMC;
-      PRINTF("IPHC: Incoming header value: %i\n\r", *hc06_ptr);
-      switch(*hc06_ptr & SICSLOWPAN_NHC_UDP_CS_P_11) {
-      case SICSLOWPAN_NHC_UDP_CS_P_00:
-    /* 1 byte for NHC, 4 byte for ports, 2 bytes chksum */
-    memcpy(&SICSLOWPAN_UDP_BUF->srcport, hc06_ptr + 1, 2);
-    memcpy(&SICSLOWPAN_UDP_BUF->destport, hc06_ptr + 3, 2);
-    PRINTF("IPHC: Uncompressed UDP ports (ptr+5): %x, %x\n\r",
-           UIP_HTONS(SICSLOWPAN_UDP_BUF->srcport), UIP_HTONS(SICSLOWPAN_UDP_BUF->destport));
-    hc06_ptr += 5;
-    break;
+    return uncompress_nhc(ip_hdr, outer);
+  }
+  return 1;
+}
 
-      case SICSLOWPAN_NHC_UDP_CS_P_01:
-        /* 1 byte for NHC + source 16bit inline, dest = 0xF0 + 8 bit inline */
-    PRINTF("IPHC: Decompressing destination\n\r");
-    memcpy(&SICSLOWPAN_UDP_BUF->srcport, hc06_ptr + 1, 2);
-    SICSLOWPAN_UDP_BUF->destport = UIP_HTONS(SICSLOWPAN_UDP_8_BIT_PORT_MIN + (*(hc06_ptr + 3)));
-    PRINTF("IPHC: Uncompressed UDP ports (ptr+4): %x, %x\n\r",
-           UIP_HTONS(SICSLOWPAN_UDP_BUF->srcport), UIP_HTONS(SICSLOWPAN_UDP_BUF->destport));
-    hc06_ptr += 4;
-    break;
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Set the length fields of the uncompressed headers
+ *
+ * Walks the uncompressed header chain in sicslowpan_buf and sets the
+ * payload length of the IPv6 header(s) and the UDP length.
+ *
+ * \param ip_len the total length of the IPv6 packet
+ */
+static void
+uncompress_set_lengths(uint16_t ip_len)
+{
+  struct uip_ip_hdr *ip_hdr = SICSLOWPAN_IP_BUF;
+  uint8_t *hdr = (uint8_t *)SICSLOWPAN_IP_BUF;
+  uint8_t *next = &ip_hdr->proto;
+  uint16_t offset = UIP_IPH_LEN;
 
-      case SICSLOWPAN_NHC_UDP_CS_P_10:
-        /* 1 byte for NHC + source = 0xF0 + 8bit inline, dest = 16 bit inline*/
-    PRINTF("IPHC: Decompressing source\n\r");
-    SICSLOWPAN_UDP_BUF->srcport = UIP_HTONS(SICSLOWPAN_UDP_8_BIT_PORT_MIN +
-                        (*(hc06_ptr + 1)));
-    memcpy(&SICSLOWPAN_UDP_BUF->destport, hc06_ptr + 2, 2);
-    PRINTF("IPHC: Uncompressed UDP ports (ptr+4): %x, %x\n\r",
-           UIP_HTONS(SICSLOWPAN_UDP_BUF->srcport), UIP_HTONS(SICSLOWPAN_UDP_BUF->destport));
-    hc06_ptr += 4;
-    break;
+  ip_hdr->len[0] = (ip_len - UIP_IPH_LEN) >> 8;
+  ip_hdr->len[1] = (ip_len - UIP_IPH_LEN) & 0x00FF;
 
-      case SICSLOWPAN_NHC_UDP_CS_P_11:
-    /* 1 byte for NHC, 1 byte for ports */
-    SICSLOWPAN_UDP_BUF->srcport = UIP_HTONS(SICSLOWPAN_UDP_4_BIT_PORT_MIN +
-                        (*(hc06_ptr + 1) >> 4));
-    SICSLOWPAN_UDP_BUF->destport = UIP_HTONS(SICSLOWPAN_UDP_4_BIT_PORT_MIN +
-                         ((*(hc06_ptr + 1)) & 0x0F));
-    PRINTF("IPHC: Uncompressed UDP ports (ptr+2): %x, %x\n\r",
-           UIP_HTONS(SICSLOWPAN_UDP_BUF->srcport), UIP_HTONS(SICSLOWPAN_UDP_BUF->destport));
-    hc06_ptr += 2;
-    break;
+  while(offset < uncomp_hdr_len) {
+    switch(*next) {
+      case UIP_PROTO_UDP:
+        ((struct uip_udp_hdr *)&hdr[offset])->udplen = UIP_HTONS(ip_len - offset);
+        return;
+
+      case UIP_PROTO_IPV6:
+        ip_hdr = (struct uip_ip_hdr *)&hdr[offset];
+        ip_hdr->len[0] = (ip_len - offset - UIP_IPH_LEN) >> 8;
+        ip_hdr->len[1] = (ip_len - offset - UIP_IPH_LEN) & 0x00FF;
+        next = &ip_hdr->proto;
+        offset += UIP_IPH_LEN;
+        break;
+
+      case UIP_PROTO_FRAG:
+        /* the lengths behind it are those of the whole datagram */
+        return;
+
+      case UIP_PROTO_HBHO:
+      case UIP_PROTO_ROUTING:
+      case UIP_PROTO_DESTO:
+        next = &((struct uip_ext_hdr *)&hdr[offset])->next;
+        offset += (((struct uip_ext_hdr *)&hdr[offset])->len << 3) + 8;
+        break;
 
       default:
-    PRINTF("sicslowpan uncompress_hdr: error unsupported UDP compression\n\r");
-    return;
-      }
-      if(!checksum_compressed) { /* has_checksum, default  */
-    memcpy(&SICSLOWPAN_UDP_BUF->udpchksum, hc06_ptr, 2);
-    hc06_ptr += 2;
-    PRINTF("IPHC: sicslowpan uncompress_hdr: checksum included\n\r");
-      } else {
-    PRINTF("IPHC: sicslowpan uncompress_hdr: checksum *NOT* included\n\r");
-      }
-      uncomp_hdr_len += UIP_UDPH_LEN;
-    }
-#ifdef SICSLOWPAN_NH_COMPRESSOR
-    else {
-      hc06_ptr += SICSLOWPAN_NH_COMPRESSOR.uncompress(hc06_ptr, sicslowpan_buf, &uncomp_hdr_len);
+        return;
     }
-#endif
+  }
+}
+
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Uncompress HC06 (i.e., IPHC and LOWPAN_NHC) headers and put
+ * them in sicslowpan_buf
+ *
+ * This function is called by the input function when the dispatch is
+ * HC06.
+ * We %process the packet in the packetbuf buffer, uncompress the header
+ * fields, and copy the result in the sicslowpan buffer.
+ * At the end of the decompression, packetbuf_hdr_len and uncompressed_hdr_len
+ * are set to the appropriate values
+ *
+ * \param ip_len Equal to 0 if the packet is not a fragment (IP length
+ * is then inferred from the L2 length), non 0 if the packet is a 1st
+ * fragment.
+ * \return 1 on success, 0 if the packet could not be uncompressed
+ */
+static uint8_t
+uncompress_hdr_hc06(uint16_t ip_len)
+{
+  hc06_ptr = packetbuf_ptr + packetbuf_hdr_len;
+
+  if(!uncompress_iphc(SICSLOWPAN_IP_BUF, NULL)) {
+    return 0;
   }
 
   packetbuf_hdr_len = hc06_ptr - packetbuf_ptr;
 
   /* IP length field. */
   if(ip_len == 0) {
-    int len = packetbuf_datalen() - packetbuf_hdr_len + uncomp_hdr_len - UIP_IPH_LEN;
     /* This is not a fragmented packet */
-    SICSLOWPAN_IP_BUF->len[0] = len >> 8;
-    SICSLOWPAN_IP_BUF->len[1] = len & 0x00FF;
-  } else {
-    /* This is a 1st fragment */
-    SICSLOWPAN_IP_BUF->len[0] = (ip_len - UIP_IPH_LEN) >> 8;
-    SICSLOWPAN_IP_BUF->len[1] = (ip_len - UIP_IPH_LEN) & 0x00FF;
-  }
-
-  /* length field in UDP header */
-  if(SICSLOWPAN_IP_BUF->proto == UIP_PROTO_UDP) {
-    memcpy(&SICSLOWPAN_UDP_BUF->udplen, &SICSLOWPAN_IP_BUF->len[0], 2);
+    ip_len = packetbuf_datalen() - packetbuf_hdr_len + uncomp_hdr_len;
   }
+  uncompress_set_lengths(ip_len);
 
-  return;
+  return 1;
 }
 /** @} */
 #endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
@@ -1759,7 +2328,10 @@ input(void)
 #if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
   if((PACKETBUF_HC1_PTR[PACKETBUF_HC1_DISPATCH] & 0xe0) == SICSLOWPAN_DISPATCH_IPHC) {
     PRINTFI("sicslowpan input: IPHC\n\r");
-    uncompress_hdr_hc06(frag_size);
+    if(!uncompress_hdr_hc06(frag_size)) {
+      PRINTFI("sicslowpan input: dropping packet, IPHC uncompression failed\n\r");
+      return;
+    }
   } else
 #endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
     switch(PACKETBUF_HC1_PTR[PACKETBUF_HC1_DISPATCH]) {
@@ -1817,7 +2389,35 @@ input(void)
     }
   }
 
-  memcpy((uint8_t *)SICSLOWPAN_IP_BUF + uncomp_hdr_len + (uint16_t)(frag_offset << 3), packetbuf_ptr + packetbuf_hdr_len, packetbuf_payload_len);
+  /* Copy the payload and sum it on the way for the upper layer checksum */
+  {
+    uint16_t pos = uncomp_hdr_len + (uint16_t)(frag_offset << 3);
+    uint16_t sum = uip_chksum_copy((uint8_t *)SICSLOWPAN_IP_BUF + pos,
+                                   packetbuf_ptr + packetbuf_hdr_len,
+                                   packetbuf_payload_len, 0);
+    if(pos & 1) {
+      sum = (sum << 8) | (sum >> 8);
+    }
+    if(frag_offset == 0) {
+      rx_chksum.offset = pos;
+      rx_chksum.end = pos;
+      rx_chksum.sum = 0;
+      rx_chksum.state = UIP_RX_CHKSUM_VERIFIED;
+    }
+    if(pos == rx_chksum.end) {
+      rx_chksum.sum = uip_chksum_add(rx_chksum.sum, sum);
+      rx_chksum.end = pos + packetbuf_payload_len;
+    } else {
+      /* A duplicate or out of order fragment would be summed twice or
+         leave a gap, the upper layer sums the reassembled packet instead */
+      rx_chksum.end = 0;
+    }
+    /* Checksum offload only counts if the driver flagged every fragment */
+    if(!(packetbuf_attr(PACKETBUF_ATTR_CHKSUM_FLAGS) &
+         PACKETBUF_ATTR_CHKSUM_L4_VALID)) {
+      rx_chksum.state = UIP_RX_CHKSUM_PARTIAL;
+    }
+  }
 
   /* update processed_ip_in_len if fragment, sicslowpan_len otherwise */
 
@@ -1875,7 +2475,12 @@ input(void)
       callback->input_callback();
     }
 
+    uip_rx_chksum = rx_chksum;
+    if(rx_chksum.end != uip_len) {
+      uip_rx_chksum.state = UIP_RX_CHKSUM_NONE;
+    }
     tcpip_input();
+    uip_rx_chksum.state = UIP_RX_CHKSUM_NONE;
 #if SICSLOWPAN_CONF_FRAG
   }
 #endif /* SICSLOWPAN_CONF_FRAG */
@@ -1909,6 +2514,10 @@ void sicslowpan_init(s_ns_t* p_netStack)
  * #define SICSLOWPAN_CONF_ADDR_CONTEXT_0 {addr_contexts[0].prefix[0]=0xbb;addr_contexts[0].prefix[1]=0xbb;}
  */
 #if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
+  memset(addr_context_cid, SICSLOWPAN_CONTEXT_NONE, sizeof(addr_context_cid));
+  memset(addr_context_hash, SICSLOWPAN_CONTEXT_NONE, sizeof(addr_context_hash));
+  memset(addr_contexts, 0, sizeof(addr_contexts));
+
   addr_contexts[0].used   = 1;
   addr_contexts[0].number = 0;
 #ifdef SICSLOWPAN_CONF_ADDR_CONTEXT_0
@@ -1920,34 +2529,150 @@ void sicslowpan_init(s_ns_t* p_netStack)
 #endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 */
 
 #if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 1
-  {
-    int i;
-    for(i = 1; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
 #ifdef SICSLOWPAN_CONF_ADDR_CONTEXT_1
-      if (i==1) {
-        addr_contexts[1].used   = 1;
-        addr_contexts[1].number = 1;
-        SICSLOWPAN_CONF_ADDR_CONTEXT_1;
-#ifdef SICSLOWPAN_CONF_ADDR_CONTEXT_2
-      } else if (i==2) {
-          addr_contexts[2].used   = 1;
-        addr_contexts[2].number = 2;
-        SICSLOWPAN_CONF_ADDR_CONTEXT_2;
+  addr_contexts[1].used   = 1;
+  addr_contexts[1].number = 1;
+  SICSLOWPAN_CONF_ADDR_CONTEXT_1;
+#if (SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 2) && defined(SICSLOWPAN_CONF_ADDR_CONTEXT_2)
+  addr_contexts[2].used   = 1;
+  addr_contexts[2].number = 2;
+  SICSLOWPAN_CONF_ADDR_CONTEXT_2;
 #endif
-      } else {
-        addr_contexts[i].used = 0;
-      }
-#else
-      addr_contexts[i].used = 0;
 #endif /* SICSLOWPAN_CONF_ADDR_CONTEXT_1 */
+#endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 1 */
 
+#if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
+  {
+    uint8_t i;
+    for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
+      if(addr_contexts[i].used) {
+        addr_contexts[i].flags = SICSLOWPAN_CONTEXT_FLAG_COMPRESS |
+                                 SICSLOWPAN_CONTEXT_FLAG_INFINITE;
+        addr_context_link(i);
+      }
     }
   }
-#endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 1 */
+#endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 */
 
 #endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
 }
 /*--------------------------------------------------------------------*/
+int8_t
+sicslowpan_context_update(uint8_t number, const uint8_t *prefix,
+                          uint8_t flags, unsigned long lifetime)
+{
+#if (SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06) && \
+    (SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0)
+  uint8_t i;
+
+  if(number >= SICSLOWPAN_CONTEXT_CID_MAX) {
+    return -1;
+  }
+  i = addr_context_cid[number];
+  if(i != SICSLOWPAN_CONTEXT_NONE) {
+    addr_context_unlink(i);
+  } else {
+    for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
+      if(!addr_contexts[i].used) {
+        break;
+      }
+    }
+    if(i == SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS) {
+      PRINTF("IPHC: no room for context %u\n\r", number);
+      return -1;
+    }
+  }
+
+  addr_contexts[i].used = 1;
+  addr_contexts[i].number = number;
+  memcpy(addr_contexts[i].prefix, prefix, 8);
+  addr_contexts[i].flags = flags;
+  if(!(flags & SICSLOWPAN_CONTEXT_FLAG_INFINITE)) {
+    stimer_set(&addr_contexts[i].lifetime, lifetime);
+  }
+  addr_context_link(i);
+  return 0;
+#else
+  return -1;
+#endif
+}
+/*--------------------------------------------------------------------*/
+void
+sicslowpan_context_remove(uint8_t number)
+{
+#if (SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06) && \
+    (SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0)
+  if(number < SICSLOWPAN_CONTEXT_CID_MAX &&
+     addr_context_cid[number] != SICSLOWPAN_CONTEXT_NONE) {
+    addr_context_unlink(addr_context_cid[number]);
+  }
+#endif
+}
+/*--------------------------------------------------------------------*/
+struct sicslowpan_addr_context *
+sicslowpan_context_next(struct sicslowpan_addr_context *ctx)
+{
+#if (SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06) && \
+    (SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0)
+  uint8_t i = (ctx == NULL) ? 0 : (uint8_t)(ctx - addr_contexts) + 1;
+  for(; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
+    if(addr_contexts[i].used && !addr_context_expire(i)) {
+      return &addr_contexts[i];
+    }
+  }
+#endif
+  return NULL;
+}
+/*--------------------------------------------------------------------*/
+uint8_t
+sicslowpan_context_6co_write(uint8_t *buf, struct sicslowpan_addr_context *ctx)
+{
+  unsigned long lifetime = 0xFFFF;
+
+  if(!(ctx->flags & SICSLOWPAN_CONTEXT_FLAG_INFINITE)) {
+    lifetime = (stimer_remaining(&ctx->lifetime) +
+                SICSLOWPAN_CONTEXT_6CO_LIFETIME_UNIT - 1) /
+               SICSLOWPAN_CONTEXT_6CO_LIFETIME_UNIT;
+    if(lifetime > 0xFFFF) {
+      lifetime = 0xFFFF;
+    }
+  }
+  buf[0] = 64;
+  buf[1] = (ctx->flags & SICSLOWPAN_CONTEXT_FLAG_COMPRESS) |
+           (ctx->number & SICSLOWPAN_CONTEXT_CID_MASK);
+  buf[2] = 0;
+  buf[3] = 0;
+  buf[4] = (uint8_t)(lifetime >> 8);
+  buf[5] = (uint8_t)lifetime;
+  memcpy(&buf[6], ctx->prefix, 8);
+  return SICSLOWPAN_CONTEXT_6CO_LEN;
+}
+/*--------------------------------------------------------------------*/
+void
+sicslowpan_context_6co_input(const uint8_t *buf, uint8_t len)
+{
+  uint8_t cid;
+  uint16_t lifetime;
+
+  if(len < SICSLOWPAN_CONTEXT_6CO_LEN) {
+    return;
+  }
+  /* Only /64 contexts are used by IPHC address compression */
+  if(buf[0] != 64) {
+    PRINTF("IPHC: ignoring /%u context\n\r", buf[0]);
+    return;
+  }
+  cid = buf[1] & SICSLOWPAN_CONTEXT_CID_MASK;
+  lifetime = ((uint16_t)buf[4] << 8) | buf[5];
+  if(lifetime == 0) {
+    sicslowpan_context_remove(cid);
+  } else {
+    sicslowpan_context_update(cid, &buf[6],
+                              buf[1] & SICSLOWPAN_CONTEXT_FLAG_COMPRESS,
+                              (unsigned long)lifetime * SICSLOWPAN_CONTEXT_6CO_LIFETIME_UNIT);
+  }
+}
+/*--------------------------------------------------------------------*/
 int
 sicslowpan_get_last_rssi(void)
 {
@@ -354,6 +354,7 @@ enum {
   PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
   PACKETBUF_ATTR_MAC_SEQNO,
   PACKETBUF_ATTR_MAC_ACK,
+  PACKETBUF_ATTR_CHKSUM_FLAGS,
 
   PACKETBUF_ATTR_IS_CREATED_AND_SECURED,
 
@@ -423,6 +424,10 @@ enum {
 #define PACKETBUF_ATTR_PACKET_TYPE_STREAM_END 3
 #define PACKETBUF_ATTR_PACKET_TYPE_TIMESTAMP 4
 
+/* Values of PACKETBUF_ATTR_CHKSUM_FLAGS, set by a driver with checksum
+   offload on reception */
+#define PACKETBUF_ATTR_CHKSUM_L4_VALID       0x01 /* ICMPv6/UDP/TCP checksum verified */
+
 
 #if NETSTACK_CONF_WITH_RIME
 #define PACKETBUF_NUM_ADDRS 4
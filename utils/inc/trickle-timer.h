@@ -0,0 +1,176 @@
+#ifndef TRICKLE_TIMER_H_
+#define TRICKLE_TIMER_H_
+/**
+ *   \addtogroup utils
+ *   @{
+*/
+/**
+ *   \defgroup trickle_timer Trickle timer library
+ *
+ *   The Trickle algorithm (RFC 6206) on top of callback timers, shared by
+ *   the RPL DIO timer and the multicast engines.
+ *   @{
+*/
+/*
+ * emb6 is licensed under the 3-clause BSD license. This license gives everyone
+ * the right to use and distribute the code, either in binary or source code
+ * format, as long as the copyright license is retained in the source code.
+ *
+ * The emb6 is derived from the Contiki OS platform with the explicit approval
+ * from Adam Dunkels. However, emb6 is made independent from the OS through the
+ * removal of protothreads. In addition, APIs are made more flexible to gain
+ * more adaptivity during run-time.
+ *
+ * The license text is:
+ *
+ * Copyright (c) 2015,
+ * Hochschule Offenburg, University of Applied Sciences
+ * Laboratory Embedded Systems and Communications Electronics.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+/*============================================================================*/
+/*!
+    \file   trickle-timer.h
+
+    \brief  Trickle timers (RFC 6206)
+
+            A timer is configured with Imin (clock ticks), Imax (doublings
+            of Imin) and the redundancy constant k. At a random point t of
+            each interval the callback runs and is told whether k consistent
+            transmissions heard in the interval suppress its own one. A
+            running timer costs one pending callback timer, a stopped one
+            nothing.
+
+  \version  0.1
+*/
+/*============================================================================*/
+/*=============================================================================
+                                 INCLUDES
+ =============================================================================*/
+#include "ctimer.h"
+
+/*=============================================================================
+                                  MACROS
+ =============================================================================*/
+/** Redundancy constant that never suppresses a transmission */
+#define TRICKLE_TIMER_INFINITE_REDUNDANCY   0xFF
+
+/** Keep per timer counters, see struct trickle_timer_stats */
+#ifdef TRICKLE_TIMER_CONF_STATS
+#define TRICKLE_TIMER_STATS                 TRICKLE_TIMER_CONF_STATS
+#else
+#define TRICKLE_TIMER_STATS                 1
+#endif
+
+/*=============================================================================
+                        STRUCTURES AND OTHER TYPEDEFS
+ =============================================================================*/
+/**
+ * Called at t of every interval. suppress is non-zero when the consistency
+ * counter reached k; the callback may reset or stop its own timer.
+ */
+typedef void (*trickle_timer_cb_t)(void *ptr, uint8_t suppress);
+
+#if TRICKLE_TIMER_STATS
+struct trickle_timer_stats {
+  uint16_t intervals;       /* intervals begun */
+  uint16_t transmissions;   /* callbacks that were not suppressed */
+  uint16_t suppressions;    /* callbacks that were suppressed */
+  uint16_t consistent;      /* consistent transmissions heard */
+  uint16_t resets;          /* intervals restarted at Imin */
+};
+#endif /* TRICKLE_TIMER_STATS */
+
+struct trickle_timer {
+  struct ctimer ct;
+  trickle_timer_cb_t cb;    /* NULL while the timer is stopped */
+  void *cb_arg;
+  clock_time_t i_min;       /* Imin, clock ticks */
+  clock_time_t i_start;     /* start of the current interval */
+  uint8_t i_max;            /* Imax, doublings of Imin */
+  uint8_t i_cur;            /* doublings of the current interval */
+  uint8_t k;                /* redundancy constant */
+  uint8_t c;                /* consistency counter */
+#if TRICKLE_TIMER_STATS
+  struct trickle_timer_stats stats;
+#endif /* TRICKLE_TIMER_STATS */
+};
+
+/*==============================================================================
+                          FUNCTION PROTOTYPES
+==============================================================================*/
+/**
+ * \brief      Set the parameters of a trickle timer.
+ * \param tt   A pointer to the trickle timer, zeroed before its first use.
+ * \param i_min  Imin in clock ticks.
+ * \param i_max  Imax as a number of doublings of Imin.
+ * \param k    Redundancy constant, TRICKLE_TIMER_INFINITE_REDUNDANCY to
+ *             never suppress.
+ *
+ *             A running timer keeps its interval, the new parameters apply
+ *             from the next interval or reset on.
+ */
+void trickle_timer_config(struct trickle_timer *tt, clock_time_t i_min,
+                          uint8_t i_max, uint8_t k);
+
+/**
+ * \brief      Start a trickle timer with an interval of Imin.
+ * \param tt   A pointer to the configured trickle timer.
+ * \param cb   Function called at t of each interval.
+ * \param ptr  Opaque pointer given to cb.
+ */
+void trickle_timer_set(struct trickle_timer *tt, trickle_timer_cb_t cb,
+                       void *ptr);
+
+/**
+ * \brief      Stop a trickle timer, its callback is not called anymore.
+ */
+void trickle_timer_stop(struct trickle_timer *tt);
+
+/**
+ * \brief      A consistent transmission was heard, increment c.
+ */
+void trickle_timer_consistency(struct trickle_timer *tt);
+
+/**
+ * \brief      An inconsistent transmission was heard: restart at Imin unless
+ *             the interval already is Imin.
+ */
+void trickle_timer_inconsistency(struct trickle_timer *tt);
+
+/**
+ * \brief      Restart a running timer at Imin, whatever its interval.
+ */
+void trickle_timer_reset_event(struct trickle_timer *tt);
+
+/** Non-zero while the timer runs */
+#define trickle_timer_is_running(tt)        ((tt)->cb != NULL)
+
+/** Length of the current interval in clock ticks */
+clock_time_t trickle_timer_interval(const struct trickle_timer *tt);
+
+#endif /* TRICKLE_TIMER_H_ */
+ /** @} */
+/** @} */
@@ -0,0 +1,244 @@
+/**
+ *   \addtogroup trickle_timer Trickle timer library
+ *   @{
+*/
+/*
+ * emb6 is licensed under the 3-clause BSD license. This license gives everyone
+ * the right to use and distribute the code, either in binary or source code
+ * format, as long as the copyright license is retained in the source code.
+ *
+ * The emb6 is derived from the Contiki OS platform with the explicit approval
+ * from Adam Dunkels. However, emb6 is made independent from the OS through the
+ * removal of protothreads. In addition, APIs are made more flexible to gain
+ * more adaptivity during run-time.
+ *
+ * The license text is:
+ *
+ * Copyright (c) 2015,
+ * Hochschule Offenburg, University of Applied Sciences
+ * Laboratory Embedded Systems and Communications Electronics.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+/*============================================================================*/
+/*!
+    \file   trickle-timer.c
+
+    \brief  Trickle timers (RFC 6206) on top of callback timers
+
+  \version  0.1
+*/
+/*============================================================================*/
+
+/*==============================================================================
+                             INCLUDE FILES
+==============================================================================*/
+#include "emb6.h"
+
+#include "bsp.h"
+#include "random.h"
+#include "trickle-timer.h"
+
+/*==============================================================================
+                             LOCAL MACROS
+==============================================================================*/
+/* Longest interval, so that tick differences stay signed */
+#define TRICKLE_TIMER_MAX_INTERVAL      ((clock_time_t)0x7FFFFFFFUL)
+
+#if TRICKLE_TIMER_STATS
+#define TRICKLE_TIMER_STAT(tt, x)       ((tt)->stats.x++)
+#else
+#define TRICKLE_TIMER_STAT(tt, x)
+#endif
+
+/* Ticks from now until the absolute time at, 0 if it passed */
+#define TICKS_UNTIL(at, now)            ((int32_t)((at) - (now)) > 0 ? (at) - (now) : 0)
+
+/*==============================================================================
+                             LOCAL FUNCTIONS
+==============================================================================*/
+static void fire(void *ptr);
+static void interval_end(void *ptr);
+
+/*============================================================================*/
+/*  random_t()                                                                */
+/*============================================================================*/
+/* Random point in [I/2, I), without a 64 bit product */
+static clock_time_t random_t(clock_time_t i)
+{
+    clock_time_t half = i / 2;
+    uint32_t r = random_rand();
+
+    return half + (half >> 16) * r + (((half & 0xFFFF) * r) >> 16);
+}
+
+/*============================================================================*/
+/*  new_interval()                                                            */
+/*============================================================================*/
+static void new_interval(struct trickle_timer *tt)
+{
+    clock_time_t t;
+
+    tt->c = 0;
+    TRICKLE_TIMER_STAT(tt, intervals);
+    t = tt->i_start + random_t(trickle_timer_interval(tt));
+    ctimer_set(&tt->ct, TICKS_UNTIL(t, bsp_getTick()), fire, tt);
+}
+
+/*============================================================================*/
+/*  start_interval()                                                          */
+/*============================================================================*/
+static void start_interval(struct trickle_timer *tt)
+{
+    tt->i_start = bsp_getTick();
+    tt->i_cur = 0;
+    new_interval(tt);
+}
+
+/*============================================================================*/
+/*  fire()                                                                    */
+/*============================================================================*/
+static void fire(void *ptr)
+{
+    struct trickle_timer *tt = (struct trickle_timer *)ptr;
+    clock_time_t end;
+    uint8_t suppress;
+
+    suppress = tt->k != TRICKLE_TIMER_INFINITE_REDUNDANCY && tt->c >= tt->k;
+    if(suppress) {
+        TRICKLE_TIMER_STAT(tt, suppressions);
+    } else {
+        TRICKLE_TIMER_STAT(tt, transmissions);
+    }
+
+    /* Arm the end of the interval first, the callback may reset or stop us */
+    end = tt->i_start + trickle_timer_interval(tt);
+    ctimer_set(&tt->ct, TICKS_UNTIL(end, bsp_getTick()), interval_end, tt);
+
+    tt->cb(tt->cb_arg, suppress);
+}
+
+/*============================================================================*/
+/*  interval_end()                                                            */
+/*============================================================================*/
+static void interval_end(void *ptr)
+{
+    struct trickle_timer *tt = (struct trickle_timer *)ptr;
+    clock_time_t now;
+
+    tt->i_start += trickle_timer_interval(tt);
+    if(tt->i_cur < tt->i_max) {
+        tt->i_cur++;
+    }
+
+    /* Intervals are back to back; after a long stall start afresh instead
+       of firing through every missed one */
+    now = bsp_getTick();
+    if((clock_time_t)(now - tt->i_start) >= trickle_timer_interval(tt)) {
+        tt->i_start = now;
+    }
+    new_interval(tt);
+}
+
+/*==============================================================================
+                             GLOBAL FUNCTIONS
+==============================================================================*/
+/*============================================================================*/
+/*  trickle_timer_interval()                                                  */
+/*============================================================================*/
+clock_time_t trickle_timer_interval(const struct trickle_timer *tt)
+{
+    if(tt->i_min > (TRICKLE_TIMER_MAX_INTERVAL >> tt->i_cur)) {
+        return TRICKLE_TIMER_MAX_INTERVAL;
+    }
+    return tt->i_min << tt->i_cur;
+}
+
+/*============================================================================*/
+/*  trickle_timer_config()                                                    */
+/*============================================================================*/
+void trickle_timer_config(struct trickle_timer *tt, clock_time_t i_min,
+                          uint8_t i_max, uint8_t k)
+{
+    tt->i_min = i_min > 0 ? i_min : 1;
+    tt->i_max = i_max;
+    tt->k = k;
+    if(tt->i_cur > i_max) {
+        tt->i_cur = i_max;
+    }
+}
+
+/*============================================================================*/
+/*  trickle_timer_set()                                                       */
+/*============================================================================*/
+void trickle_timer_set(struct trickle_timer *tt, trickle_timer_cb_t cb,
+                       void *ptr)
+{
+    tt->cb = cb;
+    tt->cb_arg = ptr;
+    start_interval(tt);
+}
+
+/*============================================================================*/
+/*  trickle_timer_stop()                                                      */
+/*============================================================================*/
+void trickle_timer_stop(struct trickle_timer *tt)
+{
+    ctimer_stop(&tt->ct);
+    tt->cb = NULL;
+}
+
+/*============================================================================*/
+/*  trickle_timer_consistency()                                               */
+/*============================================================================*/
+void trickle_timer_consistency(struct trickle_timer *tt)
+{
+    if(tt->c < 0xFF) {
+        tt->c++;
+    }
+    TRICKLE_TIMER_STAT(tt, consistent);
+}
+
+/*============================================================================*/
+/*  trickle_timer_inconsistency()                                             */
+/*============================================================================*/
+void trickle_timer_inconsistency(struct trickle_timer *tt)
+{
+    if(trickle_timer_is_running(tt) && tt->i_cur != 0) {
+        TRICKLE_TIMER_STAT(tt, resets);
+        start_interval(tt);
+    }
+}
+
+/*============================================================================*/
+/*  trickle_timer_reset_event()                                               */
+/*============================================================================*/
+void trickle_timer_reset_event(struct trickle_timer *tt)
+{
+    if(trickle_timer_is_running(tt)) {
+        TRICKLE_TIMER_STAT(tt, resets);
+        start_interval(tt);
+    }
+}
+/** @} */